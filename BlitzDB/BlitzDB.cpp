@@ -3,16 +3,293 @@
 
 #include "blitzdb.h"
 #include "../src/network/server.h"
+#include "../src/core/utils/bytes.h"
+#include "../src/core/utils/logger.h"
 #include "asio.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <csignal>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+
 using namespace std;
 
-int main()
+namespace {
+
+    // A whole token holding an integer in [min, max]; "8080x", "-1" for
+    // an unsigned option and values out of range are all rejected
+    template <typename T>
+    bool parse_number(string_view text, T& value, T min = numeric_limits<T>::min(),
+        T max = numeric_limits<T>::max()) {
+        T parsed{};
+        auto [end, error] = from_chars(text.data(), text.data() + text.size(), parsed);
+        if (error != errc() || end != text.data() + text.size() || parsed < min || parsed > max) {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    // Parses "--name value" pairs into the server configuration
+    bool parse_args(int argc, char* argv[], blitzdb::ServerConfig& config) {
+        for (int i = 1; i < argc; ++i) {
+            string_view arg = argv[i];
+            if (i + 1 >= argc) {
+                cerr << "Missing value for " << arg << endl;
+                return false;
+            }
+            string_view text = argv[++i];
+            // Counts that map 0 to a usable value
+            size_t count = 0;
+
+            if (arg == "--port") {
+                if (!parse_number(text, config.port, static_cast<unsigned short>(1))) {
+                    cerr << "Invalid port " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--max-batch-commands") {
+                if (!parse_number(text, count)) {
+                    cerr << "Invalid command count " << text << endl;
+                    return false;
+                }
+                config.max_batch_commands = max<size_t>(count, 1);
+            }
+            else if (arg == "--client-output-soft-limit" || arg == "--client-output-hard-limit") {
+                size_t& limit = arg == "--client-output-soft-limit"
+                    ? config.output_soft_limit : config.output_hard_limit;
+                if (!blitzdb::parse_bytes(text, limit) || limit == 0) {
+                    cerr << "Invalid output limit " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--client-output-soft-seconds") {
+                if (!parse_number(text, config.output_soft_seconds)) {
+                    cerr << "Invalid duration " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--pubsub-output-soft-limit" || arg == "--pubsub-output-hard-limit") {
+                size_t& limit = arg == "--pubsub-output-soft-limit"
+                    ? config.pubsub_soft_limit : config.pubsub_hard_limit;
+                if (!blitzdb::parse_bytes(text, limit) || limit == 0) {
+                    cerr << "Invalid output limit " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--pubsub-output-soft-seconds") {
+                if (!parse_number(text, config.pubsub_soft_seconds)) {
+                    cerr << "Invalid duration " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--slowlog-log-slower-than") {
+                // Microseconds; negative disables the slow log
+                if (!parse_number(text, config.slowlog_log_slower_than)) {
+                    cerr << "Invalid duration " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--slowlog-max-len") {
+                if (!parse_number(text, config.slowlog_max_len)) {
+                    cerr << "Invalid length " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--shards") {
+                if (!parse_number(text, count)) {
+                    cerr << "Invalid shard count " << text << endl;
+                    return false;
+                }
+                config.storage_shards = max<size_t>(count, 1);
+            }
+            else if (arg == "--threads") {
+                // 0 means one thread per hardware core
+                if (!parse_number(text, count)) {
+                    cerr << "Invalid thread count " << text << endl;
+                    return false;
+                }
+                config.threads = count > 0 ? count : max<size_t>(thread::hardware_concurrency(), 1);
+            }
+            else if (arg == "--thread-mode") {
+                if (text == "pool") {
+                    config.thread_mode = blitzdb::ThreadMode::Pool;
+                }
+                else if (text == "per-core") {
+                    config.thread_mode = blitzdb::ThreadMode::PerCore;
+                }
+                else {
+                    cerr << "Unknown thread mode " << text << " (expected pool or per-core)" << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--io-backend") {
+                if (text == "epoll") {
+                    config.io_backend = blitzdb::IoBackend::Epoll;
+                }
+                else if (text == "io_uring") {
+                    config.io_backend = blitzdb::IoBackend::IoUring;
+                }
+                else {
+                    cerr << "Unknown I/O backend " << text << " (expected epoll or io_uring)" << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--io-uring-busy-poll") {
+                // Microseconds; 0 disables busy polling
+                if (!parse_number(text, config.io_uring_busy_poll_us)) {
+                    cerr << "Invalid duration " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--maxmemory") {
+                if (!blitzdb::parse_bytes(text, config.max_memory)) {
+                    cerr << "Invalid memory size " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--maxmemory-policy") {
+                auto policy = blitzdb::parse_eviction_policy(text);
+                if (!policy) {
+                    cerr << "Unknown eviction policy " << text
+                        << " (expected noeviction, allkeys-lru, allkeys-lfu or volatile-ttl)" << endl;
+                    return false;
+                }
+                config.eviction_policy = *policy;
+            }
+            else if (arg == "--maxmemory-samples") {
+                if (!parse_number(text, count)) {
+                    cerr << "Invalid sample count " << text << endl;
+                    return false;
+                }
+                config.eviction_samples = max<size_t>(count, 1);
+            }
+            else if (arg == "--lazyfree-threshold") {
+                if (!blitzdb::parse_bytes(text, config.lazyfree_threshold)) {
+                    cerr << "Invalid memory size " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--hash-max-packed-fields" || arg == "--hash-max-packed-length") {
+                size_t& limit = arg == "--hash-max-packed-fields"
+                    ? config.hash_max_packed_fields : config.hash_max_packed_length;
+                if (!parse_number(text, limit)) {
+                    cerr << "Invalid hash limit " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--appendonly") {
+                if (text != "yes" && text != "no") {
+                    cerr << "Expected yes or no for " << arg << endl;
+                    return false;
+                }
+                config.append_only = text == "yes";
+            }
+            else if (arg == "--appendfilename") {
+                config.append_only_path = string(text);
+            }
+            else if (arg == "--dbfilename") {
+                config.snapshot_path = string(text);
+            }
+            else if (arg == "--tiered-path") {
+                config.tiered_path = string(text);
+            }
+            else if (arg == "--tiered-max-size" || arg == "--tiered-min-value") {
+                size_t& bytes = arg == "--tiered-max-size" ? config.tiered_max_size : config.tiered_min_value;
+                if (!blitzdb::parse_bytes(text, bytes)) {
+                    cerr << "Invalid memory size " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--tiered-cold-seconds") {
+                if (!parse_number(text, config.tiered_cold_seconds)) {
+                    cerr << "Invalid duration " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--replicaof") {
+                // host:port of the primary to follow
+                size_t colon = text.rfind(':');
+                if (colon == string_view::npos || colon == 0 ||
+                    !parse_number(text.substr(colon + 1), config.replica_of_port, static_cast<unsigned short>(1))) {
+                    cerr << "Expected host:port for " << arg << endl;
+                    return false;
+                }
+                config.replica_of_host = string(text.substr(0, colon));
+            }
+            else if (arg == "--primaryauth") {
+                config.primary_auth = string(text);
+            }
+            else if (arg == "--repl-backlog-size") {
+                if (!blitzdb::parse_bytes(text, config.repl_backlog_size) || config.repl_backlog_size == 0) {
+                    cerr << "Invalid backlog size " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--loglevel") {
+                auto level = blitzdb::parse_log_level(text);
+                if (!level) {
+                    cerr << "Unknown log level " << text << " (expected debug, info, warning or error)" << endl;
+                    return false;
+                }
+                blitzdb::Logger::set_level(*level);
+            }
+            else if (arg == "--logfile") {
+                if (!blitzdb::Logger::instance().open_file(string(text))) {
+                    cerr << "Cannot open log file " << text << endl;
+                    return false;
+                }
+            }
+            else if (arg == "--appendfsync") {
+                auto policy = blitzdb::parse_fsync_policy(text);
+                if (!policy) {
+                    cerr << "Unknown fsync policy " << text << " (expected always, everysec or no)" << endl;
+                    return false;
+                }
+                config.append_fsync = *policy;
+            }
+            else {
+                cerr << "Unknown option " << arg << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
 {
 	cout << "BlitzDB Server Starting..." << endl;
-    asio::io_context io_context;
-    blitzdb::Server server(io_context, 6380); // Redis default port
-    server.start();
-    io_context.run();
+    blitzdb::ServerConfig config; // Port 6380 unless overridden
+    if (!parse_args(argc, argv, config)) {
+        return 1;
+    }
+
+    try {
+        asio::io_context io_context;
+        blitzdb::Server server(io_context, config);
+
+        // Shut down cleanly so the append-only log is flushed and synced
+        asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([&server](const asio::error_code& ec, int) {
+            if (!ec) {
+                server.stop();
+            }
+        });
+
+        server.start();
+        server.run();
+    }
+    catch (const exception& e) {
+        blitzdb::Logger::instance().flush();
+        cerr << "Fatal: " << e.what() << endl;
+        return 1;
+    }
+    blitzdb::Logger::instance().flush();
 	return 0;
 }
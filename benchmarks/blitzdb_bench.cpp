@@ -0,0 +1,488 @@
+// blitzdb_bench.cpp : Load generator for a running server.
+//
+// Opens --connections connections, spread over --threads threads with an
+// event loop each, and keeps --pipeline requests in flight on every
+// connection: GETs and SETs of random keys from a key space of --keyspace
+// keys, a --read-ratio of them GETs. A connection writes its batch, reads
+// all the replies and only then sends the next one (a closed loop), so
+// the latency of a request runs from its batch being written to its reply
+// arriving. SET values are --value-size bytes, or uniformly between two
+// sizes given as min-max.
+//
+// The run ends after --requests requests or --duration seconds. It
+// reports throughput and latency percentiles, and with --json also
+// writes them to a file.
+//
+// Usage: blitzdb-bench [--host h] [--port n] [--password p] [--threads n]
+//        [--connections n] [--pipeline n] [--requests n] [--duration s]
+//        [--keyspace n] [--value-size n|min-max] [--read-ratio f]
+//        [--populate yes|no] [--json path]
+
+#include "metrics.h"
+#include "protocols/resp.h"
+#include <asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+    using blitzdb::LatencyHistogram;
+
+    struct Options {
+        std::string host = "127.0.0.1";
+        unsigned short port = 6380;
+        std::string password = "defaultpass";
+        size_t threads = 4;
+        size_t connections = 50;
+        size_t pipeline = 16;
+        uint64_t requests = 1000000;
+        double duration = 0;  // Seconds; overrides --requests when set
+        uint64_t keyspace = 100000;
+        size_t value_min = 100;
+        size_t value_max = 100;
+        double read_ratio = 0.9;
+        bool populate = true;
+        std::string json_path;
+    };
+
+    void append_command(std::string& out, std::initializer_list<std::string_view> args) {
+        out += '*';
+        out += std::to_string(args.size());
+        out += "\r\n";
+        for (std::string_view arg : args) {
+            out += '$';
+            out += std::to_string(arg.size());
+            out += "\r\n";
+            out += arg;
+            out += "\r\n";
+        }
+    }
+
+    std::string_view format_key(uint64_t index, char* buffer, size_t size) {
+        std::memcpy(buffer, "key:", 4);
+        auto [end, ec] = std::to_chars(buffer + 4, buffer + size, index);
+        return std::string_view(buffer, static_cast<size_t>(end - buffer));
+    }
+
+    // Reads replies until `count` of them have arrived; false on an error
+    // reply or a broken connection
+    bool read_replies(asio::ip::tcp::socket& socket, size_t count) {
+        std::string buffer;
+        char chunk[16 * 1024];
+        size_t start = 0;
+        while (count > 0) {
+            size_t consumed = 0;
+            auto status = blitzdb::resp::scan_reply(std::string_view(buffer).substr(start), consumed);
+            if (status == blitzdb::resp::ParseStatus::Complete) {
+                if (buffer[start] == '-') {
+                    std::fprintf(stderr, "server error: %s\n", buffer.substr(start, consumed - 2).c_str());
+                    return false;
+                }
+                start += consumed;
+                --count;
+                continue;
+            }
+            if (status == blitzdb::resp::ParseStatus::Error) {
+                return false;
+            }
+            asio::error_code ec;
+            size_t bytes = socket.read_some(asio::buffer(chunk), ec);
+            if (ec) {
+                return false;
+            }
+            buffer.append(chunk, bytes);
+        }
+        return true;
+    }
+
+    bool connect(asio::ip::tcp::socket& socket, const Options& options) {
+        asio::error_code ec;
+        asio::ip::tcp::resolver resolver(socket.get_executor());
+        auto endpoints = resolver.resolve(options.host, std::to_string(options.port), ec);
+        if (!ec) {
+            asio::connect(socket, endpoints, ec);
+        }
+        if (ec) {
+            std::fprintf(stderr, "cannot connect to %s:%u: %s\n", options.host.c_str(),
+                static_cast<unsigned>(options.port), ec.message().c_str());
+            return false;
+        }
+        socket.set_option(asio::ip::tcp::no_delay(true));
+        if (options.password.empty()) {
+            return true;
+        }
+        std::string auth;
+        append_command(auth, { "AUTH", options.password });
+        asio::write(socket, asio::buffer(auth), ec);
+        return !ec && read_replies(socket, 1);
+    }
+
+    // Counts shared by the threads of a run
+    struct Run {
+        const Options& options;
+        std::string values;  // SET values are slices of this
+        std::atomic<int64_t> unclaimed;
+        Clock::time_point deadline;
+        std::atomic<bool> failed{ false };
+    };
+
+    // One event loop and the connections it drives
+    class Worker {
+    public:
+        Worker(Run& run, size_t seed) : run_(run), random_(seed) {}
+
+        LatencyHistogram latency;
+        uint64_t completed = 0;
+        uint64_t errors = 0;
+        uint64_t max_ns = 0;
+        uint64_t total_ns = 0;
+
+        bool add_connection() {
+            auto connection = std::make_unique<Connection>(context_);
+            if (!connect(connection->socket, run_.options)) {
+                return false;
+            }
+            connections_.push_back(std::move(connection));
+            return true;
+        }
+
+        void run() {
+            for (auto& connection : connections_) {
+                send_batch(*connection);
+            }
+            context_.run();
+        }
+
+    private:
+        struct Connection {
+            explicit Connection(asio::io_context& context) : socket(context) {}
+
+            asio::ip::tcp::socket socket;
+            std::string request;
+            std::vector<char> buffer = std::vector<char>(64 * 1024);
+            size_t start = 0;  // First byte of the next reply
+            size_t end = 0;
+            size_t outstanding = 0;
+            Clock::time_point sent_at;
+        };
+
+        // Takes up to one batch worth of the requests still to send
+        size_t claim() {
+            const Options& options = run_.options;
+            if (options.duration > 0) {
+                return Clock::now() < run_.deadline ? options.pipeline : 0;
+            }
+            int64_t before = run_.unclaimed.fetch_sub(static_cast<int64_t>(options.pipeline));
+            return static_cast<size_t>(std::clamp<int64_t>(before, 0, static_cast<int64_t>(options.pipeline)));
+        }
+
+        void send_batch(Connection& connection) {
+            size_t count = run_.failed.load() ? 0 : claim();
+            if (count == 0) {
+                asio::error_code ec;
+                connection.socket.close(ec);
+                return;
+            }
+
+            const Options& options = run_.options;
+            std::uniform_int_distribution<uint64_t> keys(0, options.keyspace - 1);
+            std::uniform_int_distribution<size_t> sizes(options.value_min, options.value_max);
+            std::bernoulli_distribution reads(options.read_ratio);
+            char key_buffer[32];
+            connection.request.clear();
+            for (size_t i = 0; i < count; ++i) {
+                std::string_view key = format_key(keys(random_), key_buffer, sizeof(key_buffer));
+                if (reads(random_)) {
+                    append_command(connection.request, { "GET", key });
+                }
+                else {
+                    append_command(connection.request, { "SET", key,
+                        std::string_view(run_.values).substr(0, sizes(random_)) });
+                }
+            }
+
+            connection.outstanding = count;
+            connection.sent_at = Clock::now();
+            asio::async_write(connection.socket, asio::buffer(connection.request),
+                [this, &connection](const asio::error_code& ec, size_t) {
+                    if (ec) {
+                        fail(connection, ec);
+                        return;
+                    }
+                    read_batch(connection);
+                });
+        }
+
+        void read_batch(Connection& connection) {
+            if (connection.start == connection.end) {
+                connection.start = connection.end = 0;
+            }
+            else if (connection.end == connection.buffer.size()) {
+                // Make room: move the partial reply to the front, or grow
+                if (connection.start > 0) {
+                    std::copy(connection.buffer.begin() + static_cast<std::ptrdiff_t>(connection.start),
+                        connection.buffer.begin() + static_cast<std::ptrdiff_t>(connection.end), connection.buffer.begin());
+                    connection.end -= connection.start;
+                    connection.start = 0;
+                }
+                else {
+                    connection.buffer.resize(connection.buffer.size() * 2);
+                }
+            }
+            connection.socket.async_read_some(
+                asio::buffer(connection.buffer.data() + connection.end, connection.buffer.size() - connection.end),
+                [this, &connection](const asio::error_code& ec, size_t bytes) {
+                    if (ec) {
+                        fail(connection, ec);
+                        return;
+                    }
+                    connection.end += bytes;
+                    uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - connection.sent_at).count());
+                    while (connection.outstanding > 0) {
+                        std::string_view pending(connection.buffer.data() + connection.start, connection.end - connection.start);
+                        size_t consumed = 0;
+                        auto status = blitzdb::resp::scan_reply(pending, consumed);
+                        if (status == blitzdb::resp::ParseStatus::Incomplete) {
+                            break;
+                        }
+                        if (status == blitzdb::resp::ParseStatus::Error) {
+                            fail(connection, asio::error::invalid_argument);
+                            return;
+                        }
+                        errors += pending[0] == '-' ? 1 : 0;
+                        latency.record(ns);
+                        max_ns = std::max(max_ns, ns);
+                        total_ns += ns;
+                        ++completed;
+                        connection.start += consumed;
+                        --connection.outstanding;
+                    }
+                    if (connection.outstanding > 0) {
+                        read_batch(connection);
+                    }
+                    else {
+                        send_batch(connection);
+                    }
+                });
+        }
+
+        void fail(Connection& connection, const asio::error_code& ec) {
+            if (!run_.failed.exchange(true)) {
+                std::fprintf(stderr, "connection failed: %s\n", ec.message().c_str());
+            }
+            asio::error_code ignored;
+            connection.socket.close(ignored);
+        }
+
+        Run& run_;
+        std::mt19937_64 random_;
+        asio::io_context context_{ 1 };
+        std::vector<std::unique_ptr<Connection>> connections_;
+    };
+
+    // SETs every key once so GETs hit
+    bool populate(const Options& options, const std::string& values) {
+        asio::io_context context;
+        asio::ip::tcp::socket socket(context);
+        if (!connect(socket, options)) {
+            return false;
+        }
+        constexpr uint64_t kBatch = 1000;
+        std::string request;
+        char key_buffer[32];
+        for (uint64_t first = 0; first < options.keyspace; first += kBatch) {
+            uint64_t last = std::min(options.keyspace, first + kBatch);
+            request.clear();
+            for (uint64_t i = first; i < last; ++i) {
+                append_command(request, { "SET", format_key(i, key_buffer, sizeof(key_buffer)),
+                    std::string_view(values).substr(0, options.value_max) });
+            }
+            asio::error_code ec;
+            asio::write(socket, asio::buffer(request), ec);
+            if (ec || !read_replies(socket, static_cast<size_t>(last - first))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "Missing value for %s\n", argv[i]);
+                return false;
+            }
+            std::string_view text = argv[++i];
+            unsigned long long value = std::strtoull(text.data(), nullptr, 10);
+
+            if (arg == "--host") {
+                options.host = std::string(text);
+            }
+            else if (arg == "--port") {
+                options.port = static_cast<unsigned short>(value);
+            }
+            else if (arg == "--password") {
+                options.password = std::string(text);
+            }
+            else if (arg == "--threads") {
+                options.threads = std::max<size_t>(value, 1);
+            }
+            else if (arg == "--connections") {
+                options.connections = std::max<size_t>(value, 1);
+            }
+            else if (arg == "--pipeline") {
+                options.pipeline = std::max<size_t>(value, 1);
+            }
+            else if (arg == "--requests") {
+                options.requests = value;
+            }
+            else if (arg == "--duration") {
+                options.duration = std::strtod(text.data(), nullptr);
+            }
+            else if (arg == "--keyspace") {
+                options.keyspace = std::max<uint64_t>(value, 1);
+            }
+            else if (arg == "--value-size") {
+                size_t dash = text.find('-');
+                options.value_min = static_cast<size_t>(value);
+                options.value_max = dash == std::string_view::npos ? options.value_min
+                    : static_cast<size_t>(std::strtoull(text.data() + dash + 1, nullptr, 10));
+                if (options.value_max < options.value_min) {
+                    std::fprintf(stderr, "Invalid value size range %s\n", argv[i]);
+                    return false;
+                }
+            }
+            else if (arg == "--read-ratio") {
+                options.read_ratio = std::clamp(std::strtod(text.data(), nullptr), 0.0, 1.0);
+            }
+            else if (arg == "--populate") {
+                options.populate = text == "yes";
+            }
+            else if (arg == "--json") {
+                options.json_path = std::string(text);
+            }
+            else {
+                std::fprintf(stderr, "Unknown option %s\n", argv[i - 1]);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    double usec(uint64_t ns) {
+        return static_cast<double>(ns) / 1000.0;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        return 2;
+    }
+    options.threads = std::min(options.threads, options.connections);
+
+    std::string values(options.value_max, 'x');
+    if (options.populate && options.read_ratio > 0) {
+        std::printf("Populating %llu keys...\n", static_cast<unsigned long long>(options.keyspace));
+        std::fflush(stdout);
+        if (!populate(options, values)) {
+            return 1;
+        }
+    }
+
+    Run run{ options, values, static_cast<int64_t>(options.requests), {} };
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < options.threads; ++i) {
+        workers.push_back(std::make_unique<Worker>(run, 0x5eed + i));
+    }
+    for (size_t i = 0; i < options.connections; ++i) {
+        if (!workers[i % workers.size()]->add_connection()) {
+            return 1;
+        }
+    }
+
+    auto started = Clock::now();
+    run.deadline = started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&worker]() { worker->run(); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+
+    LatencyHistogram::Counts counts{};
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+    uint64_t max_ns = 0;
+    uint64_t total_ns = 0;
+    for (const auto& worker : workers) {
+        worker->latency.add_to(counts);
+        completed += worker->completed;
+        errors += worker->errors;
+        max_ns = std::max(max_ns, worker->max_ns);
+        total_ns += worker->total_ns;
+    }
+    // The histogram gives a bucket's upper bound, which can lie past the
+    // slowest request actually seen
+    auto percentile = [&](double fraction) {
+        return usec(std::min(LatencyHistogram::percentile(counts, completed, fraction), max_ns));
+    };
+    double throughput = seconds > 0 ? static_cast<double>(completed) / seconds : 0.0;
+    double average = completed ? usec(total_ns) / static_cast<double>(completed) : 0.0;
+
+    std::printf("%zu connections on %zu threads, pipeline %zu, %.0f%% reads, %llu keys, values %zu-%zu bytes\n",
+        options.connections, options.threads, options.pipeline, options.read_ratio * 100,
+        static_cast<unsigned long long>(options.keyspace), options.value_min, options.value_max);
+    std::printf("requests: %llu in %.2f s (%llu errors)\n", static_cast<unsigned long long>(completed),
+        seconds, static_cast<unsigned long long>(errors));
+    std::printf("throughput: %.0f requests/s\n", throughput);
+    std::printf("latency usec: avg %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+        average, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), usec(max_ns));
+
+    if (!options.json_path.empty()) {
+        std::FILE* file = std::fopen(options.json_path.c_str(), "w");
+        if (!file) {
+            std::fprintf(stderr, "cannot write %s\n", options.json_path.c_str());
+            return 1;
+        }
+        std::fprintf(file,
+            "{\n"
+            "  \"benchmark\": \"blitzdb-bench\",\n"
+            "  \"connections\": %zu,\n"
+            "  \"threads\": %zu,\n"
+            "  \"pipeline\": %zu,\n"
+            "  \"read_ratio\": %.3f,\n"
+            "  \"keyspace\": %llu,\n"
+            "  \"value_size_min\": %zu,\n"
+            "  \"value_size_max\": %zu,\n"
+            "  \"requests\": %llu,\n"
+            "  \"errors\": %llu,\n"
+            "  \"seconds\": %.3f,\n"
+            "  \"requests_per_second\": %.0f,\n"
+            "  \"latency_usec\": { \"avg\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f }\n"
+            "}\n",
+            options.connections, options.threads, options.pipeline, options.read_ratio,
+            static_cast<unsigned long long>(options.keyspace), options.value_min, options.value_max,
+            static_cast<unsigned long long>(completed), static_cast<unsigned long long>(errors), seconds, throughput,
+            average, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), usec(max_ns));
+        std::fclose(file);
+    }
+    return run.failed.load() ? 1 : 0;
+}
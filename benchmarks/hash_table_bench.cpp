@@ -0,0 +1,136 @@
+// hash_table_bench.cpp : Keyspace microbenchmark.
+//
+// Compares the open-addressing HashTable used by InMemoryStorage with the
+// previous layout (std::unordered_map<std::string, std::string> behind one
+// mutex). Reports throughput per operation and the worst single insert,
+// which is where a stop-the-world rehash shows up.
+//
+// Usage: blitzdb_hash_table_bench [keys]
+
+#include "storage/in_memory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // The storage engine as it was before the Swiss table
+    class UnorderedMapStorage {
+    public:
+        void set(std::string_view key, std::string_view value) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            data_[std::string(key)] = std::string(value);
+        }
+        std::optional<std::string> get(std::string_view key) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = data_.find(std::string(key));
+            return it != data_.end() ? std::optional<std::string>(it->second) : std::nullopt;
+        }
+        bool del(std::string_view key) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return data_.erase(std::string(key)) > 0;
+        }
+
+    private:
+        std::unordered_map<std::string, std::string> data_;
+        std::mutex mutex_;
+    };
+
+    struct Result {
+        double insert_mops;
+        double hit_mops;
+        double miss_mops;
+        double erase_mops;
+        double worst_insert_us;
+    };
+
+    double mops(size_t ops, Clock::duration elapsed) {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? static_cast<double>(ops) / seconds / 1e6 : 0.0;
+    }
+
+    template <typename Storage>
+    Result run(Storage& storage, const std::vector<std::string>& keys,
+        const std::vector<std::string>& misses, const std::string& value) {
+        Result result{};
+        Clock::duration worst{};
+
+        auto start = Clock::now();
+        for (const auto& key : keys) {
+            auto before = Clock::now();
+            storage.set(key, value);
+            worst = std::max(worst, Clock::now() - before);
+        }
+        result.insert_mops = mops(keys.size(), Clock::now() - start);
+        result.worst_insert_us = std::chrono::duration<double, std::micro>(worst).count();
+
+        size_t found = 0;
+        start = Clock::now();
+        for (const auto& key : keys) {
+            found += storage.get(key) ? 1 : 0;
+        }
+        result.hit_mops = mops(keys.size(), Clock::now() - start);
+
+        start = Clock::now();
+        for (const auto& key : misses) {
+            found += storage.get(key) ? 1 : 0;
+        }
+        result.miss_mops = mops(misses.size(), Clock::now() - start);
+
+        start = Clock::now();
+        for (const auto& key : keys) {
+            found += storage.del(key) ? 1 : 0;
+        }
+        result.erase_mops = mops(keys.size(), Clock::now() - start);
+
+        if (found == 0) {
+            std::printf("unexpected: nothing found\n");
+        }
+        return result;
+    }
+
+    void print(const char* name, const Result& r) {
+        std::printf("%-28s %10.2f %10.2f %10.2f %10.2f %14.1f\n", name,
+            r.insert_mops, r.hit_mops, r.miss_mops, r.erase_mops, r.worst_insert_us);
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<std::string> keys;
+    std::vector<std::string> misses;
+    keys.reserve(count);
+    misses.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("user:session:" + std::to_string(i * 2654435761ULL % 1000000007ULL));
+        misses.push_back("missing:" + std::to_string(i));
+    }
+    const std::string value(16, 'v');
+
+    std::printf("%zu keys, %zu-byte values (Mops/s; worst insert in us)\n", count, value.size());
+    std::printf("%-28s %10s %10s %10s %10s %14s\n", "storage", "insert", "get-hit", "get-miss", "erase", "worst-insert");
+
+    {
+        UnorderedMapStorage storage;
+        print("unordered_map + mutex", run(storage, keys, misses, value));
+    }
+    {
+        blitzdb::InMemoryStorage storage(1);
+        print("InMemoryStorage (1 shard)", run(storage, keys, misses, value));
+    }
+    {
+        blitzdb::InMemoryStorage storage;
+        print("InMemoryStorage (16 shards)", run(storage, keys, misses, value));
+    }
+    return 0;
+}
@@ -0,0 +1,398 @@
+// micro_bench.cpp : Microbenchmarks of the storage engine, the RESP
+// parser and reply encoding.
+//
+// Each case does a fixed amount of work per round, after an untimed
+// setup, and reports its best of --rounds rounds in nanoseconds per
+// operation. --json writes the results to a file; --baseline reads such
+// a file from an earlier run and prints the change of every case, and
+// the exit status is 1 when a case got slower by more than --threshold
+// percent, so the suite can gate a build on regressions.
+//
+// Usage: blitzdb_micro_bench [--filter text] [--rounds n] [--scale f]
+//        [--json path] [--baseline path] [--threshold percent]
+
+#include "output_buffer.h"
+#include "protocols/resp.h"
+#include "storage/in_memory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+    using blitzdb::InMemoryStorage;
+
+    // Results feed this so the optimizer cannot drop the work
+    volatile size_t sink = 0;
+
+    struct Case {
+        std::string name;
+        std::function<void()> setup;  // Untimed, before every round
+        std::function<size_t()> run;  // Timed; returns the operations done
+    };
+
+    struct Result {
+        std::string name;
+        size_t ops = 0;
+        double ns_per_op = 0;
+    };
+
+    std::vector<std::string> make_keys(size_t count, const char* prefix) {
+        std::vector<std::string> keys;
+        keys.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            keys.push_back(prefix + std::to_string(i));
+        }
+        return keys;
+    }
+
+    void append_command(std::string& out, std::initializer_list<std::string_view> args) {
+        out += '*';
+        out += std::to_string(args.size());
+        out += "\r\n";
+        for (std::string_view arg : args) {
+            out += '$';
+            out += std::to_string(arg.size());
+            out += "\r\n";
+            out += arg;
+            out += "\r\n";
+        }
+    }
+
+    // Everything the cases share: the data they work on is built once
+    struct Fixture {
+        explicit Fixture(double scale)
+            : keys(make_keys(static_cast<size_t>(200000 * scale), "key:")),
+            missing(make_keys(keys.size(), "missing:")),
+            value(100, 'v'),
+            large_value(1024, 'v') {
+            key_views.assign(keys.begin(), keys.end());
+            size_t commands = static_cast<size_t>(10000 * scale);
+            for (size_t i = 0; i < commands; ++i) {
+                const std::string& key = keys[i % keys.size()];
+                append_command(get_requests, { "GET", key });
+                append_command(set_requests, { "SET", key, value });
+                inline_requests += "GET ";
+                inline_requests += key;
+                inline_requests += "\r\n";
+            }
+        }
+
+        void fill(InMemoryStorage& storage) const {
+            for (const std::string& key : keys) {
+                storage.set(key, value);
+            }
+        }
+
+        std::vector<std::string> keys;
+        std::vector<std::string> missing;
+        std::vector<std::string_view> key_views;
+        std::string value;
+        std::string large_value;
+        std::string get_requests;
+        std::string set_requests;
+        std::string inline_requests;
+    };
+
+    size_t parse_all(const std::string& input) {
+        blitzdb::resp::RequestParser parser;
+        std::vector<std::string_view> args;
+        std::string_view data = input;
+        size_t commands = 0;
+        while (!data.empty()) {
+            size_t consumed = 0;
+            if (parser.parse(data, consumed, args) != blitzdb::resp::ParseStatus::Complete) {
+                std::fprintf(stderr, "parse failed\n");
+                std::exit(2);
+            }
+            sink = sink + args.size();
+            data.remove_prefix(consumed);
+            ++commands;
+        }
+        return commands;
+    }
+
+    // Encodes `ops` replies with `encode`, emptying the buffer every so
+    // often the way a connection does after each write
+    template <typename Encode>
+    size_t encode_replies(blitzdb::OutputBuffer& out, size_t ops, Encode&& encode) {
+        for (size_t i = 0; i < ops; ++i) {
+            encode(out, i);
+            if ((i & 255) == 255) {
+                sink = sink + out.size();
+                out.clear();
+            }
+        }
+        out.clear();
+        return ops;
+    }
+
+    std::vector<Case> make_cases(const Fixture& fixture) {
+        // The storage the storage cases share; `full` says it holds every key
+        struct Store {
+            std::unique_ptr<InMemoryStorage> storage;
+            bool full = false;
+        };
+        auto store = std::make_shared<Store>();
+        auto fresh = [store]() {
+            store->storage = std::make_unique<InMemoryStorage>();
+            store->full = false;
+        };
+        auto filled = [store, &fixture]() {
+            store->storage = std::make_unique<InMemoryStorage>();
+            fixture.fill(*store->storage);
+            store->full = false;  // The case removes keys
+        };
+        auto keep_filled = [store, &fixture]() {
+            if (!store->full) {
+                store->storage = std::make_unique<InMemoryStorage>();
+                fixture.fill(*store->storage);
+                store->full = true;
+            }
+        };
+        auto output = std::make_shared<blitzdb::OutputBuffer>();
+        auto nothing = []() {};
+        size_t replies = fixture.keys.size();
+
+        std::vector<Case> cases;
+        cases.push_back({ "storage/set_insert", fresh, [store, &fixture]() {
+            for (const std::string& key : fixture.keys) {
+                store->storage->set(key, fixture.value);
+            }
+            return fixture.keys.size();
+        } });
+        cases.push_back({ "storage/set_overwrite", keep_filled, [store, &fixture]() {
+            for (const std::string& key : fixture.keys) {
+                store->storage->set(key, fixture.value);
+            }
+            return fixture.keys.size();
+        } });
+        cases.push_back({ "storage/get_hit", keep_filled, [store, &fixture]() {
+            size_t bytes = 0;
+            for (const std::string& key : fixture.keys) {
+                store->storage->get(key, [&bytes](const blitzdb::Value& value) { bytes += value.string_size(); });
+            }
+            sink = sink + bytes;
+            return fixture.keys.size();
+        } });
+        cases.push_back({ "storage/get_miss", keep_filled, [store, &fixture]() {
+            size_t found = 0;
+            for (const std::string& key : fixture.missing) {
+                found += store->storage->get(key, [](const blitzdb::Value&) {}) ? 1 : 0;
+            }
+            sink = sink + found;
+            return fixture.missing.size();
+        } });
+        cases.push_back({ "storage/mget_100", keep_filled, [store, &fixture]() {
+            // Batches of 100 keys: one lock per shard instead of per key
+            std::span<const std::string_view> keys = fixture.key_views;
+            size_t bytes = 0;
+            for (size_t i = 0; i < keys.size(); i += 100) {
+                store->storage->mget(keys.subspan(i, std::min<size_t>(100, keys.size() - i)),
+                    [&bytes](const blitzdb::Value* value) { bytes += value ? value->string_size() : 0; });
+            }
+            sink = sink + bytes;
+            return keys.size();
+        } });
+        cases.push_back({ "storage/del", filled, [store, &fixture]() {
+            size_t deleted = 0;
+            for (const std::string& key : fixture.keys) {
+                deleted += store->storage->del(key) ? 1 : 0;
+            }
+            sink = sink + deleted;
+            return fixture.keys.size();
+        } });
+        cases.push_back({ "storage/flushall", filled, [store, &fixture]() {
+            store->storage->flush(false);
+            return fixture.keys.size();
+        } });
+        cases.push_back({ "storage/flushall_async", filled, [store, &fixture]() {
+            // Only detaching the tables is timed; the reclaimer frees them
+            store->storage->flush(true);
+            return fixture.keys.size();
+        } });
+        cases.push_back({ "storage/incr", fresh, [store, &fixture]() {
+            // Counters stay integer encoded: no parsing or formatting
+            int64_t total = 0;
+            for (const std::string& key : fixture.keys) {
+                total += store->storage->incrby(key, 1).value;
+                total += store->storage->incrby(key, 1).value;
+            }
+            sink = sink + static_cast<size_t>(total);
+            return 2 * fixture.keys.size();
+        } });
+        cases.push_back({ "storage/hset_small", fresh, [store, &fixture]() {
+            // Hashes of 8 fields, one field per call
+            static constexpr std::string_view kFields[] = { "f0", "f1", "f2", "f3", "f4", "f5", "f6", "f7" };
+            size_t hashes = fixture.keys.size() / 8;
+            for (size_t i = 0; i < hashes; ++i) {
+                for (std::string_view field : kFields) {
+                    std::string_view pair[] = { field, fixture.value };
+                    store->storage->hset(fixture.keys[i], pair);
+                }
+            }
+            return hashes * 8;
+        } });
+
+        cases.push_back({ "resp/parse_get", nothing, [&fixture]() { return parse_all(fixture.get_requests); } });
+        cases.push_back({ "resp/parse_set_100b", nothing, [&fixture]() { return parse_all(fixture.set_requests); } });
+        cases.push_back({ "resp/parse_inline", nothing, [&fixture]() { return parse_all(fixture.inline_requests); } });
+
+        cases.push_back({ "reply/integer", nothing, [output, replies]() {
+            return encode_replies(*output, replies, [](blitzdb::OutputBuffer& out, size_t i) {
+                out.integer(static_cast<long long>(i));
+            });
+        } });
+        cases.push_back({ "reply/bulk_100b", nothing, [output, replies, &fixture]() {
+            return encode_replies(*output, replies, [&fixture](blitzdb::OutputBuffer& out, size_t) {
+                out.bulk(fixture.value);
+            });
+        } });
+        cases.push_back({ "reply/bulk_1k", nothing, [output, replies, &fixture]() {
+            return encode_replies(*output, replies, [&fixture](blitzdb::OutputBuffer& out, size_t) {
+                out.bulk(fixture.large_value);
+            });
+        } });
+        cases.push_back({ "reply/array_10", nothing, [output, replies, &fixture]() {
+            return encode_replies(*output, replies / 10, [&fixture](blitzdb::OutputBuffer& out, size_t i) {
+                out.array(10);
+                for (size_t j = 0; j < 10; ++j) {
+                    out.bulk(std::string_view(fixture.keys[(i + j) % fixture.keys.size()]));
+                }
+            });
+        } });
+        return cases;
+    }
+
+    // Reads "name" / "ns_per_op" pairs back from a file written by
+    // write_json(); it does not accept JSON in general
+    std::map<std::string, double> read_baseline(const std::string& path) {
+        std::map<std::string, double> baseline;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t name = line.find("\"name\": \"");
+            size_t ns = line.find("\"ns_per_op\": ");
+            if (name == std::string::npos || ns == std::string::npos) {
+                continue;
+            }
+            name += 9;
+            size_t end = line.find('"', name);
+            baseline[line.substr(name, end - name)] = std::strtod(line.c_str() + ns + 13, nullptr);
+        }
+        return baseline;
+    }
+
+    bool write_json(const std::string& path, const std::vector<Result>& results) {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        std::fprintf(file, "{\n  \"benchmark\": \"blitzdb_micro_bench\",\n  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& result = results[i];
+            std::fprintf(file, "    { \"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.2f, \"ops_per_second\": %.0f }%s\n",
+                result.name.c_str(), result.ops, result.ns_per_op,
+                result.ns_per_op > 0 ? 1e9 / result.ns_per_op : 0.0, i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(file, "  ]\n}\n");
+        std::fclose(file);
+        return true;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string json_path;
+    std::string baseline_path;
+    size_t rounds = 3;
+    double scale = 1.0;
+    double threshold = 5.0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        const char* text = argv[i + 1];
+        if (arg == "--filter") {
+            filter = text;
+        }
+        else if (arg == "--rounds") {
+            rounds = std::max<size_t>(std::strtoull(text, nullptr, 10), 1);
+        }
+        else if (arg == "--scale") {
+            scale = std::max(std::strtod(text, nullptr), 0.01);
+        }
+        else if (arg == "--json") {
+            json_path = text;
+        }
+        else if (arg == "--baseline") {
+            baseline_path = text;
+        }
+        else if (arg == "--threshold") {
+            threshold = std::strtod(text, nullptr);
+        }
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    Fixture fixture(scale);
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty()) {
+        baseline = read_baseline(baseline_path);
+    }
+
+    std::vector<Result> results;
+    size_t regressions = 0;
+    std::printf("%-24s %10s %14s %10s\n", "case", "ns/op", "ops/s", "change");
+    for (const Case& bench : make_cases(fixture)) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        Result result{ bench.name };
+        for (size_t round = 0; round < rounds; ++round) {
+            bench.setup();
+            auto started = Clock::now();
+            size_t ops = bench.run();
+            double ns = std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+            double per_op = ops ? ns / static_cast<double>(ops) : 0.0;
+            if (round == 0 || per_op < result.ns_per_op) {
+                result.ns_per_op = per_op;
+                result.ops = ops;
+            }
+        }
+
+        std::string change;
+        auto it = baseline.find(result.name);
+        if (it != baseline.end() && it->second > 0) {
+            double percent = (result.ns_per_op / it->second - 1.0) * 100.0;
+            char text[32];
+            std::snprintf(text, sizeof(text), "%+.1f%%%s", percent, percent > threshold ? " !" : "");
+            change = text;
+            regressions += percent > threshold ? 1 : 0;
+        }
+        std::printf("%-24s %10.1f %14.0f %10s\n", result.name.c_str(), result.ns_per_op,
+            result.ns_per_op > 0 ? 1e9 / result.ns_per_op : 0.0, change.c_str());
+        results.push_back(std::move(result));
+    }
+
+    if (!json_path.empty() && !write_json(json_path, results)) {
+        std::fprintf(stderr, "cannot write %s\n", json_path.c_str());
+        return 2;
+    }
+    if (regressions > 0) {
+        std::printf("%zu case(s) slower than the baseline by more than %.1f%%\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
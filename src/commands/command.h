@@ -1,13 +0,0 @@
-#pragma once
-
-#include <string>
-
-namespace blitzdb {
-
-    class Command {
-    public:
-        virtual std::string execute() = 0;
-        virtual ~Command() = default;
-    };
-
-} // namespace blitzdb
\ No newline at end of file
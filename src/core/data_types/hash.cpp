@@ -0,0 +1,119 @@
+#include "data_types/hash.h"
+#include <functional>
+
+namespace blitzdb {
+
+    namespace packed_hash {
+
+        namespace {
+
+            // Locates the pair holding `field`: [begin, end) within `packed`
+            bool locate(std::string_view packed, std::string_view field, size_t& begin, size_t& end) {
+                const char* p = packed.data();
+                const char* limit = p + packed.size();
+                while (p < limit) {
+                    const char* start = p;
+                    uint64_t field_size;
+                    uint64_t value_size;
+                    if (!get_varint(p, limit, field_size) || !get_varint(p, limit, value_size) ||
+                        field_size > static_cast<uint64_t>(limit - p) ||
+                        value_size > static_cast<uint64_t>(limit - p) - field_size) {
+                        return false;
+                    }
+                    if (std::string_view(p, static_cast<size_t>(field_size)) == field) {
+                        begin = static_cast<size_t>(start - packed.data());
+                        end = static_cast<size_t>(p + field_size + value_size - packed.data());
+                        return true;
+                    }
+                    p += field_size + value_size;
+                }
+                return false;
+            }
+
+        } // namespace
+
+        void append(std::string& out, std::string_view field, std::string_view value) {
+            put_varint(out, field.size());
+            put_varint(out, value.size());
+            out.append(field);
+            out.append(value);
+        }
+
+        std::optional<std::string_view> find(std::string_view packed, std::string_view field) {
+            size_t begin;
+            size_t end;
+            if (!locate(packed, field, begin, end)) {
+                return std::nullopt;
+            }
+            const char* p = packed.data() + begin;
+            uint64_t field_size;
+            uint64_t value_size;
+            get_varint(p, packed.data() + end, field_size);
+            get_varint(p, packed.data() + end, value_size);
+            return std::string_view(p + field_size, static_cast<size_t>(value_size));
+        }
+
+        size_t count(std::string_view packed) {
+            size_t pairs = 0;
+            for_each(packed, [&pairs](std::string_view, std::string_view) { ++pairs; });
+            return pairs;
+        }
+
+        bool set(std::string_view packed, std::string_view field, std::string_view value, std::string& out) {
+            size_t begin;
+            size_t end;
+            bool found = locate(packed, field, begin, end);
+            out.clear();
+            if (found) {
+                out.append(packed.substr(0, begin));
+                append(out, field, value);
+                out.append(packed.substr(end));
+            }
+            else {
+                out.append(packed);
+                append(out, field, value);
+            }
+            return !found;
+        }
+
+        bool erase(std::string_view packed, std::string_view field, std::string& out) {
+            size_t begin;
+            size_t end;
+            if (!locate(packed, field, begin, end)) {
+                return false;
+            }
+            out.clear();
+            out.append(packed.substr(0, begin));
+            out.append(packed.substr(end));
+            return true;
+        }
+
+    } // namespace packed_hash
+
+    std::optional<std::string_view> HashFields::get(std::string_view field) const {
+        const HashField* entry = table_.find(field, std::hash<std::string_view>{}(field));
+        if (!entry) {
+            return std::nullopt;
+        }
+        return entry->value.view();
+    }
+
+    bool HashFields::set(std::string_view field, std::string_view value) {
+        auto [entry, inserted] = table_.insert(field, std::hash<std::string_view>{}(field));
+        size_t before = inserted ? 0 : entry->heap_bytes();
+        entry->value.assign(value);
+        payload_bytes_ += entry->heap_bytes() - before;
+        return inserted;
+    }
+
+    bool HashFields::erase(std::string_view field) {
+        HashField* entry = table_.find(field, std::hash<std::string_view>{}(field));
+        if (!entry) {
+            return false;
+        }
+        payload_bytes_ -= entry->heap_bytes();
+        table_.erase(entry);
+        return true;
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "data_types/string.h"
+#include "storage/hash_table.h"
+#include "utils/varint.h"
+
+namespace blitzdb {
+
+    // Size limits of the packed hash encoding; a hash that grows past
+    // either one is converted to a table for good
+    struct HashLimits {
+        size_t max_packed_fields = 128;
+        size_t max_packed_length = 64;  // Longest field name or value
+    };
+
+    // Small hashes are one byte string holding the pairs back to back:
+    // varint field length, varint value length, field bytes, value bytes.
+    // Lookups scan it linearly, which for a few dozen short fields touches
+    // fewer cache lines than hashing and costs no per-field allocation.
+    namespace packed_hash {
+
+        // Calls fn(field, value) for every pair; false if `packed` is
+        // malformed
+        template <typename Fn>
+        bool for_each(std::string_view packed, Fn&& fn) {
+            const char* p = packed.data();
+            const char* end = p + packed.size();
+            while (p < end) {
+                uint64_t field_size;
+                uint64_t value_size;
+                if (!get_varint(p, end, field_size) || !get_varint(p, end, value_size) ||
+                    field_size > static_cast<uint64_t>(end - p) ||
+                    value_size > static_cast<uint64_t>(end - p) - field_size) {
+                    return false;
+                }
+                std::string_view field(p, static_cast<size_t>(field_size));
+                std::string_view value(p + field_size, static_cast<size_t>(value_size));
+                p += field_size + value_size;
+                fn(field, value);
+            }
+            return true;
+        }
+
+        void append(std::string& out, std::string_view field, std::string_view value);
+
+        std::optional<std::string_view> find(std::string_view packed, std::string_view field);
+
+        size_t count(std::string_view packed);
+
+        // Writes `packed` with `field` set to `value` into `out`; returns
+        // true if the field was added rather than replaced
+        bool set(std::string_view packed, std::string_view field, std::string_view value, std::string& out);
+
+        // Writes `packed` without `field` into `out`; false if it was absent
+        bool erase(std::string_view packed, std::string_view field, std::string& out);
+
+    } // namespace packed_hash
+
+    // One field of a table-encoded hash
+    class HashField {
+    public:
+        explicit HashField(std::string_view name) : name_(name) {}
+        std::string_view key() const { return name_.view(); }
+        size_t heap_bytes() const { return name_.heap_bytes() + value.heap_bytes(); }
+
+        CompactString value;
+
+    private:
+        CompactString name_;
+    };
+
+    // Large hashes: a table of fields
+    class HashFields {
+    public:
+        std::optional<std::string_view> get(std::string_view field) const;
+
+        // Returns true if the field was added rather than replaced
+        bool set(std::string_view field, std::string_view value);
+        bool erase(std::string_view field);
+        void reserve(size_t count) { table_.reserve(count); }
+
+        size_t size() const { return table_.size(); }
+
+        template <typename Fn>
+        void for_each(Fn&& fn) const {
+            table_.for_each([&](const HashField& entry) { fn(entry.key(), entry.value.view()); });
+        }
+
+        // Bytes charged against maxmemory
+        size_t memory_usage() const { return sizeof(*this) + table_.table_bytes() + payload_bytes_; }
+
+    private:
+        HashTable<HashField> table_;
+        size_t payload_bytes_ = 0;  // Heap bytes of names and values
+    };
+
+} // namespace blitzdb
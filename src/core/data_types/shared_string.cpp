@@ -0,0 +1,36 @@
+#include "data_types/shared_string.h"
+#include "utils/allocator.h"
+#include <cstring>
+#include <new>
+
+namespace blitzdb {
+
+    SharedString* SharedString::create(std::string_view value) {
+        return create(std::span<const std::string_view>(&value, 1));
+    }
+
+    SharedString* SharedString::create(std::span<const std::string_view> parts) {
+        size_t size = 0;
+        for (std::string_view part : parts) {
+            size += part.size();
+        }
+        size_t capacity = 0;
+        void* memory = SlabAllocator::instance().allocate(sizeof(SharedString) + size, capacity);
+        SharedString* shared = new (memory) SharedString(size, capacity);
+        char* bytes = static_cast<char*>(memory) + sizeof(SharedString);
+        for (std::string_view part : parts) {
+            std::memcpy(bytes, part.data(), part.size());
+            bytes += part.size();
+        }
+        return shared;
+    }
+
+    void SharedString::release() noexcept {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t capacity = capacity_;
+            this->~SharedString();
+            SlabAllocator::instance().deallocate(this, capacity);
+        }
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace blitzdb {
+
+    // Immutable, reference-counted byte buffer for large values. A reader
+    // takes a reference under the shard lock and can keep using the bytes
+    // after releasing it, e.g. to write them to a socket; overwriting or
+    // deleting the key only drops the keyspace's reference.
+    class SharedString {
+    public:
+        // Copies `value` into a new buffer holding one reference
+        static SharedString* create(std::string_view value);
+        // ... the concatenation of `parts`
+        static SharedString* create(std::span<const std::string_view> parts);
+
+        SharedString(const SharedString&) = delete;
+        SharedString& operator=(const SharedString&) = delete;
+
+        void retain() noexcept { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+        // Frees the buffer with the last reference
+        void release() noexcept;
+
+        std::string_view view() const noexcept {
+            return std::string_view(reinterpret_cast<const char*>(this + 1), size_);
+        }
+
+        // The whole allocation, header included
+        size_t allocated_bytes() const noexcept { return capacity_; }
+
+    private:
+        SharedString(size_t size, size_t capacity) : size_(size), capacity_(capacity) {}
+        ~SharedString() = default;
+
+        std::atomic<uint32_t> refs_{ 1 };
+        uint64_t size_;
+        uint64_t capacity_;
+    };
+
+} // namespace blitzdb
@@ -0,0 +1,93 @@
+#include "data_types/string.h"
+#include "utils/allocator.h"
+#include <charconv>
+#include <cstring>
+#include <utility>
+
+namespace blitzdb {
+
+    CompactString::CompactString(std::string_view value) {
+        set_tag(0);
+        assign(value);
+    }
+
+    CompactString::CompactString(CompactString&& other) noexcept
+        : storage_(other.storage_) {
+        other.set_tag(0);
+    }
+
+    CompactString& CompactString::operator=(const CompactString& other) {
+        if (this != &other) {
+            assign(other.view());
+        }
+        return *this;
+    }
+
+    CompactString& CompactString::operator=(CompactString&& other) noexcept {
+        if (this != &other) {
+            release();
+            storage_ = other.storage_;
+            other.set_tag(0);
+        }
+        return *this;
+    }
+
+    void CompactString::assign(std::string_view value) {
+        if (value.size() <= kInlineCapacity) {
+            // Copy first: `value` may point into our own heap block
+            char copy[kInlineCapacity];
+            std::memcpy(copy, value.data(), value.size());
+            release();
+            std::memcpy(storage_.inline_data, copy, value.size());
+            set_inline_size(value.size());
+            return;
+        }
+
+        if (!is_inline() && storage_.heap.capacity >= value.size()) {
+            std::memmove(storage_.heap.data, value.data(), value.size());
+            storage_.heap.size = value.size();
+            return;
+        }
+
+        size_t capacity = 0;
+        char* data = static_cast<char*>(SlabAllocator::instance().allocate(value.size(), capacity));
+        std::memcpy(data, value.data(), value.size());
+        release();
+        storage_.heap.data = data;
+        storage_.heap.size = value.size();
+        storage_.heap.capacity = static_cast<uint32_t>(capacity);
+        storage_.heap.tag = static_cast<uint8_t>((storage_.heap.tag & ~kSizeMask) | kHeapTag);
+    }
+
+    void CompactString::release() noexcept {
+        if (!is_inline()) {
+            SlabAllocator::instance().deallocate(storage_.heap.data, storage_.heap.capacity);
+            set_inline_size(0);
+        }
+    }
+
+    namespace string_int {
+
+        bool parse(std::string_view text, int64_t& value) {
+            if (text.empty() || text.size() > kMaxLength) {
+                return false;
+            }
+            const char* digits = text.data() + (text[0] == '-' ? 1 : 0);
+            const char* end = text.data() + text.size();
+            // A leading zero is only canonical as "0" itself
+            if (digits == end || *digits < '0' || *digits > '9' || (*digits == '0' && text.size() > 1)) {
+                return false;
+            }
+            auto [parsed, ec] = std::from_chars(text.data(), end, value);
+            return ec == std::errc() && parsed == end;
+        }
+
+        std::string_view format(int64_t value, Digits& digits) {
+            auto [end, ec] = std::to_chars(digits, digits + kMaxLength, value);
+            (void)ec;  // Always fits
+            return std::string_view(digits, static_cast<size_t>(end - digits));
+        }
+
+    } // namespace string_int
+
+} // namespace blitzdb
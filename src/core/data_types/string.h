@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace blitzdb {
+
+    // Byte string sized for hash table slots: 24 bytes, holding up to 23
+    // bytes inline and spilling larger payloads to the slab allocator. Most
+    // keys and many values fit inline, which saves an allocation and a
+    // pointer chase per access compared to std::string (15 inline bytes,
+    // 32 bytes wide).
+    //
+    // The top three bits of the tag byte are flags left to the owner (the
+    // keyspace keeps a value's encoding there). Moves carry them; copies
+    // and assignments leave the target's flags alone.
+    class CompactString {
+    public:
+        static constexpr size_t kInlineCapacity = 23;
+        static constexpr uint8_t kMaxFlags = 7;
+
+        CompactString() noexcept { set_tag(0); }
+        explicit CompactString(std::string_view value);
+        CompactString(const CompactString& other) : CompactString(other.view()) {}
+        CompactString(CompactString&& other) noexcept;
+        CompactString& operator=(const CompactString& other);
+        CompactString& operator=(CompactString&& other) noexcept;
+        ~CompactString() { release(); }
+
+        // Replaces the contents, reusing the heap block when it is big enough
+        void assign(std::string_view value);
+
+        std::string_view view() const noexcept {
+            return is_inline()
+                ? std::string_view(storage_.inline_data, inline_size())
+                : std::string_view(storage_.heap.data, storage_.heap.size);
+        }
+        const char* data() const noexcept { return view().data(); }
+        size_t size() const noexcept { return is_inline() ? inline_size() : storage_.heap.size; }
+        bool empty() const noexcept { return size() == 0; }
+        bool is_inline() const noexcept { return (tag() & kSizeMask) != kHeapTag; }
+
+        // Bytes owned outside the object itself (the whole slab chunk)
+        size_t heap_bytes() const noexcept { return is_inline() ? 0 : storage_.heap.capacity; }
+
+        bool operator==(std::string_view other) const noexcept { return view() == other; }
+
+        uint8_t flags() const noexcept { return tag() >> 5; }
+        void set_flags(uint8_t flags) noexcept { set_tag(static_cast<uint8_t>((tag() & kSizeMask) | (flags << 5))); }
+
+    private:
+        // Low five bits of the tag: the inline length, or kHeapTag
+        static constexpr uint8_t kSizeMask = 0x1F;
+        static constexpr uint8_t kHeapTag = 0x1F;
+
+        struct Heap {
+            char* data;
+            uint64_t size;
+            uint32_t capacity;
+            uint8_t padding[3];
+            uint8_t tag;
+        };
+
+        union Storage {
+            Heap heap;
+            char inline_data[kInlineCapacity + 1];  // Last byte is the tag
+        };
+        static_assert(sizeof(Heap) == kInlineCapacity + 1, "tag must be the last byte");
+
+        // The tag byte doubles as the inline length
+        uint8_t tag() const noexcept {
+            return reinterpret_cast<const uint8_t*>(&storage_)[kInlineCapacity];
+        }
+        void set_tag(uint8_t tag) noexcept {
+            reinterpret_cast<uint8_t*>(&storage_)[kInlineCapacity] = tag;
+        }
+        size_t inline_size() const noexcept { return tag() & kSizeMask; }
+        void set_inline_size(size_t size) noexcept {
+            set_tag(static_cast<uint8_t>((tag() & ~kSizeMask) | size));
+        }
+        void release() noexcept;
+
+        Storage storage_;
+    };
+
+    static_assert(sizeof(CompactString) == 24, "CompactString must stay slot-sized");
+
+    // Strings that are 64-bit integers in canonical decimal form: an
+    // optional '-', no leading zeros and no "-0", so formatting the number
+    // gives back the same bytes. The keyspace stores such values as the
+    // number itself, which counters then update in place.
+    namespace string_int {
+
+        constexpr size_t kMaxLength = 20;  // "-9223372036854775808"
+
+        using Digits = char[kMaxLength];
+
+        // False unless `text` is canonical and in range
+        bool parse(std::string_view text, int64_t& value);
+
+        // Decimal form of `value`, written into `digits`
+        std::string_view format(int64_t value, Digits& digits);
+
+    } // namespace string_int
+
+} // namespace blitzdb
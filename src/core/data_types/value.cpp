@@ -0,0 +1,237 @@
+#include "data_types/value.h"
+#include <cstring>
+#include <memory>
+#include <utility>
+
+namespace blitzdb {
+
+    namespace {
+
+        // Scratch for rebuilding packed hashes; reused so steady-state
+        // updates do not allocate
+        std::string& packed_scratch() {
+            thread_local std::string scratch;
+            return scratch;
+        }
+
+        bool fits_packed(std::string_view field, std::string_view value, const HashLimits& limits) {
+            return field.size() <= limits.max_packed_length && value.size() <= limits.max_packed_length;
+        }
+
+    } // namespace
+
+    Value& Value::operator=(Value&& other) noexcept {
+        if (this != &other) {
+            reset();
+            bytes_ = std::move(other.bytes_);
+        }
+        return *this;
+    }
+
+    HashFields* Value::table() const {
+        HashFields* fields;
+        std::memcpy(&fields, bytes_.data(), sizeof(fields));
+        return fields;
+    }
+
+    SharedString* Value::shared() const {
+        SharedString* shared;
+        std::memcpy(&shared, bytes_.data(), sizeof(shared));
+        return shared;
+    }
+
+    void Value::reset() {
+        if (encoding() == Encoding::Table) {
+            delete table();
+        }
+        else if (encoding() == Encoding::Shared) {
+            shared()->release();
+        }
+        bytes_.assign({});
+        bytes_.set_flags(static_cast<uint8_t>(Encoding::Raw));
+    }
+
+    size_t Value::heap_bytes() const {
+        switch (encoding()) {
+        case Encoding::Table:
+            return table()->memory_usage();
+        case Encoding::Shared:
+            return shared()->allocated_bytes();
+        default:
+            return bytes_.heap_bytes();
+        }
+    }
+
+    std::string_view Value::cold_string() const {
+        const char* data;
+        size_t size;
+        std::memcpy(&data, bytes_.data(), sizeof(data));
+        std::memcpy(&size, bytes_.data() + sizeof(data), sizeof(size));
+        return std::string_view(data, size);
+    }
+
+    std::string_view Value::string(string_int::Digits& digits) const {
+        switch (encoding()) {
+        case Encoding::Shared:
+            return shared()->view();
+        case Encoding::Cold:
+            return cold_string();
+        case Encoding::Int:
+            return string_int::format(integer(), digits);
+        default:
+            return bytes_.view();
+        }
+    }
+
+    ValueHandle Value::string_handle() const {
+        if (encoding() == Encoding::Shared) {
+            return ValueHandle(shared());
+        }
+        // Integers are formatted and cold strings read out of the log
+        string_int::Digits digits;
+        return ValueHandle(string(digits));
+    }
+
+    size_t Value::string_size() const {
+        if (encoding() != Encoding::Int) {
+            string_int::Digits unused;
+            return string(unused).size();
+        }
+        // Digits of the magnitude, plus the sign
+        int64_t value = integer();
+        uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        size_t length = value < 0 ? 2 : 1;
+        while (magnitude >= 10) {
+            magnitude /= 10;
+            ++length;
+        }
+        return length;
+    }
+
+    void Value::assign_integer(int64_t value) {
+        if (encoding() != Encoding::Int) {
+            reset();
+            bytes_.set_flags(static_cast<uint8_t>(Encoding::Int));
+        }
+        bytes_.assign(std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
+    }
+
+    void Value::assign_string(std::string_view value) {
+        int64_t number;
+        if (value.size() <= string_int::kMaxLength && string_int::parse(value, number)) {
+            assign_integer(number);
+            return;
+        }
+        if (value.size() >= kShareThreshold) {
+            // Built before the old value goes: `value` may point into it
+            SharedString* shared = SharedString::create(value);
+            reset();
+            bytes_.assign(std::string_view(reinterpret_cast<const char*>(&shared), sizeof(shared)));
+            bytes_.set_flags(static_cast<uint8_t>(Encoding::Shared));
+            return;
+        }
+        if (encoding() != Encoding::Raw) {
+            CompactString copy(value);  // `value` may point into the old value
+            reset();
+            bytes_ = std::move(copy);
+            return;
+        }
+        bytes_.assign(value);
+    }
+
+    void Value::assign_cold(std::string_view value) {
+        reset();
+        const char* data = value.data();
+        size_t size = value.size();
+        char location[sizeof(data) + sizeof(size)];
+        std::memcpy(location, &data, sizeof(data));
+        std::memcpy(location + sizeof(data), &size, sizeof(size));
+        bytes_.assign(std::string_view(location, sizeof(location)));
+        bytes_.set_flags(static_cast<uint8_t>(Encoding::Cold));
+    }
+
+    void Value::assign_empty_hash() {
+        reset();
+        bytes_.set_flags(static_cast<uint8_t>(Encoding::Packed));
+    }
+
+    std::optional<std::string_view> Value::hash_get(std::string_view field) const {
+        if (encoding() == Encoding::Table) {
+            return table()->get(field);
+        }
+        return packed_hash::find(bytes_.view(), field);
+    }
+
+    size_t Value::hash_size() const {
+        if (encoding() == Encoding::Table) {
+            return table()->size();
+        }
+        return packed_hash::count(bytes_.view());
+    }
+
+    void Value::convert_to_table(size_t extra) {
+        auto fields = std::make_unique<HashFields>();
+        fields->reserve(packed_hash::count(bytes_.view()) + extra);
+        packed_hash::for_each(bytes_.view(), [&fields](std::string_view field, std::string_view value) {
+            fields->set(field, value);
+        });
+        HashFields* raw = fields.release();
+        bytes_.assign(std::string_view(reinterpret_cast<const char*>(&raw), sizeof(raw)));
+        bytes_.set_flags(static_cast<uint8_t>(Encoding::Table));
+    }
+
+    bool Value::hash_set(std::string_view field, std::string_view value, const HashLimits& limits) {
+        if (encoding() == Encoding::Packed) {
+            std::string& scratch = packed_scratch();
+            bool added = packed_hash::set(bytes_.view(), field, value, scratch);
+            if (fits_packed(field, value, limits) &&
+                (!added || packed_hash::count(scratch) <= limits.max_packed_fields)) {
+                bytes_.assign(scratch);
+                return added;
+            }
+            convert_to_table(1);
+        }
+        return table()->set(field, value);
+    }
+
+    bool Value::hash_erase(std::string_view field) {
+        if (encoding() == Encoding::Table) {
+            return table()->erase(field);
+        }
+        std::string& scratch = packed_scratch();
+        if (!packed_hash::erase(bytes_.view(), field, scratch)) {
+            return false;
+        }
+        bytes_.assign(scratch);
+        return true;
+    }
+
+    void Value::hash_pack(std::string& out) const {
+        if (encoding() == Encoding::Packed) {
+            out.append(bytes_.view());
+            return;
+        }
+        table()->for_each([&out](std::string_view field, std::string_view value) {
+            packed_hash::append(out, field, value);
+        });
+    }
+
+    bool Value::assign_packed_hash(std::string_view packed, const HashLimits& limits) {
+        size_t pairs = 0;
+        bool small = true;
+        bool valid = packed_hash::for_each(packed, [&](std::string_view field, std::string_view value) {
+            ++pairs;
+            small = small && fits_packed(field, value, limits);
+        });
+        if (!valid) {
+            return false;
+        }
+        assign_empty_hash();
+        bytes_.assign(packed);
+        if (!small || pairs > limits.max_packed_fields) {
+            convert_to_table(0);
+        }
+        return true;
+    }
+
+} // namespace blitzdb
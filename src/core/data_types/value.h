@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "data_types/hash.h"
+#include "data_types/shared_string.h"
+#include "data_types/string.h"
+
+namespace blitzdb {
+
+    enum class ValueType : uint8_t {
+        String = 0,
+        Hash = 1,
+    };
+
+    // A string value that stays readable after the shard lock is released.
+    // Shared values are referenced, anything smaller is copied.
+    class ValueHandle {
+    public:
+        explicit ValueHandle(std::string_view value) : copy_(value) {}
+        explicit ValueHandle(SharedString* shared) noexcept : shared_(shared) { shared_->retain(); }
+        ValueHandle(ValueHandle&& other) noexcept
+            : shared_(std::exchange(other.shared_, nullptr)), copy_(std::move(other.copy_)) {}
+        ValueHandle& operator=(ValueHandle&& other) noexcept {
+            if (this != &other) {
+                reset();
+                shared_ = std::exchange(other.shared_, nullptr);
+                copy_ = std::move(other.copy_);
+            }
+            return *this;
+        }
+        ValueHandle(const ValueHandle&) = delete;
+        ValueHandle& operator=(const ValueHandle&) = delete;
+        ~ValueHandle() { reset(); }
+
+        std::string_view view() const noexcept { return shared_ ? shared_->view() : std::string_view(copy_); }
+        size_t size() const noexcept { return view().size(); }
+
+        // Refers to the keyspace's buffer rather than a copy
+        bool shared() const noexcept { return shared_ != nullptr; }
+
+    private:
+        void reset() noexcept {
+            if (shared_) {
+                std::exchange(shared_, nullptr)->release();
+            }
+        }
+
+        SharedString* shared_ = nullptr;
+        std::string copy_;
+    };
+
+    // Keyspace value: a tagged variant held in one slot-sized CompactString,
+    // whose flag bits record the encoding, so typed values cost no more per
+    // key than plain strings did:
+    //   Raw     a string, stored as is
+    //   Int     a string that is a canonical 64-bit integer (see
+    //           string_int), held as the number in the inline bytes
+    //   Shared  a large string; the inline bytes hold a SharedString pointer
+    //   Packed  a small hash, its pairs back to back (see packed_hash)
+    //   Table   a large hash; the inline bytes hold the HashFields pointer
+    //   Cold    a string moved out to a tiered storage value log; the
+    //           inline bytes hold its address in the log's mapping and its
+    //           length, and the log owns the bytes
+    class Value {
+    public:
+        enum class Encoding : uint8_t {
+            Raw = 0,
+            Packed = 1,
+            Table = 2,
+            Shared = 3,
+            Int = 4,
+            Cold = 5,
+        };
+
+        // Strings from this size on are shared with readers instead of
+        // copied out for them
+        static constexpr size_t kShareThreshold = 4096;
+
+        Value() = default;
+        Value(Value&& other) noexcept = default;
+        Value& operator=(Value&& other) noexcept;
+        Value(const Value&) = delete;
+        Value& operator=(const Value&) = delete;
+        ~Value() { reset(); }
+
+        Encoding encoding() const { return static_cast<Encoding>(bytes_.flags()); }
+        ValueType type() const {
+            return encoding() == Encoding::Packed || encoding() == Encoding::Table ? ValueType::Hash : ValueType::String;
+        }
+
+        // Bytes owned outside the value itself, charged against maxmemory
+        size_t heap_bytes() const;
+
+        // String; valid when type() == String. An integer is formatted into
+        // `digits` only here, when it is read.
+        std::string_view string(string_int::Digits& digits) const;
+        ValueHandle string_handle() const;
+        bool shared_string() const { return encoding() == Encoding::Shared; }
+        bool cold() const { return encoding() == Encoding::Cold; }
+        // Length of the string, without formatting an integer
+        size_t string_size() const;
+        // Stores an integer-looking string as Int
+        void assign_string(std::string_view value);
+        // Refers to a string kept by a value log; `value` must stay mapped
+        // until the value is reassigned
+        void assign_cold(std::string_view value);
+
+        // Integer; valid when encoding() == Int. assign_integer() replaces a
+        // string of any encoding.
+        int64_t integer() const {
+            int64_t value;
+            std::memcpy(&value, bytes_.data(), sizeof(value));
+            return value;
+        }
+        void assign_integer(int64_t value);
+
+        // Hash; valid when type() == Hash. A packed hash is converted to a
+        // table once it outgrows `limits`.
+        void assign_empty_hash();
+        std::optional<std::string_view> hash_get(std::string_view field) const;
+        size_t hash_size() const;
+        bool hash_set(std::string_view field, std::string_view value, const HashLimits& limits);
+        bool hash_erase(std::string_view field);
+
+        template <typename Fn>
+        void hash_for_each(Fn&& fn) const {
+            if (encoding() == Encoding::Table) {
+                table()->for_each(fn);
+            }
+            else {
+                packed_hash::for_each(bytes_.view(), fn);
+            }
+        }
+
+        // The packed form of the hash (built for a table), as stored in
+        // snapshots, and the reverse; false if `packed` is malformed
+        void hash_pack(std::string& out) const;
+        bool assign_packed_hash(std::string_view packed, const HashLimits& limits);
+
+    private:
+        HashFields* table() const;
+        SharedString* shared() const;
+        std::string_view cold_string() const;
+        void convert_to_table(size_t extra);
+        void reset();
+
+        CompactString bytes_;
+    };
+
+    static_assert(sizeof(Value) == sizeof(CompactString), "Value must stay slot-sized");
+
+} // namespace blitzdb
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace blitzdb {
+
+    // What happens to writes once a storage reaches its memory limit
+    enum class EvictionPolicy {
+        NoEviction,   // Reject writes with an OOM error
+        AllKeysLru,   // Evict the least recently used of a sample
+        AllKeysLfu,   // Evict the least frequently used of a sample
+        VolatileTtl,  // Evict the key with the nearest deadline of a sample
+    };
+
+    inline std::optional<EvictionPolicy> parse_eviction_policy(std::string_view name) {
+        if (name == "noeviction") return EvictionPolicy::NoEviction;
+        if (name == "allkeys-lru") return EvictionPolicy::AllKeysLru;
+        if (name == "allkeys-lfu") return EvictionPolicy::AllKeysLfu;
+        if (name == "volatile-ttl") return EvictionPolicy::VolatileTtl;
+        return std::nullopt;
+    }
+
+    inline const char* eviction_policy_name(EvictionPolicy policy) {
+        switch (policy) {
+        case EvictionPolicy::AllKeysLru: return "allkeys-lru";
+        case EvictionPolicy::AllKeysLfu: return "allkeys-lfu";
+        case EvictionPolicy::VolatileTtl: return "volatile-ttl";
+        default: return "noeviction";
+        }
+    }
+
+    // Access metadata packed into one 32-bit word per entry: the high 24
+    // bits hold the last access time in seconds (wrapping after ~194 days),
+    // the low 8 bits a logarithmic access counter. Readers update it with
+    // relaxed atomic stores, so the hot path takes no extra lock.
+    struct AccessStamp {
+        static constexpr uint32_t kClockMask = (1u << 24) - 1;
+        static constexpr uint8_t kCounterInit = 5;     // New keys are not evicted first
+        static constexpr unsigned kLogFactor = 10;     // Higher: slower counter growth
+        static constexpr uint32_t kDecaySeconds = 60;  // Counter drops by one per idle minute
+
+        static uint32_t clock(int64_t now_ms) {
+            return static_cast<uint32_t>(now_ms / 1000) & kClockMask;
+        }
+
+        static uint32_t make(uint32_t clock, uint8_t counter) { return (clock << 8) | counter; }
+        static uint32_t clock_of(uint32_t stamp) { return stamp >> 8; }
+        static uint8_t counter_of(uint32_t stamp) { return static_cast<uint8_t>(stamp); }
+
+        static uint32_t idle_seconds(uint32_t stamp, uint32_t now_clock) {
+            return (now_clock - clock_of(stamp)) & kClockMask;
+        }
+
+        // Counter after ageing it for the time since the last access
+        static uint8_t decayed_counter(uint32_t stamp, uint32_t now_clock) {
+            uint32_t periods = idle_seconds(stamp, now_clock) / kDecaySeconds;
+            uint8_t counter = counter_of(stamp);
+            return periods >= counter ? 0 : static_cast<uint8_t>(counter - periods);
+        }
+
+        // Increments with probability 1 / ((counter - init) * factor + 1),
+        // so 255 represents on the order of a million accesses
+        static uint8_t increment(uint8_t counter, uint64_t random) {
+            if (counter == 255) {
+                return counter;
+            }
+            uint32_t base = counter > kCounterInit ? counter - kCounterInit : 0;
+            double p = 1.0 / (base * kLogFactor + 1);
+            double r = static_cast<double>(random >> 11) * (1.0 / 9007199254740992.0);
+            return r < p ? static_cast<uint8_t>(counter + 1) : counter;
+        }
+    };
+
+} // namespace blitzdb
@@ -0,0 +1,532 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLITZDB_HASH_TABLE_SSE2 1
+#endif
+
+namespace blitzdb {
+
+    namespace hash_table_detail {
+
+        // Control byte values. Full slots store the low 7 bits of the hash.
+        constexpr int8_t kEmpty = -128;   // 0b10000000
+        constexpr int8_t kDeleted = -2;   // 0b11111110
+
+        inline bool is_full(int8_t ctrl) { return ctrl >= 0; }
+
+        inline unsigned count_trailing_zeros(uint64_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long index;
+            _BitScanForward64(&index, bits);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+        }
+
+        // Iterates the set positions of a match mask
+        class BitMask {
+        public:
+            BitMask(uint64_t bits, unsigned shift) : bits_(bits), shift_(shift) {}
+            explicit operator bool() const { return bits_ != 0; }
+            size_t lowest() const { return count_trailing_zeros(bits_) >> shift_; }
+            void clear_lowest() { bits_ &= bits_ - 1; }
+
+        private:
+            uint64_t bits_;
+            unsigned shift_;
+        };
+
+#if defined(BLITZDB_HASH_TABLE_SSE2)
+        // 16 control bytes compared at once with SSE2
+        struct Group {
+            static constexpr size_t kWidth = 16;
+
+            explicit Group(const int8_t* ctrl)
+                : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {
+            }
+
+            BitMask match(int8_t h2) const {
+                __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(h2)), ctrl_);
+                return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(cmp)), 0);
+            }
+
+            BitMask match_empty() const { return match(kEmpty); }
+
+            // Empty or deleted: both have the sign bit set
+            BitMask match_free() const {
+                return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(ctrl_)), 0);
+            }
+
+            __m128i ctrl_;
+        };
+#else
+        // Portable fallback: 8 control bytes per 64-bit word (SWAR)
+        struct Group {
+            static constexpr size_t kWidth = 8;
+            static constexpr uint64_t kLsbs = 0x0101010101010101ULL;
+            static constexpr uint64_t kMsbs = 0x8080808080808080ULL;
+
+            explicit Group(const int8_t* ctrl) { std::memcpy(&ctrl_, ctrl, sizeof(ctrl_)); }
+
+            BitMask match(int8_t h2) const {
+                uint64_t x = ctrl_ ^ (kLsbs * static_cast<uint8_t>(h2));
+                return BitMask((x - kLsbs) & ~x & kMsbs, 3);
+            }
+
+            BitMask match_empty() const {
+                // Empty is the only value with the high bit set and bit 1 clear
+                return BitMask(ctrl_ & ~(ctrl_ << 6) & kMsbs, 3);
+            }
+
+            BitMask match_free() const { return BitMask(ctrl_ & kMsbs, 3); }
+
+            uint64_t ctrl_;
+        };
+#endif
+
+    } // namespace hash_table_detail
+
+    // Open-addressing hash table in the style of Swiss tables: one control
+    // byte per slot holding 7 bits of the hash, probed a group at a time, and
+    // entries stored directly in the slot array.
+    //
+    // Growing never rehashes everything at once. A bigger table is allocated
+    // and the old one is kept alongside; every mutating call migrates a few
+    // old slots until the old table is empty. Lookups consult both tables, so
+    // they never mutate and may run concurrently under a shared lock.
+    //
+    // Entry must be movable, constructible from a key (std::string_view) and
+    // provide `std::string_view key() const`. Callers supply the key hash,
+    // computed with Hash, so it can be reused (e.g. for shard selection).
+    template <typename Entry, typename Hash = std::hash<std::string_view>>
+    class HashTable {
+    public:
+        // Old-table slots migrated per mutating call while growing
+        static constexpr size_t kMigrateStep = 32;
+
+        HashTable() = default;
+        HashTable(const HashTable&) = delete;
+        HashTable& operator=(const HashTable&) = delete;
+        // Takes both tables over; `other` is left empty
+        HashTable(HashTable&& other) noexcept
+            : active_(std::move(other.active_)), draining_(std::move(other.draining_)),
+              migrate_cursor_(std::exchange(other.migrate_cursor_, 0)) {}
+        HashTable& operator=(HashTable&& other) noexcept {
+            active_ = std::move(other.active_);
+            draining_ = std::move(other.draining_);
+            migrate_cursor_ = std::exchange(other.migrate_cursor_, 0);
+            return *this;
+        }
+        ~HashTable() = default;
+
+        size_t size() const { return active_.size + draining_.size; }
+        bool empty() const { return size() == 0; }
+        bool rehashing() const { return draining_.capacity != 0; }
+        size_t capacity() const { return active_.capacity + draining_.capacity; }
+
+        // Bytes held by the slot and control arrays
+        size_t table_bytes() const { return active_.bytes() + draining_.bytes(); }
+
+        Entry* find(std::string_view key, size_t hash) {
+            if (Entry* entry = active_.find(key, hash)) {
+                return entry;
+            }
+            return draining_.capacity ? draining_.find(key, hash) : nullptr;
+        }
+
+        const Entry* find(std::string_view key, size_t hash) const {
+            return const_cast<HashTable*>(this)->find(key, hash);
+        }
+
+        // Starts loading the first group and slot a lookup of `hash` will
+        // probe, so a batch of lookups can overlap their cache misses
+        void prefetch(size_t hash) const {
+            active_.prefetch(hash);
+            draining_.prefetch(hash);
+        }
+
+        // Returns the entry for `key`, constructing it when missing. The
+        // pointer stays valid until the next mutating call.
+        std::pair<Entry*, bool> insert(std::string_view key, size_t hash) {
+            migrate(kMigrateStep);
+            if (Entry* entry = active_.find(key, hash)) {
+                return { entry, false };
+            }
+            if (draining_.capacity) {
+                if (Entry* old = draining_.find(key, hash)) {
+                    // Move it over now so the key lives in one table only
+                    Entry moved(std::move(*old));
+                    draining_.erase(old);
+                    reserve_one();
+                    return { active_.insert_new(std::move(moved), hash), false };
+                }
+            }
+            reserve_one();
+            return { active_.emplace_new(key, hash), true };
+        }
+
+        bool erase(std::string_view key, size_t hash) {
+            migrate(kMigrateStep);
+            if (Entry* entry = active_.find(key, hash)) {
+                active_.erase(entry);
+                return true;
+            }
+            if (draining_.capacity) {
+                if (Entry* entry = draining_.find(key, hash)) {
+                    draining_.erase(entry);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Removes an entry previously returned by find() or insert()
+        void erase(Entry* entry) {
+            if (active_.owns(entry)) {
+                active_.erase(entry);
+            }
+            else {
+                draining_.erase(entry);
+            }
+        }
+
+        // Performs up to `slots` steps of pending incremental migration
+        void migrate(size_t slots) {
+            if (!draining_.capacity) {
+                return;
+            }
+            while (slots-- > 0 && migrate_cursor_ < draining_.capacity) {
+                size_t i = migrate_cursor_++;
+                if (hash_table_detail::is_full(draining_.ctrl[i])) {
+                    Entry& entry = draining_.slots()[i];
+                    size_t hash = hasher_(entry.key());
+                    active_.insert_new(std::move(entry), hash);
+                    draining_.erase(&entry);
+                }
+            }
+            if (migrate_cursor_ >= draining_.capacity || draining_.size == 0) {
+                draining_.reset();
+                migrate_cursor_ = 0;
+            }
+        }
+
+        // Sizes the table for `count` entries in one step, so a bulk load
+        // does not go through repeated growth and migration
+        void reserve(size_t count) {
+            migrate(draining_.capacity);
+            size_t new_capacity = active_.capacity ? active_.capacity : Group::kWidth;
+            while (new_capacity - new_capacity / 8 <= count) {
+                new_capacity *= 2;
+            }
+            if (new_capacity <= active_.capacity) {
+                return;
+            }
+            Table next;
+            next.allocate(new_capacity);
+            draining_ = std::move(active_);
+            active_ = std::move(next);
+            migrate_cursor_ = 0;
+            migrate(draining_.capacity);
+        }
+
+        // Calls fn(Entry&) for every entry
+        template <typename Fn>
+        void for_each(Fn&& fn) {
+            active_.for_each(fn);
+            draining_.for_each(fn);
+        }
+
+        template <typename Fn>
+        void for_each(Fn&& fn) const {
+            const_cast<HashTable*>(this)->for_each([&](Entry& entry) { fn(const_cast<const Entry&>(entry)); });
+        }
+
+        // Calls fn(Entry&) for the entries among `count` slots from
+        // `position` on, stopping early when fn returns false. Returns the
+        // slot to resume from, 0 once the end of the table is reached. A
+        // scan spread over several calls may miss or revisit entries that
+        // growth moved in between.
+        template <typename Fn>
+        size_t for_each_from(size_t position, size_t count, Fn&& fn) {
+            size_t total = capacity();
+            size_t end = position < total ? std::min(total, position + count) : total;
+            for (size_t i = position; i < end; ++i) {
+                Table& table = i < active_.capacity ? active_ : draining_;
+                size_t slot = i < active_.capacity ? i : i - active_.capacity;
+                if (hash_table_detail::is_full(table.ctrl[slot]) && !fn(table.slots()[slot])) {
+                    end = i + 1;
+                    break;
+                }
+            }
+            return end < total ? end : 0;
+        }
+
+        // Returns the entry in the first full slot at or after `position`
+        // (wrapping), looking at no more than `max_scan` slots. Used for
+        // random sampling; returns nullptr if the window held no entry.
+        Entry* entry_at(size_t position, size_t max_scan) {
+            size_t total = capacity();
+            if (size() == 0) {
+                return nullptr;
+            }
+            for (size_t n = 0; n < max_scan && n < total; ++n) {
+                size_t i = (position + n) % total;
+                Table& table = i < active_.capacity ? active_ : draining_;
+                size_t slot = i < active_.capacity ? i : i - active_.capacity;
+                if (hash_table_detail::is_full(table.ctrl[slot])) {
+                    return &table.slots()[slot];
+                }
+            }
+            return nullptr;
+        }
+
+        void clear() {
+            active_.reset();
+            draining_.reset();
+            migrate_cursor_ = 0;
+        }
+
+    private:
+        using Group = hash_table_detail::Group;
+
+        static int8_t h2(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+        static size_t h1(size_t hash) { return hash >> 7; }
+
+        // One open-addressing table: `capacity` slots (a power of two) plus
+        // kWidth cloned control bytes so a group load never wraps
+        struct Table {
+            int8_t* ctrl = nullptr;
+            void* memory = nullptr;
+            size_t capacity = 0;
+            size_t size = 0;
+            size_t deleted = 0;
+
+            Table() = default;
+            Table(const Table&) = delete;
+            Table& operator=(const Table&) = delete;
+            Table(Table&& other) noexcept { *this = std::move(other); }
+            Table& operator=(Table&& other) noexcept {
+                if (this != &other) {
+                    reset();
+                    ctrl = std::exchange(other.ctrl, nullptr);
+                    memory = std::exchange(other.memory, nullptr);
+                    capacity = std::exchange(other.capacity, 0);
+                    size = std::exchange(other.size, 0);
+                    deleted = std::exchange(other.deleted, 0);
+                }
+                return *this;
+            }
+            ~Table() { reset(); }
+
+            static size_t ctrl_bytes(size_t capacity) {
+                // Round up so the slot array that follows is aligned
+                size_t bytes = capacity + Group::kWidth;
+                return (bytes + alignof(Entry) - 1) / alignof(Entry) * alignof(Entry);
+            }
+
+            size_t bytes() const {
+                return capacity ? ctrl_bytes(capacity) + capacity * sizeof(Entry) : 0;
+            }
+
+            Entry* slots() const {
+                return reinterpret_cast<Entry*>(static_cast<char*>(memory) + ctrl_bytes(capacity));
+            }
+
+            void allocate(size_t new_capacity) {
+                capacity = new_capacity;
+                memory = ::operator new(bytes(), std::align_val_t(alignof(Entry) < 16 ? 16 : alignof(Entry)));
+                ctrl = static_cast<int8_t*>(memory);
+                std::memset(ctrl, static_cast<unsigned char>(hash_table_detail::kEmpty), capacity + Group::kWidth);
+                size = 0;
+                deleted = 0;
+            }
+
+            void reset() {
+                if (memory) {
+                    if (size) {
+                        for_each([](Entry& entry) { entry.~Entry(); });
+                    }
+                    ::operator delete(memory, std::align_val_t(alignof(Entry) < 16 ? 16 : alignof(Entry)));
+                }
+                ctrl = nullptr;
+                memory = nullptr;
+                capacity = 0;
+                size = 0;
+                deleted = 0;
+            }
+
+            bool owns(const Entry* entry) const {
+                return capacity && entry >= slots() && entry < slots() + capacity;
+            }
+
+            // Usable slots before the table must grow (7/8 load factor)
+            size_t growth_limit() const { return capacity - capacity / 8; }
+
+            void set_ctrl(size_t i, int8_t value) {
+                ctrl[i] = value;
+                // Keep the cloned tail in sync with the first kWidth bytes
+                if (i < Group::kWidth) {
+                    ctrl[capacity + i] = value;
+                }
+            }
+
+            Entry* find(std::string_view key, size_t hash) const {
+                if (!capacity) {
+                    return nullptr;
+                }
+                size_t mask = capacity - 1;
+                size_t pos = h1(hash) & mask;
+                size_t step = 0;
+                while (true) {
+                    Group group(ctrl + pos);
+                    for (auto match = group.match(h2(hash)); match; match.clear_lowest()) {
+                        size_t i = (pos + match.lowest()) & mask;
+                        Entry* entry = slots() + i;
+                        if (entry->key() == key) {
+                            return entry;
+                        }
+                    }
+                    if (group.match_empty()) {
+                        return nullptr;
+                    }
+                    step += Group::kWidth;
+                    pos = (pos + step) & mask;
+                    if (step > capacity) {
+                        return nullptr;
+                    }
+                }
+            }
+
+            void prefetch(size_t hash) const {
+                if (!capacity) {
+                    return;
+                }
+                size_t pos = h1(hash) & (capacity - 1);
+#if defined(__GNUC__) || defined(__clang__)
+                __builtin_prefetch(ctrl + pos);
+                __builtin_prefetch(slots() + pos);
+#elif defined(BLITZDB_HASH_TABLE_SSE2)
+                _mm_prefetch(reinterpret_cast<const char*>(ctrl + pos), _MM_HINT_T0);
+                _mm_prefetch(reinterpret_cast<const char*>(slots() + pos), _MM_HINT_T0);
+#endif
+            }
+
+            // First empty or deleted slot on the probe sequence
+            size_t find_free(size_t hash) const {
+                size_t mask = capacity - 1;
+                size_t pos = h1(hash) & mask;
+                size_t step = 0;
+                while (true) {
+                    Group group(ctrl + pos);
+                    if (auto free = group.match_free()) {
+                        return (pos + free.lowest()) & mask;
+                    }
+                    step += Group::kWidth;
+                    pos = (pos + step) & mask;
+                }
+            }
+
+            Entry* emplace_new(std::string_view key, size_t hash) {
+                size_t i = claim(hash);
+                return new (slots() + i) Entry(key);
+            }
+
+            Entry* insert_new(Entry&& entry, size_t hash) {
+                size_t i = claim(hash);
+                return new (slots() + i) Entry(std::move(entry));
+            }
+
+            size_t claim(size_t hash) {
+                size_t i = find_free(hash);
+                if (ctrl[i] == hash_table_detail::kDeleted) {
+                    --deleted;
+                }
+                set_ctrl(i, h2(hash));
+                ++size;
+                return i;
+            }
+
+            void erase(Entry* entry) {
+                size_t i = static_cast<size_t>(entry - slots());
+                entry->~Entry();
+                --size;
+                // If the run of non-empty slots around `i` is shorter than a
+                // group, no probe ever saw a full group here and the slot can
+                // go straight back to empty; otherwise it must be a tombstone
+                size_t mask = capacity - 1;
+                size_t before = 0;
+                while (before < Group::kWidth && ctrl[(i - before - 1) & mask] != hash_table_detail::kEmpty) {
+                    ++before;
+                }
+                size_t after = 0;
+                while (after < Group::kWidth && ctrl[(i + after + 1) & mask] != hash_table_detail::kEmpty) {
+                    ++after;
+                }
+                if (before + after + 1 < Group::kWidth) {
+                    set_ctrl(i, hash_table_detail::kEmpty);
+                }
+                else {
+                    set_ctrl(i, hash_table_detail::kDeleted);
+                    ++deleted;
+                }
+            }
+
+            template <typename Fn>
+            void for_each(Fn&& fn) {
+                for (size_t i = 0; i < capacity; ++i) {
+                    if (hash_table_detail::is_full(ctrl[i])) {
+                        fn(slots()[i]);
+                    }
+                }
+            }
+        };
+
+        // Makes room for one more entry in the active table, starting an
+        // incremental migration when it is full
+        void reserve_one() {
+            if (active_.capacity && active_.size + active_.deleted < active_.growth_limit()) {
+                return;
+            }
+            if (draining_.capacity) {
+                // Still draining the previous generation: finish it first
+                migrate(draining_.capacity);
+                if (active_.size + active_.deleted < active_.growth_limit()) {
+                    return;
+                }
+            }
+
+            size_t new_capacity = active_.capacity ? active_.capacity : Group::kWidth;
+            // Grow when genuinely full; if mostly tombstones, rebuild at the same size
+            if (active_.size * 32 >= active_.capacity * 25) {
+                new_capacity *= 2;
+            }
+
+            Table next;
+            next.allocate(new_capacity);
+            draining_ = std::move(active_);
+            active_ = std::move(next);
+            migrate_cursor_ = 0;
+            if (draining_.size == 0) {
+                draining_.reset();
+            }
+        }
+
+        Table active_;
+        Table draining_;
+        size_t migrate_cursor_ = 0;
+        Hash hasher_;
+    };
+
+} // namespace blitzdb
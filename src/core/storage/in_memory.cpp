@@ -1,21 +1,1324 @@
 #include "storage/in_memory.h"
+#include "storage/tiered.h"
+#include "utils/allocator.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <limits>
 
 namespace blitzdb {
 
-    void InMemoryStorage::set(const std::string& key, const std::string& value) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        data_[key] = value;
+    namespace {
+
+        // Per-thread xorshift; used for sampling and LFU increments
+        uint64_t next_random() {
+            thread_local uint64_t state = 0x2545F4914F6CDD1DULL;
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        // Formats a deadline for a change record
+        std::string_view format_ms(int64_t value, char (&buffer)[24]) {
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            return std::string_view(buffer, static_cast<size_t>(result.ptr - buffer));
+        }
+
+        // Rebuilt values of APPEND and SETRANGE; reused so steady-state
+        // updates do not allocate
+        std::string& string_scratch() {
+            thread_local std::string scratch;
+            return scratch;
+        }
+
+        // A number as INCRBYFLOAT reads it: the whole string, not NaN
+        bool parse_long_double(std::string_view text, long double& value) {
+            auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+            return ec == std::errc() && end == text.data() + text.size() && !std::isnan(value);
+        }
+
+        // Fixed notation with 17 decimals, trailing zeros dropped, as Redis
+        // formats INCRBYFLOAT results ("10.5", "3", not "3.0e0")
+        void format_long_double(long double value, std::string& text) {
+            char buffer[64];
+            int length = std::snprintf(buffer, sizeof(buffer), "%.17Lf", value);
+            if (length < static_cast<int>(sizeof(buffer))) {
+                text.assign(buffer, static_cast<size_t>(length));
+            }
+            else {
+                text.resize(static_cast<size_t>(length) + 1);
+                std::snprintf(text.data(), text.size(), "%.17Lf", value);
+                text.resize(static_cast<size_t>(length));
+            }
+            if (text.find('.') != std::string::npos) {
+                while (text.back() == '0') {
+                    text.pop_back();
+                }
+                if (text.back() == '.') {
+                    text.pop_back();
+                }
+            }
+            if (text == "-0") {
+                text = "0";
+            }
+        }
+
+    } // namespace
+
+    void append_command(std::string& out, std::span<const std::string_view> args) {
+        char header[24];
+        out += '*';
+        out += format_ms(static_cast<int64_t>(args.size()), header);
+        out += "\r\n";
+        for (std::string_view arg : args) {
+            out += '$';
+            out += format_ms(static_cast<int64_t>(arg.size()), header);
+            out += "\r\n";
+            out += arg;
+            out += "\r\n";
+        }
+    }
+
+    InMemoryStorage::InMemoryStorage(size_t shard_count)
+        : shard_count_(1), shard_bits_(0) {
+        while (shard_count_ < shard_count && shard_count_ < (size_t{ 1 } << 16)) {
+            shard_count_ <<= 1;
+            ++shard_bits_;
+        }
+        shards_ = std::make_unique<Shard[]>(shard_count_);
+        lazy_free_ = std::make_unique<LazyFree>();
+    }
+
+    size_t InMemoryStorage::shard_index(std::string_view key) const {
+        return shard_of_hash(StringHash{}(key));
+    }
+
+    size_t InMemoryStorage::shard_of_hash(size_t hash) const {
+        if (shard_bits_ == 0) {
+            return 0;
+        }
+        // Take the shard from the high bits of a mixed hash so it stays
+        // independent from the slot chosen inside the shard's table
+        uint64_t h = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h >> (64 - shard_bits_));
+    }
+
+    std::unique_lock<std::shared_mutex> InMemoryStorage::lock_exclusive(const Shard& shard) {
+        shard.acquisitions.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            // Only contended acquisitions read the clock
+            shard.contended.fetch_add(1, std::memory_order_relaxed);
+            auto started = std::chrono::steady_clock::now();
+            lock.lock();
+            shard.wait_ns.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started).count()), std::memory_order_relaxed);
+        }
+        return lock;
+    }
+
+    std::shared_lock<std::shared_mutex> InMemoryStorage::lock_shared(const Shard& shard) {
+        shard.acquisitions.fetch_add(1, std::memory_order_relaxed);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            // Only contended acquisitions read the clock
+            shard.contended.fetch_add(1, std::memory_order_relaxed);
+            auto started = std::chrono::steady_clock::now();
+            lock.lock();
+            shard.wait_ns.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started).count()), std::memory_order_relaxed);
+        }
+        return lock;
+    }
+
+    int64_t InMemoryStorage::now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void InMemoryStorage::set_deadline(Shard& shard, StorageEntry& entry, int64_t expire_at) {
+        if (!entry.has_expiry() && expire_at != 0) {
+            ++shard.volatile_keys;
+        }
+        else if (entry.has_expiry() && expire_at == 0) {
+            --shard.volatile_keys;
+        }
+        entry.expire_at = expire_at;
+    }
+
+    StorageEntry* InMemoryStorage::insert_entry(Shard& shard, std::string_view key, size_t hash, int64_t now) const {
+        auto [entry, inserted] = shard.data.insert(key, hash);
+        if (inserted) {
+            entry->access = AccessStamp::make(AccessStamp::clock(now), AccessStamp::kCounterInit);
+            shard.used_memory += entry->memory_usage();
+        }
+        else {
+            touch(*entry, now);
+        }
+        return entry;
+    }
+
+    void InMemoryStorage::erase_entry(Shard& shard, StorageEntry* entry, size_t lazy_bytes) const {
+        forget_cold(shard, entry->value);
+        if (entry->has_expiry()) {
+            --shard.volatile_keys;
+        }
+        shard.used_memory -= entry->memory_usage();
+        size_t bytes = entry->value.heap_bytes();
+        if (lazy_bytes != 0 && bytes >= lazy_bytes) {
+            // Leaves an empty value in the slot, so the erase frees nothing
+            lazy_free_->defer(std::move(entry->value), bytes);
+        }
+        shard.data.erase(entry);
+    }
+
+    void InMemoryStorage::record(std::initializer_list<std::string_view> args) const {
+        record(std::span<const std::string_view>(args.begin(), args.size()));
+    }
+
+    void InMemoryStorage::record(std::span<const std::string_view> args) const {
+        ChangeObserver* observer = observer_.load(std::memory_order_acquire);
+        if (!observer) {
+            return;
+        }
+        thread_local std::string buffer;
+        buffer.clear();
+        append_command(buffer, args);
+        observer->on_change(buffer);
+    }
+
+    void InMemoryStorage::record(std::string_view command, std::string_view key,
+        std::span<const std::string_view> args) const {
+        if (!observer_.load(std::memory_order_acquire)) {
+            return;
+        }
+        Arena& arena = scratch_arena();
+        ArenaScope scope(arena);
+        std::vector<std::string_view, ArenaAllocator<std::string_view>> full{ ArenaAllocator<std::string_view>(arena) };
+        full.reserve(args.size() + 2);
+        full.push_back(command);
+        full.push_back(key);
+        full.insert(full.end(), args.begin(), args.end());
+        record(std::span<const std::string_view>(full.data(), full.size()));
+    }
+
+    void InMemoryStorage::drop_entry(Shard& shard, StorageEntry* entry) const {
+        record({ "DEL", entry->key() });
+        erase_entry(shard, entry, lazy_free_threshold());
+    }
+
+    void InMemoryStorage::forget_cold(Shard& shard, const Value& value) {
+        if (value.cold()) {
+            --shard.cold_keys;
+            shard.cold_bytes -= value.string_size();
+        }
+    }
+
+    void InMemoryStorage::assign_value(Shard& shard, StorageEntry& entry, std::string_view value) const {
+        forget_cold(shard, entry.value);
+        size_t bytes = entry.value.heap_bytes();
+        shard.used_memory -= bytes;
+        size_t threshold = lazy_free_threshold();
+        if (threshold != 0 && bytes >= threshold) {
+            // `value` may point into the old value: hand it over afterwards
+            Value old(std::move(entry.value));
+            entry.value.assign_string(value);
+            lazy_free_->defer(std::move(old), bytes);
+        }
+        else {
+            entry.value.assign_string(value);
+        }
+        shard.used_memory += entry.value.heap_bytes();
+    }
+
+    void InMemoryStorage::touch(const StorageEntry& entry, int64_t now) const {
+        std::atomic_ref<uint32_t> access(entry.access);
+        uint32_t stamp = access.load(std::memory_order_relaxed);
+        uint32_t clock = AccessStamp::clock(now);
+        uint32_t updated = stamp;
+
+        if (policy_.load(std::memory_order_relaxed) == EvictionPolicy::AllKeysLfu) {
+            uint8_t counter = AccessStamp::increment(AccessStamp::decayed_counter(stamp, clock), next_random());
+            updated = AccessStamp::make(clock, counter);
+        }
+        else {
+            updated = AccessStamp::make(clock, AccessStamp::counter_of(stamp));
+        }
+        // Skip the store when nothing changed so hot keys read by many
+        // threads do not bounce their cache line
+        if (updated != stamp) {
+            access.store(updated, std::memory_order_relaxed);
+        }
+    }
+
+    bool InMemoryStorage::make_room(Shard& shard, int64_t now) {
+        constexpr size_t kMaxEvictions = 16;  // Per write, so one write stays O(samples)
+
+        size_t budget = shard_budget_.load(std::memory_order_relaxed);
+        if (budget == 0 || shard.used_memory <= budget) {
+            return true;
+        }
+        EvictionPolicy policy = policy_.load(std::memory_order_relaxed);
+        if (policy == EvictionPolicy::NoEviction) {
+            return false;
+        }
+
+        size_t samples = eviction_samples_.load(std::memory_order_relaxed);
+        uint32_t clock = AccessStamp::clock(now);
+        size_t evicted = 0;
+        while (shard.used_memory > budget && evicted < kMaxEvictions) {
+            if (shard.data.size() == 0 ||
+                (policy == EvictionPolicy::VolatileTtl && shard.volatile_keys == 0)) {
+                break;
+            }
+
+            // Lower score is a better victim; expired keys always win
+            StorageEntry* victim = nullptr;
+            uint64_t best = UINT64_MAX;
+            size_t capacity = shard.data.capacity();
+            size_t sampled = 0;
+            for (size_t attempt = 0; attempt < samples * 4 && sampled < samples; ++attempt) {
+                StorageEntry* entry = shard.data.entry_at(static_cast<size_t>(next_random() % capacity), 32);
+                if (!entry || (policy == EvictionPolicy::VolatileTtl && !entry->has_expiry())) {
+                    continue;
+                }
+                ++sampled;
+
+                uint64_t score;
+                if (entry->expired(now)) {
+                    score = 0;
+                }
+                else if (policy == EvictionPolicy::AllKeysLru) {
+                    score = 1 + AccessStamp::kClockMask - AccessStamp::idle_seconds(entry->access, clock);
+                }
+                else if (policy == EvictionPolicy::AllKeysLfu) {
+                    // Counter first, idle time breaks ties
+                    score = 1 + ((uint64_t{ AccessStamp::decayed_counter(entry->access, clock) } << 24) |
+                        (AccessStamp::kClockMask - AccessStamp::idle_seconds(entry->access, clock)));
+                }
+                else {
+                    score = static_cast<uint64_t>(entry->expire_at);
+                }
+                if (score < best) {
+                    best = score;
+                    victim = entry;
+                }
+            }
+            if (!victim) {
+                break;
+            }
+            drop_entry(shard, victim);
+            ++shard.evicted_keys;
+            ++evicted;
+        }
+
+        // Refuse only when nothing could be evicted; a partial eviction
+        // still makes progress and the next write continues it
+        return shard.used_memory <= budget || evicted > 0;
+    }
+
+    StorageEntry* InMemoryStorage::find_live(Shard& shard, std::string_view key, size_t hash, int64_t now) const {
+        StorageEntry* entry = shard.data.find(key, hash);
+        if (entry && entry->expired(now)) {
+            drop_entry(shard, entry);
+            ++shard.expired_keys;
+            return nullptr;
+        }
+        return entry;
+    }
+
+    bool InMemoryStorage::set(std::string_view key, std::string_view value) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            return false;
+        }
+        StorageEntry* entry = insert_entry(shard, key, hash, now);
+        assign_value(shard, *entry, value);
+        set_deadline(shard, *entry, 0);
+        record({ "SET", key, value });
+        return true;
+    }
+
+    SetResult InMemoryStorage::set(std::string_view key, std::string_view value, const SetParams& params) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+
+        SetResult result;
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            result.out_of_memory = true;
+            return result;
+        }
+        StorageEntry* entry = find_live(shard, key, hash, now);
+        if (params.return_old && entry) {
+            if (entry->value.type() != ValueType::String) {
+                throw WrongTypeError();
+            }
+            string_int::Digits digits;
+            result.old_value.emplace(entry->value.string(digits));
+        }
+        if ((params.only_if_missing && entry) || (params.only_if_exists && !entry)) {
+            return result;
+        }
+
+        if (!entry) {
+            entry = insert_entry(shard, key, hash, now);
+        }
+        else {
+            touch(*entry, now);
+        }
+        assign_value(shard, *entry, value);
+        if (params.keep_ttl) {
+            record({ "SET", key, value, "KEEPTTL" });
+        }
+        else {
+            set_deadline(shard, *entry, params.expire_at);
+            if (params.expire_at != 0) {
+                char deadline[24];
+                record({ "SET", key, value, "PXAT", format_ms(params.expire_at, deadline) });
+            }
+            else {
+                record({ "SET", key, value });
+            }
+        }
+        result.written = true;
+        return result;
+    }
+
+    bool InMemoryStorage::restore(std::string_view key, ValueType type, std::string_view value, int64_t expire_at) {
+        int64_t now = now_ms();
+        if (expire_at != 0 && expire_at <= now) {
+            return false;
+        }
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+        StorageEntry* entry = insert_entry(shard, key, hash, now);
+        if (type == ValueType::Hash) {
+            forget_cold(shard, entry->value);
+            shard.used_memory -= entry->value.heap_bytes();
+            entry->value.assign_packed_hash(value, hash_limits_);
+            shard.used_memory += entry->value.heap_bytes();
+        }
+        else {
+            assign_value(shard, *entry, value);
+        }
+        set_deadline(shard, *entry, expire_at);
+        return true;
+    }
+
+    void InMemoryStorage::flush(bool async) {
+        drop_all(async, true);
+    }
+
+    void InMemoryStorage::clear() {
+        drop_all(true, false);
+    }
+
+    void InMemoryStorage::drop_all(bool async, bool record_flush) {
+        std::vector<Map> tables;
+        tables.reserve(shard_count_);
+        size_t keys = 0;
+        size_t bytes = 0;
+        {
+            // All locks at once, so FLUSHALL is ordered against every
+            // other record
+            std::vector<std::unique_lock<std::shared_mutex>> locks;
+            locks.reserve(shard_count_);
+            for (size_t i = 0; i < shard_count_; ++i) {
+                Shard& shard = shards_[i];
+                locks.push_back(lock_exclusive(shard));
+                keys += shard.data.size();
+                bytes += shard.used_memory;
+                tables.push_back(std::move(shard.data));
+                shard.volatile_keys = 0;
+                shard.used_memory = 0;
+                shard.cold_keys = 0;
+                shard.cold_bytes = 0;
+            }
+            if (record_flush && async) {
+                record({ "FLUSHALL", "ASYNC" });
+            }
+            else if (record_flush) {
+                record({ "FLUSHALL" });
+            }
+        }
+        if (async && keys != 0) {
+            lazy_free_->defer(std::move(tables), bytes, keys);
+        }
+    }
+
+    void InMemoryStorage::reserve(size_t shard_index, size_t count) {
+        Shard& shard = shards_[shard_index];
+        auto lock = lock_exclusive(shard);
+        shard.data.reserve(shard.data.size() + count);
+    }
+
+    std::optional<ValueHandle> InMemoryStorage::get(std::string_view key) {
+        return read_entry(key, [](const StorageEntry* entry) -> std::optional<ValueHandle> {
+            if (!entry) {
+                return std::nullopt;
+            }
+            if (entry->value.type() != ValueType::String) {
+                throw WrongTypeError();
+            }
+            return entry->value.string_handle();
+        });
+    }
+
+    bool InMemoryStorage::exists(std::string_view key) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_shared(shard);
+        const StorageEntry* entry = shard.data.find(key, hash);
+        return entry && !entry->expired(now_ms());
+    }
+
+    bool InMemoryStorage::del(std::string_view key) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+        StorageEntry* entry = shard.data.find(key, hash);
+        if (!entry) {
+            return false;
+        }
+        bool live = !entry->expired(now_ms());
+        drop_entry(shard, entry);
+        if (!live) {
+            ++shard.expired_keys;
+        }
+        return live;
+    }
+
+    void InMemoryStorage::group_keys(std::span<const std::string_view> keys, size_t step,
+        ArenaVector<KeyTarget>& targets) const {
+        targets.reserve((keys.size() + step - 1) / step);
+        for (size_t i = 0; i < keys.size(); i += step) {
+            size_t hash = StringHash{}(keys[i]);
+            targets.push_back({ shard_of_hash(hash), hash, i });
+        }
+        // Ties broken on position rather than with stable_sort, which takes
+        // a temporary buffer from the heap on every call
+        std::sort(targets.begin(), targets.end(), [](const KeyTarget& a, const KeyTarget& b) {
+            return a.shard != b.shard ? a.shard < b.shard : a.index < b.index;
+        });
+    }
+
+    // Ascending order keeps concurrent multi-key operations from deadlocking
+    void InMemoryStorage::lock_targets(const ArenaVector<KeyTarget>& targets,
+        ArenaVector<std::unique_lock<std::shared_mutex>>& locks) const {
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (i == 0 || targets[i].shard != targets[i - 1].shard) {
+                locks.push_back(lock_exclusive(shards_[targets[i].shard]));
+            }
+        }
+    }
+
+    void InMemoryStorage::lock_targets(const ArenaVector<KeyTarget>& targets,
+        ArenaVector<std::shared_lock<std::shared_mutex>>& locks) const {
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (i == 0 || targets[i].shard != targets[i - 1].shard) {
+                locks.push_back(lock_shared(shards_[targets[i].shard]));
+            }
+        }
+    }
+
+    void InMemoryStorage::find_entries(std::span<const std::string_view> keys, const StorageEntry** entries,
+        ArenaVector<std::shared_lock<std::shared_mutex>>& locks) const {
+        Arena& arena = scratch_arena();
+        ArenaVector<KeyTarget> targets{ ArenaAllocator<KeyTarget>(arena) };
+        group_keys(keys, 1, targets);
+        lock_targets(targets, locks);
+
+        // Expired keys read as missing; expiry drops them later, as it
+        // needs the exclusive lock
+        int64_t now = now_ms();
+        for (size_t i = 0; i < targets.size() && i < kPrefetchAhead; ++i) {
+            prefetch(targets[i]);
+        }
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (i + kPrefetchAhead < targets.size()) {
+                prefetch(targets[i + kPrefetchAhead]);
+            }
+            const KeyTarget& target = targets[i];
+            const StorageEntry* entry = shards_[target.shard].data.find(keys[target.index], target.hash);
+            if (entry && !entry->expired(now)) {
+                touch(*entry, now);
+                entries[target.index] = entry;
+            }
+        }
+    }
+
+    size_t InMemoryStorage::del(std::span<const std::string_view> keys) {
+        return erase_keys(keys, lazy_free_threshold());
+    }
+
+    size_t InMemoryStorage::unlink(std::span<const std::string_view> keys) {
+        size_t threshold = lazy_free_threshold();
+        return erase_keys(keys, threshold != 0 && threshold < kUnlinkLazyBytes ? threshold : kUnlinkLazyBytes);
+    }
+
+    size_t InMemoryStorage::erase_keys(std::span<const std::string_view> keys, size_t lazy_bytes) {
+        Arena& arena = scratch_arena();
+        ArenaScope scope(arena);
+        ArenaVector<KeyTarget> targets{ ArenaAllocator<KeyTarget>(arena) };
+        group_keys(keys, 1, targets);
+        ArenaVector<std::unique_lock<std::shared_mutex>> locks{ ArenaAllocator<std::unique_lock<std::shared_mutex>>(arena) };
+        lock_targets(targets, locks);
+
+        // One DEL record for everything erased, reported under all the locks
+        ArenaVector<std::string_view> erased{ ArenaAllocator<std::string_view>(arena) };
+        erased.reserve(targets.size() + 1);
+        erased.push_back("DEL");
+
+        int64_t now = now_ms();
+        size_t deleted = 0;
+        for (size_t i = 0; i < targets.size() && i < kPrefetchAhead; ++i) {
+            prefetch(targets[i]);
+        }
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (i + kPrefetchAhead < targets.size()) {
+                prefetch(targets[i + kPrefetchAhead]);
+            }
+            const KeyTarget& target = targets[i];
+            Shard& shard = shards_[target.shard];
+            std::string_view key = keys[target.index];
+            if (StorageEntry* entry = shard.data.find(key, target.hash)) {
+                if (!entry->expired(now)) {
+                    ++deleted;
+                }
+                else {
+                    ++shard.expired_keys;
+                }
+                erase_entry(shard, entry, lazy_bytes);
+                erased.push_back(key);
+            }
+        }
+        if (erased.size() > 1) {
+            record(std::span<const std::string_view>(erased.data(), erased.size()));
+        }
+        return deleted;
+    }
+
+    size_t InMemoryStorage::exists(std::span<const std::string_view> keys) {
+        Arena& arena = scratch_arena();
+        ArenaScope scope(arena);
+        ArenaVector<const StorageEntry*> entries(keys.size(), nullptr, ArenaAllocator<const StorageEntry*>(arena));
+        ArenaVector<std::shared_lock<std::shared_mutex>> locks{ ArenaAllocator<std::shared_lock<std::shared_mutex>>(arena) };
+        find_entries(keys, entries.data(), locks);
+        return static_cast<size_t>(std::count_if(entries.begin(), entries.end(),
+            [](const StorageEntry* entry) { return entry != nullptr; }));
+    }
+
+    SetResult InMemoryStorage::mset(std::span<const std::string_view> pairs, bool only_if_missing) {
+        Arena& arena = scratch_arena();
+        ArenaScope scope(arena);
+        ArenaVector<KeyTarget> targets{ ArenaAllocator<KeyTarget>(arena) };
+        group_keys(pairs, 2, targets);
+        ArenaVector<std::unique_lock<std::shared_mutex>> locks{ ArenaAllocator<std::unique_lock<std::shared_mutex>>(arena) };
+        lock_targets(targets, locks);
+
+        SetResult result;
+        int64_t now = now_ms();
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (i == 0 || targets[i].shard != targets[i - 1].shard) {
+                if (!make_room(shards_[targets[i].shard], now)) {
+                    result.out_of_memory = true;
+                    return result;
+                }
+            }
+        }
+        if (only_if_missing) {
+            for (const KeyTarget& target : targets) {
+                if (find_live(shards_[target.shard], pairs[target.index], target.hash, now)) {
+                    return result;
+                }
+            }
+        }
+
+        // Within a shard the keys keep their order, so a repeated key ends
+        // up with its last value
+        for (size_t i = 0; i < targets.size() && i < kPrefetchAhead; ++i) {
+            prefetch(targets[i]);
+        }
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (i + kPrefetchAhead < targets.size()) {
+                prefetch(targets[i + kPrefetchAhead]);
+            }
+            const KeyTarget& target = targets[i];
+            Shard& shard = shards_[target.shard];
+            StorageEntry* entry = find_live(shard, pairs[target.index], target.hash, now);
+            if (!entry) {
+                entry = insert_entry(shard, pairs[target.index], target.hash, now);
+            }
+            else {
+                touch(*entry, now);
+            }
+            assign_value(shard, *entry, pairs[target.index + 1]);
+            set_deadline(shard, *entry, 0);
+        }
+        record("MSET", pairs.front(), pairs.subspan(1));
+        result.written = true;
+        return result;
+    }
+
+    StorageEntry* InMemoryStorage::find_string(Shard& shard, std::string_view key, size_t hash, int64_t now) const {
+        StorageEntry* entry = find_live(shard, key, hash, now);
+        if (entry && entry->value.type() != ValueType::String) {
+            throw WrongTypeError();
+        }
+        return entry;
+    }
+
+    void InMemoryStorage::record_string(const StorageEntry& entry) const {
+        string_int::Digits digits;
+        std::string_view value = entry.value.string(digits);
+        // The deadline was recorded when it was set
+        if (entry.has_expiry()) {
+            record({ "SET", entry.key(), value, "KEEPTTL" });
+        }
+        else {
+            record({ "SET", entry.key(), value });
+        }
+    }
+
+    IncrementResult InMemoryStorage::incrby(std::string_view key, int64_t delta) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+
+        IncrementResult result;
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            result.status = IncrementStatus::OutOfMemory;
+            return result;
+        }
+        StorageEntry* entry = find_string(shard, key, hash, now);
+
+        // Strings that are integers are always stored as such
+        int64_t current = 0;
+        if (entry) {
+            if (entry->value.encoding() != Value::Encoding::Int) {
+                result.status = IncrementStatus::NotInteger;
+                return result;
+            }
+            current = entry->value.integer();
+        }
+        if ((delta > 0 && current > std::numeric_limits<int64_t>::max() - delta) ||
+            (delta < 0 && current < std::numeric_limits<int64_t>::min() - delta)) {
+            result.status = IncrementStatus::Overflow;
+            return result;
+        }
+        result.value = current + delta;
+
+        if (!entry) {
+            entry = insert_entry(shard, key, hash, now);
+        }
+        else {
+            touch(*entry, now);
+        }
+        entry->value.assign_integer(result.value);
+        record_string(*entry);
+        return result;
+    }
+
+    IncrementStatus InMemoryStorage::incrbyfloat(std::string_view key, long double delta, std::string& text) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            return IncrementStatus::OutOfMemory;
+        }
+        StorageEntry* entry = find_string(shard, key, hash, now);
+
+        long double current = 0;
+        if (entry) {
+            if (entry->value.encoding() == Value::Encoding::Int) {
+                current = static_cast<long double>(entry->value.integer());
+            }
+            else {
+                string_int::Digits digits;
+                if (!parse_long_double(entry->value.string(digits), current)) {
+                    return IncrementStatus::NotFloat;
+                }
+            }
+        }
+        long double updated = current + delta;
+        if (!std::isfinite(updated)) {
+            return IncrementStatus::NotFinite;
+        }
+        format_long_double(updated, text);
+
+        if (!entry) {
+            entry = insert_entry(shard, key, hash, now);
+        }
+        else {
+            touch(*entry, now);
+        }
+        assign_value(shard, *entry, text);
+        record_string(*entry);
+        return IncrementStatus::Ok;
+    }
+
+    StringWriteResult InMemoryStorage::append(std::string_view key, std::string_view value) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+
+        StringWriteResult result;
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            result.out_of_memory = true;
+            return result;
+        }
+        StorageEntry* entry = find_string(shard, key, hash, now);
+        if (!entry) {
+            entry = insert_entry(shard, key, hash, now);
+            assign_value(shard, *entry, value);
+            record({ "SET", key, value });
+            result.length = value.size();
+            return result;
+        }
+
+        string_int::Digits digits;
+        std::string_view current = entry->value.string(digits);
+        if (current.size() + value.size() > kMaxStringLength) {
+            result.too_large = true;
+            return result;
+        }
+        touch(*entry, now);
+        std::string& updated = string_scratch();
+        updated.assign(current);
+        updated.append(value);
+        assign_value(shard, *entry, updated);
+        result.length = updated.size();
+
+        // Unlike APPEND, writing the bytes at the old end can be replayed
+        char offset[24];
+        record({ "SETRANGE", key, format_ms(static_cast<int64_t>(current.size()), offset), value });
+        return result;
+    }
+
+    StringWriteResult InMemoryStorage::setrange(std::string_view key, size_t offset, std::string_view value) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+
+        StringWriteResult result;
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            result.out_of_memory = true;
+            return result;
+        }
+        StorageEntry* entry = find_string(shard, key, hash, now);
+        if (value.empty()) {
+            result.length = entry ? entry->value.string_size() : 0;
+            return result;
+        }
+        if (value.size() > kMaxStringLength || offset > kMaxStringLength - value.size()) {
+            result.too_large = true;
+            return result;
+        }
+
+        std::string& updated = string_scratch();
+        if (entry) {
+            touch(*entry, now);
+            string_int::Digits digits;
+            updated.assign(entry->value.string(digits));
+        }
+        else {
+            entry = insert_entry(shard, key, hash, now);
+            updated.clear();
+        }
+        if (updated.size() < offset + value.size()) {
+            updated.resize(offset + value.size(), '\0');
+        }
+        updated.replace(offset, value.size(), value);
+        assign_value(shard, *entry, updated);
+        result.length = updated.size();
+
+        char position[24];
+        record({ "SETRANGE", key, format_ms(static_cast<int64_t>(offset), position), value });
+        return result;
+    }
+
+    bool InMemoryStorage::set_expiry(std::string_view key, int64_t expire_at_ms) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+        int64_t now = now_ms();
+        StorageEntry* entry = find_live(shard, key, hash, now);
+        if (!entry) {
+            return false;
+        }
+        if (expire_at_ms <= now) {
+            drop_entry(shard, entry);
+        }
+        else {
+            set_deadline(shard, *entry, expire_at_ms);
+            char deadline[24];
+            record({ "PEXPIREAT", key, format_ms(expire_at_ms, deadline) });
+        }
+        return true;
+    }
+
+    bool InMemoryStorage::set_expiry(std::string_view key, std::chrono::system_clock::time_point when) {
+        return set_expiry(key, std::chrono::duration_cast<std::chrono::milliseconds>(
+            when.time_since_epoch()).count());
+    }
+
+    bool InMemoryStorage::persist(std::string_view key) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+        StorageEntry* entry = find_live(shard, key, hash, now_ms());
+        if (!entry || !entry->has_expiry()) {
+            return false;
+        }
+        set_deadline(shard, *entry, 0);
+        record({ "PERSIST", key });
+        return true;
+    }
+
+    int64_t InMemoryStorage::ttl_ms(std::string_view key) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_shared(shard);
+        int64_t now = now_ms();
+        const StorageEntry* entry = shard.data.find(key, hash);
+        if (!entry || entry->expired(now)) {
+            return -2;
+        }
+        return entry->has_expiry() ? entry->expire_at - now : -1;
+    }
+
+    StorageEntry* InMemoryStorage::find_hash(Shard& shard, std::string_view key, size_t hash, int64_t now) const {
+        StorageEntry* entry = find_live(shard, key, hash, now);
+        if (entry && entry->value.type() != ValueType::Hash) {
+            throw WrongTypeError();
+        }
+        return entry;
+    }
+
+    namespace {
+
+        // The hash value of an entry found for reading, or nullptr
+        const Value* hash_of(const StorageEntry* entry) {
+            if (!entry) {
+                return nullptr;
+            }
+            if (entry->value.type() != ValueType::Hash) {
+                throw WrongTypeError();
+            }
+            return &entry->value;
+        }
+
+    } // namespace
+
+    HashSetResult InMemoryStorage::hset(std::string_view key, std::span<const std::string_view> pairs) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+
+        HashSetResult result;
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            result.out_of_memory = true;
+            return result;
+        }
+        StorageEntry* entry = find_hash(shard, key, hash, now);
+        if (!entry) {
+            entry = insert_entry(shard, key, hash, now);
+            entry->value.assign_empty_hash();
+        }
+        else {
+            touch(*entry, now);
+        }
+
+        shard.used_memory -= entry->value.heap_bytes();
+        for (size_t i = 0; i + 1 < pairs.size(); i += 2) {
+            if (entry->value.hash_set(pairs[i], pairs[i + 1], hash_limits_)) {
+                ++result.added;
+            }
+        }
+        shard.used_memory += entry->value.heap_bytes();
+        record("HSET", key, pairs);
+        return result;
+    }
+
+    std::optional<std::string> InMemoryStorage::hget(std::string_view key, std::string_view field) {
+        return read_entry(key, [field](const StorageEntry* entry) -> std::optional<std::string> {
+            const Value* value = hash_of(entry);
+            if (!value) {
+                return std::nullopt;
+            }
+            auto found = value->hash_get(field);
+            return found ? std::optional<std::string>(*found) : std::nullopt;
+        });
+    }
+
+    std::vector<std::optional<std::string>> InMemoryStorage::hmget(std::string_view key,
+        std::span<const std::string_view> fields) {
+        return read_entry(key, [fields](const StorageEntry* entry) {
+            std::vector<std::optional<std::string>> values(fields.size());
+            if (const Value* value = hash_of(entry)) {
+                for (size_t i = 0; i < fields.size(); ++i) {
+                    if (auto found = value->hash_get(fields[i])) {
+                        values[i].emplace(*found);
+                    }
+                }
+            }
+            return values;
+        });
+    }
+
+    std::vector<std::string> InMemoryStorage::hgetall(std::string_view key) {
+        return read_entry(key, [](const StorageEntry* entry) {
+            std::vector<std::string> items;
+            if (const Value* value = hash_of(entry)) {
+                items.reserve(value->hash_size() * 2);
+                value->hash_for_each([&items](std::string_view field, std::string_view data) {
+                    items.emplace_back(field);
+                    items.emplace_back(data);
+                });
+            }
+            return items;
+        });
+    }
+
+    size_t InMemoryStorage::hlen(std::string_view key) {
+        return read_entry(key, [](const StorageEntry* entry) -> size_t {
+            const Value* value = hash_of(entry);
+            return value ? value->hash_size() : 0;
+        });
+    }
+
+    size_t InMemoryStorage::hdel(std::string_view key, std::span<const std::string_view> fields) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+        StorageEntry* entry = find_hash(shard, key, hash, now_ms());
+        if (!entry) {
+            return 0;
+        }
+
+        size_t removed = 0;
+        shard.used_memory -= entry->value.heap_bytes();
+        for (std::string_view field : fields) {
+            if (entry->value.hash_erase(field)) {
+                ++removed;
+            }
+        }
+        shard.used_memory += entry->value.heap_bytes();
+        if (removed == 0) {
+            return 0;
+        }
+        // Replaying the HDEL empties the hash there too, which deletes it
+        record("HDEL", key, fields);
+        if (entry->value.hash_size() == 0) {
+            erase_entry(shard, entry, 0);
+        }
+        return removed;
+    }
+
+    IncrementResult InMemoryStorage::hincrby(std::string_view key, std::string_view field, int64_t delta) {
+        size_t hash = StringHash{}(key);
+        Shard& shard = shards_[shard_of_hash(hash)];
+        auto lock = lock_exclusive(shard);
+
+        IncrementResult result;
+        int64_t now = now_ms();
+        if (!make_room(shard, now)) {
+            result.status = IncrementStatus::OutOfMemory;
+            return result;
+        }
+        StorageEntry* entry = find_hash(shard, key, hash, now);
+
+        int64_t current = 0;
+        if (entry) {
+            if (auto found = entry->value.hash_get(field)) {
+                auto [end, ec] = std::from_chars(found->data(), found->data() + found->size(), current);
+                if (ec != std::errc() || end != found->data() + found->size()) {
+                    result.status = IncrementStatus::NotInteger;
+                    return result;
+                }
+            }
+        }
+        if ((delta > 0 && current > std::numeric_limits<int64_t>::max() - delta) ||
+            (delta < 0 && current < std::numeric_limits<int64_t>::min() - delta)) {
+            result.status = IncrementStatus::Overflow;
+            return result;
+        }
+        result.value = current + delta;
+
+        if (!entry) {
+            entry = insert_entry(shard, key, hash, now);
+            entry->value.assign_empty_hash();
+        }
+        else {
+            touch(*entry, now);
+        }
+        char digits[24];
+        std::string_view text = format_ms(result.value, digits);
+        shard.used_memory -= entry->value.heap_bytes();
+        entry->value.hash_set(field, text, hash_limits_);
+        shard.used_memory += entry->value.heap_bytes();
+
+        // Logged as the resulting value, so replaying it is idempotent
+        std::string_view pair[] = { field, text };
+        record("HSET", key, pair);
+        return result;
+    }
+
+    ExpireCycleStats InMemoryStorage::active_expire_cycle(std::chrono::microseconds budget) {
+        constexpr size_t kSampleSize = 20;       // Keys with a deadline checked per round
+        constexpr size_t kMaxAttempts = 80;      // Slots probed per round
+        constexpr size_t kMaxScan = 32;          // Slots scanned from each random position
+
+        ExpireCycleStats stats;
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        size_t start = expire_cursor_.load(std::memory_order_relaxed);
+
+        for (size_t n = 0; n < shard_count_; ++n) {
+            size_t index = (start + n) % shard_count_;
+            Shard& shard = shards_[index];
+
+            while (true) {
+                size_t sampled = 0;
+                size_t expired = 0;
+                {
+                    auto lock = lock_exclusive(shard);
+                    if (shard.volatile_keys == 0) {
+                        break;
+                    }
+                    int64_t now = now_ms();
+                    size_t capacity = shard.data.capacity();
+                    for (size_t attempt = 0; attempt < kMaxAttempts && sampled < kSampleSize; ++attempt) {
+                        StorageEntry* entry = shard.data.entry_at(
+                            static_cast<size_t>(next_random() % capacity), kMaxScan);
+                        if (!entry || !entry->has_expiry()) {
+                            continue;
+                        }
+                        ++sampled;
+                        if (entry->expired(now)) {
+                            drop_entry(shard, entry);
+                            ++shard.expired_keys;
+                            ++expired;
+                        }
+                    }
+                }
+                stats.sampled += sampled;
+                stats.expired += expired;
+
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    // Resume from this shard next time
+                    expire_cursor_.store(index, std::memory_order_relaxed);
+                    stats.out_of_time = true;
+                    return stats;
+                }
+                // Stay on this shard while more than a quarter of the sample was stale
+                if (sampled == 0 || expired * 4 <= sampled) {
+                    break;
+                }
+            }
+        }
+
+        expire_cursor_.store((start + 1) % shard_count_, std::memory_order_relaxed);
+        return stats;
+    }
+
+    TierCycleStats InMemoryStorage::move_cold(size_t shard_index, size_t& cursor, size_t slots, ValueLog& log,
+        uint32_t cold_seconds, size_t min_bytes) {
+        return tier_pass(TierPass::Move, shard_index, cursor, slots, nullptr, log, cold_seconds, min_bytes);
+    }
+
+    TierCycleStats InMemoryStorage::relocate_cold(size_t shard_index, size_t& cursor, size_t slots,
+        const ValueLog& from, ValueLog& to) {
+        return tier_pass(TierPass::Relocate, shard_index, cursor, slots, &from, to, 0, 0);
+    }
+
+    TierCycleStats InMemoryStorage::tier_pass(TierPass pass, size_t shard_index, size_t& cursor, size_t slots,
+        const ValueLog* from, ValueLog& log, uint32_t cold_seconds, size_t min_bytes) {
+        constexpr size_t kMaxBatchBytes = 4 * 1024 * 1024;  // Read or appended per call
+
+        TierCycleStats stats;
+        Shard& shard = shards_[shard_index];
+        std::vector<TierMove> moves;
+
+        // Pick the values under the shared lock
+        {
+            auto lock = lock_shared(shard);
+            int64_t now = now_ms();
+            uint32_t clock = AccessStamp::clock(now);
+            size_t batch = 0;
+            cursor = shard.data.for_each_from(cursor, slots, [&](StorageEntry& entry) {
+                if (entry.value.type() != ValueType::String) {
+                    return true;
+                }
+                TierMove move;
+                if (pass == TierPass::Relocate) {
+                    // Expired values too: nothing may be left in `from`
+                    string_int::Digits digits;
+                    if (!entry.value.cold() || !from->contains(entry.value.string(digits).data())) {
+                        return true;
+                    }
+                    move.cold = entry.value.string(digits);
+                }
+                else {
+                    if (entry.expired(now)) {
+                        return true;
+                    }
+                    uint32_t stamp = std::atomic_ref<uint32_t>(entry.access).load(std::memory_order_relaxed);
+                    bool idle = AccessStamp::idle_seconds(stamp, clock) >= cold_seconds;
+                    if (entry.value.cold()) {
+                        // Read since it was moved out: bring it back
+                        if (idle) {
+                            return true;
+                        }
+                        string_int::Digits digits;
+                        move.cold = entry.value.string(digits);
+                    }
+                    else {
+                        if (!idle || entry.value.encoding() == Value::Encoding::Int ||
+                            entry.value.string_size() < min_bytes) {
+                            return true;
+                        }
+                        move.value = entry.value.string_handle();
+                    }
+                }
+                move.key = entry.key();
+                move.hash = StringHash{}(move.key);
+                batch += move.cold.size() + (move.value ? move.value->size() : 0);
+                moves.push_back(std::move(move));
+                return batch < kMaxBatchBytes;
+            });
+        }
+        if (moves.empty()) {
+            return stats;
+        }
+
+        // Copy with the shard unlocked. Only the caller changes the logs,
+        // so the cold addresses stay mapped meanwhile.
+        for (TierMove& move : moves) {
+            if (move.cold.data() && pass == TierPass::Move) {
+                move.value.emplace(move.cold);
+                continue;
+            }
+            move.target = log.append(move.cold.data() ? move.cold : move.value->view());
+            if (!move.target.data()) {
+                stats.log_full = true;
+            }
+        }
+        if (!log.flush()) {
+            stats.log_full = true;
+            for (TierMove& move : moves) {
+                move.target = {};
+            }
+        }
+
+        // Switch over the entries that did not change meanwhile. An
+        // address in a log is never reused while the log is open, so a
+        // cold value at the same address is the one that was copied.
+        size_t budget = shard_budget_.load(std::memory_order_relaxed);
+        auto lock = lock_exclusive(shard);
+        for (TierMove& move : moves) {
+            StorageEntry* entry = shard.data.find(move.key, move.hash);
+            if (!entry || entry->value.type() != ValueType::String) {
+                continue;
+            }
+            string_int::Digits digits;
+            std::string_view current = entry->value.string(digits);
+            if (move.cold.data()) {
+                if (!entry->value.cold() || current.data() != move.cold.data()) {
+                    continue;
+                }
+                if (pass == TierPass::Relocate) {
+                    if (move.target.data()) {
+                        entry->value.assign_cold(move.target);
+                        ++stats.relocated;
+                    }
+                    continue;
+                }
+                // Promoted values must fit in the shard's share of maxmemory
+                if (budget != 0 && shard.used_memory + move.value->size() > budget) {
+                    continue;
+                }
+                forget_cold(shard, entry->value);
+                entry->value.assign_string(move.value->view());
+                shard.used_memory += entry->value.heap_bytes();
+                ++stats.promoted;
+            }
+            else {
+                std::string_view held = move.value->view();
+                if (!move.target.data() || entry->value.cold() || entry->value.encoding() == Value::Encoding::Int ||
+                    (current.data() != held.data() && current != held)) {
+                    continue;
+                }
+                // A shared value is freed when `moves` goes, after the unlock
+                shard.used_memory -= entry->value.heap_bytes();
+                entry->value.assign_cold(move.target);
+                ++shard.cold_keys;
+                shard.cold_bytes += move.target.size();
+                ++stats.spilled;
+            }
+        }
+        return stats;
+    }
+
+    bool InMemoryStorage::holds_cold(size_t shard_index, const ValueLog& log) const {
+        const Shard& shard = shards_[shard_index];
+        auto lock = lock_shared(shard);
+        bool found = false;
+        shard.data.for_each([&](const StorageEntry& entry) {
+            string_int::Digits digits;
+            found = found || (entry.value.cold() && log.contains(entry.value.string(digits).data()));
+        });
+        return found;
+    }
+
+    void InMemoryStorage::set_max_memory(size_t bytes, EvictionPolicy policy, size_t samples) {
+        max_memory_.store(bytes, std::memory_order_relaxed);
+        shard_budget_.store(bytes == 0 ? 0 : std::max<size_t>(bytes / shard_count_, 1), std::memory_order_relaxed);
+        policy_.store(policy, std::memory_order_relaxed);
+        eviction_samples_.store(std::max<size_t>(samples, 1), std::memory_order_relaxed);
     }
 
-    std::string InMemoryStorage::get(const std::string& key) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = data_.find(key);
-        return (it != data_.end()) ? it->second : "";
+    size_t InMemoryStorage::used_memory() const {
+        size_t total = 0;
+        for (size_t i = 0; i < shard_count_; ++i) {
+            std::shared_lock<std::shared_mutex> lock(shards_[i].mutex);
+            total += shards_[i].used_memory;
+        }
+        return total;
     }
 
-    bool InMemoryStorage::del(const std::string& key) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return data_.erase(key) > 0;
+    std::vector<ShardStats> InMemoryStorage::shard_stats() const {
+        std::vector<ShardStats> stats(shard_count_);
+        for (size_t i = 0; i < shard_count_; ++i) {
+            const Shard& shard = shards_[i];
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                stats[i].keys = shard.data.size();
+                stats[i].volatile_keys = shard.volatile_keys;
+                stats[i].used_memory = shard.used_memory;
+                stats[i].cold_keys = shard.cold_keys;
+                stats[i].cold_bytes = shard.cold_bytes;
+                stats[i].evicted_keys = shard.evicted_keys;
+                stats[i].expired_keys = shard.expired_keys;
+            }
+            stats[i].acquisitions = shard.acquisitions.load(std::memory_order_relaxed);
+            stats[i].contended = shard.contended.load(std::memory_order_relaxed);
+            stats[i].wait_ns = shard.wait_ns.load(std::memory_order_relaxed);
+        }
+        return stats;
     }
 
-} // namespace blitzdb
\ No newline at end of file
+} // namespace blitzdb
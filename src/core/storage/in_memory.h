@@ -1,20 +1,532 @@
 #pragma once
 
-#include <unordered_map>
 #include <string>
+#include <string_view>
+#include <optional>
+#include <chrono>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <span>
+#include <stdexcept>
+#include <initializer_list>
+#include <cstdint>
+#include "data_types/string.h"
+#include "data_types/value.h"
+#include "storage/hash_table.h"
+#include "storage/eviction.h"
+#include "storage/lazy_free.h"
+#include "utils/allocator.h"
 
 namespace blitzdb {
 
+    // Transparent hashing so lookups can use string_views without
+    // materializing a temporary std::string
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const noexcept {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+
+    // One key/value pair as stored in a shard's table
+    class StorageEntry {
+    public:
+        explicit StorageEntry(std::string_view key) : key_(key) {}
+        std::string_view key() const { return key_.view(); }
+
+        bool has_expiry() const { return expire_at != 0; }
+        bool expired(int64_t now_ms) const { return expire_at != 0 && expire_at <= now_ms; }
+
+        // Bytes charged against maxmemory: the slot plus heap payloads
+        size_t memory_usage() const { return sizeof(StorageEntry) + 1 + key_.heap_bytes() + value.heap_bytes(); }
+
+        Value value;
+        int64_t expire_at = 0;  // Absolute unix time in ms; 0 = persistent
+        mutable uint32_t access = 0;  // AccessStamp; written atomically under a shared lock
+
+    private:
+        CompactString key_;
+    };
+
+    // Conditions and expiry applied atomically by InMemoryStorage::set
+    struct SetParams {
+        bool only_if_missing = false;  // NX
+        bool only_if_exists = false;   // XX
+        bool keep_ttl = false;         // KEEPTTL: leave an existing deadline alone
+        bool return_old = false;       // GET: report the previous value
+        int64_t expire_at = 0;         // Absolute unix time in ms; 0 = no expiry
+    };
+
+    struct SetResult {
+        bool written = false;
+        bool out_of_memory = false;  // Over maxmemory with nothing evictable
+        std::optional<std::string> old_value;  // Filled when return_old was set
+    };
+
+    struct HashSetResult {
+        size_t added = 0;            // Fields that did not exist before
+        bool out_of_memory = false;
+    };
+
+    enum class IncrementStatus {
+        Ok,
+        NotInteger,   // The current value does not parse as a 64-bit integer
+        NotFloat,     // ... or as a number, for a floating point increment
+        Overflow,
+        NotFinite,    // The result would be NaN or infinite
+        OutOfMemory,
+    };
+
+    struct IncrementResult {
+        IncrementStatus status = IncrementStatus::Ok;
+        int64_t value = 0;  // The new value when status is Ok
+    };
+
+    // Outcome of APPEND and SETRANGE
+    struct StringWriteResult {
+        size_t length = 0;           // Of the resulting string
+        bool out_of_memory = false;
+        bool too_large = false;      // Would exceed kMaxStringLength; nothing written
+    };
+
+    // Thrown by an operation on a key that holds another type of value
+    class WrongTypeError : public std::runtime_error {
+    public:
+        WrongTypeError() : std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value") {}
+    };
+
+    // Outcome of one active expiry cycle
+    struct ExpireCycleStats {
+        size_t sampled = 0;
+        size_t expired = 0;
+        bool out_of_time = false;  // Stopped by the time budget, not by running dry
+    };
+
+    // Outcome of one InMemoryStorage::move_cold call
+    struct TierCycleStats {
+        size_t spilled = 0;     // Values moved out to the log
+        size_t promoted = 0;    // Cold values copied back into memory
+        size_t relocated = 0;   // Cold values moved to another log
+        bool log_full = false;  // Some values did not fit in the log
+    };
+
+    // Lock and memory statistics of one storage shard
+    struct ShardStats {
+        size_t keys = 0;
+        size_t volatile_keys = 0;   // Keys with a deadline
+        size_t used_memory = 0;     // Bytes charged against maxmemory
+        size_t cold_keys = 0;       // Values held in a tiered storage log
+        size_t cold_bytes = 0;
+        uint64_t evicted_keys = 0;
+        uint64_t expired_keys = 0;  // Dropped lazily or by active expiry
+        uint64_t acquisitions = 0;  // Lock acquisitions (shared and exclusive)
+        uint64_t contended = 0;     // Acquisitions that had to wait
+        uint64_t wait_ns = 0;       // Time those acquisitions waited
+    };
+
+    // Receives every change applied to the keyspace as a RESP command. It is
+    // called with the changed shards locked, so records of one key arrive
+    // in the order the changes were applied. Records state effects with
+    // absolute deadlines (SET .. PXAT, PEXPIREAT, DEL), so applying one a
+    // second time on top of a later snapshot is harmless.
+    class ChangeObserver {
+    public:
+        virtual ~ChangeObserver() = default;
+        virtual void on_change(std::string_view record) = 0;
+    };
+
+    // Forwards every change to two observers (e.g. the log and replication)
+    class ChangeTee : public ChangeObserver {
+    public:
+        ChangeTee(ChangeObserver& first, ChangeObserver& second) : first_(first), second_(second) {}
+
+        void on_change(std::string_view record) override {
+            first_.on_change(record);
+            second_.on_change(record);
+        }
+
+    private:
+        ChangeObserver& first_;
+        ChangeObserver& second_;
+    };
+
+    // Appends `args` to `out` as a RESP array of bulk strings
+    void append_command(std::string& out, std::span<const std::string_view> args);
+
+    class ValueLog;
+
+    // Keyspace split into independently locked shards selected by key hash.
+    // Readers share a shard; writers take it exclusively. Operations that
+    // touch several shards lock them in ascending index order.
+    //
+    // With a memory limit each shard gets an equal share of it. A write to
+    // a shard over its share first evicts keys chosen by sampling a few
+    // entries and comparing their access stamps, so eviction costs
+    // O(samples) per write and lookups only store a stamp.
+    //
+    // Large values are not destroyed under the shard lock: a deleted or
+    // overwritten value above the lazy free threshold is moved out of its
+    // slot and handed to a reclaimer thread (see LazyFree).
     class InMemoryStorage {
     public:
-        void set(const std::string& key, const std::string& value);
-        std::string get(const std::string& key);
-        bool del(const std::string& key);
+        static constexpr size_t kDefaultShards = 16;
+        static constexpr size_t kDefaultEvictionSamples = 5;
+        static constexpr size_t kMaxStringLength = 512 * 1024 * 1024;  // APPEND and SETRANGE results
+        static constexpr size_t kDefaultLazyFreeThreshold = 64 * 1024;
+        // UNLINK hands over anything this big, whatever the threshold
+        static constexpr size_t kUnlinkLazyBytes = Value::kShareThreshold;
+
+        // The shard count is rounded up to a power of two
+        explicit InMemoryStorage(size_t shard_count = kDefaultShards);
+
+        // Current time in the unit used for deadlines (unix ms)
+        static int64_t now_ms();
+
+        // String commands. A SET replaces a value of any type; reading a key
+        // that holds another type throws WrongTypeError.
+        // Returns false if the write was refused by the memory limit
+        bool set(std::string_view key, std::string_view value);
+        SetResult set(std::string_view key, std::string_view value, const SetParams& params);
+
+        // The handle keeps a large value alive without copying it, so it
+        // can be written out after the shard lock is released
+        std::optional<ValueHandle> get(std::string_view key);
+
+        // Runs fn(const Value&) on a string value with its shard locked,
+        // e.g. to encode it straight into a reply; false if there is no key
+        template <typename Fn>
+        bool get(std::string_view key, Fn&& fn) {
+            return read_entry(key, [&fn](const StorageEntry* entry) {
+                if (!entry) {
+                    return false;
+                }
+                if (entry->value.type() != ValueType::String) {
+                    throw WrongTypeError();
+                }
+                fn(entry->value);
+                return true;
+            });
+        }
+        bool exists(std::string_view key);
+        bool del(std::string_view key);
+
+        // Multi-key commands. Keys are grouped by shard, every shard is
+        // locked once (in ascending order, so the operation is atomic) and
+        // lookups are prefetched a few keys ahead of the probe.
+
+        // Deletes several keys; returns how many existed
+        size_t del(std::span<const std::string_view> keys);
+        // Same, leaving every value of kUnlinkLazyBytes or more to the
+        // reclaimer thread. Recorded as DEL.
+        size_t unlink(std::span<const std::string_view> keys);
+
+        // Live keys among `keys`, a key repeated being counted each time
+        size_t exists(std::span<const std::string_view> keys);
+
+        // Runs fn(const Value*) for every key in order, with nullptr for a
+        // missing key or one that holds another type (MGET does not fail)
+        template <typename Fn>
+        void mget(std::span<const std::string_view> keys, Fn&& fn) {
+            Arena& arena = scratch_arena();
+            ArenaScope scope(arena);
+            ArenaVector<const StorageEntry*> entries(keys.size(), nullptr, ArenaAllocator<const StorageEntry*>(arena));
+            ArenaVector<std::shared_lock<std::shared_mutex>> locks{ ArenaAllocator<std::shared_lock<std::shared_mutex>>(arena) };
+            find_entries(keys, entries.data(), locks);
+            for (const StorageEntry* entry : entries) {
+                fn(entry && entry->value.type() == ValueType::String ? &entry->value : nullptr);
+            }
+        }
+
+        // Sets key/value pairs (MSET), or with `only_if_missing` only when
+        // none of the keys exists (MSETNX). Recorded as one MSET.
+        SetResult mset(std::span<const std::string_view> pairs, bool only_if_missing = false);
+
+        // Counters. A missing key counts as 0, a value that is not an
+        // integer fails. Integers are stored as numbers, so incrby() adds in
+        // place without parsing or formatting. Both keep the deadline and
+        // are recorded as the resulting SET, so replaying them is idempotent.
+        IncrementResult incrby(std::string_view key, int64_t delta);
+        // INCRBYFLOAT; on Ok `text` holds the new value as stored
+        IncrementStatus incrbyfloat(std::string_view key, long double delta, std::string& text);
+
+        // APPEND, and SETRANGE, which pads a shorter string with zero bytes
+        // up to `offset`. Both are recorded as SETRANGE of the bytes they
+        // wrote. Writing nothing to a missing key does not create it.
+        StringWriteResult append(std::string_view key, std::string_view value);
+        StringWriteResult setrange(std::string_view key, size_t offset, std::string_view value);
+
+        // Sets an absolute deadline; a deadline in the past deletes the key.
+        // Returns false when the key does not exist.
+        bool set_expiry(std::string_view key, int64_t expire_at_ms);
+        bool set_expiry(std::string_view key, std::chrono::system_clock::time_point when);
+
+        // Removes the deadline; returns false if the key had none or is missing
+        bool persist(std::string_view key);
+
+        // Remaining time to live in ms, -1 without a deadline, -2 if missing
+        int64_t ttl_ms(std::string_view key);
+
+        // Hash commands; all throw WrongTypeError on a key holding a string.
+        // hset() takes field/value pairs; a hash whose last field is deleted
+        // is deleted with it. Changes are recorded as HSET and HDEL effects.
+        HashSetResult hset(std::string_view key, std::span<const std::string_view> pairs);
+        std::optional<std::string> hget(std::string_view key, std::string_view field);
+        std::vector<std::optional<std::string>> hmget(std::string_view key, std::span<const std::string_view> fields);
+        size_t hdel(std::string_view key, std::span<const std::string_view> fields);
+        size_t hlen(std::string_view key);
+        IncrementResult hincrby(std::string_view key, std::string_view field, int64_t delta);
+
+        // Field, value, field, value, ...
+        std::vector<std::string> hgetall(std::string_view key);
+
+        // When small hashes are converted to tables. Set before serving.
+        void set_hash_limits(const HashLimits& limits) { hash_limits_ = limits; }
+        const HashLimits& hash_limits() const { return hash_limits_; }
+
+        // Samples keys with a deadline and deletes the expired ones, shard
+        // by shard, until a sample comes back mostly alive or `budget`
+        // runs out. Locks are held for one sample at a time.
+        ExpireCycleStats active_expire_cycle(std::chrono::microseconds budget);
+
+        // Bytes of keys, values and the slots they occupy; table slack from
+        // the load factor and incremental rehashing is not counted. 0 means
+        // unlimited.
+        void set_max_memory(size_t bytes, EvictionPolicy policy, size_t samples = kDefaultEvictionSamples);
+        size_t max_memory() const { return max_memory_.load(std::memory_order_relaxed); }
+        EvictionPolicy eviction_policy() const { return policy_.load(std::memory_order_relaxed); }
+        size_t used_memory() const;
+
+        // Attaches the observer that is told about every change (nullptr
+        // detaches). Deletions by expiry and eviction are reported as DEL.
+        void set_change_observer(ChangeObserver* observer) { observer_.store(observer, std::memory_order_release); }
+
+        // Visits the live entries of one shard under its shared lock
+        template <typename Fn>
+        void for_each_entry(size_t shard_index, Fn&& fn) const {
+            auto lock = lock_shared(shards_[shard_index]);
+            visit_live(shards_[shard_index], fn);
+        }
+
+        // Same without locking. Only valid on a copy of the keyspace that
+        // nothing else modifies, such as the one a forked child sees.
+        template <typename Fn>
+        void for_each_entry_unlocked(size_t shard_index, Fn&& fn) const {
+            visit_live(shards_[shard_index], fn);
+        }
+
+        // Runs fn() with every shard locked exclusively, so the keyspace
+        // cannot change while it runs (e.g. to fork a point-in-time copy)
+        template <typename Fn>
+        void with_all_shards_locked(Fn&& fn) const {
+            std::vector<std::unique_lock<std::shared_mutex>> locks;
+            locks.reserve(shard_count_);
+            for (size_t i = 0; i < shard_count_; ++i) {
+                locks.push_back(lock_exclusive(shards_[i]));
+            }
+            fn();
+        }
+
+        // FLUSHALL: drops every key and records it. Each shard's table is
+        // swapped for an empty one under its lock; with `async` the old
+        // tables are destroyed on the reclaimer thread, otherwise by the
+        // caller once the locks are released.
+        void flush(bool async);
+
+        // Drops every key without reporting it to the observer (a replica
+        // does this before loading a full resynchronization). The old
+        // tables go to the reclaimer thread.
+        void clear();
+
+        // Values with at least this many heap bytes that DEL, expiry,
+        // eviction or an overwrite drops are destroyed on the reclaimer
+        // thread; 0 frees everything inline
+        void set_lazy_free_threshold(size_t bytes) { lazy_free_threshold_.store(bytes, std::memory_order_relaxed); }
+        size_t lazy_free_threshold() const { return lazy_free_threshold_.load(std::memory_order_relaxed); }
+        LazyFreeStats lazy_free_stats() const { return lazy_free_->stats(); }
+
+        // Bulk loading: restore() inserts or replaces a key with its
+        // deadline without reporting it to the observer or checking the
+        // memory limit, and skips it (returning false) if the deadline has
+        // passed. A hash is passed in its packed form, which must be valid.
+        // reserve() sizes a shard for that many more keys first.
+        bool restore(std::string_view key, ValueType type, std::string_view value, int64_t expire_at);
+        void reserve(size_t shard_index, size_t count);
+
+        // Tiered storage (see TieredStorage). move_cold() looks at up to
+        // `slots` slots of a shard from `cursor` on and advances it: string
+        // values of at least `min_bytes` idle for `cold_seconds` are
+        // appended to `log` and replaced by their location in it, and cold
+        // values read since are copied back into memory. The log is read
+        // and written with the shard unlocked; entries are switched over
+        // afterwards if they did not change meanwhile. Cold values count
+        // against maxmemory with their key and slot only.
+        TierCycleStats move_cold(size_t shard_index, size_t& cursor, size_t slots, ValueLog& log,
+            uint32_t cold_seconds, size_t min_bytes);
+        // Compaction: moves the cold values of a window that are in `from`
+        // to `to`, like move_cold(). holds_cold() tells whether any value
+        // of the shard is still in `from`, scanning it under one lock.
+        TierCycleStats relocate_cold(size_t shard_index, size_t& cursor, size_t slots, const ValueLog& from,
+            ValueLog& to);
+        bool holds_cold(size_t shard_index, const ValueLog& log) const;
+
+        size_t shard_count() const { return shard_count_; }
+        size_t shard_index(std::string_view key) const;
+        std::vector<ShardStats> shard_stats() const;
 
     private:
-        std::unordered_map<std::string, std::string> data_;
-        std::mutex mutex_; // For thread safety
+        using Map = HashTable<StorageEntry, StringHash>;
+
+        template <typename T>
+        using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+        // A key of a multi-key operation; `index` is its position
+        struct KeyTarget {
+            size_t shard;
+            size_t hash;
+            size_t index;
+        };
+        static constexpr size_t kPrefetchAhead = 8;
+
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            Map data;
+            size_t volatile_keys = 0;
+            size_t used_memory = 0;
+            size_t cold_keys = 0;
+            size_t cold_bytes = 0;
+            uint64_t evicted_keys = 0;
+            uint64_t expired_keys = 0;
+            mutable std::atomic<uint64_t> acquisitions{ 0 };
+            mutable std::atomic<uint64_t> contended{ 0 };
+            mutable std::atomic<uint64_t> wait_ns{ 0 };
+        };
+
+        size_t shard_of_hash(size_t hash) const;
+
+        template <typename Fn>
+        static void visit_live(const Shard& shard, Fn& fn) {
+            int64_t now = now_ms();
+            shard.data.for_each([&](const StorageEntry& entry) {
+                if (!entry.expired(now)) {
+                    fn(entry);
+                }
+            });
+        }
+        static std::unique_lock<std::shared_mutex> lock_exclusive(const Shard& shard);
+        static std::shared_lock<std::shared_mutex> lock_shared(const Shard& shard);
+
+        // Looks a key up with the shard locked exclusively, deleting it if
+        // its deadline has passed
+        StorageEntry* find_live(Shard& shard, std::string_view key, size_t hash, int64_t now) const;
+        // Finds or inserts a key; a new entry starts with a fresh stamp
+        StorageEntry* insert_entry(Shard& shard, std::string_view key, size_t hash, int64_t now) const;
+        // Both hand the dropped value to the reclaimer when it has at least
+        // `lazy_bytes` heap bytes (0: never)
+        void erase_entry(Shard& shard, StorageEntry* entry, size_t lazy_bytes) const;
+        void assign_value(Shard& shard, StorageEntry& entry, std::string_view value) const;
+        // Uncounts a cold value that is about to be replaced or erased
+        static void forget_cold(Shard& shard, const Value& value);
+
+        // A value move_cold() or relocate_cold() picked under the shared
+        // lock and carries out with the shard unlocked
+        struct TierMove {
+            std::string key;
+            size_t hash = 0;
+            std::string_view cold;             // Where it is in a log now, if cold
+            std::optional<ValueHandle> value;  // Its bytes, when it moves into or out of memory
+            std::string_view target;           // Where it was appended
+        };
+        enum class TierPass { Move, Relocate };
+        TierCycleStats tier_pass(TierPass pass, size_t shard_index, size_t& cursor, size_t slots,
+            const ValueLog* from, ValueLog& log, uint32_t cold_seconds, size_t min_bytes);
+
+        // Runs fn(const StorageEntry*) on the live entry for `key`, or on
+        // nullptr, under the shard's shared lock; an expired key is dropped
+        // first under the exclusive lock
+        template <typename Fn>
+        auto read_entry(std::string_view key, Fn&& fn) {
+            size_t hash = StringHash{}(key);
+            Shard& shard = shards_[shard_of_hash(hash)];
+            {
+                auto lock = lock_shared(shard);
+                const StorageEntry* entry = shard.data.find(key, hash);
+                if (!entry) {
+                    return fn(static_cast<const StorageEntry*>(nullptr));
+                }
+                int64_t now = now_ms();
+                if (!entry->expired(now)) {
+                    touch(*entry, now);
+                    return fn(entry);
+                }
+            }
+
+            // Lazy expiry: the key is past its deadline, so drop it now. It
+            // may have been rewritten in between, hence the second lookup.
+            auto lock = lock_exclusive(shard);
+            const StorageEntry* entry = find_live(shard, key, hash, now_ms());
+            return fn(entry);
+        }
+
+        // Hashes every `step`-th key and sorts them by shard, keeping the
+        // order of keys within a shard
+        void group_keys(std::span<const std::string_view> keys, size_t step, ArenaVector<KeyTarget>& targets) const;
+        // Locks each shard of `targets` once, in ascending order
+        void lock_targets(const ArenaVector<KeyTarget>& targets, ArenaVector<std::unique_lock<std::shared_mutex>>& locks) const;
+        void lock_targets(const ArenaVector<KeyTarget>& targets, ArenaVector<std::shared_lock<std::shared_mutex>>& locks) const;
+        void prefetch(const KeyTarget& target) const { shards_[target.shard].data.prefetch(target.hash); }
+        // Locks the shards of `keys` shared, leaving the locks in `locks`,
+        // and sets entries[i] to the live entry of keys[i] or nullptr
+        void find_entries(std::span<const std::string_view> keys, const StorageEntry** entries,
+            ArenaVector<std::shared_lock<std::shared_mutex>>& locks) const;
+        // DEL and UNLINK
+        size_t erase_keys(std::span<const std::string_view> keys, size_t lazy_bytes);
+        // FLUSHALL and clear(): empties every shard under all the locks,
+        // recording FLUSHALL when `record_flush` is set
+        void drop_all(bool async, bool record_flush);
+
+        // Finds a hash or a string for writing; throws WrongTypeError for
+        // other types
+        StorageEntry* find_hash(Shard& shard, std::string_view key, size_t hash, int64_t now) const;
+        StorageEntry* find_string(Shard& shard, std::string_view key, size_t hash, int64_t now) const;
+        static void set_deadline(Shard& shard, StorageEntry& entry, int64_t expire_at);
+
+        // Reports a change to the observer, if any
+        void record(std::initializer_list<std::string_view> args) const;
+        void record(std::span<const std::string_view> args) const;
+        // Records `command key args...`
+        void record(std::string_view command, std::string_view key, std::span<const std::string_view> args) const;
+
+        // Records a string entry's whole value as SET, keeping its deadline
+        void record_string(const StorageEntry& entry) const;
+
+        // Erases an entry that expired or was evicted and reports it as DEL
+        void drop_entry(Shard& shard, StorageEntry* entry) const;
+
+        // Records an access in the entry's stamp; safe under a shared lock
+        void touch(const StorageEntry& entry, int64_t now) const;
+
+        // Evicts from a shard over its share of the memory limit. Returns
+        // false when the shard stays over it and the write must be refused.
+        bool make_room(Shard& shard, int64_t now);
+
+        size_t shard_count_;
+        unsigned shard_bits_;
+        std::unique_ptr<Shard[]> shards_;
+        std::atomic<size_t> expire_cursor_{ 0 };  // Shard where the next cycle starts
+
+        std::atomic<size_t> max_memory_{ 0 };
+        std::atomic<size_t> shard_budget_{ 0 };  // max_memory_ / shard count
+        std::atomic<EvictionPolicy> policy_{ EvictionPolicy::NoEviction };
+        std::atomic<size_t> eviction_samples_{ kDefaultEvictionSamples };
+
+        std::atomic<ChangeObserver*> observer_{ nullptr };
+        HashLimits hash_limits_;
+
+        std::atomic<size_t> lazy_free_threshold_{ kDefaultLazyFreeThreshold };
+        std::unique_ptr<LazyFree> lazy_free_;
     };
 
-} // namespace blitzdb
\ No newline at end of file
+} // namespace blitzdb
@@ -0,0 +1,67 @@
+#include "storage/lazy_free.h"
+
+namespace blitzdb {
+
+    LazyFree::LazyFree() {
+        reclaimer_ = std::thread([this]() { run(); });
+    }
+
+    LazyFree::~LazyFree() {
+        // The empty node wakes the reclaimer, which then sees the flag
+        stopping_.store(true, std::memory_order_release);
+        push(new Node(), 0, 0);
+        if (reclaimer_.joinable()) {
+            reclaimer_.join();
+        }
+        release(head_.exchange(nullptr, std::memory_order_acquire));
+    }
+
+    void LazyFree::push(Node* node, size_t bytes, size_t objects) {
+        node->bytes = bytes;
+        node->objects = objects;
+        pending_objects_.fetch_add(objects, std::memory_order_relaxed);
+        pending_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+
+        Node* head = head_.load(std::memory_order_relaxed);
+        do {
+            node->next = head;
+        } while (!head_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+        if (!head) {
+            head_.notify_one();
+        }
+    }
+
+    void LazyFree::run() {
+        while (true) {
+            head_.wait(nullptr, std::memory_order_acquire);
+            release(head_.exchange(nullptr, std::memory_order_acquire));
+            if (stopping_.load(std::memory_order_acquire)) {
+                return;
+            }
+        }
+    }
+
+    void LazyFree::release(Node* node) {
+        while (node) {
+            Node* next = node->next;
+            size_t bytes = node->bytes;
+            size_t objects = node->objects;
+            delete node;
+            pending_objects_.fetch_sub(objects, std::memory_order_relaxed);
+            pending_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+            freed_objects_.fetch_add(objects, std::memory_order_relaxed);
+            freed_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+            node = next;
+        }
+    }
+
+    LazyFreeStats LazyFree::stats() const {
+        LazyFreeStats stats;
+        stats.pending_objects = pending_objects_.load(std::memory_order_relaxed);
+        stats.pending_bytes = pending_bytes_.load(std::memory_order_relaxed);
+        stats.freed_objects = freed_objects_.load(std::memory_order_relaxed);
+        stats.freed_bytes = freed_bytes_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace blitzdb {
+
+    struct LazyFreeStats {
+        size_t pending_objects = 0;  // Handed over, not destroyed yet
+        size_t pending_bytes = 0;
+        uint64_t freed_objects = 0;
+        uint64_t freed_bytes = 0;
+    };
+
+    // Destroys objects on a background thread, so dropping a large value
+    // or a whole keyspace under a shard lock costs a pointer push instead
+    // of the frees behind it.
+    //
+    // Producers push onto a lock-free stack with one CAS; the reclaimer
+    // takes the whole stack with one exchange and destroys it. It sleeps on
+    // the stack head, and only a push onto an empty stack wakes it.
+    class LazyFree {
+    public:
+        LazyFree();
+        // Destroys whatever is still queued before returning
+        ~LazyFree();
+        LazyFree(const LazyFree&) = delete;
+        LazyFree& operator=(const LazyFree&) = delete;
+
+        // Takes `object` over and destroys it on the reclaimer thread.
+        // `bytes` and `objects` are what it counts for in the stats.
+        template <typename T>
+        void defer(T&& object, size_t bytes, size_t objects = 1) {
+            push(new Item<std::decay_t<T>>(std::forward<T>(object)), bytes, objects);
+        }
+
+        LazyFreeStats stats() const;
+
+    private:
+        struct Node {
+            virtual ~Node() = default;
+            Node* next = nullptr;
+            size_t bytes = 0;
+            size_t objects = 0;
+        };
+
+        template <typename T>
+        struct Item final : Node {
+            explicit Item(T&& object) : object(std::move(object)) {}
+            T object;
+        };
+
+        void push(Node* node, size_t bytes, size_t objects);
+        void run();
+        // Destroys a detached stack and updates the stats
+        void release(Node* node);
+
+        std::atomic<Node*> head_{ nullptr };
+        std::atomic<bool> stopping_{ false };
+        std::atomic<size_t> pending_objects_{ 0 };
+        std::atomic<size_t> pending_bytes_{ 0 };
+        std::atomic<uint64_t> freed_objects_{ 0 };
+        std::atomic<uint64_t> freed_bytes_{ 0 };
+        std::thread reclaimer_;
+    };
+
+} // namespace blitzdb
@@ -0,0 +1,369 @@
+#include "storage/persistent.h"
+#include "utils/file.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace blitzdb {
+
+    namespace {
+
+        // Records appended by this thread, for AppendOnlyLog::take_thread_sequence
+        thread_local uint64_t thread_sequence = 0;
+
+        // Rewrite records still buffered when the new log is swapped in
+        constexpr size_t kRewriteCatchUp = 1024 * 1024;
+
+        // Fields per HSET when a hash is rewritten
+        constexpr size_t kRewriteHashFields = 64;
+
+    } // namespace
+
+    std::optional<FsyncPolicy> parse_fsync_policy(std::string_view name) {
+        if (name == "always") return FsyncPolicy::Always;
+        if (name == "everysec") return FsyncPolicy::EverySec;
+        if (name == "no") return FsyncPolicy::No;
+        return std::nullopt;
+    }
+
+    const char* fsync_policy_name(FsyncPolicy policy) {
+        switch (policy) {
+        case FsyncPolicy::Always: return "always";
+        case FsyncPolicy::No: return "no";
+        default: return "everysec";
+        }
+    }
+
+    LogReader::LogReader(const std::string& path, size_t window)
+        : file_(std::fopen(path.c_str(), "rb")), buffer_(window) {}
+
+    LogReader::~LogReader() {
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    bool LogReader::fill() {
+        if (!file_) {
+            return false;
+        }
+        if (start_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+            end_ -= start_;
+            start_ = 0;
+        }
+        if (end_ == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2);  // One record spans the whole window
+        }
+        size_t read = std::fread(buffer_.data() + end_, 1, buffer_.size() - end_, file_);
+        end_ += read;
+        return read > 0;
+    }
+
+    AppendOnlyLog::AppendOnlyLog(std::string path, FsyncPolicy policy)
+        : path_(std::move(path)), policy_(policy) {
+        fd_ = open_file(path_, false);
+        if (fd_ < 0) {
+            throw std::runtime_error("cannot open append only log " + path_ + ": " + std::strerror(errno));
+        }
+        file_size_ = base_size_ = size_of(path_);
+        writer_ = std::thread([this]() { writer_loop(); });
+    }
+
+    AppendOnlyLog::~AppendOnlyLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (rewriter_.joinable()) {
+            rewriter_.join();
+        }
+        writer_.join();
+        close_file(fd_);
+    }
+
+    void AppendOnlyLog::on_change(std::string_view record) {
+        bool was_idle;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            was_idle = pending_.empty();
+            pending_ += record;
+            appended_ += record.size();
+            if (rewriting_) {
+                rewrite_buffer_ += record;
+            }
+            thread_sequence = appended_;
+        }
+        // The writer takes everything pending when it wakes, so only the
+        // first record of a group needs to wake it
+        if (was_idle) {
+            wake_.notify_one();
+        }
+    }
+
+    uint64_t AppendOnlyLog::take_thread_sequence() {
+        return std::exchange(thread_sequence, 0);
+    }
+
+    void AppendOnlyLog::when_synced(uint64_t sequence, std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (synced_.load(std::memory_order_relaxed) < sequence) {
+                waiters_.emplace_back(sequence, std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+    void AppendOnlyLog::finish_waiters(std::vector<Waiter>& ready) {
+        for (auto& waiter : ready) {
+            waiter.second();
+        }
+        ready.clear();
+    }
+
+    void AppendOnlyLog::writer_loop() {
+        using Clock = std::chrono::steady_clock;
+
+        std::string batch;
+        std::vector<Waiter> ready;
+        uint64_t written = 0;
+        auto last_sync = Clock::now();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait_for(lock, std::chrono::milliseconds(100),
+                [this]() { return stopping_ || !pending_.empty(); });
+
+            bool stopping = stopping_;
+            bool sync_due = written > synced_.load(std::memory_order_relaxed) &&
+                (policy_ == FsyncPolicy::Always || stopping || Clock::now() - last_sync >= std::chrono::seconds(1));
+            if (pending_.empty() && !sync_due) {
+                if (stopping) {
+                    break;
+                }
+                continue;
+            }
+
+            batch.swap(pending_);
+            uint64_t end = appended_;
+            uint64_t generation = generation_;
+            lock.unlock();
+
+            bool synced = false;
+            {
+                std::lock_guard<std::mutex> io(io_mutex_);
+                // A rewrite that swapped the file already holds this batch
+                bool current;
+                {
+                    std::lock_guard<std::mutex> check(mutex_);
+                    current = generation == generation_;
+                }
+                std::string_view rest = batch;
+                if (current) {
+                    while (!write_all(fd_, rest)) {
+                        log_error("Append only log write failed: ", std::strerror(errno));
+                        if (stopping_) {
+                            break;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                }
+                if (current && (policy_ == FsyncPolicy::Always || stopping ||
+                    (policy_ == FsyncPolicy::EverySec && Clock::now() - last_sync >= std::chrono::seconds(1)))) {
+                    synced = sync_file(fd_);
+                    last_sync = Clock::now();
+                }
+            }
+
+            lock.lock();
+            if (generation == generation_) {
+                written = end;
+                if (!batch.empty()) {
+                    ++writes_;
+                    file_size_ += batch.size();
+                }
+                if (synced) {
+                    ++fsyncs_;
+                }
+                // Without fsync, written is as durable as the policy promises
+                if (synced || policy_ == FsyncPolicy::No) {
+                    synced_.store(std::max(synced_.load(std::memory_order_relaxed), end), std::memory_order_release);
+                }
+            }
+            batch.clear();
+
+            uint64_t durable = synced_.load(std::memory_order_relaxed);
+            auto split = std::partition(waiters_.begin(), waiters_.end(),
+                [durable](const Waiter& waiter) { return waiter.first > durable; });
+            std::move(split, waiters_.end(), std::back_inserter(ready));
+            waiters_.erase(split, waiters_.end());
+            if (!ready.empty()) {
+                lock.unlock();
+                finish_waiters(ready);
+                lock.lock();
+            }
+        }
+    }
+
+    bool AppendOnlyLog::rewrite(const InMemoryStorage& storage) {
+        std::thread previous;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (rewriting_ || stopping_) {
+                return false;
+            }
+            rewriting_ = true;
+            rewrite_buffer_.clear();
+            previous = std::move(rewriter_);
+            rewriter_ = std::thread([this, &storage]() { run_rewrite(storage); });
+        }
+        if (previous.joinable()) {
+            previous.join();
+        }
+        return true;
+    }
+
+    void AppendOnlyLog::run_rewrite(const InMemoryStorage& storage) {
+        std::string temp = path_ + ".rewrite";
+        int fd = open_file(temp, true);
+        bool ok = fd >= 0;
+
+        std::string buffer;
+        std::string records;
+        auto drain = [&]() {
+            // Records appended so far may go before the rest of the dump:
+            // each shard is dumped later than they were applied
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                records.swap(rewrite_buffer_);
+            }
+            ok = ok && write_all(fd, records);
+            records.clear();
+        };
+
+        char deadline[24];
+        string_int::Digits digits;
+        std::vector<std::string_view> hset;
+        for (size_t i = 0; ok && i < storage.shard_count() && !stopping_; ++i) {
+            storage.for_each_entry(i, [&](const StorageEntry& entry) {
+                auto result = std::to_chars(deadline, deadline + sizeof(deadline), entry.expire_at);
+                std::string_view expire_at(deadline, static_cast<size_t>(result.ptr - deadline));
+                if (entry.value.type() == ValueType::Hash) {
+                    // Large hashes take several HSETs so no record gets huge
+                    hset.assign({ "HSET", entry.key() });
+                    entry.value.hash_for_each([&](std::string_view field, std::string_view value) {
+                        hset.push_back(field);
+                        hset.push_back(value);
+                        if (hset.size() >= 2 + 2 * kRewriteHashFields) {
+                            append_command(buffer, hset);
+                            hset.resize(2);
+                        }
+                    });
+                    if (hset.size() > 2) {
+                        append_command(buffer, hset);
+                    }
+                    if (entry.has_expiry()) {
+                        std::string_view args[] = { "PEXPIREAT", entry.key(), expire_at };
+                        append_command(buffer, args);
+                    }
+                }
+                else if (entry.has_expiry()) {
+                    std::string_view args[] = { "SET", entry.key(), entry.value.string(digits), "PXAT", expire_at };
+                    append_command(buffer, args);
+                }
+                else {
+                    std::string_view args[] = { "SET", entry.key(), entry.value.string(digits) };
+                    append_command(buffer, args);
+                }
+            });
+            ok = ok && write_all(fd, buffer);
+            buffer.clear();
+            drain();
+        }
+        ok = ok && !stopping_ && sync_file(fd);
+
+        // Catch up outside the locks until little is left to copy while
+        // appends are paused
+        while (ok) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (rewrite_buffer_.size() < kRewriteCatchUp) {
+                    break;
+                }
+            }
+            drain();
+        }
+
+        std::vector<Waiter> ready;
+        if (ok) {
+            std::lock_guard<std::mutex> io(io_mutex_);
+            std::lock_guard<std::mutex> lock(mutex_);
+            ok = write_all(fd, rewrite_buffer_) && sync_file(fd);
+            if (ok) {
+                close_file(fd);
+                fd = -1;
+                close_file(fd_);
+                std::error_code ec;
+                std::filesystem::rename(temp, path_, ec);
+                fd_ = open_file(path_, false);
+                if (ec || fd_ < 0) {
+                    log_error("Append only log rewrite could not replace ", path_);
+                }
+
+                // Everything appended so far is in the new file and synced
+                ++generation_;
+                pending_.clear();
+                synced_.store(appended_, std::memory_order_release);
+                file_size_ = base_size_ = size_of(path_);
+                ++rewrites_;
+                ready.swap(waiters_);
+            }
+            rewrite_buffer_.clear();
+            rewriting_ = false;
+        }
+        else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rewrite_buffer_.clear();
+            rewriting_ = false;
+        }
+
+        if (fd >= 0) {
+            close_file(fd);
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            if (!stopping_) {
+                log_error("Append only log rewrite failed");
+            }
+        }
+        finish_waiters(ready);
+    }
+
+    bool AppendOnlyLog::rewrite_due(uint64_t min_size) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !rewriting_ && file_size_ >= min_size && file_size_ >= 2 * base_size_;
+    }
+
+    AppendOnlyLogStats AppendOnlyLog::stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AppendOnlyLogStats stats;
+        stats.appended = appended_;
+        stats.synced = synced_.load(std::memory_order_relaxed);
+        stats.writes = writes_;
+        stats.fsyncs = fsyncs_;
+        stats.file_size = file_size_;
+        stats.base_size = base_size_;
+        stats.rewrites = rewrites_;
+        stats.rewriting = rewriting_;
+        return stats;
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "storage/in_memory.h"
+
+namespace blitzdb {
+
+    // When appended records are forced to stable storage
+    enum class FsyncPolicy {
+        Always,    // After every group write; replies wait for it
+        EverySec,  // At most once per second from the writer thread
+        No,        // Left to the operating system
+    };
+
+    std::optional<FsyncPolicy> parse_fsync_policy(std::string_view name);
+    const char* fsync_policy_name(FsyncPolicy policy);
+
+    struct AppendOnlyLogStats {
+        uint64_t appended = 0;   // Sequence of the last appended record
+        uint64_t synced = 0;     // Sequence known to be on stable storage
+        uint64_t writes = 0;     // Group writes issued
+        uint64_t fsyncs = 0;
+        uint64_t file_size = 0;  // Current log size
+        uint64_t base_size = 0;  // Size right after the last rewrite or load
+        uint64_t rewrites = 0;
+        bool rewriting = false;
+    };
+
+    // Reads a file through a bounded window so a large log can be replayed
+    // without loading it into memory. The window grows only when a single
+    // record does not fit.
+    class LogReader {
+    public:
+        explicit LogReader(const std::string& path, size_t window = 1024 * 1024);
+        LogReader(const LogReader&) = delete;
+        LogReader& operator=(const LogReader&) = delete;
+        ~LogReader();
+
+        bool is_open() const { return file_ != nullptr; }
+
+        // Unconsumed bytes currently in the window
+        std::string_view data() const { return std::string_view(buffer_.data() + start_, end_ - start_); }
+        void consume(size_t bytes) { start_ += bytes; offset_ += bytes; }
+
+        // Reads more of the file into the window; false at end of file
+        bool fill();
+
+        // File offset of data().front()
+        uint64_t offset() const { return offset_; }
+
+    private:
+        std::FILE* file_ = nullptr;
+        std::vector<char> buffer_;
+        size_t start_ = 0;
+        size_t end_ = 0;
+        uint64_t offset_ = 0;
+    };
+
+    // Append-only log of keyspace changes, attached to the storage as its
+    // ChangeObserver. Appending only copies the record into a pending
+    // buffer; a writer thread takes everything appended since its last
+    // round and issues one write for the whole group, then fsyncs according
+    // to the policy. Every record gets a sequence number (the logical byte
+    // count) so callers can wait until their writes are synced.
+    //
+    // rewrite() compacts the log in the background: it dumps the keyspace
+    // shard by shard under each shard's shared lock while records appended
+    // meanwhile are also kept in a rewrite buffer. The dump followed by the
+    // buffer then replaces the log. A record may describe a change the dump
+    // already contains; records are idempotent effects, so that is harmless.
+    class AppendOnlyLog : public ChangeObserver {
+    public:
+        // Opens (creating if needed) the log for appending; throws
+        // std::runtime_error if the file cannot be opened
+        AppendOnlyLog(std::string path, FsyncPolicy policy);
+        AppendOnlyLog(const AppendOnlyLog&) = delete;
+        AppendOnlyLog& operator=(const AppendOnlyLog&) = delete;
+
+        // Writes and syncs whatever is pending
+        ~AppendOnlyLog() override;
+
+        void on_change(std::string_view record) override;
+
+        // Sequence of the last record appended by the calling thread since
+        // the previous call, or 0
+        static uint64_t take_thread_sequence();
+
+        // Runs `callback` once everything up to `sequence` is synced. It may
+        // run immediately on the calling thread or later on the writer.
+        void when_synced(uint64_t sequence, std::function<void()> callback);
+
+        uint64_t synced() const { return synced_.load(std::memory_order_acquire); }
+        FsyncPolicy policy() const { return policy_; }
+
+        // Starts a background rewrite; false if one is already running
+        bool rewrite(const InMemoryStorage& storage);
+
+        // True when the log grew past `min_size` and doubled since its base
+        bool rewrite_due(uint64_t min_size) const;
+
+        AppendOnlyLogStats stats() const;
+
+    private:
+        using Waiter = std::pair<uint64_t, std::function<void()>>;
+
+        void writer_loop();
+        void run_rewrite(const InMemoryStorage& storage);
+        void finish_waiters(std::vector<Waiter>& ready);
+
+        std::string path_;
+        FsyncPolicy policy_;
+
+        // Guards everything below except the file handle
+        mutable std::mutex mutex_;
+        std::condition_variable wake_;
+        std::string pending_;
+        uint64_t appended_ = 0;
+        uint64_t generation_ = 0;       // Bumped when a rewrite swaps the file
+        std::vector<Waiter> waiters_;
+        std::atomic<bool> stopping_{ false };
+        bool rewriting_ = false;
+        std::string rewrite_buffer_;    // Records appended during a rewrite
+        uint64_t base_size_ = 0;
+        uint64_t file_size_ = 0;
+        uint64_t writes_ = 0;
+        uint64_t fsyncs_ = 0;
+        uint64_t rewrites_ = 0;
+        std::atomic<uint64_t> synced_{ 0 };
+
+        // Held while touching the file; taken before mutex_ when both are needed
+        std::mutex io_mutex_;
+        int fd_ = -1;
+
+        std::thread writer_;
+        std::thread rewriter_;
+    };
+
+} // namespace blitzdb
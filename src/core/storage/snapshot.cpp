@@ -0,0 +1,572 @@
+#include "storage/snapshot.h"
+#include "utils/checksum.h"
+#include "utils/file.h"
+#include "utils/logger.h"
+#include "utils/varint.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+#if !defined(_WIN32)
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace blitzdb {
+
+    namespace {
+
+        using namespace snapshot_format;
+
+        void put_u32(char* out, uint32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                out[i] = static_cast<char>(value >> (8 * i));
+            }
+        }
+
+        void put_u64(char* out, uint64_t value) {
+            for (int i = 0; i < 8; ++i) {
+                out[i] = static_cast<char>(value >> (8 * i));
+            }
+        }
+
+        uint32_t get_u32(const char* in) {
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        uint64_t get_u64(const char* in) {
+            uint64_t value = 0;
+            for (int i = 0; i < 8; ++i) {
+                value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        std::runtime_error corrupt(const std::string& path, uint64_t offset, const char* what) {
+            return std::runtime_error("corrupt snapshot " + path + " at offset " +
+                std::to_string(offset) + ": " + what);
+        }
+
+        // Accumulates entries of one shard into blocks and hands each block
+        // to the sink in one piece once it reaches the target size
+        class BlockWriter {
+        public:
+            explicit BlockWriter(const SnapshotSink& sink) : sink_(sink) {
+                block_.reserve(kBlockTarget + 64 * 1024);
+                block_.resize(kBlockHeaderSize);
+            }
+
+            void begin_shard(uint32_t shard) {
+                flush();
+                shard_ = shard;
+            }
+
+            void add(const StorageEntry& entry) {
+                std::string_view key = entry.key();
+                std::string_view value;
+                if (entry.value.type() == ValueType::Hash) {
+                    packed_.clear();
+                    entry.value.hash_pack(packed_);
+                    value = packed_;
+                }
+                else {
+                    value = entry.value.string(digits_);
+                }
+                put_varint(block_, key.size());
+                put_varint(block_, value.size());
+                put_varint(block_, static_cast<uint64_t>(entry.expire_at));
+                block_.push_back(static_cast<char>(entry.value.type()));
+                block_.append(key);
+                block_.append(value);
+                ++count_;
+                if (block_.size() >= kBlockTarget) {
+                    flush();
+                }
+            }
+
+            void flush() {
+                if (count_ == 0) {
+                    return;
+                }
+                seal(shard_);
+                ++stats_.blocks;
+                stats_.keys += count_;
+                count_ = 0;
+            }
+
+            // Writes the trailer block and returns the totals
+            SnapshotStats finish() {
+                flush();
+                char totals[16];
+                put_u64(totals, stats_.keys);
+                put_u64(totals + 8, stats_.blocks);
+                block_.append(totals, sizeof(totals));
+                seal(kEndShard);
+                return stats_;
+            }
+
+            void write(std::string_view data) {
+                sink_(data);
+                stats_.bytes += data.size();
+            }
+
+        private:
+            void seal(uint32_t shard) {
+                char* header = block_.data();
+                put_u32(header, static_cast<uint32_t>(block_.size() - kBlockHeaderSize));
+                put_u32(header + 4, count_);
+                put_u32(header + 8, shard);
+                uint32_t crc = crc32c(header, 12);
+                crc = crc32c(block_.data() + kBlockHeaderSize, block_.size() - kBlockHeaderSize, crc);
+                put_u32(header + 12, crc);
+                write(block_);
+                block_.resize(kBlockHeaderSize);
+            }
+
+            const SnapshotSink& sink_;
+            std::string block_;
+            std::string packed_;  // A hash being written
+            string_int::Digits digits_;  // An integer being written
+            uint32_t count_ = 0;
+            uint32_t shard_ = 0;
+            SnapshotStats stats_;
+        };
+
+        struct BlockRef {
+            uint64_t offset;  // Of the block header
+            uint32_t size;    // Payload bytes
+            uint32_t count;
+            uint32_t shard;
+        };
+
+        struct FileHeader {
+            uint32_t version;
+            uint32_t shards;  // Of the writer
+        };
+
+        // Validates a file header
+        FileHeader check_header(const char* data, size_t size, const std::string& name) {
+            if (size < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+                throw corrupt(name, 0, "not a snapshot file");
+            }
+            if (get_u32(data + 24) != crc32c(data, 24)) {
+                throw corrupt(name, 0, "header checksum mismatch");
+            }
+            uint32_t version = get_u32(data + 8);
+            if (version < kOldestVersion || version > kVersion) {
+                throw corrupt(name, 8, "unsupported version");
+            }
+            return FileHeader{ version, get_u32(data + 12) };
+        }
+
+        BlockRef read_block_header(const char* header, uint64_t offset) {
+            return BlockRef{ offset, get_u32(header), get_u32(header + 4), get_u32(header + 8) };
+        }
+
+        bool block_checksum_ok(const char* header, uint32_t size) {
+            return get_u32(header + 12) == crc32c(header + kBlockHeaderSize, size, crc32c(header, 12));
+        }
+
+        // Checks the trailer against the blocks that preceded it
+        void check_trailer(const char* header, const BlockRef& block, uint64_t keys, uint64_t blocks,
+            const std::string& name) {
+            if (block.size != 16 || !block_checksum_ok(header, 16)) {
+                throw corrupt(name, block.offset, "trailer checksum mismatch");
+            }
+            const char* payload = header + kBlockHeaderSize;
+            if (get_u64(payload) != keys || get_u64(payload + 8) != blocks) {
+                throw corrupt(name, block.offset, "trailer does not match the blocks");
+            }
+        }
+
+        // Verifies one block (starting at `header`) and inserts its entries
+        void restore_block(InMemoryStorage& storage, uint32_t version, const char* header, const BlockRef& block,
+            const std::string& name, uint64_t& loaded, uint64_t& expired) {
+            if (!block_checksum_ok(header, block.size)) {
+                throw corrupt(name, block.offset, "block checksum mismatch");
+            }
+            const char* p = header + kBlockHeaderSize;
+            const char* end = p + block.size;
+            for (uint32_t n = 0; n < block.count; ++n) {
+                uint64_t key_size;
+                uint64_t value_size;
+                uint64_t expire_at;
+                if (!get_varint(p, end, key_size) || !get_varint(p, end, value_size) ||
+                    !get_varint(p, end, expire_at)) {
+                    throw corrupt(name, block.offset, "malformed entry");
+                }
+                // Version 1 only had strings
+                ValueType type = ValueType::String;
+                if (version >= 2) {
+                    if (p == end || static_cast<uint8_t>(*p) > static_cast<uint8_t>(ValueType::Hash)) {
+                        throw corrupt(name, block.offset, "malformed entry");
+                    }
+                    type = static_cast<ValueType>(*p++);
+                }
+                if (key_size > static_cast<uint64_t>(end - p) || value_size > static_cast<uint64_t>(end - p) - key_size) {
+                    throw corrupt(name, block.offset, "malformed entry");
+                }
+                std::string_view key(p, static_cast<size_t>(key_size));
+                std::string_view value(p + key_size, static_cast<size_t>(value_size));
+                p += key_size + value_size;
+                if (type == ValueType::Hash && !packed_hash::for_each(value, [](std::string_view, std::string_view) {})) {
+                    throw corrupt(name, block.offset, "malformed hash");
+                }
+                if (storage.restore(key, type, value, static_cast<int64_t>(expire_at))) {
+                    ++loaded;
+                }
+                else {
+                    ++expired;
+                }
+            }
+            if (p != end) {
+                throw corrupt(name, block.offset, "block has trailing bytes");
+            }
+        }
+
+        // Runs fn(i) for i in [0, count) on up to `threads` threads and
+        // rethrows the first exception any of them raised
+        template <typename Fn>
+        void parallel_for(size_t count, size_t threads, Fn fn) {
+            std::atomic<size_t> next{ 0 };
+            std::atomic<bool> failed{ false };
+            std::exception_ptr error;
+            std::mutex error_mutex;
+            auto work = [&]() {
+                while (!failed.load(std::memory_order_relaxed)) {
+                    size_t i = next.fetch_add(1, std::memory_order_relaxed);
+                    if (i >= count) {
+                        break;
+                    }
+                    try {
+                        fn(i);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        failed.store(true, std::memory_order_relaxed);
+                    }
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for (size_t t = 1; t < std::min(threads, count); ++t) {
+                pool.emplace_back(work);
+            }
+            work();
+            for (std::thread& thread : pool) {
+                thread.join();
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        int64_t unix_seconds() {
+            return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+    } // namespace
+
+    SnapshotStats write_snapshot(const InMemoryStorage& storage, const SnapshotSink& sink, bool lock_shards) {
+        BlockWriter writer(sink);
+
+        char header[kHeaderSize];
+        std::memcpy(header, kMagic, sizeof(kMagic));
+        put_u32(header + 8, kVersion);
+        put_u32(header + 12, static_cast<uint32_t>(storage.shard_count()));
+        put_u64(header + 16, static_cast<uint64_t>(InMemoryStorage::now_ms()));
+        put_u32(header + 24, crc32c(header, 24));
+        writer.write(std::string_view(header, sizeof(header)));
+
+        auto add = [&writer](const StorageEntry& entry) { writer.add(entry); };
+        for (size_t i = 0; i < storage.shard_count(); ++i) {
+            writer.begin_shard(static_cast<uint32_t>(i));
+            if (lock_shards) {
+                storage.for_each_entry(i, add);
+            }
+            else {
+                storage.for_each_entry_unlocked(i, add);
+            }
+        }
+        return writer.finish();
+    }
+
+    SnapshotStats write_snapshot(const InMemoryStorage& storage, const std::string& path, bool lock_shards) {
+        std::string temp = path + ".tmp";
+        int fd = open_file(temp, true);
+        if (fd < 0) {
+            throw std::runtime_error("cannot create snapshot " + temp + ": " + std::strerror(errno));
+        }
+
+        SnapshotStats stats;
+        try {
+            SnapshotSink sink = [fd, &temp](std::string_view data) {
+                if (!write_all(fd, data)) {
+                    throw std::runtime_error("cannot write snapshot " + temp + ": " + std::strerror(errno));
+                }
+            };
+            stats = write_snapshot(storage, sink, lock_shards);
+            if (!sync_file(fd)) {
+                throw std::runtime_error("cannot sync snapshot " + temp + ": " + std::strerror(errno));
+            }
+        }
+        catch (...) {
+            close_file(fd);
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            throw;
+        }
+        close_file(fd);
+
+        std::error_code ec;
+        std::filesystem::rename(temp, path, ec);
+        if (ec) {
+            std::filesystem::remove(temp, ec);
+            throw std::runtime_error("cannot replace snapshot " + path + ": " + ec.message());
+        }
+        return stats;
+    }
+
+    SnapshotStats load_snapshot(InMemoryStorage& storage, const std::string& path, size_t threads) {
+        MappedFile file;
+        std::string error;
+        if (!file.open(path, error)) {
+            throw std::runtime_error(error);
+        }
+        const char* data = file.data();
+        size_t size = file.size();
+
+        FileHeader file_header = check_header(data, size, path);
+        size_t writer_shards = file_header.shards;
+
+        // Index the blocks; only headers are touched here
+        std::vector<BlockRef> blocks;
+        uint64_t total_keys = 0;
+        bool complete = false;
+        size_t offset = kHeaderSize;
+        while (offset + kBlockHeaderSize <= size) {
+            BlockRef block = read_block_header(data + offset, offset);
+            if (block.size > size - offset - kBlockHeaderSize) {
+                break;
+            }
+            if (block.shard == kEndShard) {
+                check_trailer(data + offset, block, total_keys, blocks.size(), path);
+                complete = true;
+                break;
+            }
+            if (block.shard >= writer_shards) {
+                throw corrupt(path, offset, "block shard out of range");
+            }
+            total_keys += block.count;
+            blocks.push_back(block);
+            offset += kBlockHeaderSize + block.size;
+        }
+        if (!complete) {
+            throw corrupt(path, offset, "file is truncated");
+        }
+
+        // The writer emits shards in order, so each shard is a run of
+        // consecutive blocks; a run is the unit of work
+        std::vector<std::pair<size_t, size_t>> runs;
+        std::vector<uint64_t> shard_keys(storage.shard_count(), 0);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            if (runs.empty() || blocks[runs.back().first].shard != blocks[i].shard) {
+                runs.emplace_back(i, i);
+            }
+            runs.back().second = i + 1;
+            if (writer_shards == storage.shard_count()) {
+                shard_keys[blocks[i].shard] += blocks[i].count;
+            }
+        }
+        if (writer_shards != storage.shard_count()) {
+            std::fill(shard_keys.begin(), shard_keys.end(), total_keys / storage.shard_count() + 1);
+        }
+
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        // Size every table once instead of growing it step by step
+        parallel_for(storage.shard_count(), threads, [&](size_t shard) {
+            storage.reserve(shard, static_cast<size_t>(shard_keys[shard]));
+        });
+
+        std::atomic<uint64_t> loaded{ 0 };
+        std::atomic<uint64_t> expired{ 0 };
+        parallel_for(runs.size(), threads, [&](size_t run) {
+            uint64_t run_loaded = 0;
+            uint64_t run_expired = 0;
+            for (size_t b = runs[run].first; b < runs[run].second; ++b) {
+                restore_block(storage, file_header.version, data + blocks[b].offset, blocks[b], path, run_loaded, run_expired);
+            }
+            loaded.fetch_add(run_loaded, std::memory_order_relaxed);
+            expired.fetch_add(run_expired, std::memory_order_relaxed);
+        });
+
+        SnapshotStats stats;
+        stats.keys = loaded.load();
+        stats.expired = expired.load();
+        stats.blocks = blocks.size();
+        stats.bytes = size;
+        return stats;
+    }
+
+    SnapshotStreamLoader::SnapshotStreamLoader(InMemoryStorage& storage, std::string name)
+        : storage_(storage), name_(std::move(name)) {}
+
+    size_t SnapshotStreamLoader::feed(std::string_view data) {
+        size_t consumed = 0;
+        if (!header_read_) {
+            if (data.size() < kHeaderSize) {
+                return 0;
+            }
+            version_ = check_header(data.data(), data.size(), name_).version;
+            header_read_ = true;
+            consumed = kHeaderSize;
+        }
+        while (!done_ && data.size() - consumed >= kBlockHeaderSize) {
+            const char* header = data.data() + consumed;
+            BlockRef block = read_block_header(header, offset_ + consumed);
+            if (block.size > data.size() - consumed - kBlockHeaderSize) {
+                break;
+            }
+            if (block.shard == kEndShard) {
+                check_trailer(header, block, block_keys_, stats_.blocks, name_);
+                done_ = true;
+            }
+            else {
+                restore_block(storage_, version_, header, block, name_, stats_.keys, stats_.expired);
+                block_keys_ += block.count;
+                ++stats_.blocks;
+            }
+            consumed += kBlockHeaderSize + block.size;
+        }
+        offset_ += consumed;
+        stats_.bytes = offset_;
+        return consumed;
+    }
+
+    SnapshotSaver::SnapshotSaver(const InMemoryStorage& storage, std::string path)
+        : storage_(storage), path_(std::move(path)), last_save_time_(unix_seconds()) {}
+
+    SnapshotSaver::~SnapshotSaver() {
+        stopping_ = true;
+#if !defined(_WIN32)
+        if (int64_t child = child_.load()) {
+            ::kill(static_cast<pid_t>(child), SIGKILL);
+        }
+#endif
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+    bool SnapshotSaver::save(std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) {
+            error = "Background save already in progress";
+            return false;
+        }
+        running_ = true;
+        bool ok = true;
+        try {
+            write_snapshot(storage_, path_, true);
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+            ok = false;
+        }
+        finish(ok);
+        return ok;
+    }
+
+    bool SnapshotSaver::save_in_background() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ || stopping_) {
+            return false;
+        }
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        running_ = true;
+
+#if !defined(_WIN32)
+        pid_t pid = -1;
+        storage_.with_all_shards_locked([&]() {
+            pid = ::fork();
+            if (pid == 0) {
+                // The child owns a frozen copy of the keyspace; other
+                // threads (and the shard locks held here) stay behind
+                int status = 0;
+                try {
+                    write_snapshot(storage_, path_, false);
+                }
+                catch (const std::exception& e) {
+                    log_error("Background save failed: ", e.what());
+                    status = 1;
+                }
+                ::_exit(status);
+            }
+        });
+        if (pid > 0) {
+            child_ = pid;
+            worker_ = std::thread([this]() { run_background(); });
+            return true;
+        }
+        log_warning("Cannot fork for background save (", std::strerror(errno), "); saving from a thread");
+#endif
+        worker_ = std::thread([this]() {
+            bool ok = true;
+            try {
+                write_snapshot(storage_, path_, true);
+            }
+            catch (const std::exception& e) {
+                log_error("Background save failed: ", e.what());
+                ok = false;
+            }
+            finish(ok);
+        });
+        return true;
+    }
+
+    void SnapshotSaver::run_background() {
+#if !defined(_WIN32)
+        pid_t child = static_cast<pid_t>(child_.load());
+        int status = 0;
+        while (::waitpid(child, &status, 0) < 0 && errno == EINTR) {
+        }
+        child_ = 0;
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (!ok) {
+            // A killed child leaves its temporary file behind
+            std::error_code ec;
+            std::filesystem::remove(path_ + ".tmp", ec);
+        }
+        finish(ok);
+#endif
+    }
+
+    void SnapshotSaver::finish(bool ok) {
+        last_save_ok_.store(ok, std::memory_order_relaxed);
+        if (ok) {
+            last_save_time_.store(unix_seconds(), std::memory_order_relaxed);
+        }
+        running_.store(false, std::memory_order_release);
+    }
+
+} // namespace blitzdb
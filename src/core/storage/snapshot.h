@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "storage/in_memory.h"
+
+namespace blitzdb {
+
+    struct SnapshotStats {
+        uint64_t keys = 0;
+        uint64_t blocks = 0;
+        uint64_t bytes = 0;    // File size
+        uint64_t expired = 0;  // Skipped while loading: the deadline had passed
+    };
+
+    // Binary point-in-time copy of the keyspace. Integers are little endian.
+    //
+    //   header   "BLTZSNAP", u32 version, u32 shard count of the writer,
+    //            i64 creation time (unix ms), u32 crc32c of those fields
+    //   block    u32 payload size, u32 entry count, u32 shard, u32 crc32c of
+    //            the three fields and the payload, then the payload: entries
+    //            of one shard, each a varint key length, varint value length,
+    //            varint deadline (unix ms, 0 = none), u8 ValueType, key bytes,
+    //            value bytes (a hash in its packed form). Version 1 entries
+    //            have no type byte and are all strings.
+    //   trailer  a block for shard kEndShard whose payload is u64 keys and
+    //            u64 blocks written
+    //
+    // Blocks are a few hundred KB, so damage is detected per block and the
+    // file can be loaded by many threads at once.
+    namespace snapshot_format {
+        constexpr char kMagic[8] = { 'B', 'L', 'T', 'Z', 'S', 'N', 'A', 'P' };
+        constexpr uint32_t kVersion = 2;
+        constexpr uint32_t kOldestVersion = 1;  // Still loaded
+        constexpr size_t kHeaderSize = 28;
+        constexpr size_t kBlockHeaderSize = 16;
+        constexpr size_t kBlockTarget = 256 * 1024;
+        constexpr uint32_t kEndShard = 0xFFFFFFFF;
+    }
+
+    // Receives an encoded snapshot piece by piece; throws to abort
+    using SnapshotSink = std::function<void(std::string_view)>;
+
+    // Encodes every live key into `sink`, one block per call. With
+    // `lock_shards` each shard is read under its shared lock; without, the
+    // caller guarantees the keyspace cannot change.
+    SnapshotStats write_snapshot(const InMemoryStorage& storage, const SnapshotSink& sink, bool lock_shards);
+
+    // Same into `path`, through a temporary file that is synced and renamed
+    // into place. Throws std::runtime_error on I/O errors.
+    SnapshotStats write_snapshot(const InMemoryStorage& storage, const std::string& path, bool lock_shards);
+
+    // Maps `path` and inserts its keys on `threads` threads (0 = one per
+    // core); every thread rebuilds whole shards of the writer, so with the
+    // same shard count they never wait for each other. Throws
+    // std::runtime_error if the file is damaged or incomplete.
+    SnapshotStats load_snapshot(InMemoryStorage& storage, const std::string& path, size_t threads = 0);
+
+    // Loads a snapshot that arrives in pieces, e.g. over a socket. Blocks
+    // are restored as soon as they are complete.
+    class SnapshotStreamLoader {
+    public:
+        SnapshotStreamLoader(InMemoryStorage& storage, std::string name);
+
+        // Consumes the complete header and blocks at the front of `data`
+        // and returns how many bytes that was; the rest must be passed
+        // again with more data appended. Throws std::runtime_error on
+        // damage.
+        size_t feed(std::string_view data);
+
+        // The trailer has been read; nothing after it belongs to the snapshot
+        bool done() const { return done_; }
+        const SnapshotStats& stats() const { return stats_; }
+
+    private:
+        InMemoryStorage& storage_;
+        std::string name_;
+        bool header_read_ = false;
+        uint32_t version_ = 0;
+        bool done_ = false;
+        uint64_t offset_ = 0;
+        uint64_t block_keys_ = 0;  // Entries in the blocks read so far
+        SnapshotStats stats_;
+    };
+
+    // Produces snapshots of one storage into one file, in the foreground or
+    // in the background. A background save forks where the platform can:
+    // the shards are locked only for the duration of fork(), and the child
+    // writes the copy-on-write image of the keyspace as it was at that
+    // instant. Elsewhere a thread saves shard by shard under shared locks,
+    // which is consistent per shard.
+    class SnapshotSaver {
+    public:
+        SnapshotSaver(const InMemoryStorage& storage, std::string path);
+        SnapshotSaver(const SnapshotSaver&) = delete;
+        SnapshotSaver& operator=(const SnapshotSaver&) = delete;
+
+        // Abandons a background save still in progress
+        ~SnapshotSaver();
+
+        // Saves on the calling thread; false with `error` set on failure or
+        // if a background save is running
+        bool save(std::string& error);
+
+        // Starts a background save; false if one is already running
+        bool save_in_background();
+
+        bool in_progress() const { return running_.load(std::memory_order_acquire); }
+
+        // Unix time (s) of the last successful save (or of construction),
+        // and whether the most recent attempt succeeded
+        int64_t last_save_time() const { return last_save_time_.load(std::memory_order_relaxed); }
+        bool last_save_ok() const { return last_save_ok_.load(std::memory_order_relaxed); }
+
+        const std::string& path() const { return path_; }
+
+    private:
+        void run_background();
+        void finish(bool ok);
+
+        const InMemoryStorage& storage_;
+        std::string path_;
+
+        std::mutex mutex_;  // Serializes starting saves
+        std::thread worker_;
+        std::atomic<bool> running_{ false };
+        std::atomic<bool> stopping_{ false };
+        std::atomic<int64_t> child_{ 0 };  // Pid of the forked writer, 0 if none
+        std::atomic<int64_t> last_save_time_;
+        std::atomic<bool> last_save_ok_{ true };
+    };
+
+} // namespace blitzdb
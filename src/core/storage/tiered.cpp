@@ -0,0 +1,222 @@
+#include "storage/tiered.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace blitzdb {
+
+    bool ValueLog::open(const std::string& path, size_t capacity, std::string& error) {
+        close();
+#if defined(_WIN32)
+        (void)path;
+        (void)capacity;
+        error = "tiered storage is not supported on this platform";
+        return false;
+#else
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        // The descriptor and the mapping keep the file alive
+        ::unlink(path.c_str());
+        void* address = ::mmap(nullptr, capacity, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+        if (address == MAP_FAILED) {
+            error = "cannot map " + path + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        // Cold reads are scattered; read-ahead would only push out pages
+        // that are still wanted
+        ::madvise(address, capacity, MADV_RANDOM);
+        fd_ = fd;
+        data_ = static_cast<const char*>(address);
+        capacity_ = capacity;
+        size_.store(0, std::memory_order_relaxed);
+        return true;
+#endif
+    }
+
+    void ValueLog::close() {
+#if !defined(_WIN32)
+        if (data_) {
+            ::munmap(const_cast<char*>(data_), capacity_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+#endif
+        fd_ = -1;
+        data_ = nullptr;
+        capacity_ = 0;
+        size_.store(0, std::memory_order_relaxed);
+        pending_.clear();
+    }
+
+    std::string_view ValueLog::append(std::string_view value) {
+        size_t offset = size() + pending_.size();
+        if (!data_ || value.size() > capacity_ - offset) {
+            return {};
+        }
+        pending_.append(value);
+        return std::string_view(data_ + offset, value.size());
+    }
+
+    bool ValueLog::flush() {
+#if defined(_WIN32)
+        pending_.clear();
+        return false;
+#else
+        size_t offset = size();
+        std::string_view rest = pending_;
+        while (!rest.empty()) {
+            ssize_t written = ::pwrite(fd_, rest.data(), rest.size(), static_cast<off_t>(offset));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // What was written is overwritten by the next flush
+                pending_.clear();
+                return false;
+            }
+            rest.remove_prefix(static_cast<size_t>(written));
+            offset += static_cast<size_t>(written);
+        }
+        pending_.clear();
+        size_.store(offset, std::memory_order_relaxed);
+        return true;
+#endif
+    }
+
+    TieredStorage::TieredStorage(InMemoryStorage& storage, Options options)
+        : storage_(storage), options_(std::move(options)), cursors_(storage.shard_count(), 0) {}
+
+    TieredStorage::~TieredStorage() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        if (mover_.joinable()) {
+            mover_.join();
+        }
+    }
+
+    bool TieredStorage::start(std::string& error) {
+        log_ = std::make_unique<ValueLog>();
+        if (!log_->open(options_.path, options_.capacity, error)) {
+            return false;
+        }
+        mover_ = std::thread([this]() { run(); });
+        return true;
+    }
+
+    void TieredStorage::run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!wake_.wait_for(lock, kRoundInterval, [this]() { return stopping_; })) {
+            lock.unlock();
+            round();
+            lock.lock();
+        }
+    }
+
+    void TieredStorage::round() {
+        size_t shards = storage_.shard_count();
+        size_t windows = std::max<size_t>(1, kSlotsPerRound / kWindowSlots / shards);
+        bool full = false;
+        for (size_t i = 0; i < shards; ++i) {
+            for (size_t n = 0; n < windows; ++n) {
+                TierCycleStats stats = storage_.move_cold(i, cursors_[i], kWindowSlots, *log_,
+                    options_.cold_seconds, options_.min_value_bytes);
+                spilled_.fetch_add(stats.spilled, std::memory_order_relaxed);
+                promoted_.fetch_add(stats.promoted, std::memory_order_relaxed);
+                full = full || stats.log_full;
+                if (cursors_[i] == 0) {
+                    break;  // Past the end; the next round starts over
+                }
+            }
+        }
+        log_full_.store(full, std::memory_order_relaxed);
+
+        // Compact once most of the log is dead, or sooner when it is full
+        size_t live = 0;
+        for (const ShardStats& shard : storage_.shard_stats()) {
+            live += shard.cold_bytes;
+        }
+        size_t size = log_bytes();
+        size_t dead = size > live ? size - live : 0;
+        if (dead >= kCompactMinBytes && (dead * 2 >= size || full)) {
+            compact();
+        }
+        log_bytes_.store(log_bytes(), std::memory_order_relaxed);
+    }
+
+    void TieredStorage::compact() {
+        auto fresh = std::make_unique<ValueLog>();
+        std::string error;
+        if (!fresh->open(options_.path, options_.capacity, error)) {
+            log_warning("Cannot compact the value log: ", error);
+            return;
+        }
+        std::vector<const ValueLog*> old{ log_.get() };
+        for (const auto& retired : retired_) {
+            old.push_back(retired.get());
+        }
+
+        // Window by window, then again for whatever growth of the table
+        // moved past the cursor, until a check under the lock finds nothing
+        bool complete = true;
+        for (size_t i = 0; i < storage_.shard_count() && complete; ++i) {
+            for (const ValueLog* from : old) {
+                do {
+                    size_t cursor = 0;
+                    do {
+                        complete = !storage_.relocate_cold(i, cursor, kWindowSlots, *from, *fresh).log_full;
+                    } while (cursor != 0 && complete);
+                } while (complete && storage_.holds_cold(i, *from));
+                if (!complete) {
+                    break;
+                }
+            }
+        }
+
+        if (complete) {
+            retired_.clear();
+        }
+        else {
+            log_warning("Value log compaction stopped part way; keeping the old log");
+            retired_.push_back(std::move(log_));
+        }
+        log_ = std::move(fresh);
+        compactions_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t TieredStorage::log_bytes() const {
+        size_t bytes = log_ ? log_->size() : 0;
+        for (const auto& retired : retired_) {
+            bytes += retired->size();
+        }
+        return bytes;
+    }
+
+    TieredStats TieredStorage::stats() const {
+        TieredStats stats;
+        for (const ShardStats& shard : storage_.shard_stats()) {
+            stats.cold_keys += shard.cold_keys;
+            stats.cold_bytes += shard.cold_bytes;
+        }
+        stats.log_bytes = log_bytes_.load(std::memory_order_relaxed);
+        stats.spilled = spilled_.load(std::memory_order_relaxed);
+        stats.promoted = promoted_.load(std::memory_order_relaxed);
+        stats.compactions = compactions_.load(std::memory_order_relaxed);
+        stats.log_full = log_full_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+} // namespace blitzdb
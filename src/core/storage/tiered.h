@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "storage/in_memory.h"
+
+namespace blitzdb {
+
+    // Append-structured file of string values, read back through a memory
+    // mapping. The whole capacity is mapped up front, so the address of a
+    // value stays valid until the log is closed; the file grows as values
+    // are appended and is never written in place.
+    //
+    // The log is a cache tier, not persistence: the file is unlinked as
+    // soon as it is created, so it is gone once the log is closed.
+    // Appending is for one thread at a time; reading is for anyone.
+    class ValueLog {
+    public:
+        ValueLog() = default;
+        ValueLog(const ValueLog&) = delete;
+        ValueLog& operator=(const ValueLog&) = delete;
+        ~ValueLog() { close(); }
+
+        // Creates the file at `path` (replacing any) and maps `capacity`
+        // bytes of it; returns false with `error` describing why not
+        bool open(const std::string& path, size_t capacity, std::string& error);
+        void close();
+
+        // Queues `value` for writing and returns where it will be readable
+        // once flush() succeeds; an empty view when the log is full
+        std::string_view append(std::string_view value);
+        // Writes the queued values; false if that failed, in which case
+        // none of them is readable
+        bool flush();
+
+        bool contains(const char* address) const {
+            return address >= data_ && address < data_ + capacity_;
+        }
+        // Bytes written, live or not
+        size_t size() const { return size_.load(std::memory_order_relaxed); }
+        size_t capacity() const { return capacity_; }
+
+    private:
+        int fd_ = -1;
+        const char* data_ = nullptr;
+        size_t capacity_ = 0;
+        std::atomic<size_t> size_{ 0 };
+        std::string pending_;  // Appended, not written yet
+    };
+
+    struct TieredStats {
+        size_t cold_keys = 0;     // Values held in the log
+        size_t cold_bytes = 0;    // ... and their size
+        size_t log_bytes = 0;     // Size of the log, dead values included
+        uint64_t spilled = 0;     // Values moved out to the log
+        uint64_t promoted = 0;    // ... and read back into memory
+        uint64_t compactions = 0;
+        bool log_full = false;    // The last pass could not move everything out
+    };
+
+    // Tiered storage: every key and its metadata stay in memory, but the
+    // values of keys that have not been accessed for a while are moved to
+    // a ValueLog on local disk, so a dataset with skewed access can be
+    // several times larger than RAM.
+    //
+    // A mover thread walks the shards a window of slots at a time (see
+    // InMemoryStorage::move_cold). Cold values are read in place through
+    // the mapping, faulting pages in; one that is read again is copied back
+    // into memory on the mover's next visit. Once dead values make up most
+    // of the log, the mover compacts it: live values are copied into a
+    // fresh log shard by shard and the old one is dropped.
+    class TieredStorage {
+    public:
+        struct Options {
+            std::string path = "values.log";
+            size_t capacity = size_t{ 64 } << 30;  // Address space reserved for the log
+            uint32_t cold_seconds = 300;           // Idle time before a value is moved out
+            size_t min_value_bytes = 64;           // Smaller values stay in memory
+        };
+
+        TieredStorage(InMemoryStorage& storage, Options options);
+        TieredStorage(const TieredStorage&) = delete;
+        TieredStorage& operator=(const TieredStorage&) = delete;
+        // Stops the mover and closes the log; cold values left in the
+        // storage must not be read afterwards, only destroyed
+        ~TieredStorage();
+
+        // Opens the log and starts the mover
+        bool start(std::string& error);
+
+        TieredStats stats() const;
+
+    private:
+        static constexpr std::chrono::milliseconds kRoundInterval{ 100 };
+        static constexpr size_t kWindowSlots = 1024;      // Slots per shard lock
+        static constexpr size_t kSlotsPerRound = 64 * 1024;
+        static constexpr size_t kCompactMinBytes = 16 * 1024 * 1024;
+
+        void run();
+        void round();
+        // Moves every cold value into a fresh log. If that fails part way,
+        // the old logs are kept, as some values are still in them.
+        void compact();
+        size_t log_bytes() const;
+
+        InMemoryStorage& storage_;
+        Options options_;
+        std::unique_ptr<ValueLog> log_;  // Replaced only by the mover
+        std::vector<std::unique_ptr<ValueLog>> retired_;  // Left over from a failed compaction
+        std::vector<size_t> cursors_;    // Per shard
+
+        std::atomic<size_t> log_bytes_{ 0 };
+        std::atomic<uint64_t> spilled_{ 0 };
+        std::atomic<uint64_t> promoted_{ 0 };
+        std::atomic<uint64_t> compactions_{ 0 };
+        std::atomic<bool> log_full_{ false };
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stopping_ = false;
+        std::thread mover_;
+    };
+
+} // namespace blitzdb
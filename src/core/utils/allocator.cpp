@@ -0,0 +1,320 @@
+#include "utils/allocator.h"
+#include <algorithm>
+#include <bit>
+#include <new>
+
+namespace blitzdb {
+
+    namespace {
+
+        constexpr size_t kSlabSize = 64 * 1024;
+
+        // 16..128 in steps of 16, then four classes per power of two
+        constexpr std::array<size_t, SlabAllocator::kClassCount> make_class_sizes() {
+            std::array<size_t, SlabAllocator::kClassCount> sizes{};
+            size_t i = 0;
+            for (size_t size = 16; size <= 128; size += 16) {
+                sizes[i++] = size;
+            }
+            for (size_t base = 128; i < sizes.size(); base *= 2) {
+                for (size_t step = 1; step <= 4; ++step) {
+                    sizes[i++] = base + step * (base / 4);
+                }
+            }
+            return sizes;
+        }
+
+        constexpr auto kClassSizes = make_class_sizes();
+        static_assert(kClassSizes.back() == SlabAllocator::kMaxChunkSize, "size classes must end at kMaxChunkSize");
+
+        // Chunks each thread may hold per class before returning some
+        constexpr size_t kCacheBytes = 32 * 1024;
+
+        // Blocks kept by Arena::reset()
+        constexpr size_t kArenaRetainBlocks = 4;
+
+        // Once the thread's cache is gone (late in thread teardown), frees
+        // and allocations go straight to the shared lists
+        enum class CacheState : uint8_t { Unset, Live, Destroyed };
+        thread_local CacheState cache_state = CacheState::Unset;
+
+    } // namespace
+
+    struct SlabAllocator::ThreadCache {
+        struct Bin {
+            FreeChunk* head = nullptr;
+            std::atomic<size_t> count{ 0 };  // Written by the owning thread only
+        };
+
+        explicit ThreadCache(SlabAllocator& owner) : owner(owner) {
+            std::lock_guard<std::mutex> lock(owner.caches_mutex_);
+            owner.caches_.push_back(this);
+            cache_state = CacheState::Live;
+        }
+
+        ~ThreadCache() {
+            for (size_t i = 0; i < kClassCount; ++i) {
+                Bin& bin = bins[i];
+                if (bin.head) {
+                    FreeChunk* tail = bin.head;
+                    while (tail->next) {
+                        tail = tail->next;
+                    }
+                    owner.release(i, bin.head, tail, bin.count.load(std::memory_order_relaxed));
+                    bin.head = nullptr;
+                    bin.count.store(0, std::memory_order_relaxed);
+                }
+            }
+            std::lock_guard<std::mutex> lock(owner.caches_mutex_);
+            owner.caches_.erase(std::find(owner.caches_.begin(), owner.caches_.end(), this));
+            cache_state = CacheState::Destroyed;
+        }
+
+        SlabAllocator& owner;
+        std::array<Bin, kClassCount> bins;
+    };
+
+    SlabAllocator& SlabAllocator::instance() {
+        // Never destroyed: strings owned by static objects may be freed
+        // after the end of main
+        static SlabAllocator* allocator = new SlabAllocator();
+        return *allocator;
+    }
+
+    size_t SlabAllocator::class_index(size_t size) {
+        if (size <= 128) {
+            return size == 0 ? 0 : (size - 1) / 16;
+        }
+        size_t last = size - 1;
+        size_t bits = std::bit_width(last);
+        size_t base = size_t{ 1 } << (bits - 1);
+        return 8 + (bits - 8) * 4 + (last - base) / (base / 4);
+    }
+
+    size_t SlabAllocator::batch_size(size_t index) {
+        return std::clamp<size_t>(kCacheBytes / 2 / kClassSizes[index], 1, 32);
+    }
+
+    size_t SlabAllocator::chunk_size_for(size_t size) {
+        return size > kMaxChunkSize ? size : kClassSizes[class_index(size)];
+    }
+
+    SlabAllocator::ThreadCache& SlabAllocator::thread_cache() {
+        thread_local ThreadCache cache(*this);
+        return cache;
+    }
+
+    void* SlabAllocator::allocate(size_t size, size_t& capacity) {
+        if (size > kMaxChunkSize) {
+            void* pointer = ::operator new(size);
+            large_allocations_.fetch_add(1, std::memory_order_relaxed);
+            large_bytes_.fetch_add(size, std::memory_order_relaxed);
+            capacity = size;
+            return pointer;
+        }
+
+        size_t index = class_index(size);
+        capacity = kClassSizes[index];
+
+        if (cache_state == CacheState::Destroyed) {
+            FreeChunk* chunk = nullptr;
+            refill(index, chunk, 1);
+            return chunk;
+        }
+
+        ThreadCache::Bin& bin = thread_cache().bins[index];
+        size_t count = bin.count.load(std::memory_order_relaxed);
+        if (!bin.head) {
+            count = refill(index, bin.head, batch_size(index));
+        }
+        FreeChunk* chunk = bin.head;
+        bin.head = chunk->next;
+        bin.count.store(count - 1, std::memory_order_relaxed);
+        return chunk;
+    }
+
+    void SlabAllocator::deallocate(void* pointer, size_t capacity) noexcept {
+        if (!pointer) {
+            return;
+        }
+        if (capacity > kMaxChunkSize) {
+            ::operator delete(pointer);
+            large_allocations_.fetch_sub(1, std::memory_order_relaxed);
+            large_bytes_.fetch_sub(capacity, std::memory_order_relaxed);
+            return;
+        }
+
+        size_t index = class_index(capacity);
+        FreeChunk* chunk = static_cast<FreeChunk*>(pointer);
+        if (cache_state == CacheState::Destroyed) {
+            chunk->next = nullptr;
+            release(index, chunk, chunk, 1);
+            return;
+        }
+
+        ThreadCache::Bin& bin = thread_cache().bins[index];
+        chunk->next = bin.head;
+        bin.head = chunk;
+        size_t count = bin.count.load(std::memory_order_relaxed) + 1;
+
+        // Keep one batch for the next allocations, hand the rest back
+        size_t batch = batch_size(index);
+        if (count >= 2 * batch) {
+            FreeChunk* keep_tail = bin.head;
+            for (size_t i = 1; i < batch; ++i) {
+                keep_tail = keep_tail->next;
+            }
+            FreeChunk* head = keep_tail->next;
+            FreeChunk* tail = head;
+            while (tail->next) {
+                tail = tail->next;
+            }
+            keep_tail->next = nullptr;
+            release(index, head, tail, count - batch);
+            count = batch;
+        }
+        bin.count.store(count, std::memory_order_relaxed);
+    }
+
+    size_t SlabAllocator::refill(size_t index, FreeChunk*& out, size_t count) {
+        Central& central = central_[index];
+        std::lock_guard<std::mutex> lock(central.mutex);
+
+        if (!central.free) {
+            size_t chunk_size = kClassSizes[index];
+            size_t chunks = kSlabSize / chunk_size;
+            char* slab = static_cast<char*>(::operator new(kSlabSize));
+            for (size_t i = chunks; i-- > 0;) {
+                FreeChunk* chunk = reinterpret_cast<FreeChunk*>(slab + i * chunk_size);
+                chunk->next = central.free;
+                central.free = chunk;
+            }
+            central.free_count += chunks;
+            ++central.slabs;
+        }
+
+        size_t taken = 0;
+        while (taken < count && central.free) {
+            FreeChunk* chunk = central.free;
+            central.free = chunk->next;
+            chunk->next = out;
+            out = chunk;
+            ++taken;
+        }
+        central.free_count -= taken;
+        central.handed_out += taken;
+        return taken;
+    }
+
+    void SlabAllocator::release(size_t index, FreeChunk* head, FreeChunk* tail, size_t count) noexcept {
+        Central& central = central_[index];
+        std::lock_guard<std::mutex> lock(central.mutex);
+        tail->next = central.free;
+        central.free = head;
+        central.free_count += count;
+        central.handed_out -= count;
+    }
+
+    MemoryStats SlabAllocator::stats() const {
+        MemoryStats stats;
+        stats.classes.resize(kClassCount);
+
+        std::array<size_t, kClassCount> cached{};
+        {
+            std::lock_guard<std::mutex> lock(caches_mutex_);
+            for (const ThreadCache* cache : caches_) {
+                for (size_t i = 0; i < kClassCount; ++i) {
+                    cached[i] += cache->bins[i].count.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < kClassCount; ++i) {
+            const Central& central = central_[i];
+            SizeClassStats& entry = stats.classes[i];
+            entry.chunk_size = kClassSizes[i];
+            {
+                std::lock_guard<std::mutex> lock(central.mutex);
+                entry.slabs = central.slabs;
+                // Thread caches are read without their owners' cooperation,
+                // so the split can be briefly off; totals stay consistent
+                size_t in_cache = std::min(cached[i], central.handed_out);
+                entry.chunks_in_use = central.handed_out - in_cache;
+                entry.chunks_free = central.free_count + in_cache;
+            }
+            stats.used_bytes += entry.chunks_in_use * entry.chunk_size;
+            stats.reserved_bytes += entry.slabs * kSlabSize;
+        }
+
+        stats.large_allocations = large_allocations_.load(std::memory_order_relaxed);
+        stats.large_bytes = large_bytes_.load(std::memory_order_relaxed);
+        stats.used_bytes += stats.large_bytes;
+        stats.reserved_bytes += stats.large_bytes;
+        if (stats.used_bytes > 0) {
+            stats.fragmentation_ratio = static_cast<double>(stats.reserved_bytes) / static_cast<double>(stats.used_bytes);
+        }
+        return stats;
+    }
+
+    Arena::Arena(size_t block_size) : block_size_(block_size) {}
+
+    Arena::~Arena() {
+        for (Block& block : blocks_) {
+            ::operator delete(block.data);
+        }
+    }
+
+    void* Arena::allocate(size_t size, size_t align) {
+        while (current_ < blocks_.size()) {
+            Block& block = blocks_[current_];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+            uintptr_t start = (base + offset_ + align - 1) & ~(uintptr_t{ align } - 1);
+            if (start + size <= base + block.size) {
+                offset_ = start + size - base;
+                return reinterpret_cast<void*>(start);
+            }
+            ++current_;
+            offset_ = 0;
+        }
+
+        size_t block_size = std::max(block_size_, size + align);
+        blocks_.push_back({ static_cast<char*>(::operator new(block_size)), block_size });
+        current_ = blocks_.size() - 1;
+        uintptr_t base = reinterpret_cast<uintptr_t>(blocks_.back().data);
+        uintptr_t start = (base + align - 1) & ~(uintptr_t{ align } - 1);
+        offset_ = start + size - base;
+        return reinterpret_cast<void*>(start);
+    }
+
+    void Arena::rewind(const Marker& marker) {
+        current_ = marker.block;
+        offset_ = marker.offset;
+    }
+
+    void Arena::reset() {
+        current_ = 0;
+        offset_ = 0;
+        // A batch with unusually large scratch needs should not pin that
+        // memory for the life of the thread
+        if (blocks_.size() > kArenaRetainBlocks) {
+            for (size_t i = 1; i < blocks_.size(); ++i) {
+                ::operator delete(blocks_[i].data);
+            }
+            blocks_.resize(1);
+        }
+    }
+
+    size_t Arena::reserved_bytes() const {
+        size_t total = 0;
+        for (const Block& block : blocks_) {
+            total += block.size;
+        }
+        return total;
+    }
+
+    Arena& scratch_arena() {
+        thread_local Arena arena;
+        return arena;
+    }
+
+} // namespace blitzdb
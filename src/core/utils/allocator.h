@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace blitzdb {
+
+    // Usage of one slab size class
+    struct SizeClassStats {
+        size_t chunk_size = 0;
+        size_t slabs = 0;          // Slabs carved for this class
+        size_t chunks_in_use = 0;  // Handed out to callers
+        size_t chunks_free = 0;    // Idle in central and thread-local free lists
+    };
+
+    struct MemoryStats {
+        size_t used_bytes = 0;       // Chunk bytes in use plus large allocations
+        size_t reserved_bytes = 0;   // Slab bytes plus large allocations
+        size_t large_allocations = 0;
+        size_t large_bytes = 0;
+        double fragmentation_ratio = 1.0;  // reserved / used
+        std::vector<SizeClassStats> classes;
+    };
+
+    // Size-class slab allocator for key and value payloads.
+    //
+    // Requests up to kMaxChunkSize are rounded up to one of a few dozen size
+    // classes (about 12% apart) and carved out of 64 KB slabs, so SET/DEL
+    // churn reuses chunks of the same size instead of fragmenting the heap.
+    // Each thread keeps a small free list per class and trades chunks with
+    // the shared per-class lists in batches, so the common path takes no
+    // lock. Larger requests go to the system allocator but are accounted.
+    //
+    // Slabs are never returned to the system: idle chunks show up in
+    // fragmentation_ratio and are reused by later writes of a similar size.
+    class SlabAllocator {
+    public:
+        static constexpr size_t kMaxChunkSize = 16 * 1024;
+        static constexpr size_t kClassCount = 36;
+
+        static SlabAllocator& instance();
+
+        // Returns at least `size` bytes; `capacity` receives the usable size,
+        // which must be passed back to deallocate()
+        void* allocate(size_t size, size_t& capacity);
+        void deallocate(void* pointer, size_t capacity) noexcept;
+
+        // Usable size allocate() would return for `size`
+        static size_t chunk_size_for(size_t size);
+
+        MemoryStats stats() const;
+
+    private:
+        struct FreeChunk {
+            FreeChunk* next;
+        };
+
+        struct alignas(64) Central {
+            mutable std::mutex mutex;
+            FreeChunk* free = nullptr;
+            size_t free_count = 0;
+            size_t slabs = 0;
+            size_t handed_out = 0;  // Chunks owned by threads (cached or in use)
+        };
+
+        struct ThreadCache;
+        friend struct ThreadCache;
+
+        SlabAllocator() = default;
+
+        static size_t class_index(size_t size);
+        static size_t batch_size(size_t index);
+        ThreadCache& thread_cache();
+
+        // Moves up to `count` chunks from the shared list into `out`
+        size_t refill(size_t index, FreeChunk*& out, size_t count);
+        void release(size_t index, FreeChunk* head, FreeChunk* tail, size_t count) noexcept;
+
+        std::array<Central, kClassCount> central_;
+        std::atomic<size_t> large_allocations_{ 0 };
+        std::atomic<size_t> large_bytes_{ 0 };
+
+        mutable std::mutex caches_mutex_;
+        std::vector<ThreadCache*> caches_;
+    };
+
+    // Bump allocator for per-request scratch memory. Allocation is a pointer
+    // increment; nothing is freed individually. reset() (or rewinding to a
+    // marker) makes the memory reusable while keeping the blocks.
+    class Arena {
+    public:
+        struct Marker {
+            size_t block = 0;
+            size_t offset = 0;
+        };
+
+        explicit Arena(size_t block_size = 16 * 1024);
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        ~Arena();
+
+        void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+        Marker mark() const { return { current_, offset_ }; }
+        void rewind(const Marker& marker);
+
+        // Releases everything; blocks beyond the first are returned to the
+        // system if the arena grew past its retention limit
+        void reset();
+
+        size_t reserved_bytes() const;
+
+    private:
+        struct Block {
+            char* data;
+            size_t size;
+        };
+
+        size_t block_size_;
+        std::vector<Block> blocks_;
+        size_t current_ = 0;
+        size_t offset_ = 0;
+    };
+
+    // Scratch arena of the calling thread. The server resets it after every
+    // batch of commands, so memory taken from it must not outlive the batch.
+    Arena& scratch_arena();
+
+    // Rewinds an arena to where it was when the scope was entered
+    class ArenaScope {
+    public:
+        explicit ArenaScope(Arena& arena) : arena_(arena), marker_(arena.mark()) {}
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+        ~ArenaScope() { arena_.rewind(marker_); }
+
+    private:
+        Arena& arena_;
+        Arena::Marker marker_;
+    };
+
+    // Standard allocator adaptor so containers can live in an arena
+    template <typename T>
+    class ArenaAllocator {
+    public:
+        using value_type = T;
+
+        explicit ArenaAllocator(Arena& arena) noexcept : arena_(&arena) {}
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T*, size_t) noexcept {}
+
+        Arena* arena() const noexcept { return arena_; }
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena_ == other.arena(); }
+
+    private:
+        Arena* arena_;
+    };
+
+} // namespace blitzdb
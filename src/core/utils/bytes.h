@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace blitzdb {
+
+    // Parses a byte count with an optional b/k/kb/m/mb/g/gb suffix (powers
+    // of 1024, any case), as used by the size options and CONFIG SET
+    inline bool parse_bytes(std::string_view text, size_t& bytes) {
+        uint64_t value = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end == text.data()) {
+            return false;
+        }
+        std::string_view suffix(end, static_cast<size_t>(text.data() + text.size() - end));
+        auto is = [suffix](std::string_view unit) {
+            if (suffix.size() != unit.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < unit.size(); ++i) {
+                if (std::tolower(static_cast<unsigned char>(suffix[i])) != unit[i]) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        unsigned shift = 0;
+        if (suffix.empty() || is("b")) {
+            shift = 0;
+        }
+        else if (is("k") || is("kb")) {
+            shift = 10;
+        }
+        else if (is("m") || is("mb")) {
+            shift = 20;
+        }
+        else if (is("g") || is("gb")) {
+            shift = 30;
+        }
+        else {
+            return false;
+        }
+        if (value > (SIZE_MAX >> shift)) {
+            return false;
+        }
+        bytes = static_cast<size_t>(value) << shift;
+        return true;
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,93 @@
+#include "utils/checksum.h"
+#include <array>
+#include <cstring>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define BLITZDB_CRC32C_SSE42 1
+#endif
+
+namespace blitzdb {
+
+    namespace {
+
+        constexpr uint32_t kPolynomial = 0x82F63B78;  // Reflected Castagnoli
+
+        using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+        constexpr Tables make_tables() {
+            Tables tables{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+                }
+                tables[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (size_t t = 1; t < 8; ++t) {
+                    tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xFF];
+                }
+            }
+            return tables;
+        }
+
+        constexpr Tables kTables = make_tables();
+
+        uint32_t crc32c_portable(const unsigned char* p, size_t size, uint32_t crc) {
+            while (size >= 8) {
+                uint32_t low;
+                uint32_t high;
+                std::memcpy(&low, p, 4);
+                std::memcpy(&high, p + 4, 4);
+                low ^= crc;  // Assumes little endian, like the file formats
+                crc = kTables[7][low & 0xFF] ^ kTables[6][(low >> 8) & 0xFF] ^
+                    kTables[5][(low >> 16) & 0xFF] ^ kTables[4][low >> 24] ^
+                    kTables[3][high & 0xFF] ^ kTables[2][(high >> 8) & 0xFF] ^
+                    kTables[1][(high >> 16) & 0xFF] ^ kTables[0][high >> 24];
+                p += 8;
+                size -= 8;
+            }
+            while (size-- > 0) {
+                crc = (crc >> 8) ^ kTables[0][(crc ^ *p++) & 0xFF];
+            }
+            return crc;
+        }
+
+#if defined(BLITZDB_CRC32C_SSE42)
+        __attribute__((target("sse4.2")))
+        uint32_t crc32c_sse42(const unsigned char* p, size_t size, uint32_t crc) {
+            uint64_t value = crc;
+            while (size >= 8) {
+                uint64_t word;
+                std::memcpy(&word, p, 8);
+                value = _mm_crc32_u64(value, word);
+                p += 8;
+                size -= 8;
+            }
+            uint32_t crc32 = static_cast<uint32_t>(value);
+            while (size-- > 0) {
+                crc32 = _mm_crc32_u8(crc32, *p++);
+            }
+            return crc32;
+        }
+
+        const bool kHasSse42 = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.2") != 0;
+        }();
+#endif
+
+    } // namespace
+
+    uint32_t crc32c(const void* data, size_t size, uint32_t crc) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        crc = ~crc;
+#if defined(BLITZDB_CRC32C_SSE42)
+        if (kHasSse42) {
+            return ~crc32c_sse42(p, size, crc);
+        }
+#endif
+        return ~crc32c_portable(p, size, crc);
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace blitzdb {
+
+    // CRC-32C (Castagnoli). `crc` is the value returned for the preceding
+    // bytes, so a checksum can be computed piecewise. Uses the SSE4.2
+    // instruction when the CPU has it, slicing-by-8 tables otherwise.
+    uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+} // namespace blitzdb
@@ -0,0 +1,163 @@
+#include "utils/file.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace blitzdb {
+
+    int open_file(const std::string& path, bool truncate) {
+#if defined(_WIN32)
+        int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : _O_APPEND);
+        return _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : O_APPEND);
+        return ::open(path.c_str(), flags, 0644);
+#endif
+    }
+
+    bool write_all(int fd, std::string_view& data) {
+        while (!data.empty()) {
+#if defined(_WIN32)
+            int written = _write(fd, data.data(), static_cast<unsigned>(std::min<size_t>(data.size(), 1u << 30)));
+#else
+            ssize_t written = ::write(fd, data.data(), data.size());
+#endif
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(written));
+        }
+        return true;
+    }
+
+    bool write_all(int fd, const std::string& data) {
+        std::string_view rest = data;
+        return write_all(fd, rest);
+    }
+
+    bool sync_file(int fd) {
+#if defined(_WIN32)
+        return _commit(fd) == 0;
+#else
+        return ::fsync(fd) == 0;
+#endif
+    }
+
+    void close_file(int fd) {
+#if defined(_WIN32)
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+
+    uint64_t size_of(const std::string& path) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : size;
+    }
+
+    bool MappedFile::open(const std::string& path, std::string& error) {
+        close();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "cannot open " + path;
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            error = "cannot stat " + path;
+            return false;
+        }
+        file_ = file;
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ == 0) {
+            return true;
+        }
+        mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) {
+            close();
+            error = "cannot map " + path;
+            return false;
+        }
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (!data_) {
+            close();
+            error = "cannot map " + path;
+            return false;
+        }
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            error = "cannot stat " + path + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ > 0) {
+            void* address = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                error = "cannot map " + path + ": " + std::strerror(errno);
+                ::close(fd);
+                size_ = 0;
+                return false;
+            }
+            data_ = static_cast<const char*>(address);
+            // Loaders read the file front to back and from several threads
+            // at once; ask for aggressive read-ahead
+            ::madvise(address, size_, MADV_WILLNEED);
+        }
+        ::close(fd);  // The mapping keeps the file referenced
+        return true;
+#endif
+    }
+
+    void MappedFile::close() {
+#if defined(_WIN32)
+        if (data_) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_) {
+            CloseHandle(mapping_);
+        }
+        if (file_) {
+            CloseHandle(file_);
+        }
+        mapping_ = nullptr;
+        file_ = nullptr;
+#else
+        if (data_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace blitzdb {
+
+    // Thin wrappers over POSIX / Windows file descriptors used by the
+    // persistence code
+
+    // Opens for writing, creating the file; appends unless `truncate`.
+    // Returns -1 with errno set on failure.
+    int open_file(const std::string& path, bool truncate);
+
+    // Consumes `data` as it is written, so a failed call can be retried
+    // with what is left
+    bool write_all(int fd, std::string_view& data);
+    bool write_all(int fd, const std::string& data);
+
+    bool sync_file(int fd);
+    void close_file(int fd);
+
+    // Size of a file, or 0 if it cannot be read
+    uint64_t size_of(const std::string& path);
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() { close(); }
+
+        // Maps `path`; returns false with `error` describing why not
+        bool open(const std::string& path, std::string& error);
+        void close();
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+#if defined(_WIN32)
+        void* file_ = nullptr;
+        void* mapping_ = nullptr;
+#endif
+    };
+
+} // namespace blitzdb
@@ -0,0 +1,312 @@
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+namespace blitzdb {
+
+    namespace {
+
+        int64_t now_us() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        // "2026-01-31 23:59:59.123"
+        size_t format_time(int64_t time_us, char* out, size_t size) {
+            std::time_t seconds = static_cast<std::time_t>(time_us / 1000000);
+            std::tm local{};
+#if defined(_WIN32)
+            localtime_s(&local, &seconds);
+#else
+            localtime_r(&seconds, &local);
+#endif
+            size_t length = std::strftime(out, size, "%Y-%m-%d %H:%M:%S", &local);
+            int written = std::snprintf(out + length, size - length, ".%03d",
+                static_cast<int>(time_us / 1000 % 1000));
+            return length + static_cast<size_t>(std::max(written, 0));
+        }
+
+#if !defined(_WIN32)
+        // Registered before main so a child forked at any point knows
+        [[maybe_unused]] const bool kAtForkRegistered = pthread_atfork(nullptr, nullptr, []() {
+            Logger::mark_forked();
+        }) == 0;
+#endif
+
+    } // namespace
+
+    std::optional<LogLevel> parse_log_level(std::string_view name) {
+        if (name == "debug") return LogLevel::Debug;
+        if (name == "info") return LogLevel::Info;
+        if (name == "warning") return LogLevel::Warning;
+        if (name == "error") return LogLevel::Error;
+        return std::nullopt;
+    }
+
+    const char* log_level_name(LogLevel level) {
+        switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warning: return "warning";
+        case LogLevel::Error: return "error";
+        }
+        return "info";
+    }
+
+    void LogRecord::append(std::string_view value) {
+        size_t room = kTextSize - length;
+        size_t count = std::min(room, value.size());
+        std::memcpy(text + length, value.data(), count);
+        length = static_cast<uint16_t>(length + count);
+    }
+
+    thread_local LogRecord Logger::direct_;
+
+    // Gives a thread's ring back for reuse when the thread exits
+    struct Logger::Lease {
+        Ring* ring = nullptr;
+
+        ~Lease() {
+            if (ring) {
+                ring->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    Logger& Logger::instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    Logger::Logger() {
+        if (!forked_.load(std::memory_order_relaxed)) {
+            writer_ = std::thread([this]() { run(); });
+        }
+    }
+
+    Logger::~Logger() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+        if (file_) {
+            std::fclose(file_);
+        }
+        // Rings are not freed: threads that outlive the logger may still
+        // hold one
+    }
+
+    void Logger::set_level(LogLevel level) {
+        threshold_.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
+
+    LogLevel Logger::level() {
+        return static_cast<LogLevel>(threshold_.load(std::memory_order_relaxed));
+    }
+
+    bool Logger::open_file(const std::string& path) {
+        FILE* file = std::fopen(path.c_str(), "a");
+        if (!file) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(sink_mutex_);
+        if (file_) {
+            std::fclose(file_);
+        }
+        file_ = file;
+        return true;
+    }
+
+    Logger::Ring* Logger::thread_ring() {
+        thread_local Lease lease;
+        if (lease.ring) {
+            return lease.ring;
+        }
+
+        // Take over the ring of a thread that has exited, or publish a new one
+        for (Ring* ring = rings_.load(std::memory_order_acquire); ring; ring = ring->next) {
+            bool idle = false;
+            if (ring->in_use.compare_exchange_strong(idle, true, std::memory_order_acquire)) {
+                lease.ring = ring;
+                return ring;
+            }
+        }
+        Ring* ring = new Ring();
+        ring->next = rings_.load(std::memory_order_relaxed);
+        while (!rings_.compare_exchange_weak(ring->next, ring,
+            std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        lease.ring = ring;
+        return ring;
+    }
+
+    LogRecord* Logger::begin_record(LogLevel level) {
+        LogRecord* record = &direct_;
+        if (!forked_.load(std::memory_order_relaxed)) {
+            Ring* ring = thread_ring();
+            uint64_t head = ring->head.load(std::memory_order_relaxed);
+            if (head - ring->tail.load(std::memory_order_acquire) == kRingRecords) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            record = &ring->records[head % kRingRecords];
+        }
+        record->time_us = now_us();
+        record->level = level;
+        record->length = 0;
+        return record;
+    }
+
+    void Logger::commit_record(LogRecord* record) {
+        if (record == &direct_) {
+            print(record->level, record->time_us, std::string_view(record->text, record->length));
+            std::fflush(nullptr);
+            return;
+        }
+        Ring* ring = thread_ring();
+        ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void Logger::flush() {
+        if (!writer_.joinable()) {
+            return;  // Forked child: everything was written directly
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint64_t ticket = ++flush_requested_;
+        wake_.notify_one();
+        flushed_.wait(lock, [this, ticket]() { return flush_done_ >= ticket || stopping_; });
+    }
+
+    void Logger::run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait_for(lock, std::chrono::milliseconds(10), [this]() {
+                return stopping_ || flush_requested_ > flush_done_;
+            });
+            uint64_t requested = flush_requested_;
+            bool stopping = stopping_;
+            lock.unlock();
+            drain();
+            lock.lock();
+            flush_done_ = requested;
+            flushed_.notify_all();
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    void Logger::drain() {
+        // Everything published so far, from all threads, in time order
+        batch_.clear();
+        for (Ring* ring = rings_.load(std::memory_order_acquire); ring; ring = ring->next) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            for (; tail != head; ++tail) {
+                batch_.push_back(ring->records[tail % kRingRecords]);
+            }
+            ring->tail.store(tail, std::memory_order_release);
+        }
+        std::stable_sort(batch_.begin(), batch_.end(), [](const LogRecord& a, const LogRecord& b) {
+            return a.time_us < b.time_us;
+        });
+
+        std::lock_guard<std::mutex> lock(sink_mutex_);
+        for (const LogRecord& record : batch_) {
+            emit(record);
+        }
+
+        // Summaries are due a second after the line they follow
+        int64_t now = now_us();
+        if (repeats_ > 0 && now - last_time_us_ >= 1000000) {
+            flush_repeats();
+        }
+        if (suppressed_ > 0 && now / 1000000 != budget_second_) {
+            flush_suppressed();
+        }
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_dropped_) {
+            line_.clear();
+            line_ += std::to_string(dropped - reported_dropped_);
+            line_ += " log messages dropped (ring full)";
+            print(LogLevel::Warning, now, line_);
+            reported_dropped_ = dropped;
+        }
+        std::fflush(nullptr);
+    }
+
+    void Logger::emit(const LogRecord& record) {
+        std::string_view text(record.text, record.length);
+        if (have_last_ && record.level == last_.level &&
+            text == std::string_view(last_.text, last_.length)) {
+            ++repeats_;
+            repeat_time_us_ = record.time_us;
+            return;
+        }
+        flush_repeats();
+
+        if (record.level >= LogLevel::Warning) {
+            int64_t second = record.time_us / 1000000;
+            if (second != budget_second_) {
+                flush_suppressed();
+                budget_second_ = second;
+                budget_used_ = 0;
+            }
+            if (++budget_used_ > kMaxErrorsPerSecond) {
+                ++suppressed_;
+                return;
+            }
+        }
+
+        print(record.level, record.time_us, text);
+        last_ = record;
+        have_last_ = true;
+        last_time_us_ = record.time_us;
+    }
+
+    void Logger::flush_repeats() {
+        if (repeats_ == 0) {
+            return;
+        }
+        line_.clear();
+        line_ += "last message repeated ";
+        line_ += std::to_string(repeats_);
+        line_ += " times";
+        print(last_.level, repeat_time_us_, line_);
+        last_time_us_ = repeat_time_us_;
+        repeats_ = 0;
+    }
+
+    void Logger::flush_suppressed() {
+        if (suppressed_ == 0) {
+            return;
+        }
+        line_.clear();
+        line_ += std::to_string(suppressed_);
+        line_ += " warnings and errors suppressed (over ";
+        line_ += std::to_string(kMaxErrorsPerSecond);
+        line_ += " per second)";
+        print(LogLevel::Warning, budget_second_ * 1000000, line_);
+        suppressed_ = 0;
+    }
+
+    void Logger::print(LogLevel level, int64_t time_us, std::string_view text) {
+        char prefix[64];
+        size_t length = format_time(time_us, prefix, sizeof(prefix));
+        FILE* out = file_ ? file_ : level >= LogLevel::Warning ? stderr : stdout;
+        std::fwrite(prefix, 1, length, out);
+        std::fprintf(out, " %-7s ", log_level_name(level));
+        std::fwrite(text.data(), 1, text.size(), out);
+        std::fputc('\n', out);
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace blitzdb {
+
+    enum class LogLevel : uint8_t {
+        Debug,
+        Info,
+        Warning,
+        Error,
+    };
+
+    std::optional<LogLevel> parse_log_level(std::string_view name);
+    const char* log_level_name(LogLevel level);
+
+    // One message as it sits in a ring; longer messages are truncated
+    struct LogRecord {
+        static constexpr size_t kTextSize = 240;
+
+        int64_t time_us = 0;  // System clock
+        LogLevel level = LogLevel::Info;
+        uint16_t length = 0;
+        char text[kTextSize];
+
+        void append(std::string_view text);
+
+        template <typename T>
+        void append_value(const T& value) {
+            if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                append(std::string_view(value));
+            }
+            else if constexpr (std::is_same_v<T, bool>) {
+                append(value ? "true" : "false");
+            }
+            else if constexpr (std::is_same_v<T, char>) {
+                append(std::string_view(&value, 1));
+            }
+            else if constexpr (std::is_arithmetic_v<T>) {
+                char digits[32];
+                auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+                append(std::string_view(digits, ec == std::errc() ? static_cast<size_t>(end - digits) : 0));
+            }
+            else {
+                static_assert(std::is_arithmetic_v<T>, "unsupported log argument");
+            }
+        }
+    };
+
+    // Leveled, asynchronous logger.
+    //
+    // A logging call formats its arguments straight into a slot of the
+    // calling thread's ring and returns; it never takes a lock, allocates
+    // or does I/O (the first call on a thread claims a ring, lock-free).
+    // A full ring drops the message and counts it. A background thread
+    // drains the rings every few milliseconds in timestamp order and
+    // writes the lines out, collapsing identical consecutive messages and
+    // capping warnings and errors at kMaxErrorsPerSecond.
+    //
+    // Messages below the level are discarded by the log_* helpers before
+    // their arguments are formatted. After fork() the child writes
+    // synchronously, as it has no writer thread.
+    class Logger {
+    public:
+        static constexpr size_t kRingRecords = 1024;
+        static constexpr uint64_t kMaxErrorsPerSecond = 100;
+
+        static Logger& instance();
+
+        static bool enabled(LogLevel level) {
+            return static_cast<uint8_t>(level) >= threshold_.load(std::memory_order_relaxed);
+        }
+        static void set_level(LogLevel level);
+        static LogLevel level();
+
+        // Writes to `path` (appending) instead of stdout and stderr
+        bool open_file(const std::string& path);
+
+        template <typename... Args>
+        void write(LogLevel level, const Args&... args) {
+            LogRecord* record = begin_record(level);
+            if (!record) {
+                return;
+            }
+            (record->append_value(args), ...);
+            commit_record(record);
+        }
+
+        // Blocks until everything logged before the call has been written.
+        // For shutdown and administrative paths, never the request path.
+        void flush();
+
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+        // Called in the child after fork()
+        static void mark_forked() { forked_.store(true, std::memory_order_relaxed); }
+
+        ~Logger();
+
+    private:
+        struct Ring {
+            std::atomic<uint64_t> head{ 0 };  // Next slot to fill (producer)
+            std::atomic<uint64_t> tail{ 0 };  // Next slot to drain (writer)
+            std::atomic<bool> in_use{ true };  // Owned by a live thread
+            Ring* next = nullptr;             // Set before the ring is published
+            std::array<LogRecord, kRingRecords> records;
+        };
+
+        struct Lease;
+
+        Logger();
+
+        Ring* thread_ring();
+        LogRecord* begin_record(LogLevel level);
+        void commit_record(LogRecord* record);
+
+        // Writer side
+        void run();
+        void drain();
+        void emit(const LogRecord& record);
+        void flush_repeats();
+        void flush_suppressed();
+        void print(LogLevel level, int64_t time_us, std::string_view text);
+
+        static inline std::atomic<uint8_t> threshold_{ static_cast<uint8_t>(LogLevel::Info) };
+        static inline std::atomic<bool> forked_{ false };
+        static thread_local LogRecord direct_;  // Used synchronously after fork()
+
+        std::atomic<Ring*> rings_{ nullptr };
+        std::atomic<uint64_t> dropped_{ 0 };
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable flushed_;
+        uint64_t flush_requested_ = 0;
+        uint64_t flush_done_ = 0;
+        bool stopping_ = false;
+        std::thread writer_;
+
+        // Writer state
+        std::mutex sink_mutex_;  // Guards file_ against open_file()
+        FILE* file_ = nullptr;
+        std::vector<LogRecord> batch_;
+        std::string line_;
+        uint64_t reported_dropped_ = 0;
+        bool have_last_ = false;
+        LogRecord last_;
+        uint64_t repeats_ = 0;
+        int64_t repeat_time_us_ = 0;
+        int64_t last_time_us_ = 0;  // Of the last line printed
+        int64_t budget_second_ = 0;
+        uint64_t budget_used_ = 0;
+        uint64_t suppressed_ = 0;
+    };
+
+    template <typename... Args>
+    void log_debug(const Args&... args) {
+        if (Logger::enabled(LogLevel::Debug)) {
+            Logger::instance().write(LogLevel::Debug, args...);
+        }
+    }
+
+    template <typename... Args>
+    void log_info(const Args&... args) {
+        if (Logger::enabled(LogLevel::Info)) {
+            Logger::instance().write(LogLevel::Info, args...);
+        }
+    }
+
+    template <typename... Args>
+    void log_warning(const Args&... args) {
+        if (Logger::enabled(LogLevel::Warning)) {
+            Logger::instance().write(LogLevel::Warning, args...);
+        }
+    }
+
+    template <typename... Args>
+    void log_error(const Args&... args) {
+        if (Logger::enabled(LogLevel::Error)) {
+            Logger::instance().write(LogLevel::Error, args...);
+        }
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace blitzdb {
+
+    // LEB128 unsigned integers: 7 bits per byte, low bits first, high bit
+    // set on every byte but the last
+
+    inline void put_varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    // Advances `p`; false if the number runs past `end` or over 64 bits
+    inline bool get_varint(const char*& p, const char* end, uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64 && p < end; shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(*p++);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace blitzdb {
+
+    // Command properties, reported by COMMAND and checked before a command runs
+    enum CommandFlag : uint32_t {
+        kCommandWrite = 1u << 0,     // Modifies the keyspace; refused on replicas
+        kCommandReadOnly = 1u << 1,
+        kCommandDenyOom = 1u << 2,   // May need more memory
+        kCommandAdmin = 1u << 3,
+        kCommandFast = 1u << 4,      // Constant or logarithmic time
+        kCommandNoAuth = 1u << 5,    // Allowed before AUTH
+        kCommandPubSub = 1u << 6,
+    };
+
+    struct CommandFlagName {
+        CommandFlag flag;
+        std::string_view name;
+    };
+
+    inline constexpr CommandFlagName kCommandFlagNames[] = {
+        { kCommandWrite, "write" },
+        { kCommandReadOnly, "readonly" },
+        { kCommandDenyOom, "denyoom" },
+        { kCommandAdmin, "admin" },
+        { kCommandFast, "fast" },
+        { kCommandNoAuth, "no-auth" },
+        { kCommandPubSub, "pubsub" },
+    };
+
+    // Where a command's keys are among its arguments (0 is the command
+    // name): every `step`-th argument from `first` to `last`. A negative
+    // `last` counts from the end, -1 being the last argument. A command
+    // without keys has `first` 0.
+    struct KeySpec {
+        int first = 0;
+        int last = 0;
+        int step = 0;
+
+        bool single() const { return first == 1 && last == 1; }
+
+        // Calls fn(index) for each key of a command with `count` arguments
+        template <typename Fn>
+        void for_each(size_t count, Fn&& fn) const {
+            if (first <= 0 || step <= 0) {
+                return;
+            }
+            long long end = last < 0 ? static_cast<long long>(count) + last : last;
+            for (long long i = first; i <= end && i < static_cast<long long>(count); i += step) {
+                fn(static_cast<size_t>(i));
+            }
+        }
+    };
+
+    constexpr char fold_case(char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    constexpr bool equals_ignore_case(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (fold_case(a[i]) != fold_case(b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // FNV-1a over the lowercased name, perturbed by `seed`
+    constexpr uint64_t command_hash(std::string_view name, uint64_t seed) {
+        uint64_t hash = 14695981039346656037ull ^ (seed * 0x9e3779b97f4a7c15ull);
+        for (char c : name) {
+            hash ^= static_cast<uint8_t>(fold_case(c));
+            hash *= 1099511628211ull;
+        }
+        return hash ^ (hash >> 32);
+    }
+
+    // Collision-free index over a fixed list of names, found at compile
+    // time by trying seeds until every name hashes to a slot of its own.
+    // A lookup hashes the name once and yields the only entry that can
+    // match; the caller compares that one name.
+    template <size_t N>
+    class PerfectHash {
+    public:
+        static_assert(N > 0 && N < 255, "slots hold 8-bit indexes");
+        static constexpr size_t kSlots = std::bit_ceil(N * 8);
+
+        template <typename Entry>
+        constexpr explicit PerfectHash(const Entry (&entries)[N]) {
+            for (uint64_t seed = 0; seed < kMaxSeeds; ++seed) {
+                if (try_seed(entries, seed)) {
+                    seed_ = seed;
+                    return;
+                }
+            }
+            throw "no collision-free seed; raise kSlots";
+        }
+
+        // Index of the entry `name` may be, or -1 when it is none of them
+        constexpr int candidate(std::string_view name) const {
+            return static_cast<int>(slots_[command_hash(name, seed_) & (kSlots - 1)]) - 1;
+        }
+
+    private:
+        static constexpr uint64_t kMaxSeeds = 1u << 16;
+
+        template <typename Entry>
+        constexpr bool try_seed(const Entry (&entries)[N], uint64_t seed) {
+            slots_.fill(0);
+            for (size_t i = 0; i < N; ++i) {
+                uint8_t& slot = slots_[command_hash(entries[i].name, seed) & (kSlots - 1)];
+                if (slot != 0) {
+                    return false;
+                }
+                slot = static_cast<uint8_t>(i + 1);
+            }
+            return true;
+        }
+
+        uint64_t seed_ = 0;
+        std::array<uint8_t, kSlots> slots_{};  // Entry index + 1; 0 is empty
+    };
+
+} // namespace blitzdb
@@ -0,0 +1,198 @@
+#include "connection.h"
+#include <algorithm>
+#include <cstring>
+#if defined(BLITZDB_HAS_IO_URING)
+#include <unistd.h>
+#endif
+
+namespace blitzdb {
+
+    namespace {
+
+        constexpr size_t kReadChunk = 16 * 1024;
+
+    } // namespace
+
+    Connection::Connection(Socket socket, uint64_t id, size_t core, std::string address, int64_t now_ms)
+        : socket_(std::move(socket)), executor_(socket_->get_executor()), id_(id), core_(core),
+        address_(std::move(address)), created_ms_(now_ms) {
+        buffer_.resize(kReadChunk);
+        stats_.last_command_ms.store(now_ms, std::memory_order_relaxed);
+    }
+
+#if defined(BLITZDB_HAS_IO_URING)
+    Connection::Connection(std::unique_ptr<UringSocket> socket, asio::any_io_executor executor,
+        uint64_t id, size_t core, std::string address, int64_t now_ms)
+        : uring_(std::move(socket)), executor_(std::move(executor)), id_(id), core_(core),
+        address_(std::move(address)), created_ms_(now_ms) {
+        buffer_.resize(kReadChunk);
+        stats_.last_command_ms.store(now_ms, std::memory_order_relaxed);
+    }
+#endif
+
+    const Connection::Socket& Connection::socket() {
+#if defined(BLITZDB_HAS_IO_URING)
+        if (!socket_ && uring_) {
+            // The duplicate shares the connection; shutting either down
+            // ends both
+            socket_ = std::make_shared<asio::ip::tcp::socket>(executor_);
+            asio::error_code ec;
+            int fd = ::dup(uring_->fd());
+            if (fd >= 0) {
+                socket_->assign(asio::ip::tcp::v4(), fd, ec);
+                if (ec) {
+                    ::close(fd);
+                }
+            }
+        }
+#endif
+        return socket_;
+    }
+
+    asio::mutable_buffer Connection::read_space() {
+        // Reclaim consumed space. A partially received command is moved to
+        // the front; the parser tracks it by offsets so this is safe.
+        if (start_ == end_) {
+            start_ = end_ = 0;
+        }
+        else if (start_ > 0 && buffer_.size() - end_ < kReadChunk / 4) {
+            std::memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+            end_ -= start_;
+            start_ = 0;
+        }
+        if (buffer_.size() - end_ < kReadChunk / 4) {
+            buffer_.resize(buffer_.size() * 2);
+        }
+        return asio::buffer(buffer_.data() + end_, buffer_.size() - end_);
+    }
+
+    void Connection::commit_read(size_t bytes) {
+        end_ += bytes;
+        stats_.bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void Connection::receive(std::string_view data) {
+        while (!data.empty()) {
+            asio::mutable_buffer space = read_space();
+            size_t bytes = std::min(space.size(), data.size());
+            std::memcpy(space.data(), data.data(), bytes);
+            commit_read(bytes);
+            data.remove_prefix(bytes);
+        }
+    }
+
+    void Connection::take_held_input() {
+        receive(arrived_);
+        arrived_.clear();
+        // Do not keep a large burst's buffer for the connection's lifetime
+        if (arrived_.capacity() > kReadChunk) {
+            arrived_.shrink_to_fit();
+        }
+    }
+
+    resp::ParseStatus Connection::parse_next() {
+        size_t consumed = 0;
+        std::string_view pending(buffer_.data() + start_, end_ - start_);
+        resp::ParseStatus status = parser_.parse(pending, consumed, args_);
+        if (status == resp::ParseStatus::Complete) {
+            start_ += consumed;
+        }
+        return status;
+    }
+
+    const std::vector<asio::const_buffer>& Connection::start_flush() {
+        flushing_.swap(output_);
+
+        // Stored values are written from the keyspace's buffers, between
+        // the pieces of reply text around them
+        gather_.clear();
+        const std::string& text = flushing_.text();
+        size_t written = 0;
+        for (const OutputBuffer::StoredValue& value : flushing_.values()) {
+            gather_.push_back(asio::buffer(text.data() + written, value.offset - written));
+            gather_.push_back(asio::buffer(value.handle.view().data(), value.handle.size()));
+            written = value.offset;
+        }
+        gather_.push_back(asio::buffer(text.data() + written, text.size() - written));
+        return gather_;
+    }
+
+    void Connection::finish_flush() {
+        stats_.bytes_out.fetch_add(flushing_.size(), std::memory_order_relaxed);
+        flushing_.clear();
+        stats_.pending_output.store(pending_output(), std::memory_order_relaxed);
+    }
+
+    bool Connection::push_message(SharedString& message) {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        inbox_.emplace_back(&message);
+        inbox_bytes_.fetch_add(message.view().size(), std::memory_order_relaxed);
+        return inbox_.size() == 1;
+    }
+
+    void Connection::take_messages() {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        for (ValueHandle& message : inbox_) {
+            output_.raw(std::move(message));
+        }
+        inbox_.clear();
+        inbox_bytes_.store(0, std::memory_order_relaxed);
+    }
+
+    void Connection::count_command(int64_t now_ms) {
+        stats_.commands.fetch_add(1, std::memory_order_relaxed);
+        stats_.last_command_ms.store(now_ms, std::memory_order_relaxed);
+    }
+
+    void Connection::end_batch() {
+        stats_.pending_output.store(pending_output(), std::memory_order_relaxed);
+    }
+
+    std::string Connection::name() const {
+        std::lock_guard<std::mutex> lock(name_mutex_);
+        return name_;
+    }
+
+    void Connection::set_name(std::string_view name) {
+        std::lock_guard<std::mutex> lock(name_mutex_);
+        name_.assign(name);
+    }
+
+    asio::steady_timer& Connection::output_limit_timer() {
+        if (!output_limit_timer_) {
+            output_limit_timer_ = std::make_unique<asio::steady_timer>(executor_);
+        }
+        return *output_limit_timer_;
+    }
+
+    void ConnectionTable::add(const std::shared_ptr<Connection>& connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection->slot_ = slots_.size();
+        slots_.push_back(connection);
+    }
+
+    void ConnectionTable::remove(Connection& connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t slot = connection.slot_;
+        if (slot >= slots_.size() || slots_[slot].get() != &connection) {
+            return;  // Already removed
+        }
+        // Move the last connection into the freed slot
+        if (slot + 1 != slots_.size()) {
+            slots_[slot] = std::move(slots_.back());
+            slots_[slot]->slot_ = slot;
+        }
+        slots_.pop_back();
+    }
+
+    size_t ConnectionTable::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return slots_.size();
+    }
+
+    std::vector<std::shared_ptr<Connection>> ConnectionTable::snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return slots_;
+    }
+
+} // namespace blitzdb
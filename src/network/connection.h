@@ -0,0 +1,258 @@
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "../core/data_types/shared_string.h"
+#include "output_buffer.h"
+#include "protocols/resp.h"
+#include "uring.h"
+
+namespace blitzdb {
+
+    // Counters of one connection. They are written on the connection's
+    // executor and may be read from anywhere (CLIENT LIST).
+    struct ConnectionStats {
+        std::atomic<uint64_t> commands{ 0 };
+        std::atomic<uint64_t> bytes_in{ 0 };
+        std::atomic<uint64_t> bytes_out{ 0 };
+        std::atomic<uint64_t> output_pauses{ 0 };  // Reads stopped by the soft output limit
+        std::atomic<int64_t> last_command_ms{ 0 };
+        std::atomic<size_t> pending_output{ 0 };   // As of the end of the last batch
+    };
+
+    // Room for the handler of a connection's one outstanding write. A
+    // gathered write carries up to 64 buffers, which makes its operation
+    // larger than asio's per-thread recycling cache takes, so without this
+    // every write of a shared value would go to the heap.
+    class HandlerMemory {
+    public:
+        HandlerMemory() = default;
+        HandlerMemory(const HandlerMemory&) = delete;
+        HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+        void* allocate(size_t size) {
+            if (!in_use_ && size <= sizeof(storage_)) {
+                in_use_ = true;
+                return storage_;
+            }
+            return ::operator new(size);
+        }
+        void deallocate(void* pointer) {
+            if (pointer == storage_) {
+                in_use_ = false;
+            }
+            else {
+                ::operator delete(pointer);
+            }
+        }
+
+    private:
+        alignas(std::max_align_t) unsigned char storage_[2048];
+        bool in_use_ = false;
+    };
+
+    template <typename T>
+    class HandlerAllocator {
+    public:
+        using value_type = T;
+
+        explicit HandlerAllocator(HandlerMemory& memory) : memory_(&memory) {}
+        template <typename U>
+        HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+        T* allocate(size_t n) { return static_cast<T*>(memory_->allocate(sizeof(T) * n)); }
+        void deallocate(T* pointer, size_t) { memory_->deallocate(pointer); }
+
+        template <typename U>
+        bool operator==(const HandlerAllocator<U>& other) const noexcept { return memory_ == other.memory_; }
+
+    private:
+        template <typename> friend class HandlerAllocator;
+        HandlerMemory* memory_;
+    };
+
+    // One client connection and what the server keeps about it: the read
+    // buffer and parser, queued replies, auth state, selected database,
+    // name and counters. Everything is used on the connection's executor
+    // (its core, or its strand in pool mode) unless noted otherwise.
+    //
+    // Received bytes are parsed in place; the arguments of the command
+    // being executed are views into the read buffer and stay valid until
+    // the next read is issued. Replies of a batch accumulate in the output
+    // buffer while the previous batch is written from the flushing buffer.
+    //
+    // With the io_uring backend the socket is a UringSocket whose data
+    // arrives whenever the kernel has some; what comes in while the read
+    // buffer is in use is held aside until the server reads again.
+    //
+    // Pub/Sub messages are queued by publishers on any thread in an inbox
+    // of references to the encoded messages, which the server moves to
+    // the output buffer on the connection's executor.
+    class Connection : public std::enable_shared_from_this<Connection> {
+    public:
+        using Socket = std::shared_ptr<asio::ip::tcp::socket>;
+
+        Connection(Socket socket, uint64_t id, size_t core, std::string address, int64_t now_ms);
+#if defined(BLITZDB_HAS_IO_URING)
+        Connection(std::unique_ptr<UringSocket> socket, asio::any_io_executor executor,
+            uint64_t id, size_t core, std::string address, int64_t now_ms);
+        UringSocket* uring() const { return uring_.get(); }
+#endif
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        // Where the connection's handlers run: its core, or its strand in
+        // pool mode
+        const asio::any_io_executor& executor() const { return executor_; }
+
+        // The asio socket. For io_uring connections it is created on first
+        // use over a duplicate of the descriptor, for replication, which
+        // streams to replicas through asio.
+        const Socket& socket();
+        bool has_socket() const { return socket_ != nullptr; }
+        uint64_t id() const { return id_; }
+        size_t core() const { return core_; }
+        const std::string& address() const { return address_; }
+        int64_t created_ms() const { return created_ms_; }
+
+        // Reading: room for the next read, compacting or growing the
+        // buffer first, and recording what arrived
+        asio::mutable_buffer read_space();
+        void commit_read(size_t bytes);
+
+        // Input that arrived while the read buffer was in use (io_uring);
+        // take_held_input() moves it into the read buffer
+        void hold_input(std::string_view data) { arrived_.append(data); }
+        size_t held_input() const { return arrived_.size(); }
+        void take_held_input();
+        // Copies received bytes into the read buffer
+        void receive(std::string_view data);
+
+        // Parses the next buffered command into args(); on Complete its
+        // bytes are consumed
+        resp::ParseStatus parse_next();
+        const std::vector<std::string_view>& args() const { return args_; }
+        const std::string& parse_error() const { return parser_.error(); }
+
+        // Replies
+        OutputBuffer& output() { return output_; }
+        size_t pending_output() const { return output_.size() + flushing_.size(); }
+
+        // Moves the queued replies to the flushing buffer and returns the
+        // buffers to write; finish_flush() releases them once written
+        const std::vector<asio::const_buffer>& start_flush();
+        void finish_flush();
+        // For the handler of the write in progress
+        HandlerAllocator<char> write_allocator() { return HandlerAllocator<char>(write_memory_); }
+
+        // Queues a published message (any thread); true when the inbox was
+        // empty, i.e. the caller must schedule take_messages()
+        bool push_message(SharedString& message);
+        // Moves the queued messages to the output buffer
+        void take_messages();
+        size_t queued_message_bytes() const { return inbox_bytes_.load(std::memory_order_relaxed); }
+
+        // Called after each executed command and after each batch
+        void count_command(int64_t now_ms);
+        void end_batch();
+
+        bool authenticated() const { return authenticated_; }
+        void set_authenticated(bool authenticated) { authenticated_ = authenticated; }
+        // The database and name may be read from any thread
+        int db() const { return db_.load(std::memory_order_relaxed); }
+        void set_db(int db) { db_.store(db, std::memory_order_relaxed); }
+        std::string name() const;
+        void set_name(std::string_view name);
+
+        const ConnectionStats& stats() const { return stats_; }
+        void count_output_pause() { stats_.output_pauses.fetch_add(1, std::memory_order_relaxed); }
+
+        // Armed while the connection is above the soft output limit
+        asio::steady_timer& output_limit_timer();
+        bool output_limit_armed = false;
+
+        // I/O state, driven by the server
+        bool reading = false;
+        bool writing = false;
+        bool closing = false;    // Flush what is queued, then disconnect
+        bool closed = false;
+        bool forwarded = false;  // Waiting for another core to run a command
+        bool replica = false;    // Handed over to replication by PSYNC
+
+        // Pub/Sub subscriptions, kept in step with the server's PubSub.
+        // A subscribed connection only manages its subscriptions.
+        std::unordered_set<std::string> channels;
+        std::unordered_set<std::string> patterns;
+        bool subscribed() const { return !channels.empty() || !patterns.empty(); }
+        size_t subscriptions() const { return channels.size() + patterns.size(); }
+        // Set by the first publisher that finds the connection over its
+        // output limit and has it disconnected
+        std::atomic<bool> messages_dropped{ false };
+
+        // Log sequence the queued replies depend on; with appendfsync
+        // always they are held until it is synced
+        uint64_t sync_sequence = 0;
+        bool awaiting_sync = false;
+
+    private:
+        friend class ConnectionTable;
+
+        Socket socket_;
+#if defined(BLITZDB_HAS_IO_URING)
+        std::unique_ptr<UringSocket> uring_;
+#endif
+        asio::any_io_executor executor_;
+        uint64_t id_;
+        size_t core_;
+        std::string address_;
+        int64_t created_ms_;
+        size_t slot_ = 0;  // Index in the ConnectionTable, under its mutex
+
+        std::vector<char> buffer_;
+        size_t start_ = 0;  // First unconsumed byte
+        size_t end_ = 0;    // One past the last received byte
+        std::string arrived_;
+        resp::RequestParser parser_;
+        std::vector<std::string_view> args_;
+
+        OutputBuffer output_;
+        OutputBuffer flushing_;
+        std::vector<asio::const_buffer> gather_;
+        HandlerMemory write_memory_;
+        std::unique_ptr<asio::steady_timer> output_limit_timer_;
+        std::mutex inbox_mutex_;
+        std::vector<ValueHandle> inbox_;
+        std::atomic<size_t> inbox_bytes_{ 0 };
+
+        bool authenticated_ = false;
+        std::atomic<int> db_{ 0 };
+        mutable std::mutex name_mutex_;
+        std::string name_;
+        ConnectionStats stats_;
+    };
+
+    // The live connections. Each connection knows its slot, so adding and
+    // removing one are O(1) and nothing is scanned on the connection path.
+    class ConnectionTable {
+    public:
+        void add(const std::shared_ptr<Connection>& connection);
+        void remove(Connection& connection);
+        size_t size() const;
+
+        // A copy of the table, for administrative commands and shutdown
+        std::vector<std::shared_ptr<Connection>> snapshot() const;
+
+    private:
+        mutable std::mutex mutex_;
+        std::vector<std::shared_ptr<Connection>> slots_;
+    };
+
+} // namespace blitzdb
@@ -0,0 +1,200 @@
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace blitzdb {
+
+    namespace {
+
+        std::atomic<uint64_t> next_generation{ 1 };
+
+        // SLOWLOG keeps long arguments recognizable without holding them
+        std::string shorten_argument(std::string_view arg) {
+            if (arg.size() <= SlowLog::kMaxArgLength) {
+                return std::string(arg);
+            }
+            std::string shortened(arg.substr(0, SlowLog::kMaxArgLength));
+            shortened += "... (";
+            shortened += std::to_string(arg.size() - SlowLog::kMaxArgLength);
+            shortened += " more bytes)";
+            return shortened;
+        }
+
+    } // namespace
+
+    uint64_t LatencyHistogram::bucket_high(size_t bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        unsigned exponent = static_cast<unsigned>(bucket / kSubBuckets) + kSubBits - 1;
+        uint64_t width = uint64_t{ 1 } << (exponent - kSubBits);
+        uint64_t low = (kSubBuckets + bucket % kSubBuckets) * width;
+        return low + width - 1;
+    }
+
+    void LatencyHistogram::add_to(Counts& counts) const {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            counts[i] += counts_[i].get();
+        }
+    }
+
+    uint64_t LatencyHistogram::percentile(const Counts& counts, uint64_t total, double fraction) {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return bucket_high(i);
+            }
+        }
+        return bucket_high(kBuckets - 1);
+    }
+
+    Metrics::Metrics(size_t commands)
+        : command_count_(commands),
+        generation_(next_generation.fetch_add(1, std::memory_order_relaxed)) {
+    }
+
+    Metrics::Lease::~Lease() {
+        if (block) {
+            block->in_use.store(false, std::memory_order_release);
+        }
+    }
+
+    void Metrics::acquire_block(Lease& lease) {
+        if (lease.block) {
+            lease.block->in_use.store(false, std::memory_order_release);
+        }
+        lease.generation = generation_;
+
+        // Take over the block of a thread that has exited, or add one
+        std::lock_guard<std::mutex> lock(blocks_mutex_);
+        for (const auto& block : blocks_) {
+            bool idle = false;
+            if (block->in_use.compare_exchange_strong(idle, true, std::memory_order_acquire)) {
+                lease.block = block;
+                return;
+            }
+        }
+        blocks_.push_back(std::make_shared<Block>(command_count_));
+        lease.block = blocks_.back();
+    }
+
+    MetricsTotals Metrics::totals() const {
+        MetricsTotals totals;
+        totals.commands.resize(command_count_);
+        std::lock_guard<std::mutex> lock(blocks_mutex_);
+        for (const auto& block : blocks_) {
+            for (size_t i = 0; i < command_count_; ++i) {
+                const CommandMetrics& metrics = block->commands[i];
+                MetricsTotals::Command& command = totals.commands[i];
+                command.calls += metrics.calls.get();
+                command.rejected += metrics.rejected.get();
+                command.timed += metrics.timed.get();
+                command.timed_ns += metrics.timed_ns.get();
+                totals.commands_processed += metrics.calls.get();
+            }
+            totals.net_input_bytes += block->net_input.get();
+            totals.net_output_bytes += block->net_output.get();
+            totals.connections_received += block->connections.get();
+        }
+        return totals;
+    }
+
+    LatencyHistogram::Counts Metrics::command_latency(size_t command) const {
+        LatencyHistogram::Counts counts{};
+        std::lock_guard<std::mutex> lock(blocks_mutex_);
+        for (const auto& block : blocks_) {
+            block->commands[command].latency.add_to(counts);
+        }
+        return counts;
+    }
+
+    void Metrics::sample(int64_t now_ms) {
+        // Calls since the previous sample, as a rate; the reported figure
+        // averages the last kRateSamples samples
+        uint64_t calls = 0;
+        {
+            std::lock_guard<std::mutex> lock(blocks_mutex_);
+            for (const auto& block : blocks_) {
+                for (const CommandMetrics& metrics : block->commands) {
+                    calls += metrics.calls.get();
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(sample_mutex_);
+        if (last_sample_ms_ != 0 && now_ms > last_sample_ms_) {
+            rate_samples_[rate_index_] = (calls - last_sample_calls_) * 1000 /
+                static_cast<uint64_t>(now_ms - last_sample_ms_);
+            rate_index_ = (rate_index_ + 1) % kRateSamples;
+            uint64_t sum = 0;
+            for (uint64_t rate : rate_samples_) {
+                sum += rate;
+            }
+            instantaneous_ops_.store(sum / kRateSamples, std::memory_order_relaxed);
+        }
+        last_sample_ms_ = now_ms;
+        last_sample_calls_ = calls;
+    }
+
+    SlowLog::SlowLog(int64_t threshold_us, size_t max_length)
+        : threshold_us_(threshold_us), max_length_(max_length) {
+    }
+
+    void SlowLog::add(const std::vector<std::string_view>& args, uint64_t duration_us,
+        std::string client_address, std::string client_name) {
+        SlowLogEntry entry;
+        entry.time = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        entry.duration_us = duration_us;
+        size_t shown = std::min(args.size(), kMaxArgs);
+        if (shown < args.size()) {
+            --shown;  // The last slot says how many were left out
+        }
+        for (size_t i = 0; i < shown; ++i) {
+            entry.args.push_back(shorten_argument(args[i]));
+        }
+        if (shown < args.size()) {
+            entry.args.push_back("... (" + std::to_string(args.size() - shown) + " more arguments)");
+        }
+        entry.client_address = std::move(client_address);
+        entry.client_name = std::move(client_name);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry.id = next_id_++;
+        entries_.push_front(std::move(entry));
+        while (entries_.size() > max_length_.load(std::memory_order_relaxed)) {
+            entries_.pop_back();
+        }
+    }
+
+    std::vector<SlowLogEntry> SlowLog::get(size_t count) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        count = std::min(count, entries_.size());
+        return std::vector<SlowLogEntry>(entries_.begin(), entries_.begin() + static_cast<std::ptrdiff_t>(count));
+    }
+
+    size_t SlowLog::length() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    void SlowLog::reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+    }
+
+    void SlowLog::set_max_length(size_t length) {
+        max_length_.store(length, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (entries_.size() > length) {
+            entries_.pop_back();
+        }
+    }
+
+} // namespace blitzdb
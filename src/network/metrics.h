@@ -0,0 +1,252 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace blitzdb {
+
+    // A counter with a single writer. Updates are plain relaxed loads and
+    // stores, not read-modify-write instructions, so counting costs no
+    // more than incrementing an ordinary variable; any thread may read it.
+    class ThreadCounter {
+    public:
+        void add(uint64_t amount) {
+            value_.store(value_.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+        uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value_{ 0 };
+    };
+
+    // Latency distribution in nanoseconds with log-linear buckets, as in
+    // HdrHistogram: values below kSubBuckets are exact, and each power of
+    // two above is split into kSubBuckets buckets, so a value is placed
+    // within 1/kSubBuckets of itself. Values from 2^(kMaxExponent+1) on
+    // share the last bucket.
+    class LatencyHistogram {
+    public:
+        static constexpr unsigned kSubBits = 3;
+        static constexpr size_t kSubBuckets = size_t{ 1 } << kSubBits;
+        static constexpr unsigned kMaxExponent = 40;  // About 18 minutes
+        static constexpr size_t kBuckets = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+        using Counts = std::array<uint64_t, kBuckets>;
+
+        static size_t bucket_of(uint64_t ns) {
+            if (ns < kSubBuckets) {
+                return static_cast<size_t>(ns);
+            }
+            unsigned exponent = static_cast<unsigned>(std::bit_width(ns)) - 1;
+            if (exponent > kMaxExponent) {
+                return kBuckets - 1;
+            }
+            size_t sub = static_cast<size_t>(ns >> (exponent - kSubBits)) - kSubBuckets;
+            return (exponent - kSubBits + 1) * kSubBuckets + sub;
+        }
+
+        // Largest value that lands in `bucket`
+        static uint64_t bucket_high(size_t bucket);
+
+        // Writer side
+        void record(uint64_t ns) { counts_[bucket_of(ns)].add(1); }
+
+        void add_to(Counts& counts) const;
+
+        // Smallest bucket bound at or below which a `fraction` of the
+        // values fall (0 if there are none)
+        static uint64_t percentile(const Counts& counts, uint64_t total, double fraction);
+
+    private:
+        std::array<ThreadCounter, kBuckets> counts_;
+    };
+
+    // Command counters of one thread
+    struct CommandMetrics {
+        ThreadCounter calls;
+        ThreadCounter rejected;  // Refused before running: arity, auth, read-only
+        ThreadCounter timed;     // Calls that were timed, and their total
+        ThreadCounter timed_ns;
+        LatencyHistogram latency;
+        uint32_t until_timed = 1;  // Owner thread only
+    };
+
+    // Server counters, summed over the threads
+    struct MetricsTotals {
+        struct Command {
+            uint64_t calls = 0;
+            uint64_t rejected = 0;
+            uint64_t timed = 0;
+            uint64_t timed_ns = 0;
+
+            // Time spent in all calls, extrapolated from the timed ones
+            uint64_t total_ns() const {
+                return timed == 0 ? 0 : static_cast<uint64_t>(
+                    static_cast<double>(timed_ns) / static_cast<double>(timed) * static_cast<double>(calls));
+            }
+        };
+        std::vector<Command> commands;
+        uint64_t commands_processed = 0;
+        uint64_t net_input_bytes = 0;
+        uint64_t net_output_bytes = 0;
+        uint64_t connections_received = 0;
+    };
+
+    // Per-thread counters aggregated on demand. Each thread that counts
+    // gets a block of its own on first use, so the request path never
+    // shares a cache line or takes a lock; INFO and LATENCY sum the
+    // blocks. A block is kept when its thread exits, so its counts stay
+    // in the totals, and is taken over by the next new thread.
+    //
+    // Every call is counted, but only one in kTimingInterval calls of a
+    // fast command is timed: reading the clock twice costs more than a
+    // pipelined GET itself. Slower commands, and every command while the
+    // slow log threshold is 0, are timed on each call so the slow log
+    // sees them. Latency distributions are built from the timed calls and
+    // total times are extrapolated from them.
+    class Metrics {
+    public:
+        static constexpr uint32_t kTimingInterval = 16;
+
+        explicit Metrics(size_t commands);
+        Metrics(const Metrics&) = delete;
+        Metrics& operator=(const Metrics&) = delete;
+
+        // Request path, on the calling thread's block. count_command()
+        // returns true when this call is to be timed and passed to
+        // record_latency(): always with `time_every_call`, otherwise one
+        // call in kTimingInterval.
+        bool count_command(size_t command, bool time_every_call) {
+            CommandMetrics& metrics = thread_block().commands[command];
+            metrics.calls.add(1);
+            if (time_every_call) {
+                return true;
+            }
+            if (--metrics.until_timed != 0) {
+                return false;
+            }
+            metrics.until_timed = kTimingInterval;
+            return true;
+        }
+        void record_latency(size_t command, uint64_t ns) {
+            CommandMetrics& metrics = thread_block().commands[command];
+            metrics.timed.add(1);
+            metrics.timed_ns.add(ns);
+            metrics.latency.record(ns);
+        }
+        void reject_command(size_t command) { thread_block().commands[command].rejected.add(1); }
+        void count_input(size_t bytes) { thread_block().net_input.add(bytes); }
+        void count_output(size_t bytes) { thread_block().net_output.add(bytes); }
+        void count_connection() { thread_block().connections.add(1); }
+
+        MetricsTotals totals() const;
+        LatencyHistogram::Counts command_latency(size_t command) const;
+
+        // Called periodically to track the recent command rate
+        void sample(int64_t now_ms);
+        uint64_t instantaneous_ops() const { return instantaneous_ops_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Block {
+            explicit Block(size_t commands) : commands(commands) {}
+
+            std::vector<CommandMetrics> commands;
+            ThreadCounter net_input;
+            ThreadCounter net_output;
+            ThreadCounter connections;
+            std::atomic<bool> in_use{ true };  // Held by a live thread
+        };
+
+        // A thread's hold on its block; the block is shared so neither the
+        // thread nor the Metrics instance has to outlive the other
+        struct Lease {
+            uint64_t generation = 0;
+            std::shared_ptr<Block> block;
+
+            ~Lease();
+        };
+
+        Block& thread_block() {
+            thread_local Lease lease;
+            if (lease.generation != generation_) {
+                acquire_block(lease);
+            }
+            return *lease.block;
+        }
+        void acquire_block(Lease& lease);
+
+        static constexpr size_t kRateSamples = 16;
+
+        size_t command_count_;
+        uint64_t generation_;  // Tells thread leases of different instances apart
+        mutable std::mutex blocks_mutex_;
+        std::vector<std::shared_ptr<Block>> blocks_;
+
+        // Recent rate, in the style of Redis' instantaneous_ops_per_sec
+        std::mutex sample_mutex_;
+        int64_t last_sample_ms_ = 0;
+        uint64_t last_sample_calls_ = 0;
+        std::array<uint64_t, kRateSamples> rate_samples_{};
+        size_t rate_index_ = 0;
+        std::atomic<uint64_t> instantaneous_ops_{ 0 };
+    };
+
+    // One command that ran for at least the slow log threshold
+    struct SlowLogEntry {
+        uint64_t id = 0;
+        int64_t time = 0;         // Unix seconds at completion
+        uint64_t duration_us = 0;
+        std::vector<std::string> args;  // Shortened like Redis' SLOWLOG
+        std::string client_address;
+        std::string client_name;
+    };
+
+    // The most recent slow commands. Commands only reach it when they
+    // exceeded the threshold, so the lock is off the normal request path.
+    // Only timed calls are checked: every call of a command that is not
+    // flagged fast, and every call at all while the threshold is 0; fast
+    // commands are otherwise sampled (see Metrics).
+    class SlowLog {
+    public:
+        static constexpr size_t kMaxArgs = 32;
+        static constexpr size_t kMaxArgLength = 128;
+
+        // A negative threshold disables the log; 0 logs every command
+        SlowLog(int64_t threshold_us, size_t max_length);
+
+        bool is_slow(uint64_t duration_us) const {
+            int64_t threshold = threshold_us_.load(std::memory_order_relaxed);
+            return threshold >= 0 && duration_us >= static_cast<uint64_t>(threshold);
+        }
+
+        void add(const std::vector<std::string_view>& args, uint64_t duration_us,
+            std::string client_address, std::string client_name);
+
+        // The newest `count` entries, newest first
+        std::vector<SlowLogEntry> get(size_t count) const;
+        size_t length() const;
+        void reset();
+
+        int64_t threshold_us() const { return threshold_us_.load(std::memory_order_relaxed); }
+        void set_threshold_us(int64_t threshold) { threshold_us_.store(threshold, std::memory_order_relaxed); }
+        size_t max_length() const { return max_length_.load(std::memory_order_relaxed); }
+        void set_max_length(size_t length);
+
+    private:
+        std::atomic<int64_t> threshold_us_;
+        std::atomic<size_t> max_length_;
+        mutable std::mutex mutex_;
+        std::deque<SlowLogEntry> entries_;  // Newest first
+        uint64_t next_id_ = 0;
+    };
+
+} // namespace blitzdb
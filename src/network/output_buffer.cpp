@@ -0,0 +1,48 @@
+#include "output_buffer.h"
+#include <utility>
+
+namespace blitzdb {
+
+    void OutputBuffer::bulk(ValueHandle&& value) {
+        if (!value.shared()) {
+            bulk(value.view());
+            return;
+        }
+        resp::append_bulk_header(text_, value.size());
+        value_bytes_ += value.size();
+        values_.push_back(StoredValue{ text_.size(), std::move(value) });
+        text_.append("\r\n", 2);
+    }
+
+    void OutputBuffer::raw(ValueHandle&& encoded) {
+        if (!encoded.shared()) {
+            raw(encoded.view());
+            return;
+        }
+        value_bytes_ += encoded.size();
+        values_.push_back(StoredValue{ text_.size(), std::move(encoded) });
+    }
+
+    void OutputBuffer::append(OutputBuffer&& other) {
+        size_t base = text_.size();
+        text_.append(other.text_);
+        for (StoredValue& value : other.values_) {
+            values_.push_back(StoredValue{ base + value.offset, std::move(value.handle) });
+        }
+        value_bytes_ += other.value_bytes_;
+        other.clear();
+    }
+
+    void OutputBuffer::swap(OutputBuffer& other) noexcept {
+        text_.swap(other.text_);
+        values_.swap(other.values_);
+        std::swap(value_bytes_, other.value_bytes_);
+    }
+
+    void OutputBuffer::clear() {
+        text_.clear();
+        values_.clear();
+        value_bytes_ = 0;
+    }
+
+} // namespace blitzdb
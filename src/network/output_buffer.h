@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../core/data_types/value.h"
+#include "protocols/resp.h"
+
+namespace blitzdb {
+
+    // Replies queued for one connection. The text and the value list keep
+    // their capacity when cleared, so a connection that has reached its
+    // working size encodes replies without allocating. Large stored values
+    // are not copied: the buffer keeps a handle and the bytes go out in
+    // place, right after the first `offset` bytes of the text, through a
+    // gather write.
+    class OutputBuffer {
+    public:
+        struct StoredValue {
+            size_t offset;
+            ValueHandle handle;
+        };
+
+        void raw(std::string_view encoded) { text_.append(encoded); }
+        // Encoded reply bytes shared with other buffers (Pub/Sub messages),
+        // written in place like stored values
+        void raw(ValueHandle&& encoded);
+        void simple(std::string_view text) { resp::append_simple(text_, text); }
+        void error(std::string_view message) { resp::append_error(text_, message); }
+        void integer(long long value) { resp::append_integer(text_, value); }
+        void bulk(std::string_view value) { resp::append_bulk(text_, value); }
+        void bulk(ValueHandle&& value);
+        void null() { text_.append(resp::replies::kNull); }
+        void array(size_t count) { resp::append_array_header(text_, count); }
+
+        // Moves everything queued in `other` to the end of this buffer
+        void append(OutputBuffer&& other);
+
+        void swap(OutputBuffer& other) noexcept;
+        void clear();
+
+        bool empty() const { return text_.empty() && values_.empty(); }
+        // Bytes a write of this buffer sends
+        size_t size() const { return text_.size() + value_bytes_; }
+
+        const std::string& text() const { return text_; }
+        const std::vector<StoredValue>& values() const { return values_; }
+
+    private:
+        std::string text_;
+        std::vector<StoredValue> values_;
+        size_t value_bytes_ = 0;
+    };
+
+} // namespace blitzdb
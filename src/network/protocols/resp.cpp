@@ -0,0 +1,408 @@
+#include "resp.h"
+#include <cstring>
+
+namespace blitzdb::resp {
+
+    namespace {
+
+        // Finds the "\r\n" terminating the line that starts at `from`
+        size_t find_crlf(std::string_view data, size_t from) {
+            while (from < data.size()) {
+                const void* cr = std::memchr(data.data() + from, '\r', data.size() - from);
+                if (!cr) {
+                    return std::string_view::npos;
+                }
+                size_t at = static_cast<size_t>(static_cast<const char*>(cr) - data.data());
+                if (at + 1 >= data.size()) {
+                    return std::string_view::npos;
+                }
+                if (data[at + 1] == '\n') {
+                    return at;
+                }
+                from = at + 1;
+            }
+            return std::string_view::npos;
+        }
+
+        bool is_inline_space(char c) {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+
+        constexpr char kDigitPairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+        // "<n>\r\n" for every n below kSharedIntegers, in fixed-size slots
+        struct SharedIntegerTable {
+            static constexpr size_t kSlot = 8;
+            char text[kSharedIntegers * kSlot] = {};
+            uint8_t length[kSharedIntegers] = {};
+        };
+
+        constexpr SharedIntegerTable build_shared_integers() {
+            SharedIntegerTable table;
+            for (long long n = 0; n < kSharedIntegers; ++n) {
+                char digits[8] = {};
+                size_t count = 0;
+                long long rest = n;
+                do {
+                    digits[count++] = static_cast<char>('0' + rest % 10);
+                    rest /= 10;
+                } while (rest > 0);
+                char* slot = table.text + n * SharedIntegerTable::kSlot;
+                for (size_t i = 0; i < count; ++i) {
+                    slot[i] = digits[count - 1 - i];
+                }
+                slot[count] = '\r';
+                slot[count + 1] = '\n';
+                table.length[n] = static_cast<uint8_t>(count + 2);
+            }
+            return table;
+        }
+
+        constexpr SharedIntegerTable kSharedIntegerTable = build_shared_integers();
+
+        // `prefix`, then `value` and CRLF
+        void append_number_line(std::string& out, char prefix, long long value) {
+            out.push_back(prefix);
+            if (value >= 0 && value < kSharedIntegers) {
+                out.append(kSharedIntegerTable.text + value * SharedIntegerTable::kSlot,
+                    kSharedIntegerTable.length[value]);
+                return;
+            }
+            char digits[kMaxIntegerLength + 2];
+            size_t length = format_integer(value, digits);
+            digits[length] = '\r';
+            digits[length + 1] = '\n';
+            out.append(digits, length + 2);
+        }
+
+    } // namespace
+
+    bool read_integer_line(std::string_view data, size_t& pos, long long& value, bool& ok) {
+        size_t end = find_crlf(data, pos);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+
+        ok = false;
+        size_t i = pos;
+        bool negative = false;
+        if (i < end && data[i] == '-') {
+            negative = true;
+            ++i;
+        }
+
+        if (i < end) {
+            unsigned long long magnitude = 0;
+            ok = true;
+            for (; i < end; ++i) {
+                char c = data[i];
+                if (c < '0' || c > '9' || magnitude > (~0ULL - 9) / 10) {
+                    ok = false;
+                    break;
+                }
+                magnitude = magnitude * 10 + static_cast<unsigned>(c - '0');
+            }
+            constexpr unsigned long long kMax = static_cast<unsigned long long>(INT64_MAX);
+            if (ok && magnitude > kMax + (negative ? 1 : 0)) {
+                ok = false;
+            }
+            if (ok) {
+                value = negative ? static_cast<long long>(0 - magnitude) : static_cast<long long>(magnitude);
+            }
+        }
+
+        pos = end + 2;
+        return true;
+    }
+
+    void RequestParser::reset() {
+        state_ = State::Start;
+        pos_ = 0;
+        remaining_ = 0;
+        bulk_length_ = 0;
+        spans_.clear();
+        error_.clear();
+    }
+
+    ParseStatus RequestParser::fail(const char* message) {
+        std::string error = std::string("Protocol error: ") + message;
+        reset();
+        error_ = std::move(error);
+        return ParseStatus::Error;
+    }
+
+    ParseStatus RequestParser::parse(std::string_view data, size_t& consumed,
+        std::vector<std::string_view>& args) {
+        if (state_ == State::Start) {
+            if (data.empty()) {
+                return ParseStatus::Incomplete;
+            }
+            if (data[0] != '*') {
+                return parse_inline(data, consumed, args);
+            }
+
+            size_t pos = 1;
+            long long count = 0;
+            bool ok = false;
+            if (!read_integer_line(data, pos, count, ok)) {
+                if (data.size() > kMaxInlineLength) {
+                    return fail("too big mbulk count string");
+                }
+                return ParseStatus::Incomplete;
+            }
+            if (!ok || count > kMaxMultibulkLength) {
+                return fail("invalid multibulk length");
+            }
+            if (count <= 0) {
+                // "*0" and "*-1" are valid no-ops
+                args.clear();
+                consumed = pos;
+                return ParseStatus::Complete;
+            }
+
+            spans_.clear();
+            spans_.reserve(static_cast<size_t>(count < 1024 ? count : 1024));
+            remaining_ = count;
+            pos_ = pos;
+            state_ = State::BulkHeader;
+        }
+
+        while (true) {
+            if (state_ == State::BulkHeader) {
+                if (pos_ >= data.size()) {
+                    return ParseStatus::Incomplete;
+                }
+                if (data[pos_] != '$') {
+                    return fail("expected '$'");
+                }
+                size_t pos = pos_ + 1;
+                long long length = 0;
+                bool ok = false;
+                if (!read_integer_line(data, pos, length, ok)) {
+                    if (data.size() - pos_ > kMaxInlineLength) {
+                        return fail("too big bulk count string");
+                    }
+                    return ParseStatus::Incomplete;
+                }
+                if (!ok || length < 0 || length > kMaxBulkLength) {
+                    return fail("invalid bulk length");
+                }
+                bulk_length_ = length;
+                pos_ = pos;
+                state_ = State::BulkData;
+            }
+
+            // State::BulkData
+            size_t length = static_cast<size_t>(bulk_length_);
+            if (data.size() - pos_ < length + 2) {
+                return ParseStatus::Incomplete;
+            }
+            if (data[pos_ + length] != '\r' || data[pos_ + length + 1] != '\n') {
+                return fail("bulk string not terminated by CRLF");
+            }
+            spans_.push_back({ pos_, length });
+            pos_ += length + 2;
+
+            if (--remaining_ == 0) {
+                args.clear();
+                for (const Span& span : spans_) {
+                    args.emplace_back(data.data() + span.offset, span.length);
+                }
+                consumed = pos_;
+                state_ = State::Start;
+                pos_ = 0;
+                spans_.clear();
+                return ParseStatus::Complete;
+            }
+            state_ = State::BulkHeader;
+        }
+    }
+
+    ParseStatus RequestParser::parse_inline(std::string_view data, size_t& consumed,
+        std::vector<std::string_view>& args) {
+        // pos_ remembers how far we already looked for the newline
+        const void* nl = std::memchr(data.data() + pos_, '\n', data.size() - pos_);
+        if (!nl) {
+            if (data.size() > kMaxInlineLength) {
+                return fail("too big inline request");
+            }
+            pos_ = data.size();
+            return ParseStatus::Incomplete;
+        }
+
+        size_t end = static_cast<size_t>(static_cast<const char*>(nl) - data.data());
+        std::string_view line = data.substr(0, end);
+        pos_ = 0;
+
+        // Split on whitespace. Quoted arguments are kept verbatim (no escape
+        // processing) so they can still be returned as views.
+        args.clear();
+        size_t i = 0;
+        while (i < line.size()) {
+            while (i < line.size() && is_inline_space(line[i])) {
+                ++i;
+            }
+            if (i == line.size()) {
+                break;
+            }
+            if (line[i] == '"' || line[i] == '\'') {
+                char quote = line[i];
+                size_t close = line.find(quote, i + 1);
+                if (close == std::string_view::npos ||
+                    (close + 1 < line.size() && !is_inline_space(line[close + 1]))) {
+                    args.clear();
+                    return fail("unbalanced quotes in request");
+                }
+                args.push_back(line.substr(i + 1, close - i - 1));
+                i = close + 1;
+            }
+            else {
+                size_t start = i;
+                while (i < line.size() && !is_inline_space(line[i])) {
+                    ++i;
+                }
+                args.push_back(line.substr(start, i - start));
+            }
+        }
+
+        consumed = end + 1;
+        return ParseStatus::Complete;
+    }
+
+    ParseStatus scan_reply(std::string_view data, size_t& consumed) {
+        size_t pos = 0;
+        long long pending = 1;  // Values still to read, aggregates add their children
+
+        while (pending > 0) {
+            if (pos >= data.size()) {
+                return ParseStatus::Incomplete;
+            }
+            char type = data[pos];
+            size_t line = pos + 1;
+
+            switch (type) {
+            case '+': case '-': case ':': case ',': case '#': case '(': case '_': {
+                size_t end = find_crlf(data, line);
+                if (end == std::string_view::npos) {
+                    return ParseStatus::Incomplete;
+                }
+                pos = end + 2;
+                break;
+            }
+            case '$': case '!': case '=': {
+                long long length = 0;
+                bool ok = false;
+                if (!read_integer_line(data, line, length, ok)) {
+                    return ParseStatus::Incomplete;
+                }
+                if (!ok || length < -1 || length > kMaxBulkLength) {
+                    return ParseStatus::Error;
+                }
+                pos = line;
+                if (length >= 0) {
+                    size_t size = static_cast<size_t>(length);
+                    if (data.size() - pos < size + 2) {
+                        return ParseStatus::Incomplete;
+                    }
+                    pos += size + 2;
+                }
+                break;
+            }
+            case '*': case '~': case '>': case '%': case '|': {
+                long long count = 0;
+                bool ok = false;
+                if (!read_integer_line(data, line, count, ok)) {
+                    return ParseStatus::Incomplete;
+                }
+                if (!ok || count < -1 || count > kMaxMultibulkLength) {
+                    return ParseStatus::Error;
+                }
+                pos = line;
+                if (count > 0) {
+                    // Maps carry key/value pairs; an attribute is followed
+                    // by the value it annotates.
+                    if (type == '%' || type == '|') {
+                        count *= 2;
+                    }
+                    pending += count;
+                }
+                if (type == '|') {
+                    ++pending;
+                }
+                break;
+            }
+            default:
+                return ParseStatus::Error;
+            }
+            --pending;
+        }
+
+        consumed = pos;
+        return ParseStatus::Complete;
+    }
+
+    size_t format_integer(long long value, char* out) {
+        // Negate in unsigned arithmetic so LLONG_MIN works too
+        unsigned long long magnitude = static_cast<unsigned long long>(value);
+        size_t sign = 0;
+        if (value < 0) {
+            magnitude = 0 - magnitude;
+            out[0] = '-';
+            sign = 1;
+        }
+
+        char digits[kMaxIntegerLength];
+        size_t pos = sizeof(digits);
+        while (magnitude >= 100) {
+            size_t pair = static_cast<size_t>(magnitude % 100) * 2;
+            magnitude /= 100;
+            digits[--pos] = kDigitPairs[pair + 1];
+            digits[--pos] = kDigitPairs[pair];
+        }
+        if (magnitude >= 10) {
+            size_t pair = static_cast<size_t>(magnitude) * 2;
+            digits[--pos] = kDigitPairs[pair + 1];
+            digits[--pos] = kDigitPairs[pair];
+        }
+        else {
+            digits[--pos] = static_cast<char>('0' + magnitude);
+        }
+        size_t count = sizeof(digits) - pos;
+        std::memcpy(out + sign, digits + pos, count);
+        return sign + count;
+    }
+
+    void append_simple(std::string& out, std::string_view text) {
+        out.push_back('+');
+        out.append(text);
+        out.append("\r\n", 2);
+    }
+
+    void append_error(std::string& out, std::string_view message) {
+        out.push_back('-');
+        out.append(message);
+        out.append("\r\n", 2);
+    }
+
+    void append_integer(std::string& out, long long value) {
+        append_number_line(out, ':', value);
+    }
+
+    void append_bulk_header(std::string& out, size_t length) {
+        append_number_line(out, '$', static_cast<long long>(length));
+    }
+
+    void append_bulk(std::string& out, std::string_view value) {
+        append_bulk_header(out, value.size());
+        out.append(value);
+        out.append("\r\n", 2);
+    }
+
+    void append_array_header(std::string& out, size_t count) {
+        append_number_line(out, '*', static_cast<long long>(count));
+    }
+
+} // namespace blitzdb::resp
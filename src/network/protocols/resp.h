@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace blitzdb::resp {
+
+    // Protocol limits (same defaults as Redis)
+    constexpr long long kMaxMultibulkLength = 1024 * 1024;
+    constexpr long long kMaxBulkLength = 512LL * 1024 * 1024;
+    constexpr size_t kMaxInlineLength = 64 * 1024;
+
+    enum class ParseStatus {
+        Complete,    // A full command is available in the args vector
+        Incomplete,  // Need more bytes; call again once more data arrived
+        Error        // Protocol error; the connection should be closed
+    };
+
+    // Incremental request parser for RESP2/RESP3 multibulk and inline commands.
+    //
+    // The parser never copies argument bytes. Arguments are returned as
+    // string_views into the caller's buffer, so the buffer must stay untouched
+    // until the command has been executed. Between calls that return
+    // Incomplete the caller may move or grow the buffer, as long as the
+    // unconsumed bytes stay contiguous and start at the same position it
+    // passes back in: all parser state is kept as offsets relative to the
+    // start of the pending command, so already scanned bytes are not
+    // re-parsed when more data arrives.
+    class RequestParser {
+    public:
+        // Parses at most one command from `data`. On Complete, `consumed` is
+        // the size of the command in bytes and `args` holds its arguments.
+        ParseStatus parse(std::string_view data, size_t& consumed,
+            std::vector<std::string_view>& args);
+
+        // Drops any partially parsed command
+        void reset();
+
+        const std::string& error() const { return error_; }
+
+    private:
+        enum class State {
+            Start,        // Waiting for the first byte of a command
+            BulkHeader,   // Waiting for "$<len>\r\n"
+            BulkData,     // Waiting for <len> bytes plus CRLF
+        };
+
+        struct Span {
+            size_t offset;
+            size_t length;
+        };
+
+        ParseStatus parse_inline(std::string_view data, size_t& consumed,
+            std::vector<std::string_view>& args);
+        ParseStatus fail(const char* message);
+
+        State state_ = State::Start;
+        size_t pos_ = 0;             // Scan position relative to the command start
+        long long remaining_ = 0;    // Bulk strings still expected
+        long long bulk_length_ = 0;  // Length of the bulk string being read
+        std::vector<Span> spans_;
+        std::string error_;
+    };
+
+    // Reads "<digits>\r\n" starting at `pos`. Returns false with `pos`
+    // untouched when the line is not complete yet; `ok` reports whether the
+    // line held a valid signed 64-bit integer.
+    bool read_integer_line(std::string_view data, size_t& pos, long long& value, bool& ok);
+
+    // Validates one complete RESP2/RESP3 reply frame (any type, nested
+    // aggregates included) and reports its size without materializing it.
+    // Used by clients of the protocol such as replicas and load generators.
+    ParseStatus scan_reply(std::string_view data, size_t& consumed);
+
+    // Replies that never change, encoded once
+    namespace replies {
+        constexpr std::string_view kOk = "+OK\r\n";
+        constexpr std::string_view kPong = "+PONG\r\n";
+        constexpr std::string_view kNull = "$-1\r\n";
+        constexpr std::string_view kZero = ":0\r\n";
+        constexpr std::string_view kOne = ":1\r\n";
+        constexpr std::string_view kEmptyArray = "*0\r\n";
+    }
+
+    // Longest text format_integer() produces
+    constexpr size_t kMaxIntegerLength = 20;
+
+    // Writes the decimal form of `value` to `out`, two digits per step;
+    // returns the number of characters
+    size_t format_integer(long long value, char* out);
+
+    // Reply encoders. They append to a buffer the caller reuses, so once it
+    // has grown to its working size encoding allocates nothing. Integers
+    // and lengths below kSharedIntegers are copied from a precomputed table.
+    constexpr long long kSharedIntegers = 10000;
+
+    void append_simple(std::string& out, std::string_view text);
+    void append_error(std::string& out, std::string_view message);  // Without the leading '-'
+    void append_integer(std::string& out, long long value);
+    void append_bulk_header(std::string& out, size_t length);
+    void append_bulk(std::string& out, std::string_view value);
+    void append_array_header(std::string& out, size_t count);
+
+} // namespace blitzdb::resp
@@ -0,0 +1,245 @@
+#include "pubsub.h"
+#include "protocols/resp.h"
+#include <algorithm>
+
+namespace blitzdb {
+
+    namespace {
+
+        // Matches `c` against the pattern element at `p`: ?, a class, a
+        // quoted or a plain character. `next` is set past the element.
+        bool match_element(std::string_view pattern, size_t p, char c, size_t& next) {
+            if (pattern[p] == '?') {
+                next = p + 1;
+                return true;
+            }
+            if (pattern[p] == '\\' && p + 1 < pattern.size()) {
+                next = p + 2;
+                return pattern[p + 1] == c;
+            }
+            if (pattern[p] != '[') {
+                next = p + 1;
+                return pattern[p] == c;
+            }
+
+            size_t i = p + 1;
+            bool negate = i < pattern.size() && pattern[i] == '^';
+            if (negate) {
+                ++i;
+            }
+            auto byte = [](char x) { return static_cast<unsigned char>(x); };
+            bool matched = false;
+            while (i < pattern.size() && pattern[i] != ']') {
+                if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+                    matched = matched || pattern[i + 1] == c;
+                    i += 2;
+                }
+                else if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                    unsigned char low = std::min(byte(pattern[i]), byte(pattern[i + 2]));
+                    unsigned char high = std::max(byte(pattern[i]), byte(pattern[i + 2]));
+                    matched = matched || (byte(c) >= low && byte(c) <= high);
+                    i += 3;
+                }
+                else {
+                    matched = matched || pattern[i] == c;
+                    ++i;
+                }
+            }
+            // An unterminated class runs to the end of the pattern
+            next = i < pattern.size() ? i + 1 : i;
+            return matched != negate;
+        }
+
+        // Where a pattern's first wildcard (or quoted character) is
+        size_t literal_prefix(std::string_view pattern) {
+            size_t end = pattern.find_first_of("*?[\\");
+            return end == std::string_view::npos ? pattern.size() : end;
+        }
+
+        bool remove_subscriber(std::vector<PubSub::Subscriber>& subscribers, const Connection& subscriber) {
+            auto found = std::find_if(subscribers.begin(), subscribers.end(),
+                [&subscriber](const PubSub::Subscriber& entry) { return entry.get() == &subscriber; });
+            if (found == subscribers.end()) {
+                return false;
+            }
+            *found = std::move(subscribers.back());
+            subscribers.pop_back();
+            return true;
+        }
+
+    } // namespace
+
+    bool glob_match(std::string_view pattern, std::string_view text) {
+        // On a mismatch, the last * seen takes one more character
+        size_t p = 0;
+        size_t t = 0;
+        size_t star = std::string_view::npos;
+        size_t star_text = 0;
+        while (t < text.size()) {
+            size_t next = 0;
+            if (p < pattern.size() && pattern[p] == '*') {
+                star = ++p;
+                star_text = t;
+            }
+            else if (p < pattern.size() && match_element(pattern, p, text[t], next)) {
+                p = next;
+                ++t;
+            }
+            else if (star != std::string_view::npos) {
+                p = star;
+                t = ++star_text;
+            }
+            else {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '*') {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+
+    bool PubSub::subscribe(const Subscriber& subscriber, std::string_view channel) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto found = channels_.find(channel);
+        if (found == channels_.end()) {
+            found = channels_.emplace(std::string(channel), std::vector<Subscriber>()).first;
+        }
+        else if (std::any_of(found->second.begin(), found->second.end(),
+            [&subscriber](const Subscriber& entry) { return entry == subscriber; })) {
+            return false;
+        }
+        found->second.push_back(subscriber);
+        return true;
+    }
+
+    bool PubSub::unsubscribe(const Connection& subscriber, std::string_view channel) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto found = channels_.find(channel);
+        if (found == channels_.end() || !remove_subscriber(found->second, subscriber)) {
+            return false;
+        }
+        if (found->second.empty()) {
+            channels_.erase(found);
+        }
+        return true;
+    }
+
+    bool PubSub::psubscribe(const Subscriber& subscriber, std::string_view pattern) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto found = patterns_.find(pattern);
+        if (found == patterns_.end()) {
+            found = patterns_.emplace(std::string(pattern), std::make_unique<Pattern>()).first;
+            Pattern& entry = *found->second;
+            entry.text = std::string(pattern);
+            entry.prefix = literal_prefix(pattern);
+            index_pattern(entry);
+        }
+        else if (std::any_of(found->second->subscribers.begin(), found->second->subscribers.end(),
+            [&subscriber](const Subscriber& entry) { return entry == subscriber; })) {
+            return false;
+        }
+        found->second->subscribers.push_back(subscriber);
+        return true;
+    }
+
+    bool PubSub::punsubscribe(const Connection& subscriber, std::string_view pattern) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto found = patterns_.find(pattern);
+        if (found == patterns_.end() || !remove_subscriber(found->second->subscribers, subscriber)) {
+            return false;
+        }
+        if (found->second->subscribers.empty()) {
+            unindex_pattern(*found->second);
+            patterns_.erase(found);
+        }
+        return true;
+    }
+
+    void PubSub::index_pattern(const Pattern& pattern) {
+        Node* node = &root_;
+        for (size_t i = 0; i < pattern.prefix; ++i) {
+            char c = pattern.text[i];
+            auto child = std::find_if(node->children.begin(), node->children.end(),
+                [c](const auto& entry) { return entry.first == c; });
+            if (child == node->children.end()) {
+                node->children.emplace_back(c, std::make_unique<Node>());
+                child = node->children.end() - 1;
+            }
+            node = child->second.get();
+        }
+        node->patterns.push_back(&pattern);
+    }
+
+    void PubSub::unindex_pattern(const Pattern& pattern) {
+        // The nodes along the prefix, so the branch can be pruned bottom-up
+        std::vector<Node*> path{ &root_ };
+        for (size_t i = 0; i < pattern.prefix; ++i) {
+            path.push_back(const_cast<Node*>(path.back()->child(pattern.text[i])));
+        }
+        std::vector<const Pattern*>& patterns = path.back()->patterns;
+        patterns.erase(std::find(patterns.begin(), patterns.end(), &pattern));
+
+        for (size_t depth = pattern.prefix; depth > 0; --depth) {
+            Node* node = path[depth];
+            if (!node->patterns.empty() || !node->children.empty()) {
+                break;
+            }
+            auto& siblings = path[depth - 1]->children;
+            siblings.erase(std::find_if(siblings.begin(), siblings.end(),
+                [node](const auto& entry) { return entry.second.get() == node; }));
+        }
+    }
+
+    SharedString* PubSub::encode_message(std::string_view channel, std::string_view message) {
+        // *3 message <channel> <message>
+        std::string head;
+        resp::append_array_header(head, 3);
+        resp::append_bulk(head, "message");
+        resp::append_bulk(head, channel);
+        resp::append_bulk_header(head, message.size());
+        const std::string_view parts[] = { head, message, "\r\n" };
+        return SharedString::create(parts);
+    }
+
+    SharedString* PubSub::encode_pmessage(std::string_view pattern, std::string_view channel,
+        std::string_view message) {
+        // *4 pmessage <pattern> <channel> <message>
+        std::string head;
+        resp::append_array_header(head, 4);
+        resp::append_bulk(head, "pmessage");
+        resp::append_bulk(head, pattern);
+        resp::append_bulk(head, channel);
+        resp::append_bulk_header(head, message.size());
+        const std::string_view parts[] = { head, message, "\r\n" };
+        return SharedString::create(parts);
+    }
+
+    std::vector<std::string> PubSub::channels(std::string_view pattern) const {
+        std::vector<std::string> names;
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& [name, subscribers] : channels_) {
+            if (pattern.empty() || glob_match(pattern, name)) {
+                names.push_back(name);
+            }
+        }
+        return names;
+    }
+
+    size_t PubSub::subscribers(std::string_view channel) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto found = channels_.find(channel);
+        return found == channels_.end() ? 0 : found->second.size();
+    }
+
+    size_t PubSub::channel_count() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return channels_.size();
+    }
+
+    size_t PubSub::pattern_count() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return patterns_.size();
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../core/data_types/shared_string.h"
+#include "../core/storage/in_memory.h"
+
+namespace blitzdb {
+
+    class Connection;
+
+    // Glob-style match of the whole of `text`: * and ? wildcards, [abc],
+    // [^abc] and [a-z] classes, and \ quoting the next character
+    bool glob_match(std::string_view pattern, std::string_view text);
+
+    // Channel and pattern subscriptions of every connection. A published
+    // message is encoded once, as the push reply subscribers receive, into
+    // a reference-counted buffer that is handed to each of them: fan-out
+    // costs a reference per subscriber, not a copy.
+    //
+    // Patterns are indexed in a trie by their literal prefix (what comes
+    // before the first wildcard). A channel walks the trie along its own
+    // characters, so only the patterns whose prefix it starts with are
+    // matched against it.
+    //
+    // Publishers take the lock shared and run in parallel; subscribing and
+    // unsubscribing take it exclusively. Connections keep their own list
+    // of subscriptions and must drop them all before they go away.
+    class PubSub {
+    public:
+        using Subscriber = std::shared_ptr<Connection>;
+
+        PubSub() = default;
+        PubSub(const PubSub&) = delete;
+        PubSub& operator=(const PubSub&) = delete;
+
+        // Each returns false when the subscription already was (or was not)
+        // in place
+        bool subscribe(const Subscriber& subscriber, std::string_view channel);
+        bool unsubscribe(const Connection& subscriber, std::string_view channel);
+        bool psubscribe(const Subscriber& subscriber, std::string_view pattern);
+        bool punsubscribe(const Connection& subscriber, std::string_view pattern);
+
+        // Calls deliver(subscriber, message) for each subscriber of
+        // `channel` and each subscription to a pattern matching it, where
+        // `message` is the encoded push reply; returns the number of calls.
+        // `deliver` runs under the lock and must take its own reference to
+        // keep the message.
+        template <typename Deliver>
+        size_t publish(std::string_view channel, std::string_view message, Deliver&& deliver) const {
+            size_t receivers = 0;
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto found = channels_.find(channel);
+            if (found != channels_.end()) {
+                Encoded encoded(encode_message(channel, message));
+                for (const Subscriber& subscriber : found->second) {
+                    deliver(subscriber, *encoded);
+                }
+                receivers += found->second.size();
+            }
+            for_each_match(channel, [&](const Pattern& pattern) {
+                Encoded encoded(encode_pmessage(pattern.text, channel, message));
+                for (const Subscriber& subscriber : pattern.subscribers) {
+                    deliver(subscriber, *encoded);
+                }
+                receivers += pattern.subscribers.size();
+            });
+            return receivers;
+        }
+
+        // PUBSUB: channels with subscribers (matching `pattern` unless it
+        // is empty), subscribers of one channel, and subscribed patterns
+        std::vector<std::string> channels(std::string_view pattern) const;
+        size_t subscribers(std::string_view channel) const;
+        size_t channel_count() const;
+        size_t pattern_count() const;
+
+    private:
+        struct Release {
+            void operator()(SharedString* shared) const noexcept { shared->release(); }
+        };
+        using Encoded = std::unique_ptr<SharedString, Release>;
+
+        struct Pattern {
+            std::string text;
+            size_t prefix = 0;  // Length of the literal prefix
+            std::vector<Subscriber> subscribers;
+        };
+
+        // One character of a literal prefix; the patterns whose prefix
+        // ends here are checked against the rest of the channel
+        struct Node {
+            std::vector<std::pair<char, std::unique_ptr<Node>>> children;
+            std::vector<const Pattern*> patterns;
+
+            const Node* child(char c) const {
+                for (const auto& [key, node] : children) {
+                    if (key == c) {
+                        return node.get();
+                    }
+                }
+                return nullptr;
+            }
+        };
+
+        static SharedString* encode_message(std::string_view channel, std::string_view message);
+        static SharedString* encode_pmessage(std::string_view pattern, std::string_view channel,
+            std::string_view message);
+
+        template <typename Fn>
+        void for_each_match(std::string_view channel, Fn&& fn) const {
+            const Node* node = &root_;
+            for (size_t depth = 0; node; ++depth) {
+                for (const Pattern* pattern : node->patterns) {
+                    if (glob_match(std::string_view(pattern->text).substr(pattern->prefix), channel.substr(depth))) {
+                        fn(*pattern);
+                    }
+                }
+                node = depth < channel.size() ? node->child(channel[depth]) : nullptr;
+            }
+        }
+
+        void index_pattern(const Pattern& pattern);
+        void unindex_pattern(const Pattern& pattern);
+
+        mutable std::shared_mutex mutex_;
+        std::unordered_map<std::string, std::vector<Subscriber>, StringHash, std::equal_to<>> channels_;
+        std::unordered_map<std::string, std::unique_ptr<Pattern>, StringHash, std::equal_to<>> patterns_;
+        Node root_;
+    };
+
+} // namespace blitzdb
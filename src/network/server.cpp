@@ -1,313 +1,2361 @@
 #include "server.h"
-#include <iostream>
+#include "../core/utils/allocator.h"
+#include "../core/utils/bytes.h"
+#include "../core/utils/logger.h"
 #include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <span>
 #include <sstream>
-#include <unordered_map>
+#include <stdexcept>
 #include <unordered_set>
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+#if defined(BLITZDB_HAS_IO_URING)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 namespace blitzdb {
 
-    const std::unordered_map<std::string, Command> Server::command_map = {
-        {"PING", Command::PING},
-        {"SET", Command::SET},
-        {"GET", Command::GET},
-        {"DEL", Command::DEL},
-        {"QUIT", Command::QUIT},
-        {"AUTH", Command::AUTH},
-    };
+    // Every command the server knows. The arity counts the command name;
+    // a negative arity is a minimum. Names are found through a perfect
+    // hash built at compile time, so a lookup hashes the name once and
+    // compares it with a single entry.
+    struct CommandTable {
+        static constexpr uint32_t kRead = kCommandReadOnly | kCommandFast;
+        static constexpr uint32_t kUpdate = kCommandWrite | kCommandFast;
+        static constexpr KeySpec kOneKey{ 1, 1, 1 };
+        static constexpr KeySpec kAllKeys{ 1, -1, 1 };
+        static constexpr KeySpec kKeyValuePairs{ 1, -1, 2 };
+
+        static constexpr CommandInfo commands[] = {
+            // Connection and server
+            { "ping", 1, kCommandFast | kCommandNoAuth, {}, &Server::ping_command },
+            { "quit", 1, kCommandFast | kCommandNoAuth, {}, &Server::quit_command },
+            { "auth", 2, kCommandFast | kCommandNoAuth, {}, &Server::auth_command },
+            { "select", 2, kCommandFast, {}, &Server::select_command },
+            { "client", -2, 0, {}, &Server::client_command },
+            { "command", -1, 0, {}, &Server::command_command },
+            { "config", -3, kCommandAdmin, {}, &Server::config_command },
+            { "debug", -2, kCommandAdmin, {}, &Server::debug_command },
+            { "flushall", -1, kCommandWrite, {}, &Server::flushall_command },
+            { "flushdb", -1, kCommandWrite, {}, &Server::flushall_command },  // One keyspace
+
+            // Introspection
+            { "info", -1, 0, {}, &Server::info_command },
+            { "latency", -2, kCommandAdmin, {}, &Server::latency_command },
+            { "slowlog", -2, kCommandAdmin, {}, &Server::slowlog_command },
+
+            // Strings and keys. GET and SET have always been allowed before
+            // AUTH; everything else added since requires it.
+            { "get", 2, kRead | kCommandNoAuth, kOneKey, &Server::get_command },
+            { "set", -3, kCommandWrite | kCommandDenyOom | kCommandNoAuth, kOneKey, &Server::set_command },
+            { "del", -2, kCommandWrite, kAllKeys, &Server::del_command },
+            { "unlink", -2, kCommandWrite | kCommandFast, kAllKeys, &Server::unlink_command },
+            { "exists", -2, kRead, kAllKeys, &Server::exists_command },
+            { "mget", -2, kRead, kAllKeys, &Server::mget_command },
+            { "mset", -3, kCommandWrite | kCommandDenyOom, kKeyValuePairs, &Server::mset_command },
+            { "msetnx", -3, kCommandWrite | kCommandDenyOom, kKeyValuePairs, &Server::msetnx_command },
+            { "incr", 2, kUpdate | kCommandDenyOom, kOneKey, &Server::incr_command },
+            { "decr", 2, kUpdate | kCommandDenyOom, kOneKey, &Server::decr_command },
+            { "incrby", 3, kUpdate | kCommandDenyOom, kOneKey, &Server::incrby_command },
+            { "decrby", 3, kUpdate | kCommandDenyOom, kOneKey, &Server::decrby_command },
+            { "incrbyfloat", 3, kUpdate | kCommandDenyOom, kOneKey, &Server::incrbyfloat_command },
+            { "append", 3, kUpdate | kCommandDenyOom, kOneKey, &Server::append_command },
+            { "strlen", 2, kRead, kOneKey, &Server::strlen_command },
+            { "getrange", 4, kCommandReadOnly, kOneKey, &Server::getrange_command },
+            { "setrange", 4, kCommandWrite | kCommandDenyOom, kOneKey, &Server::setrange_command },
+            { "expire", 3, kUpdate, kOneKey, &Server::expire_command },
+            { "pexpire", 3, kUpdate, kOneKey, &Server::pexpire_command },
+            { "expireat", 3, kUpdate, kOneKey, &Server::expireat_command },
+            { "pexpireat", 3, kUpdate, kOneKey, &Server::pexpireat_command },
+            { "ttl", 2, kRead, kOneKey, &Server::ttl_command },
+            { "pttl", 2, kRead, kOneKey, &Server::pttl_command },
+            { "persist", 2, kUpdate, kOneKey, &Server::persist_command },
+
+            // Hashes
+            { "hset", -4, kUpdate | kCommandDenyOom, kOneKey, &Server::hset_command },
+            { "hget", 3, kRead, kOneKey, &Server::hget_command },
+            { "hmget", -3, kRead, kOneKey, &Server::hmget_command },
+            { "hdel", -3, kUpdate, kOneKey, &Server::hdel_command },
+            { "hgetall", 2, kCommandReadOnly, kOneKey, &Server::hgetall_command },
+            { "hincrby", 4, kUpdate | kCommandDenyOom, kOneKey, &Server::hincrby_command },
+            { "hlen", 2, kRead, kOneKey, &Server::hlen_command },
+
+            // Persistence
+            { "bgrewriteaof", 1, kCommandAdmin, {}, &Server::bgrewriteaof_command },
+            { "save", 1, kCommandAdmin, {}, &Server::save_command },
+            { "bgsave", 1, kCommandAdmin, {}, &Server::bgsave_command },
+            { "lastsave", 1, kCommandFast, {}, &Server::lastsave_command },
+
+            // Pub/Sub
+            { "subscribe", -2, kCommandPubSub, {}, &Server::subscribe_command },
+            { "unsubscribe", -1, kCommandPubSub, {}, &Server::unsubscribe_command },
+            { "psubscribe", -2, kCommandPubSub, {}, &Server::psubscribe_command },
+            { "punsubscribe", -1, kCommandPubSub, {}, &Server::punsubscribe_command },
+            { "publish", 3, kCommandPubSub | kCommandFast, {}, &Server::publish_command },
+            { "pubsub", -2, kCommandPubSub, {}, &Server::pubsub_command },
+
+            // Replication
+            { "psync", 3, kCommandAdmin, {}, &Server::psync_command },
+            { "replconf", -2, kCommandAdmin, {}, &Server::replconf_command },
+            { "replicaof", 3, kCommandAdmin, {}, &Server::replicaof_command },
+            { "role", 1, kCommandFast, {}, &Server::role_command },
+        };
 
-    const std::unordered_map<Command, CommandInfo> Server::command_info = {
-        {Command::PING, {Command::PING, 0, 0, false}},
-        {Command::SET, {Command::SET, 2, 2, false}},
-        {Command::GET, {Command::GET, 1, 1, false}},
-        {Command::DEL, {Command::DEL, 1, -1, true}},
-        {Command::QUIT, {Command::QUIT, 0, 0, false}},
-        {Command::AUTH, {Command::AUTH, 1, 1, false}},
+        static constexpr PerfectHash<std::size(commands)> index{ commands };
     };
 
+    namespace {
+
+        ServerConfig config_for_port(unsigned short port) {
+            ServerConfig config;
+            config.port = port;
+            return config;
+        }
+
+        // Every core needs at least one storage shard of its own
+        size_t shards_for(const ServerConfig& config) {
+            if (config.thread_mode == ThreadMode::PerCore) {
+                return std::max(config.storage_shards, config.threads);
+            }
+            return config.storage_shards;
+        }
+
+        // Input an io_uring connection may hold aside while its commands
+        // are held back; beyond it the socket stops receiving
+        [[maybe_unused]] constexpr size_t kMaxHeldInput = 256 * 1024;
+
+        std::string format_address(const asio::ip::tcp::endpoint& endpoint) {
+            std::string address = endpoint.address().to_string();
+            address += ':';
+            address += std::to_string(endpoint.port());
+            return address;
+        }
+
+        void pin_to_core(std::thread& thread, size_t core) {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(core % std::max(1u, std::thread::hardware_concurrency()), &set);
+            pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+            (void)thread;
+            (void)core;
+#endif
+        }
+
+    } // namespace
+
     Server::Server(asio::io_context& io_context, unsigned short port)
-        : acceptor_(io_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)),
-        storage_(), running_(true) {
-        std::cout << "BlitzDB server listening on port " << port << std::endl;
+        : Server(io_context, config_for_port(port)) {
     }
 
-    void Server::start() {
-        if (!running_.load()) return;
+    Server::Server(asio::io_context& io_context, const ServerConfig& config)
+        : config_(config),
+        storage_(shards_for(config)), running_(true), started_ms_(InMemoryStorage::now_ms()),
+        metrics_(std::size(CommandTable::commands)),
+        slowlog_(config.slowlog_log_slower_than, config.slowlog_max_len) {
+        config_.threads = std::max<size_t>(config_.threads, 1);
+        storage_.set_max_memory(config_.max_memory, config_.eviction_policy, config_.eviction_samples);
+        storage_.set_hash_limits(HashLimits{ config_.hash_max_packed_fields, config_.hash_max_packed_length });
+        storage_.set_lazy_free_threshold(config_.lazyfree_threshold);
+        if (config_.append_only) {
+            load_append_only_log();
+            aof_ = std::make_unique<AppendOnlyLog>(config_.append_only_path, config_.append_fsync);
+            storage_.set_change_observer(aof_.get());
+        }
+        else {
+            load_snapshot_file();
+        }
+        snapshots_ = std::make_unique<SnapshotSaver>(storage_, config_.snapshot_path);
+        if (!config_.tiered_path.empty()) {
+            // Started after loading: the mover moves cold values out over time
+            TieredStorage::Options options;
+            options.path = config_.tiered_path;
+            options.capacity = config_.tiered_max_size;
+            options.cold_seconds = config_.tiered_cold_seconds;
+            options.min_value_bytes = config_.tiered_min_value;
+            tiered_ = std::make_unique<TieredStorage>(storage_, options);
+            std::string error;
+            if (!tiered_->start(error)) {
+                throw std::runtime_error("cannot start tiered storage: " + error);
+            }
+        }
+
+        // Changes are only recorded for replicas once the first one attaches
+        primary_ = std::make_unique<ReplicationPrimary>(storage_, config_.repl_backlog_size,
+            config_.repl_output_limit, [this]() {
+                if (aof_) {
+                    change_tee_ = std::make_unique<ChangeTee>(*aof_, *primary_);
+                    storage_.set_change_observer(change_tee_.get());
+                }
+                else {
+                    storage_.set_change_observer(primary_.get());
+                }
+            });
+        contexts_.push_back(&io_context);
+
+        asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), config_.port);
+        if (config_.thread_mode == ThreadMode::PerCore) {
+            for (size_t i = 1; i < config_.threads; ++i) {
+                owned_contexts_.push_back(std::make_unique<asio::io_context>(1));
+                contexts_.push_back(owned_contexts_.back().get());
+                work_guards_.push_back(asio::make_work_guard(*owned_contexts_.back()));
+            }
 
-        auto socket = std::make_shared<asio::ip::tcp::socket>(acceptor_.get_executor());
+#if defined(SO_REUSEPORT)
+            // The kernel spreads incoming connections over one listening
+            // socket per core
+            for (asio::io_context* context : contexts_) {
+                auto acceptor = std::make_unique<asio::ip::tcp::acceptor>(*context);
+                acceptor->open(endpoint.protocol());
+                acceptor->set_option(asio::ip::tcp::acceptor::reuse_address(true));
+                acceptor->set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+                acceptor->bind(endpoint);
+                acceptor->listen();
+                acceptors_.push_back(std::move(acceptor));
+            }
+#endif
+        }
+        if (acceptors_.empty()) {
+            // Single listener; in PerCore mode without SO_REUSEPORT accepted
+            // sockets are handed to the cores round-robin
+            acceptors_.push_back(std::make_unique<asio::ip::tcp::acceptor>(io_context, endpoint));
+        }
+
+        if (config_.io_backend == IoBackend::IoUring) {
+            setup_io_uring();
+        }
+
+        log_info("BlitzDB server listening on port ", config_.port, " (", config_.threads, " thread(s), ",
+            config_.thread_mode == ThreadMode::PerCore ? "per-core" : "pool", " mode, ",
+            config_.io_backend == IoBackend::IoUring ? "io_uring" : "epoll", ")");
+    }
+
+    void Server::setup_io_uring() {
+#if defined(BLITZDB_HAS_IO_URING)
+        if (config_.thread_mode == ThreadMode::Pool && config_.threads > 1) {
+            log_warning("io_uring needs one thread per event loop; using epoll for the thread pool");
+            config_.io_backend = IoBackend::Epoll;
+            return;
+        }
+        UringOptions options;
+        options.busy_poll_us = config_.io_uring_busy_poll_us;
+        try {
+            for (asio::io_context* context : contexts_) {
+                rings_.push_back(std::make_unique<UringLoop>(*context, options));
+            }
+        }
+        catch (const std::system_error& e) {
+            log_warning("io_uring unavailable (", e.what(), "); using epoll");
+            rings_.clear();
+            config_.io_backend = IoBackend::Epoll;
+        }
+#else
+        log_warning("Built without io_uring support (BLITZDB_WITH_IO_URING); using epoll");
+        config_.io_backend = IoBackend::Epoll;
+#endif
+    }
 
-        acceptor_.async_accept(*socket, [this, socket](asio::error_code ec) {
-            if (!ec) {
-                {
-                    std::lock_guard<std::mutex> lock(connections_mutex_);
-                    if (!running_.load()) return;
+    Server::~Server() {
+        // The log and replication go before the keyspace; stop reporting to them
+        storage_.set_change_observer(nullptr);
+    }
 
-                    active_connections_.emplace_back(socket);
+    void Server::load_append_only_log() {
+        LogReader reader(config_.append_only_path);
+        if (!reader.is_open()) {
+            return;  // Nothing logged yet
+        }
 
-                    std::cout << "New connection from: "
-                        << socket->remote_endpoint().address().to_string()
-                        << std::endl;
+        // Stream the log through the request parser, applying each record
+        // as if it came from a trusted client
+        resp::RequestParser parser;
+        std::vector<std::string_view> args;
+        OutputBuffer replies;  // Discarded
+        size_t records = 0;
+        while (true) {
+            size_t consumed = 0;
+            auto status = parser.parse(reader.data(), consumed, args);
+            if (status == resp::ParseStatus::Complete) {
+                if (!args.empty()) {
+                    process_command(nullptr, lookup_command(args[0]), args, replies);
+                    replies.clear();
+                    ++records;
                 }
+                reader.consume(consumed);
+                scratch_arena().reset();
+                continue;
+            }
+            if (status == resp::ParseStatus::Error) {
+                throw std::runtime_error("corrupt append only log " + config_.append_only_path +
+                    " at offset " + std::to_string(reader.offset()) + ": " + parser.error());
+            }
+            if (!reader.fill()) {
+                break;
+            }
+        }
+
+        // A crash can leave half a record at the end; drop it
+        if (!reader.data().empty()) {
+            log_warning("Truncating incomplete record at the end of ", config_.append_only_path,
+                " (offset ", reader.offset(), ")");
+            std::filesystem::resize_file(config_.append_only_path, reader.offset());
+        }
+        log_info("Loaded ", records, " records from ", config_.append_only_path);
+    }
+
+    void Server::load_snapshot_file() {
+        std::error_code ec;
+        if (!std::filesystem::exists(config_.snapshot_path, ec)) {
+            return;
+        }
+        auto started = std::chrono::steady_clock::now();
+        SnapshotStats stats = load_snapshot(storage_, config_.snapshot_path);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started);
+        log_info("Loaded ", stats.keys, " keys (", stats.expired, " expired) from ",
+            config_.snapshot_path, " in ", elapsed.count(), " ms");
+    }
+
+    void Server::start() {
+#if defined(BLITZDB_HAS_IO_URING)
+        if (!rings_.empty()) {
+            // Each listener is served by the ring of the loop it belongs to
+            for (auto& ring : rings_) {
+                ring->start();
+            }
+            for (size_t i = 0; i < acceptors_.size(); ++i) {
+                uring_acceptors_.push_back(std::make_unique<UringAcceptor>(*rings_[i],
+                    acceptors_[i]->native_handle(), [this, i](int fd) { accept_uring(i, fd); }));
+                uring_acceptors_.back()->start();
+            }
+        }
+#endif
+        for (size_t i = 0; i < acceptors_.size() && config_.io_backend == IoBackend::Epoll; ++i) {
+            accept(i);
+        }
+        cron_timer_ = std::make_unique<asio::steady_timer>(*contexts_[0]);
+        schedule_cron();
+        if (!config_.replica_of_host.empty()) {
+            follow(config_.replica_of_host, config_.replica_of_port);
+        }
+    }
+
+    void Server::follow(const std::string& host, unsigned short port) {
+        std::lock_guard<std::mutex> lock(replication_mutex_);
+        ReplicaStatus previous;
+        if (replica_) {
+            replica_->stop();
+            previous = replica_->status();
+            replica_.reset();
+        }
+        // Whatever this server streamed so far is no longer a history
+        // anyone can continue
+        primary_->new_history();
+        following_ = !host.empty();
+        if (host.empty()) {
+            log_info("Stopped following; serving writes as a primary");
+            return;
+        }
+        log_info("Following primary ", host, ":", port);
+        ReplicationSink& sink = *this;
+        replica_ = std::make_shared<ReplicaClient>(*contexts_[0], storage_, sink, host, port,
+            config_.primary_auth, config_.port);
+        // The keyspace is still where the previous link left it; if this is
+        // the same primary it can continue from there
+        if (previous.offset >= 0) {
+            replica_->resume_from(previous.replid, previous.offset);
+        }
+        replica_->start();
+    }
+
+    void Server::reset_stream() {
+        stream_parser_.reset();
+    }
+
+    size_t Server::apply_stream(std::string_view data) {
+        // The stream holds change records, applied like a replayed log
+        size_t applied = 0;
+        while (true) {
+            size_t consumed = 0;
+            auto status = stream_parser_.parse(data.substr(applied), consumed, stream_args_);
+            if (status == resp::ParseStatus::Incomplete) {
+                break;
+            }
+            if (status == resp::ParseStatus::Error) {
+                throw std::runtime_error("malformed replication stream: " + stream_parser_.error());
+            }
+            applied += consumed;
+            if (!stream_args_.empty()) {
+                process_command(nullptr, lookup_command(stream_args_[0]), stream_args_, stream_replies_);
+                stream_replies_.clear();
+            }
+        }
+        scratch_arena().reset();
+        return applied;
+    }
+
+    void Server::full_sync_done(const SnapshotStats&) {
+        // The keyspace was replaced without being logged; rewrite the log
+        // from it so a restart does not bring the old keys back
+        if (aof_ && !aof_->rewrite(storage_)) {
+            log_warning("Append only log rewrite already in progress; the log may hold keys "
+                "from before the resynchronization until the next rewrite");
+        }
+    }
+
+    void Server::schedule_cron() {
+        auto period = std::chrono::microseconds(1000000 / std::max(config_.hz, 1u));
+        cron_timer_->expires_after(period);
+        cron_timer_->async_wait([this, period](const asio::error_code& ec) {
+            if (ec || !running_.load()) {
+                return;
+            }
+            // Bounded sweep so millions of volatile keys expire without
+            // stalling the loop
+            storage_.active_expire_cycle(period / 4);
+            metrics_.sample(InMemoryStorage::now_ms());
+            if (aof_ && aof_->rewrite_due(config_.auto_rewrite_min_size)) {
+                aof_->rewrite(storage_);
+            }
+            schedule_cron();
+        });
+    }
+
+    void Server::run() {
+        std::vector<std::thread> threads;
+        if (config_.thread_mode == ThreadMode::PerCore) {
+            for (size_t core = 1; core < contexts_.size(); ++core) {
+                threads.emplace_back([this, core]() { contexts_[core]->run(); });
+                pin_to_core(threads.back(), core);
+            }
+        }
+        else {
+            for (size_t i = 1; i < config_.threads; ++i) {
+                threads.emplace_back([this]() { contexts_[0]->run(); });
+            }
+        }
+
+        contexts_[0]->run();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
 
-                handle_connection(socket);
+    void Server::accept(size_t index) {
+        if (!running_.load()) return;
+
+        // Pick the core that will own the connection. In pool mode the
+        // socket gets a strand so its handlers never run concurrently.
+        size_t core = index;
+        if (acceptors_.size() < contexts_.size()) {
+            core = next_core_.fetch_add(1, std::memory_order_relaxed) % contexts_.size();
+        }
+        std::shared_ptr<asio::ip::tcp::socket> socket;
+        if (config_.thread_mode == ThreadMode::Pool && config_.threads > 1) {
+            socket = std::make_shared<asio::ip::tcp::socket>(asio::make_strand(*contexts_[core]));
+        }
+        else {
+            socket = std::make_shared<asio::ip::tcp::socket>(*contexts_[core]);
+        }
+
+        acceptors_[index]->async_accept(*socket, [this, socket, index, core](asio::error_code ec) {
+            if (!ec && running_.load()) {
+                // Replies are written whole; Nagle would hold back the tail
+                // of a gathered write until the client's delayed ACK
+                asio::error_code ignored;
+                socket->set_option(asio::ip::tcp::no_delay(true), ignored);
+                asio::error_code endpoint_error;
+                auto endpoint = socket->remote_endpoint(endpoint_error);
+                std::string address = endpoint_error ? "?" : format_address(endpoint);
+                auto connection = std::make_shared<Connection>(socket,
+                    next_connection_id_.fetch_add(1, std::memory_order_relaxed), core,
+                    std::move(address), InMemoryStorage::now_ms());
+                connections_.add(connection);
+                metrics_.count_connection();
+                log_debug("New connection from ", connection->address(), " (id ", connection->id(), ")");
+
+                // Continue on the connection's own executor (its core or
+                // strand); stop() may have missed it if it raced with us
+                asio::post(socket->get_executor(), [this, connection]() {
+                    if (running_.load()) {
+                        read_request(connection);
+                    }
+                    else {
+                        close_connection(connection);
+                    }
+                });
             }
-            else if (ec != asio::error::operation_aborted) {
-                std::cerr << "Accept error: " << ec.message() << std::endl;
+            else if (ec && ec != asio::error::operation_aborted) {
+                log_warning("Accept error: ", ec.message());
             }
 
             if (running_.load()) {
-                start();
+                accept(index);
             }
             });
     }
 
+#if defined(BLITZDB_HAS_IO_URING)
+    void Server::accept_uring(size_t index, int fd) {
+        if (!running_.load()) {
+            ::close(fd);
+            return;
+        }
+        size_t core = index;
+        if (acceptors_.size() < contexts_.size()) {
+            core = next_core_.fetch_add(1, std::memory_order_relaxed) % contexts_.size();
+        }
+
+        int no_delay = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        sockaddr_storage peer{};
+        socklen_t length = sizeof(peer);
+        std::string address = "?";
+        if (::getpeername(fd, reinterpret_cast<sockaddr*>(&peer), &length) == 0) {
+            asio::ip::tcp::endpoint endpoint;
+            std::memcpy(endpoint.data(), &peer, std::min<size_t>(length, endpoint.capacity()));
+            address = format_address(endpoint);
+        }
+        auto connection = std::make_shared<Connection>(std::make_unique<UringSocket>(*rings_[core], fd),
+            contexts_[core]->get_executor(), next_connection_id_.fetch_add(1, std::memory_order_relaxed),
+            core, std::move(address), InMemoryStorage::now_ms());
+        connections_.add(connection);
+        metrics_.count_connection();
+        log_debug("New connection from ", connection->address(), " (id ", connection->id(), ")");
+
+        // The handlers hold the connection until its socket has drained
+        // after close_connection()
+        UringSocket& socket = *connection->uring();
+        socket.on_data = [this, connection](std::string_view data) {
+            metrics_.count_input(data.size());
+            if (connection->closed) {
+                return;
+            }
+            if (connection->reading && connection->held_input() == 0) {
+                connection->reading = false;
+                connection->receive(data);
+                process_buffer(connection);
+                return;
+            }
+            // The read buffer is in use; keep a bounded amount aside
+            connection->hold_input(data);
+            if (!connection->reading && connection->held_input() >= kMaxHeldInput) {
+                connection->uring()->pause_reading();
+            }
+        };
+        socket.on_read_end = [this, connection](int error) {
+            if (error != 0) {
+                log_warning("Read error from ", connection->address(), ": ", std::strerror(error));
+                close_connection(connection);
+                return;
+            }
+            // The peer is done sending; replies still queued go out first
+            connection->closing = true;
+            flush_output(connection);
+        };
+        socket.on_sent = [this, connection](int error, size_t bytes) {
+            write_done(connection, asio::error_code(error, asio::system_category()), bytes);
+        };
+
+        asio::post(connection->executor(), [this, connection]() {
+            if (running_.load()) {
+                read_request(connection);
+            }
+            else {
+                close_connection(connection);
+            }
+        });
+    }
+#endif
+
     void Server::stop() {
         running_ = false;
 
-        std::lock_guard<std::mutex> lock(connections_mutex_);
-        for (auto& weak_conn : active_connections_) {
-            if (auto conn = weak_conn.lock()) {
-                asio::error_code ec;
-                conn->shutdown(asio::ip::tcp::socket::shutdown_both, ec);
-                conn->close(ec);
+        // Each connection is closed on its own executor
+        for (auto& connection : connections_.snapshot()) {
+            asio::post(connection->executor(), [this, connection]() {
+                close_connection(connection);
+            });
+        }
+
+        {
+            std::lock_guard<std::mutex> replication_lock(replication_mutex_);
+            if (replica_) {
+                replica_->stop();
             }
         }
-        active_connections_.clear();
 
+#if defined(BLITZDB_HAS_IO_URING)
+        // After the connections closed above, each ring stops its accepts
+        // and lets its loop finish once the kernel has let go of them
+        for (size_t i = 0; i < rings_.size(); ++i) {
+            asio::post(rings_[i]->context(), [this, i]() {
+                if (i < uring_acceptors_.size()) {
+                    uring_acceptors_[i]->stop();
+                }
+                rings_[i]->shutdown();
+            });
+        }
+#endif
         asio::error_code ec;
-        acceptor_.close(ec);
+        for (auto& acceptor : acceptors_) {
+            acceptor->close(ec);
+        }
+        if (cron_timer_) {
+            cron_timer_->cancel();
+        }
+        work_guards_.clear();
     }
 
-    void Server::handle_connection(std::shared_ptr<asio::ip::tcp::socket> socket) {
-        if (!socket || !socket->is_open()) {
-            std::cerr << "Invalid socket in handle_connection" << std::endl;
-            return;
+    namespace {
+
+        bool parse_integer(std::string_view text, long long& value) {
+            auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+            return ec == std::errc() && end == text.data() + text.size();
+        }
+
+        // A floating point argument; the whole token, not NaN
+        bool parse_float(std::string_view text, long double& value) {
+            auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+            return ec == std::errc() && end == text.data() + text.size() && !std::isnan(value);
+        }
+
+        std::string bulk_reply(const std::optional<std::string>& value) {
+            std::string reply;
+            if (value) {
+                resp::append_bulk(reply, *value);
+            }
+            else {
+                reply = resp::replies::kNull;
+            }
+            return reply;
+        }
+
+        bool iequals(std::string_view a, std::string_view b) {
+            return a.size() == b.size() &&
+                std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                    return std::toupper(static_cast<unsigned char>(x)) ==
+                        std::toupper(static_cast<unsigned char>(y));
+                });
         }
 
-        auto buffer = std::make_shared<std::string>();  // Use string as buffer
+    } // namespace
+
+    void Server::read_request(std::shared_ptr<Connection> connection) {
+        if (connection->reading || connection->closing || connection->forwarded) {
+            return;
+        }
 
-        asio::async_read_until(*socket, asio::dynamic_buffer(*buffer), "\r\n",
-            [this, socket, buffer](const asio::error_code& ec, size_t bytes) {
+        connection->reading = true;
+#if defined(BLITZDB_HAS_IO_URING)
+        if (UringSocket* socket = connection->uring()) {
+            // Data arrives through on_data; what came in meanwhile is
+            // processed first, from a fresh handler
+            socket->start_reading();
+            if (connection->held_input() > 0) {
+                asio::post(connection->executor(), [this, connection]() {
+                    if (!connection->reading || connection->closed) {
+                        return;
+                    }
+                    connection->reading = false;
+                    connection->take_held_input();
+                    process_buffer(connection);
+                });
+            }
+            return;
+        }
+#endif
+        connection->socket()->async_read_some(connection->read_space(),
+            [this, connection](const asio::error_code& ec, size_t bytes) {
+                connection->reading = false;
                 if (ec) {
                     if (ec != asio::error::eof && ec != asio::error::operation_aborted) {
-                        std::cerr << "Read error: " << ec.message() << std::endl;
+                        log_warning("Read error from ", connection->address(), ": ", ec.message());
                     }
-                    handle_disconnection(socket);
+                    close_connection(connection);
                     return;
                 }
 
-                try {
-                    // Extract the line (including the delimiter)
-                    std::string line = buffer->substr(0, bytes);
-                    buffer->erase(0, bytes);  // Remove processed data
+                connection->commit_read(bytes);
+                metrics_.count_input(bytes);
+                process_buffer(connection);
+            });
+    }
 
-                    // Clean CRLF
-                    if (!line.empty() && line.back() == '\n') {
-                        line.pop_back();
-                        if (!line.empty() && line.back() == '\r') {
-                            line.pop_back();
-                        }
-                    }
+    void Server::process_buffer(std::shared_ptr<Connection> connection) {
+        if (connection->closed || connection->forwarded) {
+            return;
+        }
 
-                    // Process command if not empty
-                    if (!line.empty()) {
-                        auto tokens = parse_command(line);
-                        auto response = std::make_shared<std::string>(process_command(socket, tokens));
+        // Execute every complete command already buffered, appending the
+        // replies to one output buffer that is flushed once per batch
+        size_t executed = 0;
+        bool need_data = false;
+        int64_t now = InMemoryStorage::now_ms();
+        OutputBuffer& output = connection->output();
+        try {
+            while (!connection->closing) {
+                if (executed == config_.max_batch_commands ||
+                    connection->pending_output() >= config_.output_soft_limit) {
+                    break;
+                }
 
-                        if (!tokens.empty() && tokens[0] == "QUIT") {
-                            asio::async_write(*socket, asio::buffer(*response),
-                                [this, socket](const asio::error_code&, size_t) {
-                                    handle_disconnection(socket);
-                                });
-                            return;
-                        }
+                auto status = connection->parse_next();
+                if (status == resp::ParseStatus::Incomplete) {
+                    need_data = true;
+                    break;
+                }
+                if (status == resp::ParseStatus::Error) {
+                    output.error("ERR " + connection->parse_error());
+                    connection->closing = true;
+                    break;
+                }
 
-                        asio::async_write(*socket, asio::buffer(*response),
-                            [this, socket, response](const asio::error_code& ec, size_t) {
-                                if (ec) {
-                                    std::cerr << "Write error: " << ec.message() << std::endl;
-                                    handle_disconnection(socket);
-                                    return;
-                                }
-                                handle_connection(socket);  // Continue processing
-                            });
-                    }
-                    else {
-                        handle_connection(socket);  // No data, continue
-                    }
+                const std::vector<std::string_view>& args = connection->args();
+                if (args.empty()) {
+                    continue;  // Blank line or empty multibulk
+                }
+
+                ++executed;
+                const CommandInfo* info = lookup_command(args[0]);
+                if (forward_command(connection, info)) {
+                    break;  // Resumed by the owning core once it replied
                 }
-                catch (const std::exception& e) {
-                    std::cerr << "Processing error: " << e.what() << std::endl;
-                    handle_disconnection(socket);
+                process_command(connection.get(), info, args, output);
+                connection->count_command(now);
+                if (connection->replica) {
+                    continue;  // Replication owns the socket's output now
                 }
+                connection->sync_sequence = std::max(connection->sync_sequence, AppendOnlyLog::take_thread_sequence());
+                if (iequals(args[0], "QUIT")) {
+                    connection->closing = true;
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            log_error("Processing error: ", e.what());
+            scratch_arena().reset();
+            close_connection(connection);
+            return;
+        }
+        // Scratch memory only lives for the batch
+        scratch_arena().reset();
+
+        connection->end_batch();
+        if (!check_output_limits(connection)) {
+            return;
+        }
+        flush_output(connection);
+
+        if (connection->forwarded) {
+            return;
+        }
+        if (need_data) {
+            // Keep reading the next batch while this one is being written,
+            // unless the client already has too many replies outstanding
+            if (connection->pending_output() < config_.output_soft_limit) {
+                read_request(connection);
+            }
+        }
+        else if (!connection->closing && executed == config_.max_batch_commands) {
+            // Batch limit hit: yield so other connections get to run
+            asio::post(connection->executor(), [this, connection]() {
+                process_buffer(connection);
             });
+        }
+        // Otherwise the output limit was hit; write completion resumes us
     }
 
-    void Server::handle_disconnection(std::shared_ptr<asio::ip::tcp::socket> socket) {
-        deauthenticate_client(socket);
+    bool Server::check_output_limits(const std::shared_ptr<Connection>& connection) {
+        // Subscribers have limits of their own
+        bool subscriber = connection->subscribed();
+        size_t soft_limit = subscriber ? config_.pubsub_soft_limit : config_.output_soft_limit;
+        size_t hard_limit = subscriber ? config_.pubsub_hard_limit : config_.output_hard_limit;
+        unsigned soft_seconds = subscriber ? config_.pubsub_soft_seconds : config_.output_soft_seconds;
 
-        std::lock_guard<std::mutex> lock(connections_mutex_);
-        active_connections_.erase(
-            std::remove_if(active_connections_.begin(), active_connections_.end(),
-                [socket](const std::weak_ptr<asio::ip::tcp::socket>& weak_conn) {
-                    auto conn = weak_conn.lock();
-                    return !conn || conn == socket;
-                }),
-            active_connections_.end()
-        );
-    }
+        size_t pending = connection->pending_output();
+        if (pending > hard_limit) {
+            log_warning("Disconnecting client ", connection->address(), ": ", pending,
+                " reply bytes queued, over the hard output limit");
+            close_connection(connection);
+            return false;
+        }
 
-    std::vector<std::string> Server::parse_command(const std::string& input) {
-        std::vector<std::string> tokens;
-        size_t start = 0;
-        size_t end = input.find(' ');
+        if (pending >= soft_limit) {
+            // Reads are paused from here on; a client that does not catch
+            // up within the grace period is dropped
+            if (!connection->output_limit_armed) {
+                connection->output_limit_armed = true;
+                connection->count_output_pause();
+                if (soft_seconds > 0) {
+                    asio::steady_timer& timer = connection->output_limit_timer();
+                    timer.expires_after(std::chrono::seconds(soft_seconds));
+                    timer.async_wait([this, connection, soft_seconds](const asio::error_code& ec) {
+                        // A timer re-armed since this wait expires later
+                        if (ec || connection->closed || !connection->output_limit_armed ||
+                            connection->output_limit_timer().expiry() > std::chrono::steady_clock::now()) {
+                            return;
+                        }
+                        log_warning("Disconnecting client ", connection->address(),
+                            ": over the soft output limit for ", soft_seconds, " s");
+                        close_connection(connection);
+                    });
+                }
+            }
+        }
+        else if (connection->output_limit_armed) {
+            connection->output_limit_armed = false;
+            connection->output_limit_timer().cancel();
+        }
+        return true;
+    }
 
-        while (end != std::string::npos) {
-            std::string token = input.substr(start, end - start);
-            if (!token.empty()) {
-                tokens.push_back(token);
+    void Server::flush_output(std::shared_ptr<Connection> connection) {
+        if (connection->writing || connection->closed || connection->awaiting_sync) {
+            return;
+        }
+        if (connection->output().empty()) {
+            if (connection->closing) {
+                close_connection(connection);
             }
-            start = end + 1;
-            end = input.find(' ', start);
+            return;
         }
 
-        // Add the last token
-        std::string last_token = input.substr(start);
-        if (!last_token.empty()) {
-            tokens.push_back(last_token);
+        // appendfsync always: replies are released only once the writes
+        // they acknowledge have been synced by the log's group commit
+        if (aof_ && aof_->policy() == FsyncPolicy::Always && connection->sync_sequence > aof_->synced()) {
+            connection->awaiting_sync = true;
+            aof_->when_synced(connection->sync_sequence, [this, connection]() {
+                asio::post(connection->executor(), [this, connection]() {
+                    connection->awaiting_sync = false;
+                    flush_output(connection);
+                });
+            });
+            return;
+        }
+
+        connection->writing = true;
+        const std::vector<asio::const_buffer>& buffers = connection->start_flush();
+#if defined(BLITZDB_HAS_IO_URING)
+        if (UringSocket* socket = connection->uring()) {
+            socket->send(buffers);
+            return;
+        }
+#endif
+        auto on_written = asio::bind_allocator(connection->write_allocator(),
+            [this, connection](const asio::error_code& ec, size_t bytes) {
+                write_done(connection, ec, bytes);
+            });
+        if (buffers.size() == 1) {
+            asio::async_write(*connection->socket(), buffers.front(), std::move(on_written));
+        }
+        else {
+            // Through a span: the write keeps its own copy of the sequence
+            asio::async_write(*connection->socket(), std::span<const asio::const_buffer>(buffers),
+                std::move(on_written));
         }
+    }
 
-        // Clean any remaining CR/LF from tokens
-        for (auto& token : tokens) {
-            token.erase(std::remove(token.begin(), token.end(), '\r'), token.end());
-            token.erase(std::remove(token.begin(), token.end(), '\n'), token.end());
+    void Server::write_done(std::shared_ptr<Connection> connection, const asio::error_code& ec, size_t bytes) {
+        connection->writing = false;
+        connection->finish_flush();
+        metrics_.count_output(bytes);
+        if (ec) {
+            if (ec != asio::error::operation_aborted) {
+                log_warning("Write error to ", connection->address(), ": ", ec.message());
+            }
+            close_connection(connection);
+            return;
         }
 
-        return tokens;
+        // Ship whatever accumulated meanwhile, then resume commands that
+        // were held back by the output limit
+        check_output_limits(connection);
+        flush_output(connection);
+        if (!connection->reading) {
+            process_buffer(connection);
+        }
     }
 
-    bool Server::validate_command(const CommandInfo& info, const std::vector<std::string>& tokens) {
-        size_t arg_count = tokens.size() - 1;
-        if (info.min_args >= 0 && arg_count < static_cast<size_t>(info.min_args)) {
+    bool Server::forward_command(std::shared_ptr<Connection> connection, const CommandInfo* info) {
+        const std::vector<std::string_view>& args = connection->args();
+        if (config_.thread_mode != ThreadMode::PerCore || contexts_.size() == 1 ||
+            !info || !info->keys.single() || args.size() < 2) {
             return false;
         }
-        if (info.max_args >= 0 && arg_count > static_cast<size_t>(info.max_args)) {
+        size_t owner = storage_.shard_index(args[1]) % contexts_.size();
+        if (owner == connection->core()) {
             return false;
         }
+
+        // Run the command on the core that owns the key. The arguments stay
+        // valid because the read buffer is left alone until we resume.
+        connection->forwarded = true;
+        asio::post(*contexts_[owner], [this, connection, info]() {
+            OutputBuffer reply;
+            process_command(connection.get(), info, connection->args(), reply);
+            uint64_t sequence = AppendOnlyLog::take_thread_sequence();
+            scratch_arena().reset();
+            asio::post(connection->executor(), [this, connection, sequence, reply = std::move(reply)]() mutable {
+                connection->forwarded = false;
+                connection->output().append(std::move(reply));
+                connection->count_command(InMemoryStorage::now_ms());
+                connection->sync_sequence = std::max(connection->sync_sequence, sequence);
+                process_buffer(connection);
+            });
+        });
         return true;
     }
 
-    std::string Server::process_command(std::shared_ptr<asio::ip::tcp::socket> socket,
-        const std::vector<std::string>& tokens) {
-        
-        
-        std::cout << "=== DEBUG START ===" << std::endl;
-        std::cout << "Received " << tokens.size() << " tokens" << std::endl;
-
-        if (tokens.empty()) {
-            std::cout << "DEBUG: No tokens provided" << std::endl;
-            return "-ERR no command provided\r\n";
+    void Server::deliver_messages(std::shared_ptr<Connection> connection) {
+        if (connection->closed) {
+            return;
+        }
+        connection->take_messages();
+        connection->end_batch();
+        if (check_output_limits(connection)) {
+            flush_output(connection);
         }
+    }
 
-        // Print each token with index and length
-        for (size_t i = 0; i < tokens.size(); ++i) {
-            std::cout << "Token " << i << ": [" << tokens[i] << "] (length: "
-                << tokens[i].length() << ")" << std::endl;
+    void Server::close_connection(std::shared_ptr<Connection> connection) {
+        if (connection->closed) {
+            return;
         }
+        connection->closed = true;
+        connection->closing = true;
+        if (connection->output_limit_armed) {
+            connection->output_limit_timer().cancel();
+        }
+        // The registry holds subscribers until they leave
+        for (const std::string& channel : connection->channels) {
+            pubsub_.unsubscribe(*connection, channel);
+        }
+        for (const std::string& pattern : connection->patterns) {
+            pubsub_.punsubscribe(*connection, pattern);
+        }
+        connection->channels.clear();
+        connection->patterns.clear();
 
-        if (tokens.empty()) {
-            return "-ERR no command provided\r\n";
+#if defined(BLITZDB_HAS_IO_URING)
+        if (UringSocket* socket = connection->uring()) {
+            socket->close();
         }
+#endif
+        if (connection->has_socket()) {
+            asio::error_code ec;
+            connection->socket()->shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+            connection->socket()->close(ec);
+            primary_->detach(connection->socket().get());
+        }
+        connections_.remove(*connection);
+    }
 
+    const CommandInfo* Server::lookup_command(std::string_view name) {
+        int index = CommandTable::index.candidate(name);
+        if (index < 0) {
+            return nullptr;
+        }
+        const CommandInfo& info = CommandTable::commands[index];
+        return equals_ignore_case(info.name, name) ? &info : nullptr;
+    }
 
-        std::string cmd_str = tokens[0];
-        std::transform(cmd_str.begin(), cmd_str.end(), cmd_str.begin(), ::toupper);
+    bool Server::check_arity(const CommandInfo& info, size_t count) {
+        if (info.arity >= 0) {
+            return count == static_cast<size_t>(info.arity);
+        }
+        return count >= static_cast<size_t>(-info.arity);
+    }
 
-        auto cmd_it = command_map.find(cmd_str);
-        if (cmd_it == command_map.end()) {
-            return "-ERR unknown command '" + cmd_str + "'\r\n";
+    void Reply::write_to(OutputBuffer& out) const {
+        switch (kind_) {
+        case Kind::None:
+            break;
+        case Kind::View:
+            out.raw(view_);
+            break;
+        case Kind::Text:
+            out.raw(text_);
+            break;
+        case Kind::Integer:
+            out.integer(integer_);
+            break;
         }
+    }
 
-        Command cmd = cmd_it->second;
-        const CommandInfo& info = command_info.at(cmd);
+    void Server::process_command(Connection* connection, const CommandInfo* info,
+        const std::vector<std::string_view>& tokens, OutputBuffer& out) {
+        if (tokens.empty()) {
+            out.error("ERR no command provided");
+            return;
+        }
+        log_debug("Command ", tokens[0], " with ", tokens.size() - 1, " argument(s)",
+            connection ? "" : " (replayed)");
 
-        if (!validate_command(info, tokens)) {
-            return "-ERR wrong number of arguments for '" + cmd_str + "' command\r\n";
+        if (!info) {
+            out.error("ERR unknown command '" + std::string(tokens[0]) + "'");
+            return;
         }
 
-        if (info.auth_required && !is_authenticated(socket)) {
-            return "-NOAUTH Authentication required\r\n";
+        // Client commands are counted and timed; replayed changes are not
+        size_t command = static_cast<size_t>(info - CommandTable::commands);
+        if (!check_arity(*info, tokens.size())) {
+            if (connection) {
+                metrics_.reject_command(command);
+            }
+            out.error("ERR wrong number of arguments for '" + std::string(info->name) + "' command");
+            return;
         }
 
-        switch (cmd) {
-        case Command::PING:
-            return "+PONG\r\n";
+        // No connection means the server itself is replaying changes
+        if (!(info->flags & kCommandNoAuth) && connection && !connection->authenticated()) {
+            metrics_.reject_command(command);
+            out.error("NOAUTH Authentication required");
+            return;
+        }
 
-        case Command::SET:
-            storage_.set(tokens[1], tokens[2]);
-            return "+OK\r\n";
+        // A subscribed client only manages its subscriptions
+        if (connection && connection->subscribed() && !allowed_when_subscribed(*info)) {
+            metrics_.reject_command(command);
+            out.error("ERR Can't execute '" + std::string(info->name) +
+                "': only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING / QUIT are allowed in this context");
+            return;
+        }
 
-        case Command::GET: {
-            std::string value = storage_.get(tokens[1]);
-            if (value.empty()) {
-                return "$-1\r\n";
-            }
-            return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+        // Replicas only change through their primary's stream
+        if ((info->flags & kCommandWrite) && connection && following_.load(std::memory_order_relaxed)) {
+            metrics_.reject_command(command);
+            out.error("READONLY You can't write against a read only replica.");
+            return;
         }
 
-        case Command::DEL: {
-            int deleted_count = 0;
-            for (size_t i = 1; i < tokens.size(); ++i) {
-                if (storage_.del(tokens[i])) {
-                    deleted_count++;
-                }
-            }
-            return ":" + std::to_string(deleted_count) + "\r\n";
+        // Fast commands are timed on a sample of their calls, unless the
+        // slow log wants every command; anything slower on each call, so
+        // a single slow KEYS or FLUSHALL reaches the slow log (see Metrics)
+        bool time_every_call = !(info->flags & kCommandFast) || slowlog_.threshold_us() == 0;
+        bool timed = connection && metrics_.count_command(command, time_every_call);
+        std::chrono::steady_clock::time_point started;
+        if (timed) {
+            started = std::chrono::steady_clock::now();
         }
 
-        case Command::QUIT:
-            return "+OK\r\n";
+        // Type mismatches surface from the storage as exceptions
+        try {
+            CommandCall call{ connection, tokens, out };
+            (this->*info->handler)(call).write_to(out);
+        }
+        catch (const WrongTypeError& e) {
+            out.error(e.what());
+        }
 
-        case Command::AUTH:
-            if (tokens[1] == "defaultpass") {
-                authenticate_client(socket);
-                return "+OK\r\n";
+        if (timed) {
+            uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started).count());
+            metrics_.record_latency(command, ns);
+            if (slowlog_.is_slow(ns / 1000)) {
+                slowlog_.add(tokens, ns / 1000, connection->address(), connection->name());
             }
-            return "-ERR invalid password\r\n";
+        }
+    }
 
-        default:
-            return "-ERR unknown command\r\n";
+    Reply Server::ping_command(const CommandCall& call) {
+        // Subscribers get a push-style reply, like their messages
+        if (call.connection && call.connection->subscribed()) {
+            return "*2\r\n$4\r\npong\r\n$0\r\n\r\n";
         }
+        return "+PONG\r\n";
     }
 
-    void Server::write_response(std::shared_ptr<asio::ip::tcp::socket> socket,
-        const std::string& response,
-        std::function<void()> callback) {
-        asio::async_write(*socket, asio::buffer(response),
-            [callback](const asio::error_code& ec, size_t) {
-                if (ec) {
-                    std::cerr << "Write error: " << ec.message() << std::endl;
-                    return;
-                }
-                if (callback) {
-                    callback();
-                }
-            });
+    Reply Server::quit_command(const CommandCall&) {
+        return "+OK\r\n";
     }
 
-    bool Server::is_authenticated(std::shared_ptr<asio::ip::tcp::socket> socket) {
-        std::lock_guard<std::mutex> lock(auth_mutex_);
-        return authenticated_clients_.find(socket) != authenticated_clients_.end();
+    Reply Server::auth_command(const CommandCall& call) {
+        if (call.args[1] != "defaultpass") {
+            return "-ERR invalid password\r\n";
+        }
+        if (call.connection) {
+            call.connection->set_authenticated(true);
+        }
+        return "+OK\r\n";
     }
 
-    void Server::authenticate_client(std::shared_ptr<asio::ip::tcp::socket> socket) {
-        std::lock_guard<std::mutex> lock(auth_mutex_);
-        authenticated_clients_.insert(socket);
+    Reply Server::select_command(const CommandCall& call) {
+        // There is one keyspace; database 0 is all a client can select
+        long long db = 0;
+        if (!parse_integer(call.args[1], db)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (db != 0) {
+            return "-ERR DB index is out of range\r\n";
+        }
+        if (call.connection) {
+            call.connection->set_db(0);
+        }
+        return "+OK\r\n";
     }
 
-    void Server::deauthenticate_client(std::shared_ptr<asio::ip::tcp::socket> socket) {
-        std::lock_guard<std::mutex> lock(auth_mutex_);
-        authenticated_clients_.erase(socket);
+    Reply Server::client_command(const CommandCall& call) {
+        Connection* connection = call.connection;
+        const std::vector<std::string_view>& tokens = call.args;
+        if (!connection) {
+            return "-ERR CLIENT needs a connection\r\n";
+        }
+        std::string sub(tokens[1]);
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub == "ID" && tokens.size() == 2) {
+            return Reply::integer(static_cast<long long>(connection->id()));
+        }
+        if (sub == "GETNAME" && tokens.size() == 2) {
+            std::string name = connection->name();
+            return name.empty() ? "$-1\r\n" : bulk_reply(name);
+        }
+        if (sub == "SETNAME" && tokens.size() == 3) {
+            // Names are shown space separated in CLIENT LIST
+            for (char c : tokens[2]) {
+                if (c <= ' ' || c > '~') {
+                    return "-ERR Client names cannot contain spaces, newlines or special characters.\r\n";
+                }
+            }
+            connection->set_name(tokens[2]);
+            return "+OK\r\n";
+        }
+        if (sub == "LIST" && tokens.size() == 2) {
+            // One line per connection, in the style of Redis' CLIENT LIST
+            int64_t now = InMemoryStorage::now_ms();
+            std::string report;
+            for (const auto& client : connections_.snapshot()) {
+                const ConnectionStats& stats = client->stats();
+                report += "id=" + std::to_string(client->id());
+                report += " addr=" + client->address();
+                report += " name=" + client->name();
+                report += " db=" + std::to_string(client->db());
+                report += " age=" + std::to_string((now - client->created_ms()) / 1000);
+                report += " idle=" + std::to_string((now - stats.last_command_ms.load(std::memory_order_relaxed)) / 1000);
+                report += " cmds=" + std::to_string(stats.commands.load(std::memory_order_relaxed));
+                report += " net-in=" + std::to_string(stats.bytes_in.load(std::memory_order_relaxed));
+                report += " net-out=" + std::to_string(stats.bytes_out.load(std::memory_order_relaxed));
+                report += " omem=" + std::to_string(stats.pending_output.load(std::memory_order_relaxed));
+                report += " output-pauses=" + std::to_string(stats.output_pauses.load(std::memory_order_relaxed));
+                report += '\n';
+            }
+            return bulk_reply(report);
+        }
+        return "-ERR unknown CLIENT subcommand or wrong number of arguments for '" + sub + "'\r\n";
+    }
+
+    namespace {
+
+        // COMMAND's description of one command: name, arity, flags and
+        // the first key, last key and step between keys
+        void append_command_info(OutputBuffer& out, const CommandInfo& info) {
+            out.array(6);
+            out.bulk(info.name);
+            out.integer(info.arity);
+            size_t flags = 0;
+            for (const CommandFlagName& flag : kCommandFlagNames) {
+                flags += (info.flags & flag.flag) ? 1 : 0;
+            }
+            out.array(flags);
+            for (const CommandFlagName& flag : kCommandFlagNames) {
+                if (info.flags & flag.flag) {
+                    out.simple(flag.name);
+                }
+            }
+            out.integer(info.keys.first);
+            out.integer(info.keys.last);
+            out.integer(info.keys.step);
+        }
+
+    } // namespace
+
+    Reply Server::command_command(const CommandCall& call) {
+        const std::vector<std::string_view>& tokens = call.args;
+        OutputBuffer& out = call.out;
+        if (tokens.size() == 1) {
+            out.array(std::size(CommandTable::commands));
+            for (const CommandInfo& info : CommandTable::commands) {
+                append_command_info(out, info);
+            }
+            return {};
+        }
+
+        std::string sub(tokens[1]);
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub == "COUNT" && tokens.size() == 2) {
+            return Reply::integer(static_cast<long long>(std::size(CommandTable::commands)));
+        }
+        if (sub == "INFO") {
+            out.array(tokens.size() - 2);
+            for (size_t i = 2; i < tokens.size(); ++i) {
+                if (const CommandInfo* info = lookup_command(tokens[i])) {
+                    append_command_info(out, *info);
+                }
+                else {
+                    out.null();
+                }
+            }
+            return {};
+        }
+        if (sub == "GETKEYS" && tokens.size() > 2) {
+            // The keys a command line would touch, for clients routing by key
+            std::span<const std::string_view> command = std::span(tokens).subspan(2);
+            const CommandInfo* info = lookup_command(command[0]);
+            if (!info) {
+                return "-ERR Invalid command specified\r\n";
+            }
+            if (!check_arity(*info, command.size())) {
+                return "-ERR Invalid number of arguments specified for command\r\n";
+            }
+            if (info->keys.first == 0) {
+                return "-ERR The command has no key arguments\r\n";
+            }
+            size_t keys = 0;
+            info->keys.for_each(command.size(), [&keys](size_t) { ++keys; });
+            out.array(keys);
+            info->keys.for_each(command.size(), [&out, command](size_t i) { out.bulk(command[i]); });
+            return {};
+        }
+        return "-ERR unknown COMMAND subcommand or wrong number of arguments for '" + sub + "'\r\n";
+    }
+
+    Reply Server::config_command(const CommandCall& call) {
+        // The settings that can change at runtime
+        const std::vector<std::string_view>& tokens = call.args;
+        std::string sub(tokens[1]);
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if ((sub != "GET" || tokens.size() != 3) && (sub != "SET" || tokens.size() != 4)) {
+            return "-ERR unknown CONFIG subcommand or wrong number of arguments for '" + sub + "'\r\n";
+        }
+        std::string name(tokens[2]);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+        if (sub == "GET") {
+            std::string value;
+            if (name == "loglevel") {
+                value = log_level_name(Logger::level());
+            }
+            else if (name == "slowlog-log-slower-than") {
+                value = std::to_string(slowlog_.threshold_us());
+            }
+            else if (name == "slowlog-max-len") {
+                value = std::to_string(slowlog_.max_length());
+            }
+            else if (name == "lazyfree-threshold") {
+                value = std::to_string(storage_.lazy_free_threshold());
+            }
+            else {
+                call.out.array(0);
+                return {};
+            }
+            call.out.array(2);
+            call.out.bulk(name);
+            call.out.bulk(value);
+            return {};
+        }
+
+        if (name == "loglevel") {
+            std::string level_name(tokens[3]);
+            std::transform(level_name.begin(), level_name.end(), level_name.begin(), ::tolower);
+            auto level = parse_log_level(level_name);
+            if (!level) {
+                return "-ERR Invalid log level '" + level_name + "' (expected debug, info, warning or error)\r\n";
+            }
+            Logger::set_level(*level);
+            log_info("Log level set to ", log_level_name(*level));
+            return "+OK\r\n";
+        }
+        if (name == "slowlog-log-slower-than" || name == "slowlog-max-len") {
+            long long value = 0;
+            if (!parse_integer(tokens[3], value) || (name == "slowlog-max-len" && value < 0)) {
+                return "-ERR Invalid argument '" + std::string(tokens[3]) + "' for CONFIG SET '" + name + "'\r\n";
+            }
+            if (name == "slowlog-max-len") {
+                slowlog_.set_max_length(static_cast<size_t>(value));
+            }
+            else {
+                slowlog_.set_threshold_us(value);
+            }
+            return "+OK\r\n";
+        }
+        if (name == "lazyfree-threshold") {
+            size_t value = 0;
+            if (!parse_bytes(tokens[3], value)) {
+                return "-ERR Invalid argument '" + std::string(tokens[3]) + "' for CONFIG SET '" + name + "'\r\n";
+            }
+            storage_.set_lazy_free_threshold(value);
+            return "+OK\r\n";
+        }
+        return "-ERR Unsupported CONFIG parameter: " + name + "\r\n";
+    }
+
+    Reply Server::debug_command(const CommandCall& call) {
+        std::string sub(call.args[1]);
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        std::string report;
+        if (sub == "SHARDS") {
+            // One line per shard: keys held and how often its lock was contended
+            auto stats = storage_.shard_stats();
+            for (size_t i = 0; i < stats.size(); ++i) {
+                report += "shard:" + std::to_string(i) +
+                    " keys=" + std::to_string(stats[i].keys) +
+                    " volatile=" + std::to_string(stats[i].volatile_keys) +
+                    " memory=" + std::to_string(stats[i].used_memory) +
+                    " cold=" + std::to_string(stats[i].cold_keys) +
+                    " evicted=" + std::to_string(stats[i].evicted_keys) +
+                    " expired=" + std::to_string(stats[i].expired_keys) +
+                    " acquisitions=" + std::to_string(stats[i].acquisitions) +
+                    " contended=" + std::to_string(stats[i].contended) +
+                    " wait_us=" + std::to_string(stats[i].wait_ns / 1000) + "\r\n";
+            }
+        }
+        else if (sub == "MEMORY") {
+            // Keyspace and allocator totals, then one line per size class in use
+            auto stats = SlabAllocator::instance().stats();
+            char ratio[32];
+            std::snprintf(ratio, sizeof(ratio), "%.2f", stats.fragmentation_ratio);
+            report += "dataset_bytes:" + std::to_string(storage_.used_memory()) + "\r\n" +
+                "maxmemory:" + std::to_string(storage_.max_memory()) + "\r\n" +
+                "maxmemory_policy:" + eviction_policy_name(storage_.eviction_policy()) + "\r\n" +
+                "used_bytes:" + std::to_string(stats.used_bytes) + "\r\n" +
+                "reserved_bytes:" + std::to_string(stats.reserved_bytes) + "\r\n" +
+                "fragmentation_ratio:" + ratio + "\r\n" +
+                "large_allocations:" + std::to_string(stats.large_allocations) + "\r\n" +
+                "large_bytes:" + std::to_string(stats.large_bytes) + "\r\n";
+            for (const auto& size_class : stats.classes) {
+                if (size_class.slabs == 0) {
+                    continue;
+                }
+                report += "class:" + std::to_string(size_class.chunk_size) +
+                    " slabs=" + std::to_string(size_class.slabs) +
+                    " used=" + std::to_string(size_class.chunks_in_use) +
+                    " free=" + std::to_string(size_class.chunks_free) + "\r\n";
+            }
+        }
+        else if (sub == "REPLICATION") {
+            report = replication_report();
+        }
+        else {
+            return "-ERR unknown DEBUG subcommand '" + sub + "'\r\n";
+        }
+        return "$" + std::to_string(report.size()) + "\r\n" + report + "\r\n";
+    }
+
+    Reply Server::flushall_command(const CommandCall& call) {
+        // ASYNC returns once the tables are detached; SYNC also frees them
+        if (call.args.size() > 2) {
+            return "-ERR syntax error\r\n";
+        }
+        bool async = false;
+        if (call.args.size() == 2) {
+            if (iequals(call.args[1], "ASYNC")) {
+                async = true;
+            }
+            else if (!iequals(call.args[1], "SYNC")) {
+                return "-ERR syntax error\r\n";
+            }
+        }
+        storage_.flush(async);
+        return "+OK\r\n";
+    }
+
+    namespace {
+
+        // INFO sections in the order they are reported. The default reply
+        // leaves out the per-command ones, as Redis does.
+        constexpr std::string_view kInfoSections[] = {
+            "server", "clients", "memory", "persistence", "stats", "replication", "keyspace",
+            "commandstats", "latencystats",
+        };
+        constexpr size_t kDefaultInfoSections = 7;
+
+        std::string format_usec(uint64_t ns) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.3f", static_cast<double>(ns) / 1000.0);
+            return text;
+        }
+
+    } // namespace
+
+    Reply Server::info_command(const CommandCall& call) {
+        // INFO [section ...]; "all" or "everything" adds the per-command
+        // sections to the default ones
+        bool wanted[std::size(kInfoSections)] = {};
+        if (call.args.size() == 1) {
+            std::fill(wanted, wanted + kDefaultInfoSections, true);
+        }
+        for (size_t i = 1; i < call.args.size(); ++i) {
+            std::string name(call.args[i]);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if (name == "all" || name == "everything") {
+                std::fill(std::begin(wanted), std::end(wanted), true);
+            }
+            else if (name == "default") {
+                std::fill(wanted, wanted + kDefaultInfoSections, true);
+            }
+            for (size_t section = 0; section < std::size(kInfoSections); ++section) {
+                wanted[section] = wanted[section] || kInfoSections[section] == name;
+            }
+        }
+
+        std::string report;
+        for (size_t section = 0; section < std::size(kInfoSections); ++section) {
+            if (!wanted[section]) {
+                continue;
+            }
+            if (!report.empty()) {
+                report += "\r\n";
+            }
+            report += info_section(kInfoSections[section]);
+        }
+        return bulk_reply(report);
+    }
+
+    std::string Server::info_section(std::string_view section) const {
+        std::string report;
+        auto field = [&report](std::string_view name, const std::string& value) {
+            report += name;
+            report += ':';
+            report += value;
+            report += "\r\n";
+        };
+
+        if (section == "server") {
+            int64_t uptime = (InMemoryStorage::now_ms() - started_ms_) / 1000;
+            report += "# Server\r\n";
+            field("tcp_port", std::to_string(config_.port));
+            field("thread_mode", config_.thread_mode == ThreadMode::PerCore ? "per-core" : "pool");
+            field("threads", std::to_string(config_.threads));
+            field("io_backend", config_.io_backend == IoBackend::IoUring ? "io_uring" : "epoll");
+            field("storage_shards", std::to_string(storage_.shard_count()));
+            field("hz", std::to_string(config_.hz));
+            field("uptime_in_seconds", std::to_string(uptime));
+            field("uptime_in_days", std::to_string(uptime / 86400));
+        }
+        else if (section == "clients") {
+            report += "# Clients\r\n";
+            field("connected_clients", std::to_string(connections_.size()));
+        }
+        else if (section == "memory") {
+            auto stats = SlabAllocator::instance().stats();
+            char ratio[32];
+            std::snprintf(ratio, sizeof(ratio), "%.2f", stats.fragmentation_ratio);
+            report += "# Memory\r\n";
+            field("used_memory", std::to_string(storage_.used_memory()));
+            field("used_memory_allocator", std::to_string(stats.used_bytes + stats.large_bytes));
+            field("used_memory_reserved", std::to_string(stats.reserved_bytes + stats.large_bytes));
+            field("mem_fragmentation_ratio", ratio);
+            field("maxmemory", std::to_string(storage_.max_memory()));
+            field("maxmemory_policy", eviction_policy_name(storage_.eviction_policy()));
+            LazyFreeStats lazy = storage_.lazy_free_stats();
+            field("lazyfree_pending_objects", std::to_string(lazy.pending_objects));
+            field("lazyfree_pending_bytes", std::to_string(lazy.pending_bytes));
+            field("lazyfreed_objects", std::to_string(lazy.freed_objects));
+            field("lazyfreed_bytes", std::to_string(lazy.freed_bytes));
+            field("tiered_enabled", tiered_ ? "1" : "0");
+            if (tiered_) {
+                TieredStats tiered = tiered_->stats();
+                field("tiered_cold_keys", std::to_string(tiered.cold_keys));
+                field("tiered_cold_bytes", std::to_string(tiered.cold_bytes));
+                field("tiered_log_bytes", std::to_string(tiered.log_bytes));
+                field("tiered_spilled", std::to_string(tiered.spilled));
+                field("tiered_promoted", std::to_string(tiered.promoted));
+                field("tiered_compactions", std::to_string(tiered.compactions));
+                field("tiered_log_full", tiered.log_full ? "1" : "0");
+            }
+        }
+        else if (section == "persistence") {
+            report += "# Persistence\r\n";
+            field("rdb_bgsave_in_progress", snapshots_->in_progress() ? "1" : "0");
+            field("rdb_last_save_time", std::to_string(snapshots_->last_save_time()));
+            field("rdb_last_bgsave_status", snapshots_->last_save_ok() ? "ok" : "err");
+            field("aof_enabled", aof_ ? "1" : "0");
+            if (aof_) {
+                AppendOnlyLogStats stats = aof_->stats();
+                field("aof_rewrite_in_progress", stats.rewriting ? "1" : "0");
+                field("aof_rewrites", std::to_string(stats.rewrites));
+                field("aof_current_size", std::to_string(stats.file_size));
+                field("aof_base_size", std::to_string(stats.base_size));
+                field("aof_fsync", fsync_policy_name(aof_->policy()));
+                field("aof_pending_bytes", std::to_string(stats.appended - stats.synced));
+                field("aof_writes", std::to_string(stats.writes));
+                field("aof_fsyncs", std::to_string(stats.fsyncs));
+            }
+        }
+        else if (section == "stats") {
+            MetricsTotals totals = metrics_.totals();
+            uint64_t expired = 0;
+            uint64_t evicted = 0;
+            uint64_t acquisitions = 0;
+            uint64_t contended = 0;
+            uint64_t wait_ns = 0;
+            for (const ShardStats& shard : storage_.shard_stats()) {
+                expired += shard.expired_keys;
+                evicted += shard.evicted_keys;
+                acquisitions += shard.acquisitions;
+                contended += shard.contended;
+                wait_ns += shard.wait_ns;
+            }
+            report += "# Stats\r\n";
+            field("total_connections_received", std::to_string(totals.connections_received));
+            field("total_commands_processed", std::to_string(totals.commands_processed));
+            field("instantaneous_ops_per_sec", std::to_string(metrics_.instantaneous_ops()));
+            field("total_net_input_bytes", std::to_string(totals.net_input_bytes));
+            field("total_net_output_bytes", std::to_string(totals.net_output_bytes));
+            field("expired_keys", std::to_string(expired));
+            field("evicted_keys", std::to_string(evicted));
+            field("shard_lock_acquisitions", std::to_string(acquisitions));
+            field("shard_lock_contended", std::to_string(contended));
+            field("shard_lock_wait_usec", std::to_string(wait_ns / 1000));
+            field("pubsub_channels", std::to_string(pubsub_.channel_count()));
+            field("pubsub_patterns", std::to_string(pubsub_.pattern_count()));
+            field("slowlog_len", std::to_string(slowlog_.length()));
+            field("log_messages_dropped", std::to_string(Logger::instance().dropped()));
+        }
+        else if (section == "replication") {
+            // Redis' field names, so replication dashboards read them as is
+            report += "# Replication\r\n";
+            std::lock_guard<std::mutex> lock(replication_mutex_);
+            if (replica_) {
+                ReplicaStatus status = replica_->status();
+                field("role", "slave");
+                field("master_host", status.host);
+                field("master_port", std::to_string(status.port));
+                field("master_link_status", status.link_up ? "up" : "down");
+                field("master_last_io_seconds_ago", std::to_string(status.last_io_ms < 0 ? -1 : status.last_io_ms / 1000));
+                field("master_replid", status.replid);
+                field("slave_repl_offset", std::to_string(status.offset));
+            }
+            else {
+                auto replicas = primary_->replicas();
+                field("role", "master");
+                field("connected_slaves", std::to_string(replicas.size()));
+                for (size_t i = 0; i < replicas.size(); ++i) {
+                    const ReplicaInfo& replica = replicas[i];
+                    field("slave" + std::to_string(i), "ip=" + replica.address +
+                        ",port=" + std::to_string(replica.port) +
+                        ",state=" + (replica.online ? "online" : "wait_bgsave") +
+                        ",offset=" + std::to_string(replica.ack_offset) +
+                        ",lag=" + std::to_string(replica.last_ack_ms / 1000));
+                }
+                field("master_replid", primary_->replid());
+                field("master_repl_offset", std::to_string(primary_->offset()));
+                field("repl_backlog_size", std::to_string(primary_->backlog_capacity()));
+                field("repl_backlog_first_byte_offset", std::to_string(primary_->backlog_start()));
+            }
+        }
+        else if (section == "keyspace") {
+            size_t keys = 0;
+            size_t expires = 0;
+            for (const ShardStats& shard : storage_.shard_stats()) {
+                keys += shard.keys;
+                expires += shard.volatile_keys;
+            }
+            report += "# Keyspace\r\n";
+            if (keys > 0) {
+                field("db0", "keys=" + std::to_string(keys) + ",expires=" + std::to_string(expires));
+            }
+        }
+        else if (section == "commandstats") {
+            MetricsTotals totals = metrics_.totals();
+            report += "# Commandstats\r\n";
+            for (size_t i = 0; i < totals.commands.size(); ++i) {
+                const MetricsTotals::Command& command = totals.commands[i];
+                if (command.calls == 0 && command.rejected == 0) {
+                    continue;
+                }
+                char per_call[32];
+                std::snprintf(per_call, sizeof(per_call), "%.2f", command.timed == 0 ? 0.0
+                    : static_cast<double>(command.timed_ns) / 1000.0 / static_cast<double>(command.timed));
+                field("cmdstat_" + std::string(CommandTable::commands[i].name),
+                    "calls=" + std::to_string(command.calls) +
+                    ",usec=" + std::to_string(command.total_ns() / 1000) +
+                    ",usec_per_call=" + per_call +
+                    ",rejected_calls=" + std::to_string(command.rejected));
+            }
+        }
+        else if (section == "latencystats") {
+            MetricsTotals totals = metrics_.totals();
+            report += "# Latencystats\r\n";
+            for (size_t i = 0; i < totals.commands.size(); ++i) {
+                uint64_t timed = totals.commands[i].timed;
+                if (timed == 0) {
+                    continue;
+                }
+                LatencyHistogram::Counts counts = metrics_.command_latency(i);
+                field("latency_percentiles_usec_" + std::string(CommandTable::commands[i].name),
+                    "p50=" + format_usec(LatencyHistogram::percentile(counts, timed, 0.5)) +
+                    ",p99=" + format_usec(LatencyHistogram::percentile(counts, timed, 0.99)) +
+                    ",p99.9=" + format_usec(LatencyHistogram::percentile(counts, timed, 0.999)));
+            }
+        }
+        return report;
+    }
+
+    Reply Server::latency_command(const CommandCall& call) {
+        // LATENCY HISTOGRAM [command ...], in Redis' layout: per command its
+        // calls and the cumulative count at each power of two microseconds.
+        // Counts are the timed calls scaled up to all calls.
+        const std::vector<std::string_view>& tokens = call.args;
+        std::string sub(tokens[1]);
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub != "HISTOGRAM") {
+            return "-ERR unknown LATENCY subcommand or wrong number of arguments for '" + sub + "'\r\n";
+        }
+
+        MetricsTotals totals = metrics_.totals();
+        std::vector<size_t> commands;
+        if (tokens.size() == 2) {
+            for (size_t i = 0; i < totals.commands.size(); ++i) {
+                commands.push_back(i);
+            }
+        }
+        for (size_t i = 2; i < tokens.size(); ++i) {
+            if (const CommandInfo* info = lookup_command(tokens[i])) {
+                commands.push_back(static_cast<size_t>(info - CommandTable::commands));
+            }
+        }
+        std::erase_if(commands, [&totals](size_t i) { return totals.commands[i].timed == 0; });
+
+        OutputBuffer& out = call.out;
+        out.array(commands.size() * 2);
+        std::vector<std::pair<uint64_t, uint64_t>> steps;
+        for (size_t command : commands) {
+            const MetricsTotals::Command& stats = totals.commands[command];
+            uint64_t calls = stats.calls;
+            double scale = static_cast<double>(calls) / static_cast<double>(stats.timed);
+            LatencyHistogram::Counts counts = metrics_.command_latency(command);
+            steps.clear();
+            uint64_t seen = 0;
+            size_t bucket = 0;
+            for (uint64_t usec = 1; bucket < counts.size(); usec *= 2) {
+                uint64_t before = seen;
+                while (bucket < counts.size() && LatencyHistogram::bucket_high(bucket) < usec * 1000) {
+                    seen += counts[bucket++];
+                }
+                if (seen > before) {
+                    steps.emplace_back(usec, std::min(calls, static_cast<uint64_t>(static_cast<double>(seen) * scale + 0.5)));
+                }
+                if (seen == stats.timed) {
+                    break;
+                }
+            }
+
+            out.bulk(CommandTable::commands[command].name);
+            out.array(4);
+            out.bulk("calls");
+            out.integer(static_cast<long long>(calls));
+            out.bulk("histogram_usec");
+            out.array(steps.size() * 2);
+            for (const auto& [usec, count] : steps) {
+                out.integer(static_cast<long long>(usec));
+                out.integer(static_cast<long long>(count));
+            }
+        }
+        return {};
+    }
+
+    Reply Server::slowlog_command(const CommandCall& call) {
+        const std::vector<std::string_view>& tokens = call.args;
+        std::string sub(tokens[1]);
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub == "LEN" && tokens.size() == 2) {
+            return Reply::integer(static_cast<long long>(slowlog_.length()));
+        }
+        if (sub == "RESET" && tokens.size() == 2) {
+            slowlog_.reset();
+            return "+OK\r\n";
+        }
+        if (sub == "GET" && tokens.size() <= 3) {
+            // Newest first: id, unix time, microseconds, arguments, client
+            // address and name
+            long long count = 10;
+            if (tokens.size() == 3 && (!parse_integer(tokens[2], count) || count < -1)) {
+                return "-ERR count should be greater than or equal to -1\r\n";
+            }
+            auto entries = slowlog_.get(count < 0 ? std::numeric_limits<size_t>::max() : static_cast<size_t>(count));
+            OutputBuffer& out = call.out;
+            out.array(entries.size());
+            for (const SlowLogEntry& entry : entries) {
+                out.array(6);
+                out.integer(static_cast<long long>(entry.id));
+                out.integer(entry.time);
+                out.integer(static_cast<long long>(entry.duration_us));
+                out.array(entry.args.size());
+                for (const std::string& arg : entry.args) {
+                    out.bulk(arg);
+                }
+                out.bulk(entry.client_address);
+                out.bulk(entry.client_name);
+            }
+            return {};
+        }
+        return "-ERR unknown SLOWLOG subcommand or wrong number of arguments for '" + sub + "'\r\n";
+    }
+
+    Reply Server::get_command(const CommandCall& call) {
+        // Encoded under the shard lock; large values are referenced
+        OutputBuffer& out = call.out;
+        bool found = storage_.get(call.args[1], [&out](const Value& value) {
+            if (value.shared_string()) {
+                out.bulk(value.string_handle());
+            }
+            else {
+                string_int::Digits digits;
+                out.bulk(value.string(digits));
+            }
+        });
+        if (!found) {
+            out.null();
+        }
+        return {};
+    }
+
+    Reply Server::set_command(const CommandCall& call) {
+        const std::vector<std::string_view>& tokens = call.args;
+        // SET key value [NX|XX] [GET] [EX s|PX ms|EXAT s|PXAT ms|KEEPTTL]
+        SetParams params;
+        bool has_expiry = false;
+        for (size_t i = 3; i < tokens.size(); ++i) {
+            std::string option(tokens[i]);
+            std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+
+            if (option == "NX" && !params.only_if_exists) {
+                params.only_if_missing = true;
+            }
+            else if (option == "XX" && !params.only_if_missing) {
+                params.only_if_exists = true;
+            }
+            else if (option == "GET") {
+                params.return_old = true;
+            }
+            else if (option == "KEEPTTL" && !has_expiry) {
+                params.keep_ttl = true;
+            }
+            else if ((option == "EX" || option == "PX" || option == "EXAT" || option == "PXAT") &&
+                !has_expiry && !params.keep_ttl && i + 1 < tokens.size()) {
+                long long amount = 0;
+                if (!parse_integer(tokens[++i], amount)) {
+                    return "-ERR value is not an integer or out of range\r\n";
+                }
+                int64_t unit = (option == "EX" || option == "EXAT") ? 1000 : 1;
+                bool absolute = option == "EXAT" || option == "PXAT";
+                int64_t base = absolute ? 0 : InMemoryStorage::now_ms();
+                if (amount <= 0 || amount > (std::numeric_limits<int64_t>::max() - base) / unit) {
+                    return "-ERR invalid expire time in 'set' command\r\n";
+                }
+                params.expire_at = base + amount * unit;
+                has_expiry = true;
+            }
+            else {
+                return "-ERR syntax error\r\n";
+            }
+        }
+
+        SetResult result = storage_.set(tokens[1], tokens[2], params);
+        if (result.out_of_memory) {
+            return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+        }
+        if (params.return_old) {
+            return bulk_reply(result.old_value);
+        }
+        return result.written ? "+OK\r\n" : "$-1\r\n";
+    }
+
+    Reply Server::del_command(const CommandCall& call) {
+        return Reply::integer(static_cast<long long>(storage_.del(std::span(call.args).subspan(1))));
+    }
+
+    Reply Server::unlink_command(const CommandCall& call) {
+        return Reply::integer(static_cast<long long>(storage_.unlink(std::span(call.args).subspan(1))));
+    }
+
+    Reply Server::exists_command(const CommandCall& call) {
+        return Reply::integer(static_cast<long long>(storage_.exists(std::span(call.args).subspan(1))));
+    }
+
+    Reply Server::mget_command(const CommandCall& call) {
+        // One array, encoded under the shard locks like GET
+        OutputBuffer& out = call.out;
+        out.array(call.args.size() - 1);
+        storage_.mget(std::span(call.args).subspan(1), [&out](const Value* value) {
+            if (!value) {
+                out.null();
+            }
+            else if (value->shared_string()) {
+                out.bulk(value->string_handle());
+            }
+            else {
+                string_int::Digits digits;
+                out.bulk(value->string(digits));
+            }
+        });
+        return {};
+    }
+
+    Reply Server::mset_command(const CommandCall& call) {
+        if (call.args.size() % 2 == 0) {
+            return "-ERR wrong number of arguments for 'mset' command\r\n";
+        }
+        SetResult result = storage_.mset(std::span(call.args).subspan(1));
+        if (result.out_of_memory) {
+            return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+        }
+        return "+OK\r\n";
+    }
+
+    Reply Server::msetnx_command(const CommandCall& call) {
+        if (call.args.size() % 2 == 0) {
+            return "-ERR wrong number of arguments for 'msetnx' command\r\n";
+        }
+        SetResult result = storage_.mset(std::span(call.args).subspan(1), true);
+        if (result.out_of_memory) {
+            return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+        }
+        return Reply::integer(result.written ? 1 : 0);
+    }
+
+    Reply Server::increment(std::string_view key, long long delta) {
+        IncrementResult result = storage_.incrby(key, delta);
+        switch (result.status) {
+        case IncrementStatus::Overflow:
+            return "-ERR increment or decrement would overflow\r\n";
+        case IncrementStatus::OutOfMemory:
+            return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+        case IncrementStatus::Ok:
+            return Reply::integer(result.value);
+        default:
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+    }
+
+    Reply Server::incr_command(const CommandCall& call) {
+        return increment(call.args[1], 1);
+    }
+
+    Reply Server::decr_command(const CommandCall& call) {
+        return increment(call.args[1], -1);
+    }
+
+    Reply Server::incrby_command(const CommandCall& call) {
+        long long delta = 0;
+        if (!parse_integer(call.args[2], delta)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        return increment(call.args[1], delta);
+    }
+
+    Reply Server::decrby_command(const CommandCall& call) {
+        long long delta = 0;
+        if (!parse_integer(call.args[2], delta)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (delta == std::numeric_limits<long long>::min()) {
+            return "-ERR decrement would overflow\r\n";
+        }
+        return increment(call.args[1], -delta);
+    }
+
+    Reply Server::incrbyfloat_command(const CommandCall& call) {
+        long double delta = 0;
+        if (!parse_float(call.args[2], delta)) {
+            return "-ERR value is not a valid float\r\n";
+        }
+        std::string text;
+        switch (storage_.incrbyfloat(call.args[1], delta, text)) {
+        case IncrementStatus::Ok:
+            call.out.bulk(text);
+            return {};
+        case IncrementStatus::NotFinite:
+            return "-ERR increment would produce NaN or Infinity\r\n";
+        case IncrementStatus::OutOfMemory:
+            return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+        default:
+            return "-ERR value is not a valid float\r\n";
+        }
+    }
+
+    namespace {
+
+        Reply string_write_reply(const StringWriteResult& result) {
+            if (result.out_of_memory) {
+                return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+            }
+            if (result.too_large) {
+                return "-ERR string exceeds maximum allowed size (proto-max-bulk-len)\r\n";
+            }
+            return Reply::integer(static_cast<long long>(result.length));
+        }
+
+    } // namespace
+
+    Reply Server::append_command(const CommandCall& call) {
+        return string_write_reply(storage_.append(call.args[1], call.args[2]));
+    }
+
+    Reply Server::setrange_command(const CommandCall& call) {
+        long long offset = 0;
+        if (!parse_integer(call.args[2], offset)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (offset < 0) {
+            return "-ERR offset is out of range\r\n";
+        }
+        return string_write_reply(storage_.setrange(call.args[1], static_cast<size_t>(offset), call.args[3]));
+    }
+
+    Reply Server::strlen_command(const CommandCall& call) {
+        size_t length = 0;
+        storage_.get(call.args[1], [&length](const Value& value) { length = value.string_size(); });
+        return Reply::integer(static_cast<long long>(length));
+    }
+
+    Reply Server::getrange_command(const CommandCall& call) {
+        long long start = 0;
+        long long end = 0;
+        if (!parse_integer(call.args[2], start) || !parse_integer(call.args[3], end)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        // Inclusive range; negative indexes count from the end
+        OutputBuffer& out = call.out;
+        bool found = storage_.get(call.args[1], [&](const Value& value) {
+            string_int::Digits digits;
+            std::string_view text = value.string(digits);
+            long long length = static_cast<long long>(text.size());
+            long long first = start < 0 ? std::max(length + start, 0LL) : start;
+            long long last = end < 0 ? std::max(length + end, 0LL) : std::min(end, length - 1);
+            if ((start < 0 && end < 0 && start > end) || first > last || length == 0) {
+                out.bulk(std::string_view());
+            }
+            else {
+                out.bulk(text.substr(static_cast<size_t>(first), static_cast<size_t>(last - first + 1)));
+            }
+        });
+        if (!found) {
+            out.bulk(std::string_view());
+        }
+        return {};
+    }
+
+    Reply Server::expire_command(const CommandCall& call) {
+        return set_expiry(call.args, 1000, false);
+    }
+
+    Reply Server::pexpire_command(const CommandCall& call) {
+        return set_expiry(call.args, 1, false);
+    }
+
+    Reply Server::expireat_command(const CommandCall& call) {
+        return set_expiry(call.args, 1000, true);
+    }
+
+    Reply Server::pexpireat_command(const CommandCall& call) {
+        return set_expiry(call.args, 1, true);
+    }
+
+    Reply Server::set_expiry(const std::vector<std::string_view>& tokens,
+        int64_t unit_ms, bool absolute) {
+        long long amount = 0;
+        if (!parse_integer(tokens[2], amount)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+
+        int64_t base = absolute ? 0 : InMemoryStorage::now_ms();
+        int64_t limit = std::numeric_limits<int64_t>::max() / 2;
+        if (amount > (limit - base) / unit_ms || amount < -(limit - base) / unit_ms) {
+            std::string name(tokens[0]);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            return "-ERR invalid expire time in '" + name + "' command\r\n";
+        }
+
+        // A deadline in the past deletes the key
+        int64_t expire_at = std::max<int64_t>(base + amount * unit_ms, 1);
+        return storage_.set_expiry(tokens[1], expire_at) ? ":1\r\n" : ":0\r\n";
+    }
+
+    Reply Server::ttl_command(const CommandCall& call) {
+        int64_t ttl = storage_.ttl_ms(call.args[1]);
+        return Reply::integer(ttl >= 0 ? (ttl + 500) / 1000 : ttl);
+    }
+
+    Reply Server::pttl_command(const CommandCall& call) {
+        return Reply::integer(storage_.ttl_ms(call.args[1]));
+    }
+
+    Reply Server::persist_command(const CommandCall& call) {
+        return storage_.persist(call.args[1]) ? ":1\r\n" : ":0\r\n";
+    }
+
+    Reply Server::hset_command(const CommandCall& call) {
+        std::span<const std::string_view> args = std::span(call.args).subspan(2);
+        if (args.size() % 2 != 0) {
+            return "-ERR wrong number of arguments for 'hset' command\r\n";
+        }
+        HashSetResult result = storage_.hset(call.args[1], args);
+        if (result.out_of_memory) {
+            return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+        }
+        return Reply::integer(static_cast<long long>(result.added));
+    }
+
+    Reply Server::hget_command(const CommandCall& call) {
+        return bulk_reply(storage_.hget(call.args[1], call.args[2]));
+    }
+
+    Reply Server::hmget_command(const CommandCall& call) {
+        auto values = storage_.hmget(call.args[1], std::span(call.args).subspan(2));
+        call.out.array(values.size());
+        for (const auto& value : values) {
+            if (value) {
+                call.out.bulk(*value);
+            }
+            else {
+                call.out.null();
+            }
+        }
+        return {};
+    }
+
+    Reply Server::hdel_command(const CommandCall& call) {
+        return Reply::integer(static_cast<long long>(storage_.hdel(call.args[1], std::span(call.args).subspan(2))));
+    }
+
+    Reply Server::hgetall_command(const CommandCall& call) {
+        auto items = storage_.hgetall(call.args[1]);
+        call.out.array(items.size());
+        for (const std::string& item : items) {
+            call.out.bulk(item);
+        }
+        return {};
+    }
+
+    Reply Server::hincrby_command(const CommandCall& call) {
+        long long delta = 0;
+        if (!parse_integer(call.args[3], delta)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        IncrementResult result = storage_.hincrby(call.args[1], call.args[2], delta);
+        switch (result.status) {
+        case IncrementStatus::NotInteger:
+            return "-ERR hash value is not an integer\r\n";
+        case IncrementStatus::Overflow:
+            return "-ERR increment or decrement would overflow\r\n";
+        case IncrementStatus::OutOfMemory:
+            return "-OOM command not allowed when used memory > 'maxmemory'.\r\n";
+        default:
+            break;
+        }
+        return Reply::integer(result.value);
+    }
+
+    Reply Server::hlen_command(const CommandCall& call) {
+        return Reply::integer(static_cast<long long>(storage_.hlen(call.args[1])));
+    }
+
+    Reply Server::bgrewriteaof_command(const CommandCall&) {
+        if (!aof_) {
+            return "-ERR append only log is disabled\r\n";
+        }
+        if (!aof_->rewrite(storage_)) {
+            return "-ERR Background append only file rewriting already in progress\r\n";
+        }
+        return "+Background append only file rewriting started\r\n";
+    }
+
+    Reply Server::save_command(const CommandCall&) {
+        std::string error;
+        if (!snapshots_->save(error)) {
+            return "-ERR " + error + "\r\n";
+        }
+        return "+OK\r\n";
+    }
+
+    Reply Server::bgsave_command(const CommandCall&) {
+        if (!snapshots_->save_in_background()) {
+            return "-ERR Background save already in progress\r\n";
+        }
+        return "+Background saving started\r\n";
+    }
+
+    Reply Server::lastsave_command(const CommandCall&) {
+        return Reply::integer(snapshots_->last_save_time());
+    }
+
+    namespace {
+
+        // [p](un)subscribe, name or null, subscriptions left
+        void append_subscription(OutputBuffer& out, std::string_view kind,
+            const std::string_view* name, size_t count) {
+            out.array(3);
+            out.bulk(kind);
+            if (name) {
+                out.bulk(*name);
+            }
+            else {
+                out.null();
+            }
+            out.integer(static_cast<long long>(count));
+        }
+
+    } // namespace
+
+    bool Server::allowed_when_subscribed(const CommandInfo& info) {
+        return info.handler == &Server::subscribe_command || info.handler == &Server::unsubscribe_command ||
+            info.handler == &Server::psubscribe_command || info.handler == &Server::punsubscribe_command ||
+            info.handler == &Server::ping_command || info.handler == &Server::quit_command;
+    }
+
+    Reply Server::subscribe(const CommandCall& call, bool pattern) {
+        Connection* connection = call.connection;
+        if (!connection) {
+            return "-ERR SUBSCRIBE needs a connection\r\n";
+        }
+        std::unordered_set<std::string>& names = pattern ? connection->patterns : connection->channels;
+        for (size_t i = 1; i < call.args.size(); ++i) {
+            std::string_view name = call.args[i];
+            bool added = pattern ? pubsub_.psubscribe(connection->shared_from_this(), name)
+                : pubsub_.subscribe(connection->shared_from_this(), name);
+            if (added) {
+                names.emplace(name);
+            }
+            append_subscription(call.out, pattern ? "psubscribe" : "subscribe", &name, connection->subscriptions());
+        }
+        return {};
+    }
+
+    Reply Server::unsubscribe(const CommandCall& call, bool pattern) {
+        Connection* connection = call.connection;
+        if (!connection) {
+            return "-ERR UNSUBSCRIBE needs a connection\r\n";
+        }
+        std::unordered_set<std::string>& names = pattern ? connection->patterns : connection->channels;
+        std::string_view kind = pattern ? "punsubscribe" : "unsubscribe";
+
+        // Without arguments: every subscription, and one reply even if none
+        std::vector<std::string> targets;
+        if (call.args.size() == 1) {
+            targets.assign(names.begin(), names.end());
+            if (targets.empty()) {
+                append_subscription(call.out, kind, nullptr, connection->subscriptions());
+            }
+        }
+        else {
+            targets.assign(call.args.begin() + 1, call.args.end());
+        }
+        for (const std::string& name : targets) {
+            bool removed = pattern ? pubsub_.punsubscribe(*connection, name)
+                : pubsub_.unsubscribe(*connection, name);
+            if (removed) {
+                names.erase(name);
+            }
+            std::string_view view = name;
+            append_subscription(call.out, kind, &view, connection->subscriptions());
+        }
+        return {};
+    }
+
+    Reply Server::subscribe_command(const CommandCall& call) {
+        return subscribe(call, false);
+    }
+
+    Reply Server::unsubscribe_command(const CommandCall& call) {
+        return unsubscribe(call, false);
+    }
+
+    Reply Server::psubscribe_command(const CommandCall& call) {
+        return subscribe(call, true);
+    }
+
+    Reply Server::punsubscribe_command(const CommandCall& call) {
+        return unsubscribe(call, true);
+    }
+
+    Reply Server::publish_command(const CommandCall& call) {
+        // Every subscriber gets a reference to the same encoded message in
+        // its inbox; the first one queued schedules delivery on the
+        // subscriber's executor
+        size_t receivers = pubsub_.publish(call.args[1], call.args[2],
+            [this](const std::shared_ptr<Connection>& subscriber, SharedString& message) {
+                size_t queued = subscriber->stats().pending_output.load(std::memory_order_relaxed) +
+                    subscriber->queued_message_bytes();
+                if (queued > config_.pubsub_hard_limit) {
+                    if (!subscriber->messages_dropped.exchange(true)) {
+                        asio::post(subscriber->executor(), [this, subscriber]() {
+                            log_warning("Disconnecting subscriber ", subscriber->address(),
+                                ": over the hard output limit");
+                            close_connection(subscriber);
+                        });
+                    }
+                    return;
+                }
+                if (subscriber->push_message(message)) {
+                    asio::post(subscriber->executor(), [this, subscriber]() {
+                        deliver_messages(subscriber);
+                    });
+                }
+            });
+
+        // Replicas pass messages on to their own subscribers
+        if (primary_->active()) {
+            std::string record;
+            blitzdb::append_command(record, call.args);
+            primary_->on_change(record);
+        }
+        return Reply::integer(static_cast<long long>(receivers));
+    }
+
+    Reply Server::pubsub_command(const CommandCall& call) {
+        const std::vector<std::string_view>& tokens = call.args;
+        std::string sub(tokens[1]);
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub == "CHANNELS" && tokens.size() <= 3) {
+            std::vector<std::string> names = pubsub_.channels(tokens.size() == 3 ? tokens[2] : std::string_view());
+            call.out.array(names.size());
+            for (const std::string& name : names) {
+                call.out.bulk(name);
+            }
+            return {};
+        }
+        if (sub == "NUMSUB") {
+            call.out.array(2 * (tokens.size() - 2));
+            for (size_t i = 2; i < tokens.size(); ++i) {
+                call.out.bulk(tokens[i]);
+                call.out.integer(static_cast<long long>(pubsub_.subscribers(tokens[i])));
+            }
+            return {};
+        }
+        if (sub == "NUMPAT" && tokens.size() == 2) {
+            return Reply::integer(static_cast<long long>(pubsub_.pattern_count()));
+        }
+        return "-ERR Unknown PUBSUB subcommand or wrong number of arguments\r\n";
+    }
+
+    Reply Server::psync_command(const CommandCall& call) {
+        // PSYNC <replid> <offset>: the connection becomes a replication
+        // link and gets no further replies
+        long long offset = 0;
+        if (!parse_integer(call.args[2], offset)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (!call.connection) {
+            return "-ERR PSYNC needs a connection\r\n";
+        }
+        if (following_.load()) {
+            return "-ERR PSYNC is not supported by a replica\r\n";
+        }
+        primary_->attach(call.connection->socket(), call.args[1], offset);
+        call.connection->replica = true;
+        return {};
+    }
+
+    Reply Server::replconf_command(const CommandCall& call) {
+        const std::vector<std::string_view>& tokens = call.args;
+        std::string option(tokens[1]);
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        long long value = 0;
+        if ((option == "LISTENING-PORT" || option == "ACK") &&
+            (tokens.size() != 3 || !parse_integer(tokens[2], value) || value < 0)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (option == "LISTENING-PORT" && call.connection) {
+            primary_->set_listening_port(call.connection->socket(), static_cast<unsigned short>(value));
+        }
+        else if (option == "ACK") {
+            // Acknowledgements are never answered
+            if (call.connection) {
+                primary_->acknowledge(call.connection->socket().get(), static_cast<uint64_t>(value));
+            }
+            return {};
+        }
+        return "+OK\r\n";  // Other options are accepted and ignored
+    }
+
+    Reply Server::replicaof_command(const CommandCall& call) {
+        const std::vector<std::string_view>& tokens = call.args;
+        if (iequals(tokens[1], "NO") && iequals(tokens[2], "ONE")) {
+            follow("", 0);
+            return "+OK\r\n";
+        }
+        long long port = 0;
+        if (!parse_integer(tokens[2], port) || port <= 0 || port > 65535) {
+            return "-ERR Invalid master port\r\n";
+        }
+        follow(std::string(tokens[1]), static_cast<unsigned short>(port));
+        return "+OK\r\n";
+    }
+
+    Reply Server::role_command(const CommandCall&) {
+        // Same shape as Redis' reply so existing tooling understands it
+        std::lock_guard<std::mutex> lock(replication_mutex_);
+        if (replica_) {
+            ReplicaStatus status = replica_->status();
+            std::string state = status.state == "streaming" ? "connected"
+                : status.state == "handshake" ? "connecting" : status.state;
+            return "*5\r\n$5\r\nslave\r\n" + bulk_reply(status.host) +
+                ":" + std::to_string(status.port) + "\r\n" + bulk_reply(state) +
+                ":" + std::to_string(status.offset) + "\r\n";
+        }
+        auto replicas = primary_->replicas();
+        std::string reply = "*3\r\n$6\r\nmaster\r\n:" + std::to_string(primary_->offset()) +
+            "\r\n*" + std::to_string(replicas.size()) + "\r\n";
+        for (const auto& replica : replicas) {
+            reply += "*3\r\n" + bulk_reply(replica.address) + bulk_reply(std::to_string(replica.port)) +
+                bulk_reply(std::to_string(replica.ack_offset));
+        }
+        return reply;
+    }
+
+    std::string Server::replication_report() const {
+        std::lock_guard<std::mutex> lock(replication_mutex_);
+        std::string report;
+        if (replica_) {
+            ReplicaStatus status = replica_->status();
+            report += "role:replica\r\n"
+                "primary_host:" + status.host + "\r\n" +
+                "primary_port:" + std::to_string(status.port) + "\r\n" +
+                "link:" + (status.link_up ? "up" : "down") + "\r\n" +
+                "state:" + status.state + "\r\n" +
+                "primary_replid:" + status.replid + "\r\n" +
+                "offset:" + std::to_string(status.offset) + "\r\n" +
+                "last_io_ms:" + std::to_string(status.last_io_ms) + "\r\n" +
+                "full_syncs:" + std::to_string(status.full_syncs) + "\r\n" +
+                "partial_syncs:" + std::to_string(status.partial_syncs) + "\r\n";
+            return report;
+        }
+
+        // One line per replica: what it acknowledged and how far behind it is
+        auto replicas = primary_->replicas();
+        report += "role:primary\r\n"
+            "replid:" + primary_->replid() + "\r\n" +
+            "offset:" + std::to_string(primary_->offset()) + "\r\n" +
+            "backlog_start:" + std::to_string(primary_->backlog_start()) + "\r\n" +
+            "backlog_size:" + std::to_string(primary_->backlog_capacity()) + "\r\n" +
+            "replicas:" + std::to_string(replicas.size()) + "\r\n";
+        for (size_t i = 0; i < replicas.size(); ++i) {
+            const ReplicaInfo& replica = replicas[i];
+            report += "replica:" + std::to_string(i) +
+                " address=" + replica.address +
+                " port=" + std::to_string(replica.port) +
+                " state=" + (replica.online ? "online" : "sync") +
+                " ack_offset=" + std::to_string(replica.ack_offset) +
+                " lag_bytes=" + std::to_string(replica.lag_bytes) +
+                " last_ack_ms=" + std::to_string(replica.last_ack_ms) +
+                " pending_bytes=" + std::to_string(replica.pending_bytes) + "\r\n";
+        }
+        return report;
     }
 
 } // namespace blitzdb
@@ -1,81 +1,364 @@
 #pragma once
 #include <asio.hpp>
 #include <memory>
-#include <unordered_set>
+#include <optional>
 #include <mutex>
 #include <atomic>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include "../core/storage/in_memory.h"
+#include "../core/storage/persistent.h"
+#include "../core/storage/snapshot.h"
+#include "../core/storage/tiered.h"
+#include "../replication/primary.h"
+#include "../replication/replica.h"
+#include "command_table.h"
+#include "connection.h"
+#include "metrics.h"
+#include "output_buffer.h"
+#include "protocols/resp.h"
+#include "pubsub.h"
 
 namespace blitzdb {
 
-    // Command enumeration
-    enum class Command {
-        UNKNOWN,
-        PING,
-        SET,
-        GET,
-        DEL,
-        QUIT,
-        AUTH,
-        // Add more commands here
+    // What a command returns, encoded into the connection's output buffer
+    // right after it ran: usually a string literal or an integer, which
+    // need no allocation; text built for rarer replies; or nothing, when
+    // the command encoded its reply into the buffer itself.
+    class Reply {
+    public:
+        Reply() = default;
+        Reply(const char* encoded) : kind_(Kind::View), view_(encoded) {}
+        Reply(std::string encoded) : kind_(Kind::Text), text_(std::move(encoded)) {}
+
+        static Reply integer(long long value) {
+            Reply reply;
+            reply.kind_ = Kind::Integer;
+            reply.integer_ = value;
+            return reply;
+        }
+
+        void write_to(OutputBuffer& out) const;
+
+    private:
+        enum class Kind : uint8_t { None, View, Text, Integer };
+
+        Kind kind_ = Kind::None;
+        std::string_view view_;
+        std::string text_;
+        long long integer_ = 0;
     };
 
-    // Command metadata structure
+    class Server;
+
+    // A command being run: its arguments (the name first) and the buffer
+    // its reply goes to. The connection is null when the server replays
+    // its log or a primary's stream.
+    struct CommandCall {
+        Connection* connection;
+        const std::vector<std::string_view>& args;
+        OutputBuffer& out;
+    };
+
+    // One entry of the command table
     struct CommandInfo {
-        Command cmd;
-        int min_args;
-        int max_args;
-        bool auth_required;
-        // Add more metadata as needed (ACL categories, etc.)
+        std::string_view name;  // Lowercase
+        int arity;              // Arguments including the name; -N means at least N
+        uint32_t flags;         // CommandFlag bits
+        KeySpec keys;
+        Reply (Server::*handler)(const CommandCall& call);
+    };
+
+    // How connections are spread over threads
+    enum class ThreadMode {
+        // All threads run one io_context; each connection's handlers are
+        // serialized through its own strand
+        Pool,
+        // Shared-nothing: one io_context and one acceptor per core (bound
+        // with SO_REUSEPORT where available). Each core owns a slice of the
+        // storage shards, and single-key commands run on the owning core.
+        PerCore,
     };
 
-    class Server {
+    // How client sockets are driven
+    enum class IoBackend {
+        // asio's reactor: readiness from epoll, then read() and write()
+        Epoll,
+        // io_uring with multishot accept and receive, provided buffers and
+        // one submission per loop iteration (built with BLITZDB_WITH_IO_URING;
+        // falls back to Epoll where unavailable)
+        IoUring,
+    };
+
+    // Startup configuration
+    struct ServerConfig {
+        unsigned short port = 6380;
+
+        // Commands executed from one connection's buffer before its replies
+        // are flushed and other connections get a turn
+        size_t max_batch_commands = 1024;
+
+        // Reply bytes a client may have queued or in flight. Above the soft
+        // limit the server stops reading (and executing) its pipelined
+        // commands until it catches up, and disconnects it if it stays
+        // there for `output_soft_seconds` (0 = never). Above the hard limit
+        // it is disconnected at once.
+        size_t output_soft_limit = 4 * 1024 * 1024;
+        size_t output_hard_limit = 256 * 1024 * 1024;
+        unsigned output_soft_seconds = 60;
+
+        // The same limits for subscribed clients, whose output is messages
+        // pushed by publishers. A publisher skips a subscriber above the
+        // hard limit and has it disconnected, so a slow subscriber never
+        // holds publishers up or queues without bound.
+        size_t pubsub_soft_limit = 8 * 1024 * 1024;
+        size_t pubsub_hard_limit = 32 * 1024 * 1024;
+        unsigned pubsub_soft_seconds = 60;
+
+        // Independently locked keyspace partitions (rounded up to a power of two)
+        size_t storage_shards = InMemoryStorage::kDefaultShards;
+
+        // Client commands that take at least this many microseconds are
+        // kept in the slow log (negative disables it), up to this many
+        int64_t slowlog_log_slower_than = 10000;
+        size_t slowlog_max_len = 128;
+
+        // Background task frequency (active expiry runs once per tick and
+        // may use up to a quarter of the tick)
+        unsigned hz = 10;
+
+        // Threads serving connections (cores in PerCore mode)
+        size_t threads = 1;
+        ThreadMode thread_mode = ThreadMode::Pool;
+
+        // Socket I/O. io_uring needs one thread per event loop, so it
+        // applies to per-core mode and to a single thread. With a busy-poll
+        // bound an idle loop watches for completions for up to that many
+        // microseconds before sleeping (0 = never).
+        IoBackend io_backend = IoBackend::Epoll;
+        unsigned io_uring_busy_poll_us = 0;
+
+        // Memory limit for the keyspace in bytes (0 = unlimited) and what
+        // writes do once it is reached
+        size_t max_memory = 0;
+        EvictionPolicy eviction_policy = EvictionPolicy::NoEviction;
+        size_t eviction_samples = InMemoryStorage::kDefaultEvictionSamples;
+
+        // Deleted or overwritten values with at least this many heap bytes
+        // are freed by a background thread (0 = always inline)
+        size_t lazyfree_threshold = InMemoryStorage::kDefaultLazyFreeThreshold;
+
+        // Hashes stay in one packed buffer up to this many fields, each
+        // field and value at most this long, and become tables beyond
+        size_t hash_max_packed_fields = HashLimits{}.max_packed_fields;
+        size_t hash_max_packed_length = HashLimits{}.max_packed_length;
+
+        // Append-only log: replayed at startup, then every change is
+        // appended. The log is rewritten in the background once it has
+        // doubled since the last rewrite and is at least the minimum size.
+        bool append_only = false;
+        std::string append_only_path = "appendonly.aof";
+        FsyncPolicy append_fsync = FsyncPolicy::EverySec;
+        uint64_t auto_rewrite_min_size = 64 * 1024 * 1024;
+
+        // Binary snapshot written by SAVE / BGSAVE. It is loaded at startup
+        // unless the append-only log is enabled, which is the more recent
+        // of the two.
+        std::string snapshot_path = "dump.bdb";
+
+        // Tiered storage, off unless a value log path is set: values idle
+        // for `tiered_cold_seconds` move to the log on local disk (see
+        // TieredStorage). `tiered_max_size` bounds the log.
+        std::string tiered_path;
+        size_t tiered_max_size = TieredStorage::Options{}.capacity;
+        uint32_t tiered_cold_seconds = TieredStorage::Options{}.cold_seconds;
+        size_t tiered_min_value = TieredStorage::Options{}.min_value_bytes;
+
+        // Replication. With a primary set the server follows it and refuses
+        // writes from clients. As a primary it keeps the most recent
+        // `repl_backlog_size` bytes of its change stream so replicas that
+        // lose the link briefly can continue where they left off, and drops
+        // a replica that has more than `repl_output_limit` bytes queued.
+        std::string replica_of_host;
+        unsigned short replica_of_port = 0;
+        std::string primary_auth = "defaultpass";
+        size_t repl_backlog_size = 16 * 1024 * 1024;
+        size_t repl_output_limit = 256 * 1024 * 1024;
+    };
+
+    class Server : private ReplicationSink {
     public:
         Server(asio::io_context& io_context, unsigned short port);
+        Server(asio::io_context& io_context, const ServerConfig& config);
+        ~Server() override;
 
         // Start accepting connections
         void start();
 
+        // Runs the event loops on the configured threads; returns once the
+        // server has been stopped and all work has drained
+        void run();
+
         // Shutdown gracefully
         void stop();
 
     private:
         // Connection handlers
-        void handle_connection(std::shared_ptr<asio::ip::tcp::socket> socket);
-        void handle_disconnection(std::shared_ptr<asio::ip::tcp::socket> socket);
-
-        // Command processing
-        std::vector<std::string> parse_command(const std::string& input);
-        bool validate_command(const CommandInfo& info, const std::vector<std::string>& tokens);
-        std::string process_command(std::shared_ptr<asio::ip::tcp::socket> socket,
-            const std::vector<std::string>& tokens);
-
-        // Response handling
-        void write_response(
-            std::shared_ptr<asio::ip::tcp::socket> socket,
-            const std::string& response,
-            std::function<void()> callback = nullptr
-        );
-
-        // Authentication
-        bool is_authenticated(std::shared_ptr<asio::ip::tcp::socket> socket);
-        void authenticate_client(std::shared_ptr<asio::ip::tcp::socket> socket);
-        void deauthenticate_client(std::shared_ptr<asio::ip::tcp::socket> socket);
+        void accept(size_t index);
+        void setup_io_uring();
+#if defined(BLITZDB_HAS_IO_URING)
+        void accept_uring(size_t index, int fd);
+#endif
+        // Runs after a write completes (bytes written, or an error)
+        void write_done(std::shared_ptr<Connection> connection, const asio::error_code& ec, size_t bytes);
+        void read_request(std::shared_ptr<Connection> connection);
+        void process_buffer(std::shared_ptr<Connection> connection);
+        void flush_output(std::shared_ptr<Connection> connection);
+        void close_connection(std::shared_ptr<Connection> connection);
+        // Moves published messages to the connection's output and sends them
+        void deliver_messages(std::shared_ptr<Connection> connection);
+        bool forward_command(std::shared_ptr<Connection> connection, const CommandInfo* info);
+        // Applies the output limits; false once the connection was dropped
+        bool check_output_limits(const std::shared_ptr<Connection>& connection);
+
+        // Periodic background work (active key expiry, log rewrites)
+        void schedule_cron();
+
+        // Replays the append-only log into the keyspace
+        void load_append_only_log();
+        void load_snapshot_file();
+
+        // Replication: following a primary (an empty host stops following)
+        // and applying its stream
+        void follow(const std::string& host, unsigned short port);
+        void reset_stream() override;
+        size_t apply_stream(std::string_view data) override;
+        void full_sync_done(const SnapshotStats& stats) override;
+
+        // Command processing. Each command has a handler below, listed
+        // in the command table in server.cpp.
+        friend struct CommandTable;
+        static const CommandInfo* lookup_command(std::string_view name);
+        static bool check_arity(const CommandInfo& info, size_t count);
+        // Runs a command and encodes its reply into `out`; a null `info`
+        // is an unknown command
+        void process_command(Connection* connection, const CommandInfo* info,
+            const std::vector<std::string_view>& tokens, OutputBuffer& out);
+
+        // Connection and server
+        Reply ping_command(const CommandCall& call);
+        Reply quit_command(const CommandCall& call);
+        Reply auth_command(const CommandCall& call);
+        Reply select_command(const CommandCall& call);
+        Reply client_command(const CommandCall& call);
+        Reply command_command(const CommandCall& call);
+        Reply config_command(const CommandCall& call);
+        Reply debug_command(const CommandCall& call);
+        Reply flushall_command(const CommandCall& call);
+
+        // Introspection
+        Reply info_command(const CommandCall& call);
+        Reply latency_command(const CommandCall& call);
+        Reply slowlog_command(const CommandCall& call);
+        std::string info_section(std::string_view section) const;
+
+        // Strings and keys
+        Reply get_command(const CommandCall& call);
+        Reply set_command(const CommandCall& call);
+        Reply del_command(const CommandCall& call);
+        Reply unlink_command(const CommandCall& call);
+        Reply exists_command(const CommandCall& call);
+        Reply mget_command(const CommandCall& call);
+        Reply mset_command(const CommandCall& call);
+        Reply msetnx_command(const CommandCall& call);
+        Reply incr_command(const CommandCall& call);
+        Reply decr_command(const CommandCall& call);
+        Reply incrby_command(const CommandCall& call);
+        Reply decrby_command(const CommandCall& call);
+        Reply incrbyfloat_command(const CommandCall& call);
+        Reply increment(std::string_view key, long long delta);
+        Reply append_command(const CommandCall& call);
+        Reply strlen_command(const CommandCall& call);
+        Reply getrange_command(const CommandCall& call);
+        Reply setrange_command(const CommandCall& call);
+        Reply expire_command(const CommandCall& call);
+        Reply pexpire_command(const CommandCall& call);
+        Reply expireat_command(const CommandCall& call);
+        Reply pexpireat_command(const CommandCall& call);
+        Reply set_expiry(const std::vector<std::string_view>& tokens, int64_t unit_ms, bool absolute);
+        Reply ttl_command(const CommandCall& call);
+        Reply pttl_command(const CommandCall& call);
+        Reply persist_command(const CommandCall& call);
+
+        // Hashes
+        Reply hset_command(const CommandCall& call);
+        Reply hget_command(const CommandCall& call);
+        Reply hmget_command(const CommandCall& call);
+        Reply hdel_command(const CommandCall& call);
+        Reply hgetall_command(const CommandCall& call);
+        Reply hincrby_command(const CommandCall& call);
+        Reply hlen_command(const CommandCall& call);
+
+        // Persistence
+        Reply bgrewriteaof_command(const CommandCall& call);
+        Reply save_command(const CommandCall& call);
+        Reply bgsave_command(const CommandCall& call);
+        Reply lastsave_command(const CommandCall& call);
+
+        // Pub/Sub
+        Reply subscribe_command(const CommandCall& call);
+        Reply unsubscribe_command(const CommandCall& call);
+        Reply psubscribe_command(const CommandCall& call);
+        Reply punsubscribe_command(const CommandCall& call);
+        Reply publish_command(const CommandCall& call);
+        Reply pubsub_command(const CommandCall& call);
+        Reply subscribe(const CommandCall& call, bool pattern);
+        Reply unsubscribe(const CommandCall& call, bool pattern);
+        static bool allowed_when_subscribed(const CommandInfo& info);
+
+        // Replication
+        Reply psync_command(const CommandCall& call);
+        Reply replconf_command(const CommandCall& call);
+        Reply replicaof_command(const CommandCall& call);
+        Reply role_command(const CommandCall& call);
+        std::string replication_report() const;
 
         // Members
-        asio::ip::tcp::acceptor acceptor_;
+        ServerConfig config_;
+        std::vector<std::unique_ptr<asio::io_context>> owned_contexts_;
+        std::vector<asio::io_context*> contexts_;  // One per core (PerCore) or just one (Pool)
+        std::vector<asio::executor_work_guard<asio::io_context::executor_type>> work_guards_;
+        std::vector<std::unique_ptr<asio::ip::tcp::acceptor>> acceptors_;
+        std::atomic<size_t> next_core_{ 0 };
+#if defined(BLITZDB_HAS_IO_URING)
+        std::vector<std::unique_ptr<UringLoop>> rings_;  // One per context with the io_uring backend
+        std::vector<std::unique_ptr<UringAcceptor>> uring_acceptors_;
+#endif
         InMemoryStorage storage_;
+        std::unique_ptr<TieredStorage> tiered_;  // Outlives everything that reads values
+        std::unique_ptr<AppendOnlyLog> aof_;
+        std::unique_ptr<SnapshotSaver> snapshots_;
+        std::unique_ptr<ReplicationPrimary> primary_;
+        std::unique_ptr<ChangeTee> change_tee_;  // Log and replication both observing
+        std::shared_ptr<ReplicaClient> replica_;  // Set while following a primary
+        std::atomic<bool> following_{ false };
+        mutable std::mutex replication_mutex_;    // Guards replica_
+        resp::RequestParser stream_parser_;       // Replication stream (replica strand only)
+        std::vector<std::string_view> stream_args_;
+        OutputBuffer stream_replies_;  // Discarded
+        std::unique_ptr<asio::steady_timer> cron_timer_;
         std::atomic<bool> running_{ false };
+        int64_t started_ms_;
+
+        // Instrumentation
+        Metrics metrics_;
+        SlowLog slowlog_;
 
         // Connection tracking
-        std::unordered_set<std::shared_ptr<asio::ip::tcp::socket>> authenticated_clients_;
-        std::vector<std::weak_ptr<asio::ip::tcp::socket>> active_connections_;
-        std::mutex connections_mutex_;
-        std::mutex auth_mutex_;
-
-        // Command mappings (could be moved to a separate class)
-        static const std::unordered_map<std::string, Command> command_map;
-        static const std::unordered_map<Command, CommandInfo> command_info;
+        ConnectionTable connections_;
+        PubSub pubsub_;
+        std::atomic<uint64_t> next_connection_id_{ 1 };
     };
 
 } // namespace blitzdb
\ No newline at end of file
@@ -0,0 +1,574 @@
+#include "uring.h"
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace blitzdb {
+
+    namespace {
+
+        // The raw system calls; liburing is not required
+        int io_uring_setup(unsigned entries, io_uring_params* params) {
+            return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+        }
+
+        int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+        }
+
+        int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned count) {
+            return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+        }
+
+        // Ring indices are shared with the kernel
+        unsigned load_acquire(const unsigned* value) {
+            return std::atomic_ref<const unsigned>(*value).load(std::memory_order_acquire);
+        }
+
+        void store_release(unsigned* value, unsigned next) {
+            std::atomic_ref<unsigned>(*value).store(next, std::memory_order_release);
+        }
+
+        void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+
+        [[noreturn]] void fail(const char* what) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        constexpr unsigned kMinPollWindowUs = 2;
+        constexpr uint16_t kBufferGroup = 0;
+
+    } // namespace
+
+    // The mapped queues and the provided buffer ring
+    struct UringLoop::Ring {
+        int fd = -1;
+        int event_fd = -1;
+
+        void* rings = nullptr;
+        size_t rings_size = 0;
+        io_uring_sqe* sqes = nullptr;
+        size_t sqes_size = 0;
+
+        unsigned* sq_head = nullptr;
+        unsigned* sq_tail = nullptr;
+        unsigned* sq_flags = nullptr;
+        unsigned sq_mask = 0;
+        unsigned sq_entries = 0;
+        unsigned sq_local_tail = 0;  // Prepared, not yet published
+        unsigned sq_submitted = 0;   // Published and handed to the kernel
+
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        unsigned* cq_flags = nullptr;
+        unsigned cq_mask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        // The kernel's io_uring_buf_ring, as an array: the header declares
+        // it with a flexible array that C++ places 8 bytes in. The tail
+        // overlays the reserved field of the first entry.
+        io_uring_buf* buffer_ring = nullptr;
+        size_t buffer_ring_size = 0;
+        char* buffers = nullptr;
+        size_t buffers_size = 0;
+        unsigned buffer_mask = 0;
+        uint16_t buffer_tail = 0;
+
+        ~Ring() {
+            if (buffers) munmap(buffers, buffers_size);
+            if (buffer_ring) munmap(buffer_ring, buffer_ring_size);
+            if (sqes) munmap(sqes, sqes_size);
+            if (rings) munmap(rings, rings_size);
+            if (fd >= 0) ::close(fd);
+        }
+    };
+
+    UringLoop::UringLoop(asio::io_context& context, const UringOptions& options)
+        : context_(context), options_(options), ring_(std::make_unique<Ring>()), wake_(context),
+        poll_window_us_(options.busy_poll_us) {
+        Ring& ring = *ring_;
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CLAMP;
+        ring.fd = io_uring_setup(options_.entries, &params);
+        if (ring.fd < 0) {
+            fail("io_uring_setup");
+        }
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+            errno = ENOSYS;
+            fail("io_uring features");
+        }
+
+        // Submission and completion rings share one mapping
+        ring.rings_size = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        ring.rings = mmap(nullptr, ring.rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring.fd, IORING_OFF_SQ_RING);
+        if (ring.rings == MAP_FAILED) {
+            ring.rings = nullptr;
+            fail("mmap io_uring rings");
+        }
+        ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring.fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            fail("mmap io_uring sqes");
+        }
+        ring.sqes = static_cast<io_uring_sqe*>(sqes);
+
+        char* base = static_cast<char*>(ring.rings);
+        ring.sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+        ring.sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        ring.sq_flags = reinterpret_cast<unsigned*>(base + params.sq_off.flags);
+        ring.sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        ring.sq_entries = params.sq_entries;
+        ring.sq_local_tail = ring.sq_submitted = *ring.sq_tail;
+        // Slot i of the submission array always names entry i
+        unsigned* array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        for (unsigned i = 0; i < params.sq_entries; ++i) {
+            array[i] = i;
+        }
+        ring.cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        ring.cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        ring.cq_flags = reinterpret_cast<unsigned*>(base + params.cq_off.flags);
+        ring.cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        ring.cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+        // Receive buffers, handed to the kernel through a buffer ring
+        unsigned count = 1;
+        while (count < options_.buffers && count < 32768) {
+            count <<= 1;
+        }
+        ring.buffer_mask = count - 1;
+        ring.buffer_ring_size = count * sizeof(io_uring_buf);
+        void* buffer_ring = mmap(nullptr, ring.buffer_ring_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer_ring == MAP_FAILED) {
+            fail("mmap buffer ring");
+        }
+        ring.buffer_ring = static_cast<io_uring_buf*>(buffer_ring);
+        ring.buffers_size = static_cast<size_t>(count) * options_.buffer_size;
+        void* buffers = mmap(nullptr, ring.buffers_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffers == MAP_FAILED) {
+            fail("mmap receive buffers");
+        }
+        ring.buffers = static_cast<char*>(buffers);
+
+        io_uring_buf_reg registration{};
+        registration.ring_addr = reinterpret_cast<uint64_t>(ring.buffer_ring);
+        registration.ring_entries = count;
+        registration.bgid = kBufferGroup;
+        if (io_uring_register(ring.fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+            fail("io_uring provided buffer ring");
+        }
+        for (unsigned i = 0; i < count; ++i) {
+            io_uring_buf& buffer = ring.buffer_ring[i];
+            buffer.addr = reinterpret_cast<uint64_t>(ring.buffers + static_cast<size_t>(i) * options_.buffer_size);
+            buffer.len = options_.buffer_size;
+            buffer.bid = static_cast<uint16_t>(i);
+        }
+        ring.buffer_tail = static_cast<uint16_t>(count);
+        std::atomic_ref<uint16_t>(ring.buffer_ring[0].resv).store(ring.buffer_tail, std::memory_order_release);
+
+        ring.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ring.event_fd < 0) {
+            fail("eventfd");
+        }
+        wake_.assign(ring.event_fd);
+        if (io_uring_register(ring.fd, IORING_REGISTER_EVENTFD, &ring.event_fd, 1) < 0) {
+            fail("io_uring eventfd");
+        }
+    }
+
+    UringLoop::~UringLoop() {
+        asio::error_code ec;
+        wake_.close(ec);
+    }
+
+    void UringLoop::start() {
+        wait();
+    }
+
+    void UringLoop::shutdown() {
+        stopping_ = true;
+        if (in_flight_ == 0) {
+            asio::error_code ec;
+            wake_.cancel(ec);
+        }
+    }
+
+    void* UringLoop::prepare(uint8_t opcode, int fd, UringOperation* op) {
+        Ring& ring = *ring_;
+        if (ring.sq_local_tail - load_acquire(ring.sq_head) == ring.sq_entries) {
+            submit();  // Full: the kernel consumes everything on submission
+        }
+        io_uring_sqe* sqe = &ring.sqes[ring.sq_local_tail & ring.sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = reinterpret_cast<uint64_t>(op);
+        ++ring.sq_local_tail;
+        if (op) {
+            ++in_flight_;
+        }
+        schedule_submit();
+        return sqe;
+    }
+
+    void UringLoop::accept(int fd, UringOperation& op) {
+        auto* sqe = static_cast<io_uring_sqe*>(prepare(IORING_OP_ACCEPT, fd, &op));
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    }
+
+    void UringLoop::receive(int fd, UringOperation& op) {
+        auto* sqe = static_cast<io_uring_sqe*>(prepare(IORING_OP_RECV, fd, &op));
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+    }
+
+    void UringLoop::send(int fd, const msghdr* message, UringOperation& op) {
+        auto* sqe = static_cast<io_uring_sqe*>(prepare(IORING_OP_SENDMSG, fd, &op));
+        sqe->addr = reinterpret_cast<uint64_t>(message);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+    }
+
+    void UringLoop::cancel(UringOperation& op) {
+        // The cancellation's own completion carries no operation
+        auto* sqe = static_cast<io_uring_sqe*>(prepare(IORING_OP_ASYNC_CANCEL, -1, nullptr));
+        sqe->addr = reinterpret_cast<uint64_t>(&op);
+    }
+
+    std::string_view UringLoop::buffer(int result, uint32_t flags) const {
+        size_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+        return std::string_view(ring_->buffers + id * options_.buffer_size, static_cast<size_t>(result));
+    }
+
+    void UringLoop::release_buffer(uint32_t flags) {
+        if (!(flags & IORING_CQE_F_BUFFER)) {
+            return;
+        }
+        Ring& ring = *ring_;
+        uint16_t id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        io_uring_buf& buffer = ring.buffer_ring[ring.buffer_tail & ring.buffer_mask];
+        buffer.addr = reinterpret_cast<uint64_t>(ring.buffers + static_cast<size_t>(id) * options_.buffer_size);
+        buffer.len = options_.buffer_size;
+        buffer.bid = id;
+        ++ring.buffer_tail;
+        std::atomic_ref<uint16_t>(ring.buffer_ring[0].resv).store(ring.buffer_tail, std::memory_order_release);
+    }
+
+    void UringLoop::submit() {
+        Ring& ring = *ring_;
+        unsigned pending = ring.sq_local_tail - ring.sq_submitted;
+        if (pending == 0) {
+            return;
+        }
+        store_release(ring.sq_tail, ring.sq_local_tail);
+        while (pending > 0) {
+            int submitted = io_uring_enter(ring.fd, pending, 0, 0);
+            if (submitted < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EBUSY) {
+                    // Out of resources for now; completions free them
+                    io_uring_enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS);
+                    continue;
+                }
+                fail("io_uring_enter");
+            }
+            pending -= static_cast<unsigned>(submitted);
+            ring.sq_submitted += static_cast<unsigned>(submitted);
+        }
+    }
+
+    void UringLoop::schedule_submit() {
+        // Requests issued while reaping go out together at its end; the
+        // rest are collected until the handlers queued so far have run
+        if (reaping_ || submit_posted_) {
+            return;
+        }
+        submit_posted_ = true;
+        asio::post(context_, [this]() {
+            submit_posted_ = false;
+            submit();
+        });
+    }
+
+    void UringLoop::wait() {
+        wake_.async_wait(asio::posix::stream_descriptor::wait_read, [this](const asio::error_code& ec) {
+            if (ec) {
+                return;
+            }
+            on_wake();
+        });
+    }
+
+    void UringLoop::on_wake() {
+        uint64_t signals = 0;
+        while (::read(ring_->event_fd, &signals, sizeof(signals)) < 0 && errno == EINTR) {
+        }
+        reap();
+        if (options_.busy_poll_us > 0 && !stopping_) {
+            busy_poll();
+        }
+        if (stopping_ && in_flight_ == 0) {
+            return;
+        }
+        wait();
+    }
+
+    bool UringLoop::completions_ready() const {
+        const Ring& ring = *ring_;
+        return *ring.cq_head != load_acquire(ring.cq_tail) ||
+            (load_acquire(ring.sq_flags) & IORING_SQ_CQ_OVERFLOW);
+    }
+
+    size_t UringLoop::reap() {
+        Ring& ring = *ring_;
+        reaping_ = true;
+        size_t reaped = 0;
+        while (true) {
+            unsigned head = *ring.cq_head;
+            unsigned tail = load_acquire(ring.cq_tail);
+            if (head == tail) {
+                // Completions that did not fit are flushed by entering
+                if (load_acquire(ring.sq_flags) & IORING_SQ_CQ_OVERFLOW) {
+                    io_uring_enter(ring.fd, 0, 0, IORING_ENTER_GETEVENTS);
+                    continue;
+                }
+                break;
+            }
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = ring.cqes[head & ring.cq_mask];
+                auto* op = reinterpret_cast<UringOperation*>(cqe.user_data);
+                int result = cqe.res;
+                uint32_t flags = cqe.flags;
+                store_release(ring.cq_head, head + 1);
+                if (!op) {
+                    continue;
+                }
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    --in_flight_;
+                }
+                op->complete(result, flags);
+                ++reaped;
+            }
+        }
+        reaping_ = false;
+        submit();
+        if (stopping_ && in_flight_ == 0) {
+            asio::error_code ec;
+            wake_.cancel(ec);
+        }
+        return reaped;
+    }
+
+    void UringLoop::busy_poll() {
+        // Keep the other handlers of the loop from waiting too long: the
+        // window is bounded and polling ends at the first empty one
+        Ring& ring = *ring_;
+        std::atomic_ref<unsigned> cq_flags(*ring.cq_flags);
+        cq_flags.store(cq_flags.load(std::memory_order_relaxed) | IORING_CQ_EVENTFD_DISABLED, std::memory_order_release);
+        bool found = false;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(poll_window_us_);
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (completions_ready()) {
+                reap();
+                found = true;
+                if (stopping_) {
+                    break;
+                }
+            }
+            else {
+                cpu_relax();
+            }
+        }
+        cq_flags.store(cq_flags.load(std::memory_order_relaxed) & ~IORING_CQ_EVENTFD_DISABLED, std::memory_order_release);
+        // What completed while signalling was off raised no event
+        if (completions_ready()) {
+            reap();
+        }
+        poll_window_us_ = found ? std::min(poll_window_us_ * 2, options_.busy_poll_us)
+            : std::max(poll_window_us_ / 2, std::min(kMinPollWindowUs, options_.busy_poll_us));
+    }
+
+    UringSocket::UringSocket(UringLoop& loop, int fd) : loop_(loop), fd_(fd) {
+    }
+
+    UringSocket::~UringSocket() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    void UringSocket::start_reading() {
+        want_reading_ = true;
+        if (!receive_armed_ && !read_ended_ && !closed_) {
+            receive_armed_ = true;
+            loop_.receive(fd_, receive_);
+        }
+    }
+
+    void UringSocket::pause_reading() {
+        want_reading_ = false;
+        if (receive_armed_) {
+            loop_.cancel(receive_);
+        }
+    }
+
+    void UringSocket::received(int result, uint32_t flags) {
+        if (!(flags & IORING_CQE_F_MORE)) {
+            receive_armed_ = false;
+        }
+        if (result > 0) {
+            if (!closed_ && on_data) {
+                on_data(loop_.buffer(result, flags));
+            }
+            loop_.release_buffer(flags);
+        }
+        else if (result != -ENOBUFS && result != -ECANCELED) {
+            // End of stream or a socket error
+            read_ended_ = true;
+            if (!closed_ && on_read_end) {
+                on_read_end(result == 0 ? 0 : -result);
+            }
+        }
+        if (!receive_armed_ && want_reading_ && !read_ended_ && !closed_) {
+            receive_armed_ = true;
+            loop_.receive(fd_, receive_);
+        }
+        finish_if_drained();
+    }
+
+    void UringSocket::send(const std::vector<asio::const_buffer>& buffers) {
+        iovecs_.clear();
+        for (const asio::const_buffer& buffer : buffers) {
+            if (buffer.size() > 0) {
+                iovecs_.push_back({ const_cast<void*>(buffer.data()), buffer.size() });
+            }
+        }
+        send_offset_ = 0;
+        sent_bytes_ = 0;
+        if (iovecs_.empty()) {
+            if (on_sent) {
+                on_sent(0, 0);
+            }
+            return;
+        }
+        message_ = msghdr{};
+        message_.msg_iov = iovecs_.data();
+        message_.msg_iovlen = iovecs_.size();
+        sending_ = true;
+        loop_.send(fd_, &message_, send_);
+    }
+
+    void UringSocket::sent(int result, uint32_t) {
+        if (result > 0) {
+            // Skip what was written; a short write is continued
+            size_t written = static_cast<size_t>(result);
+            sent_bytes_ += written;
+            while (send_offset_ < iovecs_.size() && written >= iovecs_[send_offset_].iov_len) {
+                written -= iovecs_[send_offset_].iov_len;
+                ++send_offset_;
+            }
+            if (send_offset_ < iovecs_.size()) {
+                iovec& partial = iovecs_[send_offset_];
+                partial.iov_base = static_cast<char*>(partial.iov_base) + written;
+                partial.iov_len -= written;
+                if (!closed_) {
+                    message_.msg_iov = iovecs_.data() + send_offset_;
+                    message_.msg_iovlen = iovecs_.size() - send_offset_;
+                    loop_.send(fd_, &message_, send_);
+                    return;
+                }
+            }
+        }
+        sending_ = false;
+        if (!closed_ && on_sent) {
+            int error = result < 0 ? -result : send_offset_ < iovecs_.size() ? EPIPE : 0;
+            on_sent(error, sent_bytes_);
+        }
+        finish_if_drained();
+    }
+
+    void UringSocket::close() {
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        want_reading_ = false;
+        // Ends the pending receive and any send in progress
+        ::shutdown(fd_, SHUT_RDWR);
+        if (receive_armed_) {
+            loop_.cancel(receive_);
+        }
+        finish_if_drained();
+    }
+
+    void UringSocket::finish_if_drained() {
+        if (!closed_ || receive_armed_ || sending_ || released_) {
+            return;
+        }
+        released_ = true;
+        // Not from inside a handler that may be the one released
+        asio::post(loop_.context(), [this]() {
+            ::close(fd_);
+            fd_ = -1;
+            auto data = std::move(on_data);
+            auto read_end = std::move(on_read_end);
+            auto sent = std::move(on_sent);
+            // These may hold the last reference to the socket's owner
+        });
+    }
+
+    UringAcceptor::UringAcceptor(UringLoop& loop, int fd, std::function<void(int fd)> on_accept)
+        : loop_(loop), fd_(fd), on_accept_(std::move(on_accept)) {
+    }
+
+    void UringAcceptor::start() {
+        if (!armed_ && !stopped_) {
+            armed_ = true;
+            loop_.accept(fd_, *this);
+        }
+    }
+
+    void UringAcceptor::stop() {
+        stopped_ = true;
+        if (armed_) {
+            loop_.cancel(*this);
+        }
+    }
+
+    void UringAcceptor::complete(int result, uint32_t flags) {
+        if (!(flags & IORING_CQE_F_MORE)) {
+            armed_ = false;
+        }
+        if (result >= 0) {
+            if (stopped_) {
+                ::close(result);
+            }
+            else {
+                on_accept_(result);
+            }
+        }
+        start();
+    }
+
+} // namespace blitzdb
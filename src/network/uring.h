@@ -0,0 +1,186 @@
+#pragma once
+
+// io_uring transport for client connections. Only built on Linux with
+// BLITZDB_WITH_IO_URING, which defines BLITZDB_HAS_IO_URING.
+#if defined(BLITZDB_HAS_IO_URING)
+
+#include <asio.hpp>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace blitzdb {
+
+    // A request submitted to a UringLoop. A multishot request completes
+    // several times; its last completion lacks IORING_CQE_F_MORE.
+    class UringOperation {
+    public:
+        virtual void complete(int result, uint32_t flags) = 0;
+
+    protected:
+        ~UringOperation() = default;
+    };
+
+    struct UringOptions {
+        unsigned entries = 1024;             // Submission queue slots
+        unsigned buffers = 256;              // Provided receive buffers (a power of two)
+        unsigned buffer_size = 16 * 1024;
+        unsigned busy_poll_us = 0;           // Longest busy-poll window; 0 disables it
+    };
+
+    // One io_uring instance serving the sockets of one event loop, used
+    // from that loop's thread only.
+    //
+    // Completions are signalled on an eventfd the io_context watches, so
+    // timers, posted handlers and asio sockets keep working alongside.
+    // One wake-up reaps every completion that is ready, and the requests
+    // their handlers issue (replies to many connections) go to the kernel
+    // in one io_uring_enter() at the end. Receives are multishot requests
+    // drawing from a ring of provided buffers, so an idle socket holds no
+    // buffer of its own.
+    //
+    // With busy polling the loop keeps watching the completion queue for
+    // a while before going back to sleep, with eventfd signalling off.
+    // The window doubles each time polling finds completions and halves
+    // each time it does not, up to the configured bound.
+    class UringLoop {
+    public:
+        // Throws std::system_error when the kernel lacks what the loop
+        // needs (provided buffer rings arrived in Linux 5.19, multishot
+        // receive in 6.0)
+        UringLoop(asio::io_context& context, const UringOptions& options);
+        UringLoop(const UringLoop&) = delete;
+        UringLoop& operator=(const UringLoop&) = delete;
+        ~UringLoop();
+
+        asio::io_context& context() { return context_; }
+
+        // Begins waiting for completions
+        void start();
+        // Stops waiting once every request has completed, so the
+        // io_context can run out of work
+        void shutdown();
+
+        // Requests; `op` must stay alive until its last completion
+        void accept(int fd, UringOperation& op);
+        void receive(int fd, UringOperation& op);
+        void send(int fd, const msghdr* message, UringOperation& op);
+        void cancel(UringOperation& op);
+
+        // The provided buffer a receive completion filled; it goes back
+        // to the ring with release_buffer() once consumed
+        std::string_view buffer(int result, uint32_t flags) const;
+        void release_buffer(uint32_t flags);
+
+    private:
+        struct Ring;
+
+        void* prepare(uint8_t opcode, int fd, UringOperation* op);
+        void submit();
+        void schedule_submit();
+        void wait();
+        void on_wake();
+        size_t reap();
+        bool completions_ready() const;
+        void busy_poll();
+
+        asio::io_context& context_;
+        UringOptions options_;
+        std::unique_ptr<Ring> ring_;
+        asio::posix::stream_descriptor wake_;
+
+        size_t in_flight_ = 0;   // Requests with a completion still to come
+        bool reaping_ = false;   // Submission waits for the end of the reap
+        bool submit_posted_ = false;
+        bool stopping_ = false;
+        unsigned poll_window_us_ = 0;
+    };
+
+    // A connected socket driven through a UringLoop. Data arrives through
+    // a multishot receive that stays armed until pause_reading(), the end
+    // of the stream or close() (it is re-armed when the buffer ring ran
+    // dry). One send is in flight at a time and is re-issued until all of
+    // it is written.
+    //
+    // The handlers are set once and may hold the socket's owner: they are
+    // released after close(), once the last request has completed, which
+    // keeps the socket alive exactly as long as the kernel may use it.
+    class UringSocket {
+    public:
+        UringSocket(UringLoop& loop, int fd);
+        UringSocket(const UringSocket&) = delete;
+        UringSocket& operator=(const UringSocket&) = delete;
+        ~UringSocket();
+
+        int fd() const { return fd_; }
+
+        std::function<void(std::string_view data)> on_data;
+        std::function<void(int error)> on_read_end;  // 0 when the peer closed
+        std::function<void(int error, size_t bytes)> on_sent;
+
+        void start_reading();
+        void pause_reading();
+        void send(const std::vector<asio::const_buffer>& buffers);
+
+        // Shuts the socket down; the descriptor is closed once drained
+        void close();
+
+    private:
+        struct Receive final : UringOperation {
+            explicit Receive(UringSocket& socket) : socket(socket) {}
+            void complete(int result, uint32_t flags) override { socket.received(result, flags); }
+            UringSocket& socket;
+        };
+        struct Send final : UringOperation {
+            explicit Send(UringSocket& socket) : socket(socket) {}
+            void complete(int result, uint32_t flags) override { socket.sent(result, flags); }
+            UringSocket& socket;
+        };
+
+        void received(int result, uint32_t flags);
+        void sent(int result, uint32_t flags);
+        void finish_if_drained();
+
+        UringLoop& loop_;
+        int fd_;
+        Receive receive_{ *this };
+        Send send_{ *this };
+        std::vector<iovec> iovecs_;
+        msghdr message_{};
+        size_t send_offset_ = 0;  // First iovec not fully written
+        size_t sent_bytes_ = 0;
+        bool want_reading_ = false;
+        bool receive_armed_ = false;
+        bool read_ended_ = false;
+        bool sending_ = false;
+        bool closed_ = false;
+        bool released_ = false;
+    };
+
+    // Multishot accept on a listening socket; on_accept gets each new
+    // descriptor (non-blocking, close-on-exec)
+    class UringAcceptor final : private UringOperation {
+    public:
+        UringAcceptor(UringLoop& loop, int fd, std::function<void(int fd)> on_accept);
+
+        void start();
+        void stop();
+
+    private:
+        void complete(int result, uint32_t flags) override;
+
+        UringLoop& loop_;
+        int fd_;
+        std::function<void(int fd)> on_accept_;
+        bool armed_ = false;
+        bool stopped_ = false;
+    };
+
+} // namespace blitzdb
+
+#endif
@@ -0,0 +1,40 @@
+#include "backlog.h"
+#include <algorithm>
+#include <cstring>
+
+namespace blitzdb {
+
+    ReplicationBacklog::ReplicationBacklog(size_t capacity) : ring_(std::max<size_t>(capacity, 1)) {}
+
+    void ReplicationBacklog::append(std::string_view data) {
+        // Only the tail of an oversized append can be kept
+        if (data.size() > ring_.size()) {
+            end_ += data.size() - ring_.size();
+            data.remove_prefix(data.size() - ring_.size());
+        }
+        size_t position = static_cast<size_t>(end_ % ring_.size());
+        size_t first = std::min(data.size(), ring_.size() - position);
+        std::memcpy(ring_.data() + position, data.data(), first);
+        std::memcpy(ring_.data(), data.data() + first, data.size() - first);
+        end_ += data.size();
+        held_ = std::min(ring_.size(), held_ + data.size());
+    }
+
+    void ReplicationBacklog::reset(uint64_t offset) {
+        end_ = offset;
+        held_ = 0;
+    }
+
+    bool ReplicationBacklog::copy_from(uint64_t offset, std::string& out) const {
+        if (offset < start_offset() || offset > end_) {
+            return false;
+        }
+        size_t length = static_cast<size_t>(end_ - offset);
+        size_t position = static_cast<size_t>(offset % ring_.size());
+        size_t first = std::min(length, ring_.size() - position);
+        out.append(ring_.data() + position, first);
+        out.append(ring_.data(), length - first);
+        return true;
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace blitzdb {
+
+    // Fixed-size ring holding the most recent bytes of the replication
+    // stream. Offsets count every byte ever appended, so a replica that
+    // reconnects with the offset it had reached can be served the rest
+    // from here as long as it has not been overwritten yet. Not
+    // synchronized; the owner serializes access.
+    class ReplicationBacklog {
+    public:
+        explicit ReplicationBacklog(size_t capacity);
+
+        void append(std::string_view data);
+
+        // Discards the contents and continues counting from `offset`
+        void reset(uint64_t offset);
+
+        // Offsets of the oldest byte held and one past the newest
+        uint64_t start_offset() const { return end_ - held_; }
+        uint64_t end_offset() const { return end_; }
+        size_t capacity() const { return ring_.size(); }
+
+        // Appends the bytes from `offset` to the end to `out`; false if that
+        // range is no longer (or not yet) in the ring
+        bool copy_from(uint64_t offset, std::string& out) const;
+
+    private:
+        std::vector<char> ring_;
+        uint64_t end_ = 0;
+        size_t held_ = 0;
+    };
+
+} // namespace blitzdb
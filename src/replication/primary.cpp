@@ -0,0 +1,397 @@
+#include "primary.h"
+#include "../core/storage/snapshot.h"
+#include "../core/utils/logger.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#if !defined(_WIN32)
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace blitzdb {
+
+    namespace {
+
+        // 40 hex digits naming one history of the replication stream
+        std::string make_replid() {
+            std::random_device device;
+            std::mt19937_64 generator((static_cast<uint64_t>(device()) << 32) ^ device() ^
+                static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+            static constexpr char kHex[] = "0123456789abcdef";
+            std::string id(40, '0');
+            for (char& c : id) {
+                c = kHex[generator() & 15];
+            }
+            return id;
+        }
+
+        int64_t steady_ms() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+#if !defined(_WIN32)
+        // Writes from the forked child to the replica's socket, which the
+        // parent keeps in non-blocking mode
+        void send_all(int fd, std::string_view data) {
+            constexpr int kStallMs = 60000;
+#if defined(MSG_NOSIGNAL)
+            constexpr int kFlags = MSG_NOSIGNAL;
+#else
+            constexpr int kFlags = 0;
+#endif
+            while (!data.empty()) {
+                ssize_t sent = ::send(fd, data.data(), data.size(), kFlags);
+                if (sent >= 0) {
+                    data.remove_prefix(static_cast<size_t>(sent));
+                    continue;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    throw std::runtime_error(std::strerror(errno));
+                }
+                pollfd target{ fd, POLLOUT, 0 };
+                if (::poll(&target, 1, kStallMs) == 0) {
+                    throw std::runtime_error("replica stopped reading");
+                }
+            }
+        }
+#endif
+
+    } // namespace
+
+    struct ReplicationPrimary::Link {
+        enum class State {
+            Handshake,  // Sent REPLCONF, not PSYNC yet
+            Syncing,    // Full sync in transfer; changes are queued
+            Online,
+        };
+
+        Socket socket;
+        std::string address;
+        unsigned short port = 0;
+        State state = State::Handshake;
+        std::string pending;     // Queued for writing
+        std::string writing;     // Buffer of the write in flight
+        bool flush_scheduled = false;
+        bool write_in_flight = false;
+        bool dropped = false;
+        uint64_t ack_offset = 0;
+        int64_t ack_time = -1;   // steady_ms() of the last acknowledgement
+    };
+
+    struct ReplicationPrimary::SyncJob {
+        std::thread thread;
+        std::atomic<bool> done{ false };
+        std::atomic<int64_t> child{ 0 };
+    };
+
+    ReplicationPrimary::ReplicationPrimary(const InMemoryStorage& storage, size_t backlog_size,
+        size_t output_limit, std::function<void()> activate)
+        : storage_(storage), output_limit_(output_limit), activate_(std::move(activate)),
+        replid_(make_replid()), backlog_(backlog_size) {}
+
+    ReplicationPrimary::~ReplicationPrimary() {
+        stopping_ = true;
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        for (auto& job : jobs_) {
+#if !defined(_WIN32)
+            if (int64_t child = job->child.load()) {
+                ::kill(static_cast<pid_t>(child), SIGKILL);
+            }
+#endif
+            job->thread.join();
+        }
+    }
+
+    void ReplicationPrimary::on_change(std::string_view record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        backlog_.append(record);
+
+        std::vector<std::shared_ptr<Link>> overflowed;
+        for (auto& [connection, link] : links_) {
+            if (link->state == Link::State::Handshake) {
+                continue;
+            }
+            link->pending.append(record);
+            if (link->pending.size() > output_limit_) {
+                overflowed.push_back(link);
+            }
+            else if (link->state == Link::State::Online) {
+                schedule_flush(link);
+            }
+        }
+        for (auto& link : overflowed) {
+            log_warning("Disconnecting replica ", link->address, ":", link->port,
+                ": output buffer limit reached");
+            drop(link);
+        }
+    }
+
+    std::shared_ptr<ReplicationPrimary::Link> ReplicationPrimary::link_for(const Socket& socket) {
+        auto& link = links_[socket.get()];
+        if (!link) {
+            link = std::make_shared<Link>();
+            link->socket = socket;
+            asio::error_code ec;
+            auto endpoint = socket->remote_endpoint(ec);
+            link->address = ec ? "?" : endpoint.address().to_string();
+        }
+        return link;
+    }
+
+    void ReplicationPrimary::set_listening_port(const Socket& socket, unsigned short port) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        link_for(socket)->port = port;
+    }
+
+    void ReplicationPrimary::attach(Socket socket, std::string_view replid, int64_t offset) {
+        std::shared_ptr<Link> link;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            link = link_for(socket);
+            std::string backlog;
+            if (active_ && replid == replid_ && offset >= 0 &&
+                backlog_.copy_from(static_cast<uint64_t>(offset), backlog)) {
+                // Partial resync: the replica only missed what the ring holds
+                link->pending = "+CONTINUE " + replid_ + "\r\n" + backlog;
+                link->state = Link::State::Online;
+                link->ack_offset = static_cast<uint64_t>(offset);
+                link->ack_time = steady_ms();
+                schedule_flush(link);
+                return;
+            }
+        }
+        full_sync(link);
+    }
+
+    void ReplicationPrimary::full_sync(const std::shared_ptr<Link>& link) {
+        std::string header;
+#if !defined(_WIN32)
+        pid_t pid = -1;
+#endif
+        storage_.with_all_shards_locked([&]() {
+            // No change can be recorded while the shards are locked, so the
+            // offset below is exactly where the snapshot stands
+            if (!active_) {
+                activate_();
+                active_ = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                link->state = Link::State::Syncing;
+                link->pending.clear();
+                link->ack_offset = backlog_.end_offset();
+                link->ack_time = steady_ms();
+                header = "+FULLRESYNC " + replid_ + " " + std::to_string(backlog_.end_offset()) + "\r\n";
+            }
+#if !defined(_WIN32)
+            pid = ::fork();
+            if (pid == 0) {
+                int status = 0;
+                try {
+                    int fd = static_cast<int>(link->socket->native_handle());
+                    send_all(fd, header);
+                    write_snapshot(storage_, [fd](std::string_view data) { send_all(fd, data); }, false);
+                }
+                catch (const std::exception& e) {
+                    log_error("Replica full sync failed: ", e.what());
+                    status = 1;
+                }
+                ::_exit(status);
+            }
+#endif
+        });
+
+        auto job = std::make_unique<SyncJob>();
+        SyncJob* current = job.get();
+#if !defined(_WIN32)
+        if (pid > 0) {
+            current->child = pid;
+            current->thread = std::thread([this, link, current, pid]() {
+                int status = 0;
+                while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+                }
+                current->child = 0;
+                finish_sync(link, WIFEXITED(status) && WEXITSTATUS(status) == 0, std::string());
+                current->done = true;
+            });
+        }
+        else
+#endif
+        {
+#if !defined(_WIN32)
+            log_warning("Cannot fork for replica full sync (", std::strerror(errno),
+                "); building it in memory");
+#endif
+            current->thread = std::thread([this, link, current, header]() {
+                std::string image = header;
+                bool ok = true;
+                try {
+                    write_snapshot(storage_, [&image](std::string_view data) { image.append(data); }, true);
+                }
+                catch (const std::exception& e) {
+                    log_error("Replica full sync failed: ", e.what());
+                    ok = false;
+                }
+                finish_sync(link, ok, std::move(image));
+                current->done = true;
+            });
+        }
+
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        for (auto it = jobs_.begin(); it != jobs_.end();) {
+            if ((*it)->done) {
+                (*it)->thread.join();
+                it = jobs_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        jobs_.push_back(std::move(job));
+    }
+
+    void ReplicationPrimary::finish_sync(const std::shared_ptr<Link>& link, bool ok, std::string image) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (link->dropped || stopping_) {
+            return;
+        }
+        if (!ok) {
+            drop(link);
+            return;
+        }
+        // Built in memory: the snapshot goes before the changes queued meanwhile
+        link->pending.insert(0, image);
+        link->state = Link::State::Online;
+        schedule_flush(link);
+    }
+
+    void ReplicationPrimary::schedule_flush(const std::shared_ptr<Link>& link) {
+        if (link->flush_scheduled || link->write_in_flight || link->dropped) {
+            return;
+        }
+        link->flush_scheduled = true;
+        asio::post(link->socket->get_executor(), [this, link]() { flush(link); });
+    }
+
+    void ReplicationPrimary::flush(const std::shared_ptr<Link>& link) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            link->flush_scheduled = false;
+            if (link->dropped || link->write_in_flight || link->pending.empty()) {
+                return;
+            }
+            link->writing.clear();
+            link->writing.swap(link->pending);
+            link->write_in_flight = true;
+        }
+        asio::async_write(*link->socket, asio::buffer(link->writing),
+            [this, link](const asio::error_code& ec, size_t) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                link->write_in_flight = false;
+                if (ec) {
+                    if (!link->dropped) {
+                        drop(link);
+                    }
+                    return;
+                }
+                if (!link->pending.empty()) {
+                    schedule_flush(link);
+                }
+            });
+    }
+
+    void ReplicationPrimary::drop(const std::shared_ptr<Link>& link) {
+        link->dropped = true;
+        links_.erase(link->socket.get());
+        // Shutting down also stops a forked child still writing the snapshot
+        asio::post(link->socket->get_executor(), [link]() {
+            asio::error_code ec;
+            link->socket->shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+            link->socket->close(ec);
+        });
+    }
+
+    void ReplicationPrimary::acknowledge(const asio::ip::tcp::socket* connection, uint64_t offset) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = links_.find(connection);
+        if (it != links_.end()) {
+            it->second->ack_offset = offset;
+            it->second->ack_time = steady_ms();
+        }
+    }
+
+    void ReplicationPrimary::detach(const asio::ip::tcp::socket* connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = links_.find(connection);
+        if (it != links_.end()) {
+            it->second->dropped = true;
+            links_.erase(it);
+        }
+    }
+
+    void ReplicationPrimary::new_history() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::shared_ptr<Link>> links;
+        for (auto& [connection, link] : links_) {
+            links.push_back(link);
+        }
+        for (auto& link : links) {
+            drop(link);
+        }
+        replid_ = make_replid();
+        backlog_.reset(backlog_.end_offset());
+    }
+
+    std::string ReplicationPrimary::replid() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return replid_;
+    }
+
+    uint64_t ReplicationPrimary::offset() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return backlog_.end_offset();
+    }
+
+    uint64_t ReplicationPrimary::backlog_start() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return backlog_.start_offset();
+    }
+
+    size_t ReplicationPrimary::backlog_capacity() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return backlog_.capacity();
+    }
+
+    std::vector<ReplicaInfo> ReplicationPrimary::replicas() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<ReplicaInfo> result;
+        int64_t now = steady_ms();
+        for (const auto& [connection, link] : links_) {
+            if (link->state == Link::State::Handshake) {
+                continue;
+            }
+            ReplicaInfo info;
+            info.address = link->address;
+            info.port = link->port;
+            info.online = link->state == Link::State::Online;
+            info.ack_offset = link->ack_offset;
+            info.lag_bytes = backlog_.end_offset() > link->ack_offset ? backlog_.end_offset() - link->ack_offset : 0;
+            info.last_ack_ms = link->ack_time < 0 ? -1 : now - link->ack_time;
+            info.pending_bytes = link->pending.size();
+            result.push_back(std::move(info));
+        }
+        return result;
+    }
+
+} // namespace blitzdb
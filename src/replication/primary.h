@@ -0,0 +1,115 @@
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../core/storage/in_memory.h"
+#include "backlog.h"
+
+namespace blitzdb {
+
+    // What a primary knows about one attached replica
+    struct ReplicaInfo {
+        std::string address;
+        unsigned short port = 0;      // Listening port the replica reported
+        bool online = false;          // false while its full sync is in transfer
+        uint64_t ack_offset = 0;      // Last offset it acknowledged
+        uint64_t lag_bytes = 0;       // Stream bytes it has not acknowledged
+        int64_t last_ack_ms = -1;     // Since its last acknowledgement
+        size_t pending_bytes = 0;     // Queued for it and not written yet
+    };
+
+    // Primary side of replication. As the storage's ChangeObserver it
+    // receives every change record, appends it to the backlog ring and
+    // queues it for every attached replica; each replica's queue is written
+    // from its socket's executor, one write per accumulated batch.
+    //
+    // A replica sends PSYNC with the history id and offset it reached. If
+    // the backlog still holds everything after that offset it continues
+    // from there; otherwise it gets a full sync: the shards are locked just
+    // long enough to fork, and the child streams "+FULLRESYNC <id> <offset>"
+    // and a snapshot straight to the socket while the parent queues the
+    // changes that follow. Where fork is unavailable the snapshot is built
+    // in memory under per-shard locks and the queued changes, which are
+    // idempotent effects, are applied on top of it.
+    //
+    // Nothing is recorded until the first replica arrives: `activate` is
+    // then called, with every shard locked, and must make the storage
+    // report its changes here.
+    class ReplicationPrimary : public ChangeObserver {
+    public:
+        using Socket = std::shared_ptr<asio::ip::tcp::socket>;
+
+        ReplicationPrimary(const InMemoryStorage& storage, size_t backlog_size, size_t output_limit,
+            std::function<void()> activate);
+        ReplicationPrimary(const ReplicationPrimary&) = delete;
+        ReplicationPrimary& operator=(const ReplicationPrimary&) = delete;
+
+        // Abandons full syncs in progress
+        ~ReplicationPrimary() override;
+
+        void on_change(std::string_view record) override;
+        // Whether changes are recorded yet (a replica has arrived)
+        bool active() const { return active_.load(std::memory_order_acquire); }
+
+        // REPLCONF listening-port from a connection that is about to sync
+        void set_listening_port(const Socket& socket, unsigned short port);
+
+        // Takes over writing to a connection that sent PSYNC. Every reply
+        // sent on it before must already be written.
+        void attach(Socket socket, std::string_view replid, int64_t offset);
+
+        // REPLCONF ACK
+        void acknowledge(const asio::ip::tcp::socket* connection, uint64_t offset);
+
+        // The connection was closed
+        void detach(const asio::ip::tcp::socket* connection);
+
+        // Disconnects every replica and starts a new history id, e.g. when
+        // this server starts or stops following another primary
+        void new_history();
+
+        std::string replid() const;
+        uint64_t offset() const;
+        uint64_t backlog_start() const;
+        size_t backlog_capacity() const;
+        std::vector<ReplicaInfo> replicas() const;
+
+    private:
+        struct Link;
+        struct SyncJob;
+
+        void full_sync(const std::shared_ptr<Link>& link);
+        void finish_sync(const std::shared_ptr<Link>& link, bool ok, std::string image);
+
+        // Both called with mutex_ held
+        void schedule_flush(const std::shared_ptr<Link>& link);
+        void drop(const std::shared_ptr<Link>& link);
+
+        void flush(const std::shared_ptr<Link>& link);
+        std::shared_ptr<Link> link_for(const Socket& socket);
+
+        const InMemoryStorage& storage_;
+        size_t output_limit_;
+        std::function<void()> activate_;
+        std::atomic<bool> active_{ false };
+
+        mutable std::mutex mutex_;
+        std::string replid_;
+        ReplicationBacklog backlog_;
+        std::unordered_map<const asio::ip::tcp::socket*, std::shared_ptr<Link>> links_;
+
+        std::mutex jobs_mutex_;
+        std::vector<std::unique_ptr<SyncJob>> jobs_;
+        std::atomic<bool> stopping_{ false };
+    };
+
+} // namespace blitzdb
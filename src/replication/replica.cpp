@@ -0,0 +1,370 @@
+#include "replica.h"
+#include "../core/utils/logger.h"
+#include <charconv>
+#include <stdexcept>
+
+namespace blitzdb {
+
+    namespace {
+
+        constexpr size_t kReadChunk = 64 * 1024;
+        constexpr size_t kMaxReplyLine = 64 * 1024;
+        constexpr auto kRetryDelay = std::chrono::seconds(1);
+        constexpr auto kAckPeriod = std::chrono::seconds(1);
+
+        bool starts_with(std::string_view text, std::string_view prefix) {
+            return text.substr(0, prefix.size()) == prefix;
+        }
+
+    } // namespace
+
+    ReplicaClient::ReplicaClient(asio::io_context& context, InMemoryStorage& storage, ReplicationSink& sink,
+        std::string host, unsigned short port, std::string password, unsigned short listening_port)
+        : strand_(asio::make_strand(context)), resolver_(strand_), socket_(strand_),
+        retry_timer_(strand_), ack_timer_(strand_), storage_(storage), sink_(sink),
+        host_(std::move(host)), port_(port), password_(std::move(password)),
+        listening_port_(listening_port), chunk_(kReadChunk) {
+        status_.host = host_;
+        status_.port = port_;
+        status_.state = "connecting";
+        status_.replid = "?";
+    }
+
+    void ReplicaClient::resume_from(std::string replid, int64_t offset) {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        status_.replid = std::move(replid);
+        status_.offset = offset;
+    }
+
+    void ReplicaClient::start() {
+        asio::post(strand_, [self = shared_from_this()]() { self->connect(); });
+    }
+
+    void ReplicaClient::stop() {
+        stopped_ = true;
+        asio::post(strand_, [self = shared_from_this()]() {
+            asio::error_code ec;
+            self->resolver_.cancel();
+            self->retry_timer_.cancel();
+            self->ack_timer_.cancel();
+            self->socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+            self->socket_.close(ec);
+            self->loader_.reset();
+            std::lock_guard<std::mutex> lock(self->status_mutex_);
+            self->status_.link_up = false;
+            self->status_.state = "stopped";
+        });
+    }
+
+    ReplicaStatus ReplicaClient::status() const {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        ReplicaStatus status = status_;
+        if (last_io_.time_since_epoch().count() != 0) {
+            status.last_io_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - last_io_).count();
+        }
+        return status;
+    }
+
+    void ReplicaClient::set_state(State state) {
+        state_ = state;
+        static constexpr const char* kNames[] = { "connecting", "handshake", "sync", "streaming" };
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        status_.state = kNames[static_cast<int>(state)];
+        status_.link_up = state == State::Streaming;
+    }
+
+    void ReplicaClient::touch() {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        last_io_ = std::chrono::steady_clock::now();
+    }
+
+    void ReplicaClient::connect() {
+        if (stopped_) {
+            return;
+        }
+        uint64_t generation = ++generation_;
+        input_.clear();
+        ack_in_flight_ = false;
+        loader_.reset();
+        set_state(State::Connecting);
+
+        auto self = shared_from_this();
+        resolver_.async_resolve(host_, std::to_string(port_),
+            [self, generation](const asio::error_code& ec, asio::ip::tcp::resolver::results_type results) {
+                if (!self->current(generation)) {
+                    return;
+                }
+                if (ec) {
+                    self->fail("cannot resolve " + self->host_ + ": " + ec.message());
+                    return;
+                }
+                asio::async_connect(self->socket_, results,
+                    [self, generation](const asio::error_code& ec, const asio::ip::tcp::endpoint&) {
+                        if (!self->current(generation)) {
+                            return;
+                        }
+                        if (ec) {
+                            self->fail("cannot connect: " + ec.message());
+                            return;
+                        }
+                        asio::error_code ignored;
+                        self->socket_.set_option(asio::ip::tcp::no_delay(true), ignored);
+                        self->handshake();
+                    });
+            });
+    }
+
+    void ReplicaClient::handshake() {
+        set_state(State::Handshake);
+        sink_.reset_stream();
+
+        // AUTH, REPLCONF listening-port, PSYNC; each waits for the previous reply
+        auto self = shared_from_this();
+        auto send_psync = [self]() {
+            std::string replid;
+            int64_t offset;
+            {
+                std::lock_guard<std::mutex> lock(self->status_mutex_);
+                replid = self->status_.replid;
+                offset = self->status_.offset;
+            }
+            std::string offset_text = std::to_string(offset);
+            self->request({ "PSYNC", replid, offset_text }, [self](std::string line) {
+                self->on_psync_reply(line);
+            });
+        };
+        auto send_port = [self, send_psync]() {
+            std::string port = std::to_string(self->listening_port_);
+            self->request({ "REPLCONF", "listening-port", port }, [self, send_psync](std::string line) {
+                if (!starts_with(line, "+")) {
+                    self->fail("REPLCONF refused: " + line);
+                    return;
+                }
+                send_psync();
+            });
+        };
+        if (password_.empty()) {
+            send_port();
+            return;
+        }
+        request({ "AUTH", password_ }, [self, send_port](std::string line) {
+            if (!starts_with(line, "+")) {
+                self->fail("authentication failed: " + line);
+                return;
+            }
+            send_port();
+        });
+    }
+
+    void ReplicaClient::request(std::vector<std::string_view> args, LineHandler handler) {
+        output_.clear();
+        append_command(output_, args);
+        auto self = shared_from_this();
+        asio::async_write(socket_, asio::buffer(output_),
+            [self, generation = generation_, handler = std::move(handler)](const asio::error_code& ec, size_t) mutable {
+                if (!self->current(generation)) {
+                    return;
+                }
+                if (ec) {
+                    self->fail("write failed: " + ec.message());
+                    return;
+                }
+                self->read_line(std::move(handler));
+            });
+    }
+
+    void ReplicaClient::read_line(LineHandler handler) {
+        size_t end = input_.find("\r\n");
+        if (end != std::string::npos) {
+            std::string line = input_.substr(0, end);
+            input_.erase(0, end + 2);
+            handler(std::move(line));
+            return;
+        }
+        if (input_.size() > kMaxReplyLine) {
+            fail("reply line too long");
+            return;
+        }
+        auto self = shared_from_this();
+        socket_.async_read_some(asio::buffer(chunk_),
+            [self, generation = generation_, handler = std::move(handler)](const asio::error_code& ec, size_t bytes) mutable {
+                if (!self->current(generation)) {
+                    return;
+                }
+                if (ec) {
+                    self->fail("read failed: " + ec.message());
+                    return;
+                }
+                self->input_.append(self->chunk_.data(), bytes);
+                self->touch();
+                self->read_line(std::move(handler));
+            });
+    }
+
+    void ReplicaClient::on_psync_reply(const std::string& line) {
+        std::string_view reply = line;
+        if (starts_with(reply, "+FULLRESYNC ")) {
+            // "+FULLRESYNC <replid> <offset>", then the snapshot
+            reply.remove_prefix(12);
+            size_t space = reply.find(' ');
+            long long offset = 0;
+            if (space == std::string_view::npos) {
+                fail("malformed reply to PSYNC: " + line);
+                return;
+            }
+            std::string_view number = reply.substr(space + 1);
+            auto [end, ec] = std::from_chars(number.data(), number.data() + number.size(), offset);
+            if (ec != std::errc() || end != number.data() + number.size() || offset < 0) {
+                fail("malformed reply to PSYNC: " + line);
+                return;
+            }
+            sync_replid_ = std::string(reply.substr(0, space));
+            sync_offset_ = offset;
+            {
+                // Until the snapshot is complete there is nothing to continue from
+                std::lock_guard<std::mutex> lock(status_mutex_);
+                status_.replid = "?";
+                status_.offset = -1;
+            }
+            log_info("Full resynchronization from ", host_, ":", port_, " at offset ", offset);
+            storage_.clear();
+            loader_.emplace(storage_, "replication stream from " + host_ + ":" + std::to_string(port_));
+            set_state(State::Sync);
+        }
+        else if (starts_with(reply, "+CONTINUE")) {
+            // "+CONTINUE [<replid>]"; the missed part of the stream follows
+            {
+                std::lock_guard<std::mutex> lock(status_mutex_);
+                if (reply.size() > 10) {
+                    status_.replid = std::string(reply.substr(10));
+                }
+                ++status_.partial_syncs;
+            }
+            log_info("Partial resynchronization from ", host_, ":", port_);
+            set_state(State::Streaming);
+            schedule_ack();
+        }
+        else {
+            fail("PSYNC refused: " + line);
+            return;
+        }
+        consume();
+    }
+
+    void ReplicaClient::consume() {
+        try {
+            if (state_ == State::Sync) {
+                input_.erase(0, loader_->feed(input_));
+                if (!loader_->done()) {
+                    receive();
+                    return;
+                }
+                SnapshotStats stats = loader_->stats();
+                loader_.reset();
+                {
+                    std::lock_guard<std::mutex> lock(status_mutex_);
+                    status_.replid = sync_replid_;
+                    status_.offset = sync_offset_;
+                    ++status_.full_syncs;
+                }
+                log_info("Loaded ", stats.keys, " keys from the primary");
+                sink_.full_sync_done(stats);
+                set_state(State::Streaming);
+                send_ack();
+                schedule_ack();
+            }
+            size_t applied = sink_.apply_stream(input_);
+            if (applied > 0) {
+                input_.erase(0, applied);
+                std::lock_guard<std::mutex> lock(status_mutex_);
+                status_.offset += static_cast<int64_t>(applied);
+            }
+        }
+        catch (const std::exception& e) {
+            fail(e.what());
+            return;
+        }
+        receive();
+    }
+
+    void ReplicaClient::receive() {
+        auto self = shared_from_this();
+        socket_.async_read_some(asio::buffer(chunk_),
+            [self, generation = generation_](const asio::error_code& ec, size_t bytes) {
+                if (!self->current(generation)) {
+                    return;
+                }
+                if (ec) {
+                    self->fail(ec == asio::error::eof ? "primary closed the link" : "read failed: " + ec.message());
+                    return;
+                }
+                self->input_.append(self->chunk_.data(), bytes);
+                self->touch();
+                self->consume();
+            });
+    }
+
+    void ReplicaClient::send_ack() {
+        if (ack_in_flight_ || state_ != State::Streaming) {
+            return;
+        }
+        int64_t offset;
+        {
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            offset = status_.offset;
+        }
+        std::string offset_text = std::to_string(offset);
+        std::string_view args[] = { "REPLCONF", "ACK", offset_text };
+        output_.clear();
+        append_command(output_, args);
+        ack_in_flight_ = true;
+        auto self = shared_from_this();
+        asio::async_write(socket_, asio::buffer(output_),
+            [self, generation = generation_](const asio::error_code& ec, size_t) {
+                if (!self->current(generation)) {
+                    return;
+                }
+                self->ack_in_flight_ = false;
+                if (ec) {
+                    self->fail("write failed: " + ec.message());
+                }
+            });
+    }
+
+    void ReplicaClient::schedule_ack() {
+        ack_timer_.expires_after(kAckPeriod);
+        ack_timer_.async_wait([self = shared_from_this(), generation = generation_](const asio::error_code& ec) {
+            if (ec || !self->current(generation)) {
+                return;
+            }
+            self->send_ack();
+            self->schedule_ack();
+        });
+    }
+
+    void ReplicaClient::fail(const std::string& reason) {
+        if (stopped_) {
+            return;
+        }
+        ++generation_;
+        log_warning("Replication link to ", host_, ":", port_, " failed: ", reason, "; retrying in 1 s");
+
+        asio::error_code ec;
+        resolver_.cancel();
+        ack_timer_.cancel();
+        socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+        socket_.close(ec);
+        loader_.reset();
+        set_state(State::Connecting);
+
+        retry_timer_.expires_after(kRetryDelay);
+        retry_timer_.async_wait([self = shared_from_this(), generation = generation_](const asio::error_code& ec) {
+            if (ec || !self->current(generation)) {
+                return;
+            }
+            self->connect();
+        });
+    }
+
+} // namespace blitzdb
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../core/storage/in_memory.h"
+#include "../core/storage/snapshot.h"
+
+namespace blitzdb {
+
+    // Where a replica applies what its primary sends. Called from the
+    // replica client's strand only.
+    class ReplicationSink {
+    public:
+        virtual ~ReplicationSink() = default;
+
+        // A new link is starting; forget any partially received command
+        virtual void reset_stream() = 0;
+
+        // Executes the complete commands at the front of `data` and returns
+        // how many bytes they took. Throws std::runtime_error if the stream
+        // is malformed.
+        virtual size_t apply_stream(std::string_view data) = 0;
+
+        // The keyspace was replaced by a full resynchronization
+        virtual void full_sync_done(const SnapshotStats& stats) = 0;
+    };
+
+    struct ReplicaStatus {
+        std::string host;
+        unsigned short port = 0;
+        bool link_up = false;        // Streaming from the primary
+        std::string state;           // connecting, handshake, sync, streaming
+        std::string replid;          // History id of the primary ("?" if unknown)
+        int64_t offset = -1;         // Stream offset reached; -1 before the first sync
+        uint64_t full_syncs = 0;
+        uint64_t partial_syncs = 0;
+        int64_t last_io_ms = -1;     // Since data last arrived from the primary
+    };
+
+    // Replica side of replication: connects to the primary, authenticates,
+    // asks to continue from the offset it reached (PSYNC) and then applies
+    // the stream, acknowledging its offset once a second. A lost link is
+    // retried every second; as long as the primary's backlog still covers
+    // the offset, reconnecting costs only the missed bytes.
+    class ReplicaClient : public std::enable_shared_from_this<ReplicaClient> {
+    public:
+        ReplicaClient(asio::io_context& context, InMemoryStorage& storage, ReplicationSink& sink,
+            std::string host, unsigned short port, std::string password, unsigned short listening_port);
+        ReplicaClient(const ReplicaClient&) = delete;
+        ReplicaClient& operator=(const ReplicaClient&) = delete;
+
+        // Asks to continue the stream from where an earlier client following
+        // the same keyspace stopped; call before start()
+        void resume_from(std::string replid, int64_t offset);
+
+        void start();
+
+        // Closes the link; the client does nothing afterwards
+        void stop();
+
+        ReplicaStatus status() const;
+
+    private:
+        enum class State {
+            Connecting,
+            Handshake,
+            Sync,        // Receiving the snapshot of a full resynchronization
+            Streaming,
+        };
+
+        using LineHandler = std::function<void(std::string line)>;
+
+        void connect();
+        void handshake();
+        void request(std::vector<std::string_view> args, LineHandler handler);
+        void read_line(LineHandler handler);
+        void on_psync_reply(const std::string& line);
+        void receive();
+        void consume();
+        void send_ack();
+        void schedule_ack();
+        void fail(const std::string& reason);
+
+        void set_state(State state);
+        void touch();
+        bool current(uint64_t generation) const { return !stopped_ && generation == generation_; }
+
+        asio::strand<asio::io_context::executor_type> strand_;
+        asio::ip::tcp::resolver resolver_;
+        asio::ip::tcp::socket socket_;
+        asio::steady_timer retry_timer_;
+        asio::steady_timer ack_timer_;
+
+        InMemoryStorage& storage_;
+        ReplicationSink& sink_;
+        std::string host_;
+        unsigned short port_;
+        std::string password_;
+        unsigned short listening_port_;
+
+        // Strand-only state
+        State state_ = State::Connecting;
+        uint64_t generation_ = 0;  // Bumped per link so stale handlers bail out
+        std::vector<char> chunk_;  // Target of socket reads
+        std::string input_;        // Received and not consumed yet
+        std::string output_;
+        bool ack_in_flight_ = false;
+        std::optional<SnapshotStreamLoader> loader_;
+        std::string sync_replid_;
+        int64_t sync_offset_ = 0;
+        std::atomic<bool> stopped_{ false };
+
+        mutable std::mutex status_mutex_;
+        ReplicaStatus status_;
+        std::chrono::steady_clock::time_point last_io_;
+    };
+
+} // namespace blitzdb
@@ -0,0 +1,519 @@
+// network_tests.cpp : End-to-end tests against servers running in-process
+// on loopback: append-only log replay, a damaged log, a rewrite, the slow
+// log and replication between two servers.
+
+#include "../test.h"
+#include "server.h"
+#include <asio.hpp>
+#include <chrono>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace blitzdb;
+
+namespace {
+
+    unsigned short free_port() {
+        asio::io_context context;
+        asio::ip::tcp::acceptor acceptor(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+        return acceptor.local_endpoint().port();
+    }
+
+    ServerConfig aof_config(const test::TempDir& dir) {
+        ServerConfig config;
+        config.port = free_port();
+        config.append_only = true;
+        config.append_only_path = dir.file("appendonly.aof");
+        config.append_fsync = FsyncPolicy::Always;
+        config.snapshot_path = dir.file("dump.bdb");
+        return config;
+    }
+
+    // A server on its own thread, stopped and joined when it goes away;
+    // the append-only log is complete on disk after that
+    class TestServer {
+    public:
+        explicit TestServer(const ServerConfig& config) : server_(context_, config) {
+            server_.start();
+            thread_ = std::thread([this]() { server_.run(); });
+        }
+        TestServer(const TestServer&) = delete;
+        TestServer& operator=(const TestServer&) = delete;
+        ~TestServer() {
+            server_.stop();
+            thread_.join();
+        }
+
+    private:
+        asio::io_context context_;
+        Server server_;
+        std::thread thread_;
+    };
+
+    // Blocking client that sends one command and reads its reply
+    class Client {
+    public:
+        explicit Client(unsigned short port) : socket_(context_) {
+            socket_.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+            command({ "AUTH", "defaultpass" });
+        }
+
+        // The reply as encoded on the wire
+        std::string command(std::initializer_list<std::string_view> args) {
+            std::string request = "*";
+            request += std::to_string(args.size());
+            request += "\r\n";
+            for (std::string_view arg : args) {
+                request += '$';
+                request += std::to_string(arg.size());
+                request += "\r\n";
+                request += arg;
+                request += "\r\n";
+            }
+            asio::write(socket_, asio::buffer(request));
+
+            while (true) {
+                size_t consumed = 0;
+                auto status = resp::scan_reply(input_, consumed);
+                if (status == resp::ParseStatus::Complete) {
+                    std::string reply = input_.substr(0, consumed);
+                    input_.erase(0, consumed);
+                    return reply;
+                }
+                if (status == resp::ParseStatus::Error) {
+                    throw std::runtime_error("malformed reply");
+                }
+                char chunk[16 * 1024];
+                size_t n = socket_.read_some(asio::buffer(chunk));
+                input_.append(chunk, n);
+            }
+        }
+
+        // One field of INFO <section>
+        std::string info(std::string_view section, std::string_view field) {
+            std::string reply = command({ "INFO", section });
+            std::string key = std::string(field) + ":";
+            size_t at = reply.find(key);
+            if (at == std::string::npos) {
+                return "";
+            }
+            at += key.size();
+            return reply.substr(at, reply.find("\r\n", at) - at);
+        }
+
+    private:
+        asio::io_context context_;
+        asio::ip::tcp::socket socket_;
+        std::string input_;
+    };
+
+    // Built with += rather than "literal" + std::string, which trips a
+    // false -Wrestrict in GCC 12
+    std::string name(std::string_view prefix, int n) {
+        std::string out(prefix);
+        out += std::to_string(n);
+        return out;
+    }
+
+    std::string bulk(std::string_view value) {
+        std::string out = "$";
+        out += std::to_string(value.size());
+        out += "\r\n";
+        out += value;
+        out += "\r\n";
+        return out;
+    }
+
+    // Changes of every kind the log records
+    void write_mixed(Client& client) {
+        client.command({ "SET", "gone", "before flush" });
+        client.command({ "FLUSHALL" });
+        client.command({ "SET", "plain", "value" });
+        client.command({ "SET", "big", std::string(20000, 'b') });
+        client.command({ "SET", "ttl", "soon", "EX", "3600" });
+        client.command({ "SET", "persisted", "x", "EX", "3600" });
+        client.command({ "PERSIST", "persisted" });
+        client.command({ "SET", "counter", "10" });
+        client.command({ "INCRBY", "counter", "32" });
+        client.command({ "INCRBYFLOAT", "float", "1.5" });
+        client.command({ "APPEND", "appended", "abc" });
+        client.command({ "APPEND", "appended", "def" });
+        client.command({ "SETRANGE", "ranged", "3", "xyz" });
+        client.command({ "MSET", "m1", "one", "m2", "two" });
+        client.command({ "SET", "deleted", "x" });
+        client.command({ "DEL", "deleted" });
+        client.command({ "SET", "unlinked", std::string(100000, 'u') });
+        client.command({ "UNLINK", "unlinked" });
+        client.command({ "HSET", "hash", "a", "1", "b", "2", "c", "3" });
+        client.command({ "HDEL", "hash", "b" });
+        client.command({ "HINCRBY", "hash", "a", "41" });
+        for (int i = 0; i < 300; ++i) {
+            client.command({ "HSET", "bighash", name("field", i), std::to_string(i) });
+        }
+        client.command({ "EXPIRE", "bighash", "3600" });
+    }
+
+    // Replies to reads covering everything write_mixed() changed
+    std::vector<std::string> read_mixed(Client& client) {
+        std::vector<std::string> replies;
+        for (std::string_view key : { "gone", "plain", "big", "ttl", "persisted", "counter", "float",
+                 "appended", "ranged", "m1", "m2", "deleted", "unlinked" }) {
+            replies.push_back(client.command({ "GET", key }));
+        }
+        replies.push_back(client.command({ "HGET", "hash", "a" }));
+        replies.push_back(client.command({ "HGET", "hash", "b" }));
+        replies.push_back(client.command({ "HGET", "hash", "c" }));
+        replies.push_back(client.command({ "HLEN", "bighash" }));
+        replies.push_back(client.command({ "HGET", "bighash", "field299" }));
+        for (std::string_view key : { "ttl", "persisted", "bighash", "plain" }) {
+            // Only whether there is a deadline; the remaining time moves on
+            std::string ttl = client.command({ "TTL", key });
+            replies.push_back(ttl == ":-1\r\n" || ttl == ":-2\r\n" ? ttl : "deadline");
+        }
+        return replies;
+    }
+
+    uintmax_t file_size(const std::string& path) {
+        return std::filesystem::file_size(path);
+    }
+
+    // Polls `done` for up to ten seconds
+    template <typename Predicate>
+    bool eventually(Predicate done) {
+        for (int wait = 0; wait < 1000; ++wait) {
+            if (done()) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return done();
+    }
+
+    // Forwards connections to a server on loopback until drop() cuts
+    // every one of them, as a network failure would; later connections
+    // are forwarded again
+    class LinkProxy {
+    public:
+        explicit LinkProxy(unsigned short target)
+            : target_(target), acceptor_(context_, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)) {
+            port_ = acceptor_.local_endpoint().port();
+            accept_thread_ = std::thread([this]() { accept_loop(); });
+        }
+        LinkProxy(const LinkProxy&) = delete;
+        LinkProxy& operator=(const LinkProxy&) = delete;
+        ~LinkProxy() {
+            stopping_ = true;
+            // Wakes the blocking accept
+            asio::io_context context;
+            asio::ip::tcp::socket wake(context);
+            asio::error_code ignored;
+            wake.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port_), ignored);
+            accept_thread_.join();
+            drop();
+            for (std::thread& thread : pumps_) {
+                thread.join();
+            }
+        }
+
+        unsigned short port() const { return port_; }
+
+        void drop() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& socket : sockets_) {
+                asio::error_code ignored;
+                socket->shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+            }
+        }
+
+    private:
+        using Socket = std::shared_ptr<asio::ip::tcp::socket>;
+
+        void accept_loop() {
+            while (true) {
+                auto client = std::make_shared<asio::ip::tcp::socket>(context_);
+                asio::error_code ec;
+                acceptor_.accept(*client, ec);
+                if (ec || stopping_) {
+                    return;
+                }
+                auto server = std::make_shared<asio::ip::tcp::socket>(context_);
+                server->connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), target_), ec);
+                if (ec) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                sockets_.push_back(client);
+                sockets_.push_back(server);
+                pumps_.emplace_back([client, server]() { pump(client, server); });
+                pumps_.emplace_back([client, server]() { pump(server, client); });
+            }
+        }
+
+        // Copies one direction until either side fails, then ends both
+        static void pump(const Socket& from, const Socket& to) {
+            char chunk[16 * 1024];
+            asio::error_code ec;
+            while (!ec) {
+                size_t n = from->read_some(asio::buffer(chunk), ec);
+                if (!ec) {
+                    asio::write(*to, asio::buffer(chunk, n), ec);
+                }
+            }
+            asio::error_code ignored;
+            from->shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+            to->shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+        }
+
+        unsigned short target_;
+        unsigned short port_ = 0;
+        asio::io_context context_;
+        asio::ip::tcp::acceptor acceptor_;
+        std::atomic<bool> stopping_{ false };
+        std::thread accept_thread_;
+        std::mutex mutex_;
+        std::vector<Socket> sockets_;
+        std::vector<std::thread> pumps_;
+    };
+
+} // namespace
+
+BLITZDB_TEST(aof_replay_round_trip) {
+    test::TempDir dir;
+    ServerConfig config = aof_config(dir);
+    std::vector<std::string> expected;
+    {
+        TestServer server(config);
+        Client client(config.port);
+        write_mixed(client);
+        expected = read_mixed(client);
+    }
+    CHECK_EQ(expected[1], bulk("value"));
+    CHECK_EQ(expected[5], bulk("42"));
+    CHECK_EQ(expected[7], bulk("abcdef"));
+    CHECK_EQ(expected[8], bulk(std::string(3, '\0') + "xyz"));
+
+    // Twice, so replaying does not change what the next replay sees
+    for (int restart = 0; restart < 2; ++restart) {
+        config.port = free_port();
+        TestServer server(config);
+        Client client(config.port);
+        CHECK(read_mixed(client) == expected);
+    }
+}
+
+BLITZDB_TEST(aof_truncated_tail_is_dropped) {
+    test::TempDir dir;
+    ServerConfig config = aof_config(dir);
+    std::vector<std::string> expected;
+    {
+        TestServer server(config);
+        Client client(config.port);
+        write_mixed(client);
+        expected = read_mixed(client);
+    }
+    uintmax_t complete = file_size(config.append_only_path);
+
+    // A crash part way through writing a record
+    {
+        std::ofstream out(config.append_only_path, std::ios::binary | std::ios::app);
+        out << "*3\r\n$3\r\nSET\r\n$4\r\nhalf\r\n$10\r\nwrit";
+    }
+    {
+        config.port = free_port();
+        TestServer server(config);
+        CHECK_EQ(file_size(config.append_only_path), complete);
+        Client client(config.port);
+        CHECK(read_mixed(client) == expected);
+        CHECK_EQ(client.command({ "GET", "half" }), std::string("$-1\r\n"));
+        client.command({ "SET", "after", "restart" });
+    }
+
+    // Records appended after the truncation replay cleanly
+    config.port = free_port();
+    TestServer server(config);
+    Client client(config.port);
+    CHECK(read_mixed(client) == expected);
+    CHECK_EQ(client.command({ "GET", "after" }), bulk("restart"));
+}
+
+BLITZDB_TEST(aof_damaged_record_refuses_to_start) {
+    test::TempDir dir;
+    ServerConfig config = aof_config(dir);
+    {
+        TestServer server(config);
+        Client client(config.port);
+        client.command({ "SET", "a", "1" });
+    }
+    {
+        std::ofstream out(config.append_only_path, std::ios::binary | std::ios::app);
+        out << "*2\r\n$x\r\n";
+        out << "*3\r\n$3\r\nSET\r\n$1\r\nb\r\n$1\r\n2\r\n";
+    }
+    bool refused = false;
+    try {
+        config.port = free_port();
+        TestServer server(config);
+    }
+    catch (const std::runtime_error&) {
+        refused = true;
+    }
+    CHECK(refused);
+}
+
+BLITZDB_TEST(aof_rewrite_round_trip) {
+    test::TempDir dir;
+    ServerConfig config = aof_config(dir);
+    std::vector<std::string> expected;
+    {
+        TestServer server(config);
+        Client client(config.port);
+        write_mixed(client);
+        // Overwrites that a rewrite collapses
+        for (int round = 0; round < 50; ++round) {
+            for (int i = 0; i < 100; ++i) {
+                client.command({ "SET", name("churn:", i), std::to_string(round) });
+            }
+        }
+        uintmax_t before = file_size(config.append_only_path);
+
+        CHECK_EQ(client.command({ "BGREWRITEAOF" }), std::string("+Background append only file rewriting started\r\n"));
+        // Changes made while the rewrite runs go to its buffer as well
+        for (int i = 0; i < 100; ++i) {
+            client.command({ "SET", name("churn:", i), "final" });
+        }
+        client.command({ "HSET", "hash", "d", "4" });
+        client.command({ "DEL", "m1" });
+        for (int wait = 0; wait < 500 && client.info("persistence", "aof_rewrite_in_progress") != "0"; ++wait) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        CHECK_EQ(client.info("persistence", "aof_rewrites"), std::string("1"));
+        CHECK(file_size(config.append_only_path) < before);
+
+        expected = read_mixed(client);
+        expected.push_back(client.command({ "GET", "churn:7" }));
+        expected.push_back(client.command({ "HGET", "hash", "d" }));
+        // The rewritten log keeps taking appends
+        client.command({ "SET", "after", "rewrite" });
+        expected.push_back(client.command({ "GET", "after" }));
+    }
+    CHECK_EQ(expected[9], std::string("$-1\r\n"));  // m1
+    CHECK_EQ(expected[expected.size() - 3], bulk("final"));
+    CHECK_EQ(expected[expected.size() - 2], bulk("4"));
+
+    config.port = free_port();
+    TestServer server(config);
+    Client client(config.port);
+    std::vector<std::string> replayed = read_mixed(client);
+    replayed.push_back(client.command({ "GET", "churn:7" }));
+    replayed.push_back(client.command({ "HGET", "hash", "d" }));
+    replayed.push_back(client.command({ "GET", "after" }));
+    CHECK(replayed == expected);
+}
+
+BLITZDB_TEST(slowlog_sees_every_slow_call) {
+    test::TempDir dir;
+    ServerConfig config;
+    config.port = free_port();
+    config.snapshot_path = dir.file("dump.bdb");
+    TestServer server(config);
+    Client client(config.port);
+
+    auto logged = [&client](std::string_view name) {
+        std::string reply = client.command({ "SLOWLOG", "GET", "1000" });
+        size_t count = 0;
+        for (size_t at = reply.find(name); at != std::string::npos; at = reply.find(name, at + 1)) {
+            ++count;
+        }
+        return count;
+    };
+
+    // Commands that are not fast are timed on every call, not a sample
+    CHECK_EQ(client.command({ "CONFIG", "SET", "slowlog-log-slower-than", "1" }), std::string("+OK\r\n"));
+    for (int i = 0; i < 1000; ++i) {
+        client.command({ "HSET", "big", name("field", i), "value" });
+    }
+    CHECK_EQ(client.command({ "SLOWLOG", "RESET" }), std::string("+OK\r\n"));
+    for (int round = 0; round < 20; ++round) {
+        client.command({ "HGETALL", "big" });
+    }
+    CHECK_EQ(logged("HGETALL"), 20u);
+
+    // With a threshold of 0 every command is logged, fast ones included
+    CHECK_EQ(client.command({ "CONFIG", "SET", "slowlog-log-slower-than", "0" }), std::string("+OK\r\n"));
+    CHECK_EQ(client.command({ "SLOWLOG", "RESET" }), std::string("+OK\r\n"));
+    for (int i = 0; i < 40; ++i) {
+        client.command({ "GET", "nothing" });
+    }
+    CHECK_EQ(logged("nothing"), 40u);
+}
+
+BLITZDB_TEST(replication_full_sync_stream_and_partial_resync) {
+    test::TempDir dir;
+    ServerConfig primary_config;
+    primary_config.port = free_port();
+    primary_config.snapshot_path = dir.file("primary.bdb");
+    TestServer primary(primary_config);
+    Client writer(primary_config.port);
+
+    // Keys that exist before the replica arrives come with the full sync
+    for (int i = 0; i < 1000; ++i) {
+        writer.command({ "SET", name("before:", i), std::to_string(i) });
+    }
+    writer.command({ "SET", "big", std::string(20000, 'b') });
+    writer.command({ "HSET", "hash", "a", "1", "b", "2" });
+
+    // The replica reaches the primary through a link the test can cut
+    LinkProxy link(primary_config.port);
+    ServerConfig replica_config;
+    replica_config.port = free_port();
+    replica_config.snapshot_path = dir.file("replica.bdb");
+    replica_config.replica_of_host = "127.0.0.1";
+    replica_config.replica_of_port = link.port();
+    TestServer replica(replica_config);
+    Client reader(replica_config.port);
+
+    // Keys load block by block; the link is up once the snapshot is complete
+    CHECK(eventually([&]() { return reader.info("replication", "master_link_status") == "up"; }));
+    CHECK_EQ(reader.command({ "GET", "before:0" }), bulk("0"));
+    CHECK_EQ(reader.command({ "GET", "before:999" }), bulk("999"));
+    CHECK_EQ(reader.command({ "GET", "big" }), bulk(std::string(20000, 'b')));
+    CHECK_EQ(reader.command({ "HGET", "hash", "b" }), bulk("2"));
+    CHECK_EQ(reader.info("keyspace", "db0"), writer.info("keyspace", "db0"));
+
+    // Later writes stream through
+    writer.command({ "SET", "after", "streamed" });
+    writer.command({ "DEL", "before:1" });
+    writer.command({ "HSET", "hash", "c", "3" });
+    writer.command({ "INCRBY", "counter", "5" });
+    CHECK(eventually([&]() { return reader.command({ "GET", "counter" }) == bulk("5"); }));
+    CHECK_EQ(reader.command({ "GET", "after" }), bulk("streamed"));
+    CHECK_EQ(reader.command({ "GET", "before:1" }), std::string("$-1\r\n"));
+    CHECK_EQ(reader.command({ "HGET", "hash", "c" }), bulk("3"));
+
+    // The replica serves reads and refuses writes
+    CHECK_EQ(reader.command({ "SET", "mine", "x" }), std::string("-READONLY You can't write against a read only replica.\r\n"));
+    CHECK_EQ(reader.command({ "GET", "mine" }), std::string("$-1\r\n"));
+    CHECK_EQ(reader.info("replication", "role"), std::string("slave"));
+
+    // A dropped link resumes from the backlog rather than syncing again;
+    // what was written while it was down arrives after the reconnect
+    link.drop();
+    for (int i = 0; i < 100; ++i) {
+        writer.command({ "SET", name("during:", i), std::to_string(i) });
+    }
+    CHECK(eventually([&]() { return reader.command({ "GET", "during:99" }) == bulk("99"); }));
+    CHECK_EQ(reader.command({ "GET", "during:0" }), bulk("0"));
+    std::string report = reader.command({ "DEBUG", "REPLICATION" });
+    CHECK(report.find("full_syncs:1\r\n") != std::string::npos);
+    CHECK(report.find("partial_syncs:1\r\n") != std::string::npos);
+    CHECK_EQ(reader.info("keyspace", "db0"), writer.info("keyspace", "db0"));
+}
@@ -0,0 +1,267 @@
+// reply_alloc_tests.cpp : Heap allocations on the command path.
+//
+// Runs a server in-process and drives it over loopback with pipelined
+// batches. Global operator new is replaced with a counting version that
+// only counts on the server's thread, so the client side does not disturb
+// the figure. After a warm-up, which lets the output buffers, the keyspace
+// and asio's handler memory reach their working size, the steady state
+// must allocate nothing.
+
+#include "../test.h"
+#include "server.h"
+#include <asio.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <thread>
+
+// The replacements below pair malloc with free, which GCC cannot see
+// through once they are inlined into callers
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+
+    thread_local bool count_allocations = false;
+    std::atomic<uint64_t> allocations{ 0 };
+
+    void* counted_malloc(std::size_t size) noexcept {
+        if (count_allocations) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        return std::malloc(size ? size : 1);
+    }
+
+    void* counted_aligned_alloc(std::size_t size, std::align_val_t alignment) noexcept {
+        if (count_allocations) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        size_t align = static_cast<size_t>(alignment);
+        return std::aligned_alloc(align, (size + align - 1) / align * align);
+    }
+
+} // namespace
+
+// Every form is replaced, so nothrow and aligned allocations (temporary
+// buffers, hash table slots) are counted too and frees pair with mallocs
+
+void* operator new(std::size_t size) {
+    if (void* pointer = counted_malloc(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* pointer = counted_aligned_alloc(size, alignment)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_aligned_alloc(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+using namespace blitzdb;
+
+namespace {
+
+    unsigned short free_port() {
+        asio::io_context context;
+        asio::ip::tcp::acceptor acceptor(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+        return acceptor.local_endpoint().port();
+    }
+
+    void append_command(std::string& out, std::initializer_list<std::string_view> args) {
+        out += '*';
+        out += std::to_string(args.size());
+        out += "\r\n";
+        for (std::string_view arg : args) {
+            out += '$';
+            out += std::to_string(arg.size());
+            out += "\r\n";
+            out += arg;
+            out += "\r\n";
+        }
+    }
+
+    std::string bulk(std::string_view value) {
+        std::string out = "$";
+        out += std::to_string(value.size());
+        out += "\r\n";
+        out += value;
+        out += "\r\n";
+        return out;
+    }
+
+    // A server whose thread counts its allocations, and one connection to it
+    class AllocationHarness {
+    public:
+        AllocationHarness() : port_(free_port()), server_(server_context_, config(port_)), socket_(client_context_) {
+            server_.start();
+            server_thread_ = std::thread([this]() {
+                count_allocations = true;
+                server_.run();
+            });
+            socket_.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port_));
+        }
+        AllocationHarness(const AllocationHarness&) = delete;
+        AllocationHarness& operator=(const AllocationHarness&) = delete;
+        ~AllocationHarness() {
+            asio::error_code ignored;
+            socket_.close(ignored);
+            server_.stop();
+            server_thread_.join();
+        }
+
+        // Sends `request` and reads exactly `expected` back
+        bool round_trip(const std::string& request, const std::string& expected) {
+            asio::error_code ec;
+            asio::write(socket_, asio::buffer(request), ec);
+            if (ec) {
+                return false;
+            }
+            reply_.resize(expected.size());
+            asio::read(socket_, asio::buffer(reply_.data(), reply_.size()), ec);
+            return !ec && reply_ == expected;
+        }
+
+        // Allocations on the server thread over `rounds` repetitions of
+        // the batch, after as many again to warm up; -1 if a reply was wrong
+        long long steady_state(const std::string& request, const std::string& expected, size_t rounds) {
+            for (size_t i = 0; i < rounds; ++i) {
+                if (!round_trip(request, expected)) {
+                    return -1;
+                }
+            }
+            uint64_t before = allocations.load();
+            for (size_t i = 0; i < rounds; ++i) {
+                if (!round_trip(request, expected)) {
+                    return -1;
+                }
+            }
+            long long counted = static_cast<long long>(allocations.load() - before);
+            std::printf("  %zu rounds of %zu bytes: %lld allocations\n", rounds, request.size(), counted);
+            return counted;
+        }
+
+    private:
+        static ServerConfig config(unsigned short port) {
+            ServerConfig config;
+            config.port = port;
+            config.snapshot_path = "reply_alloc_tests.bdb";  // Never written
+            return config;
+        }
+
+        unsigned short port_;
+        asio::io_context server_context_;
+        Server server_;
+        std::thread server_thread_;
+        asio::io_context client_context_;
+        asio::ip::tcp::socket socket_;
+        std::string reply_;
+    };
+
+    constexpr size_t kKeysPerBatch = 64;
+
+} // namespace
+
+BLITZDB_TEST(reply_alloc_set_get_del) {
+    AllocationHarness harness;
+
+    // SET, GET and DEL for each key, with 100-byte values kept inline
+    const std::string value(100, 'v');
+    std::string request;
+    std::string expected;
+    append_command(request, { "AUTH", "defaultpass" });
+    expected += "+OK\r\n";
+    for (size_t i = 0; i < kKeysPerBatch; ++i) {
+        std::string key = "user:";
+        key += std::to_string(i);
+        append_command(request, { "SET", key, value });
+        append_command(request, { "GET", key });
+        append_command(request, { "DEL", key });
+        expected += "+OK\r\n" + bulk(value) + ":1\r\n";
+    }
+    CHECK_EQ(harness.steady_state(request, expected, 1000), 0);
+}
+
+BLITZDB_TEST(reply_alloc_shared_value_get) {
+    AllocationHarness harness;
+
+    // Values at and above Value::kShareThreshold are held in refcounted
+    // buffers and sent with a gathered write straight from them
+    std::string setup;
+    std::string setup_expected = "+OK\r\n";
+    append_command(setup, { "AUTH", "defaultpass" });
+    std::string request;
+    std::string expected;
+    for (size_t size : { Value::kShareThreshold, Value::kShareThreshold + 1, size_t{ 16 * 1024 }, size_t{ 200 * 1024 } }) {
+        for (size_t copy = 0; copy < 4; ++copy) {
+            std::string key = "shared:";
+            key += std::to_string(size);
+            key += ':';
+            key += std::to_string(copy);
+            std::string value(size, static_cast<char>('a' + copy));
+            append_command(setup, { "SET", key, value });
+            setup_expected += "+OK\r\n";
+            append_command(request, { "GET", key });
+            expected += bulk(value);
+        }
+    }
+    REQUIRE(harness.round_trip(setup, setup_expected));
+    CHECK_EQ(harness.steady_state(request, expected, 300), 0);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+
+// A small self-contained test harness, so the tests build wherever the
+// server does without pulling in a framework.
+//
+//   BLITZDB_TEST(parser_handles_inline) {
+//       CHECK(parse("PING\r\n"));           // Records a failure, carries on
+//       REQUIRE_EQ(args.size(), 1u);        // Records a failure, ends the test
+//   }
+//
+// Every test registers itself; test_main.cpp runs them all, or only those
+// whose name contains the first command-line argument.
+
+namespace blitzdb::test {
+
+    using TestFunction = void (*)();
+
+    struct Registration {
+        Registration(const char* name, TestFunction function);
+    };
+
+    // Thrown by the REQUIRE macros to end the current test
+    struct Abort {};
+
+    void fail(const char* file, int line, const std::string& message);
+
+    // A fresh directory under the system temp directory, removed with
+    // everything in it when the object goes away
+    class TempDir {
+    public:
+        TempDir() {
+            std::random_device random;
+            path_ = std::filesystem::temp_directory_path() /
+                ("blitzdb_test_" + std::to_string(random()) + std::to_string(random()));
+            std::filesystem::create_directories(path_);
+        }
+        TempDir(const TempDir&) = delete;
+        TempDir& operator=(const TempDir&) = delete;
+        ~TempDir() {
+            std::error_code ignored;
+            std::filesystem::remove_all(path_, ignored);
+        }
+
+        std::string file(const std::string& name) const { return (path_ / name).string(); }
+
+    private:
+        std::filesystem::path path_;
+    };
+
+    template <typename T>
+    std::string describe(const T& value) {
+        if constexpr (requires(std::ostream& out) { out << value; }) {
+            std::ostringstream out;
+            out << value;
+            return out.str();
+        }
+        else {
+            return "?";
+        }
+    }
+
+    template <typename A, typename B>
+    bool check_equal(const A& a, const B& b, const char* expression, const char* file, int line) {
+        if (a == b) {
+            return true;
+        }
+        fail(file, line, std::string(expression) + " (" + describe(a) + " vs " + describe(b) + ")");
+        return false;
+    }
+
+} // namespace blitzdb::test
+
+#define BLITZDB_TEST(name)                                                              \
+    static void name();                                                                 \
+    static const ::blitzdb::test::Registration name##_registration(#name, &name);       \
+    static void name()
+
+#define CHECK(condition)                                                                \
+    ((condition) ? true : (::blitzdb::test::fail(__FILE__, __LINE__, #condition), false))
+
+#define CHECK_EQ(a, b)                                                                  \
+    ::blitzdb::test::check_equal((a), (b), #a " == " #b, __FILE__, __LINE__)
+
+#define REQUIRE(condition)                                                              \
+    do {                                                                                \
+        if (!CHECK(condition)) throw ::blitzdb::test::Abort{};                          \
+    } while (0)
+
+#define REQUIRE_EQ(a, b)                                                                \
+    do {                                                                                \
+        if (!CHECK_EQ(a, b)) throw ::blitzdb::test::Abort{};                            \
+    } while (0)
@@ -0,0 +1,68 @@
+// test_main.cpp : Runs the tests registered with BLITZDB_TEST.
+//
+// Usage: <test binary> [name filter]
+
+#include "test.h"
+#include <cstdio>
+#include <exception>
+#include <string_view>
+#include <vector>
+
+namespace blitzdb::test {
+
+    namespace {
+
+        struct Test {
+            const char* name;
+            TestFunction function;
+        };
+
+        // Function-local so registration from other files' static
+        // initializers finds it constructed
+        std::vector<Test>& registry() {
+            static std::vector<Test> tests;
+            return tests;
+        }
+
+        size_t failures = 0;
+
+    } // namespace
+
+    Registration::Registration(const char* name, TestFunction function) {
+        registry().push_back({ name, function });
+    }
+
+    void fail(const char* file, int line, const std::string& message) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, message.c_str());
+        ++failures;
+    }
+
+} // namespace blitzdb::test
+
+int main(int argc, char* argv[]) {
+    using namespace blitzdb::test;
+    std::string_view filter = argc > 1 ? argv[1] : "";
+
+    size_t run = 0;
+    size_t failed = 0;
+    for (const Test& test : registry()) {
+        if (std::string_view(test.name).find(filter) == std::string_view::npos) {
+            continue;
+        }
+        size_t before = failures;
+        try {
+            test.function();
+        }
+        catch (const Abort&) {
+        }
+        catch (const std::exception& e) {
+            fail(test.name, 0, std::string("unexpected exception: ") + e.what());
+        }
+        ++run;
+        bool passed = failures == before;
+        failed += passed ? 0 : 1;
+        std::printf("%s %s\n", passed ? "[  ok  ]" : "[ FAIL ]", test.name);
+    }
+    std::printf("%zu tests, %zu failed\n", run, failed);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+// core_tests.cpp : RESP request parser and reply scanner.
+
+#include "../test.h"
+#include "protocols/resp.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace blitzdb;
+using resp::ParseStatus;
+
+namespace {
+
+    using Command = std::vector<std::string>;
+
+    std::string multibulk(const Command& args) {
+        std::string out = "*";
+        out += std::to_string(args.size());
+        out += "\r\n";
+        for (const std::string& arg : args) {
+            out += "$";
+            out += std::to_string(arg.size());
+            out += "\r\n";
+            out += arg;
+            out += "\r\n";
+        }
+        return out;
+    }
+
+    // Feeds `input` in pieces cut at `cuts`, the way a connection does: new
+    // bytes are appended to the unconsumed ones and each complete command
+    // is dropped from the front. Stops at the first error.
+    ParseStatus feed(std::string_view input, const std::vector<size_t>& cuts, std::vector<Command>& commands) {
+        resp::RequestParser parser;
+        std::vector<std::string_view> args;
+        std::string buffer;
+        size_t from = 0;
+        for (size_t i = 0; i <= cuts.size(); ++i) {
+            size_t to = i < cuts.size() ? cuts[i] : input.size();
+            buffer.append(input.substr(from, to - from));
+            from = to;
+            while (true) {
+                size_t consumed = 0;
+                ParseStatus status = parser.parse(buffer, consumed, args);
+                if (status == ParseStatus::Error) {
+                    return status;
+                }
+                if (status == ParseStatus::Incomplete) {
+                    break;
+                }
+                commands.emplace_back(args.begin(), args.end());
+                buffer.erase(0, consumed);
+            }
+        }
+        return buffer.empty() ? ParseStatus::Complete : ParseStatus::Incomplete;
+    }
+
+    ParseStatus parse_one(std::string_view input, std::vector<std::string_view>& args, size_t& consumed) {
+        resp::RequestParser parser;
+        return parser.parse(input, consumed, args);
+    }
+
+} // namespace
+
+BLITZDB_TEST(resp_request_split_at_every_byte) {
+    const std::vector<Command> expected = {
+        { "SET", "key", "value" },
+        { "GET", "key" },
+        { "SET", "bin", std::string("a\r\nb\0c", 6) },  // CRLF and NUL inside a bulk string
+        { "SET", "empty", "" },
+        { "PING" },
+        { "ECHO", "hello", "world" },
+    };
+    std::string input;
+    for (size_t i = 0; i < 4; ++i) {
+        input += multibulk(expected[i]);
+    }
+    input += "PING\r\n";
+    input += "ECHO  hello\tworld\n";
+
+    std::vector<Command> whole;
+    REQUIRE(feed(input, {}, whole) == ParseStatus::Complete);
+    CHECK(whole == expected);
+
+    for (size_t cut = 1; cut < input.size(); ++cut) {
+        std::vector<Command> commands;
+        CHECK(feed(input, { cut }, commands) == ParseStatus::Complete);
+        if (!CHECK(commands == expected)) {
+            break;
+        }
+    }
+
+    std::vector<size_t> every;
+    for (size_t cut = 1; cut < input.size(); ++cut) {
+        every.push_back(cut);
+    }
+    std::vector<Command> one_by_one;
+    CHECK(feed(input, every, one_by_one) == ParseStatus::Complete);
+    CHECK(one_by_one == expected);
+}
+
+BLITZDB_TEST(resp_request_arguments_point_into_the_buffer) {
+    std::string input = multibulk({ "GET", "key" });
+    std::vector<std::string_view> args;
+    size_t consumed = 0;
+    REQUIRE(parse_one(input, args, consumed) == ParseStatus::Complete);
+    REQUIRE_EQ(args.size(), 2u);
+    CHECK_EQ(consumed, input.size());
+    CHECK(args[1].data() >= input.data() && args[1].data() < input.data() + input.size());
+}
+
+BLITZDB_TEST(resp_request_inline) {
+    std::vector<Command> commands;
+    CHECK(feed("PING\r\n", {}, commands) == ParseStatus::Complete);
+    CHECK(feed("  SET  k \t v  \r\n", {}, commands) == ParseStatus::Complete);
+    CHECK(feed("SET k \"two words\"\n", {}, commands) == ParseStatus::Complete);
+    CHECK(feed("SET k 'it''s'\r\n", {}, commands) == ParseStatus::Error);
+    CHECK(feed("SET k \"open\r\n", {}, commands) == ParseStatus::Error);
+    CHECK(feed("\r\n", {}, commands) == ParseStatus::Complete);
+    const std::vector<Command> expected = { { "PING" }, { "SET", "k", "v" }, { "SET", "k", "two words" }, {} };
+    CHECK(commands == expected);
+
+    // No newline yet
+    std::vector<std::string_view> args;
+    size_t consumed = 0;
+    CHECK(parse_one("PING", args, consumed) == ParseStatus::Incomplete);
+    CHECK(parse_one(std::string(resp::kMaxInlineLength + 1, 'a'), args, consumed) == ParseStatus::Error);
+}
+
+BLITZDB_TEST(resp_request_empty_and_null_multibulk) {
+    std::vector<std::string_view> args{ "stale" };
+    size_t consumed = 0;
+    CHECK(parse_one("*0\r\n", args, consumed) == ParseStatus::Complete);
+    CHECK(args.empty());
+    CHECK_EQ(consumed, 4u);
+
+    args = { "stale" };
+    CHECK(parse_one("*-1\r\n", args, consumed) == ParseStatus::Complete);
+    CHECK(args.empty());
+    CHECK_EQ(consumed, 5u);
+
+    // A no-op followed by a command
+    std::vector<Command> commands;
+    CHECK(feed("*0\r\n" + multibulk({ "PING" }), {}, commands) == ParseStatus::Complete);
+    const std::vector<Command> expected = { {}, { "PING" } };
+    CHECK(commands == expected);
+}
+
+BLITZDB_TEST(resp_request_negative_lengths) {
+    std::vector<std::string_view> args;
+    size_t consumed = 0;
+    CHECK(parse_one("*1\r\n$-1\r\n", args, consumed) == ParseStatus::Error);
+    CHECK(parse_one("*1\r\n$-5\r\nabc\r\n", args, consumed) == ParseStatus::Error);
+    CHECK(parse_one("*1\r\n$-\r\n", args, consumed) == ParseStatus::Error);
+    CHECK(parse_one("*-\r\n", args, consumed) == ParseStatus::Error);
+}
+
+BLITZDB_TEST(resp_request_oversized_lengths) {
+    std::vector<std::string_view> args;
+    size_t consumed = 0;
+    std::string too_many = "*";
+    too_many += std::to_string(resp::kMaxMultibulkLength + 1) + "\r\n";
+    CHECK(parse_one(too_many, args, consumed) == ParseStatus::Error);
+    std::string too_long = "*1\r\n$";
+    too_long += std::to_string(resp::kMaxBulkLength + 1) + "\r\n";
+    CHECK(parse_one(too_long, args, consumed) == ParseStatus::Error);
+    CHECK(parse_one("*1\r\n$99999999999999999999\r\n", args, consumed) == ParseStatus::Error);
+    CHECK(parse_one("*99999999999999999999\r\n", args, consumed) == ParseStatus::Error);
+
+    // The largest allowed length only waits for its data
+    std::string largest = "*1\r\n$";
+    largest += std::to_string(resp::kMaxBulkLength) + "\r\nabc";
+    CHECK(parse_one(largest, args, consumed) == ParseStatus::Incomplete);
+
+    // A length line that never ends
+    std::string endless = "*1\r\n$";
+    endless.append(resp::kMaxInlineLength + 1, '1');
+    CHECK(parse_one(endless, args, consumed) == ParseStatus::Error);
+}
+
+BLITZDB_TEST(resp_request_malformed) {
+    std::vector<std::string_view> args;
+    size_t consumed = 0;
+    CHECK(parse_one("*1\r\n+OK\r\n", args, consumed) == ParseStatus::Error);
+    CHECK(parse_one("*1\r\n$3\r\nabcd\r\n", args, consumed) == ParseStatus::Error);
+    CHECK(parse_one("*x\r\n", args, consumed) == ParseStatus::Error);
+
+    // The parser can be reused after an error
+    resp::RequestParser parser;
+    CHECK(parser.parse("*1\r\n$x\r\n", consumed, args) == ParseStatus::Error);
+    CHECK(!parser.error().empty());
+    std::string ping = multibulk({ "PING" });
+    CHECK(parser.parse(ping, consumed, args) == ParseStatus::Complete);
+    CHECK_EQ(args.size(), 1u);
+}
+
+BLITZDB_TEST(resp_reply_scan_resp3_types) {
+    const std::vector<std::string> frames = {
+        "+OK\r\n",
+        "-ERR bad\r\n",
+        ":-42\r\n",
+        "$5\r\nhello\r\n",
+        "$-1\r\n",
+        "*-1\r\n",
+        "_\r\n",
+        "#t\r\n",
+        ",3.14\r\n",
+        ",inf\r\n",
+        "(3492890328409238509324850943850943825024385\r\n",
+        "!21\r\nSYNTAX invalid syntax\r\n",
+        "=15\r\ntxt:Some string\r\n",
+        "*2\r\n$1\r\na\r\n:1\r\n",
+        "~2\r\n+a\r\n+b\r\n",
+        "%2\r\n+first\r\n:1\r\n+second\r\n*2\r\n_\r\n#f\r\n",
+        ">3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$0\r\n\r\n",
+        "|1\r\n+key-popularity\r\n%1\r\n$1\r\na\r\n,0.19\r\n*2\r\n:1\r\n:2\r\n",
+        "*0\r\n",
+        "%0\r\n",
+    };
+    for (const std::string& frame : frames) {
+        // Followed by another frame, which must not be consumed
+        std::string data = frame + "+NEXT\r\n";
+        size_t consumed = 0;
+        if (!CHECK(resp::scan_reply(data, consumed) == ParseStatus::Complete) ||
+            !CHECK_EQ(consumed, frame.size())) {
+            continue;
+        }
+        for (size_t cut = 0; cut < frame.size(); ++cut) {
+            if (!CHECK(resp::scan_reply(std::string_view(frame).substr(0, cut), consumed) == ParseStatus::Incomplete)) {
+                break;
+            }
+        }
+    }
+
+    size_t consumed = 0;
+    CHECK(resp::scan_reply("?\r\n", consumed) == ParseStatus::Error);
+    CHECK(resp::scan_reply("$-2\r\n", consumed) == ParseStatus::Error);
+    CHECK(resp::scan_reply("*x\r\n", consumed) == ParseStatus::Error);
+    CHECK(resp::scan_reply("~2\r\n+a\r\n&\r\n", consumed) == ParseStatus::Error);
+}
+
+BLITZDB_TEST(resp_reply_encoders) {
+    std::string out;
+    resp::append_integer(out, 0);
+    resp::append_integer(out, 9999);
+    resp::append_integer(out, 10000);
+    resp::append_integer(out, -1);
+    resp::append_integer(out, INT64_MIN);
+    resp::append_bulk(out, "abc");
+    resp::append_array_header(out, 2);
+    resp::append_simple(out, "OK");
+    resp::append_error(out, "ERR x");
+    CHECK_EQ(out, std::string(":0\r\n:9999\r\n:10000\r\n:-1\r\n:-9223372036854775808\r\n"
+        "$3\r\nabc\r\n*2\r\n+OK\r\n-ERR x\r\n"));
+}
@@ -0,0 +1,278 @@
+// hash_table_tests.cpp : Swiss table lookups, tombstones and incremental
+// migration.
+
+#include "../test.h"
+#include "storage/hash_table.h"
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace blitzdb;
+
+namespace {
+
+    int live_entries = 0;
+
+    struct TestEntry {
+        std::string key_;
+        int value = 0;
+
+        explicit TestEntry(std::string_view key) : key_(key) { ++live_entries; }
+        TestEntry(TestEntry&& other) noexcept : key_(std::move(other.key_)), value(other.value) { ++live_entries; }
+        ~TestEntry() { --live_entries; }
+        std::string_view key() const { return key_; }
+    };
+
+    // Few distinct hashes: long probe runs, shared 7-bit tags and plenty
+    // of tombstones
+    struct CollidingHash {
+        size_t operator()(std::string_view key) const {
+            return std::hash<std::string_view>()(key) % 13 * 0x9E3779B97F4A7C15ULL;
+        }
+    };
+
+    template <typename Hash>
+    struct Harness {
+        HashTable<TestEntry, Hash> table;
+        std::unordered_map<std::string, int> model;
+        Hash hasher;
+
+        void insert(const std::string& key, int value) {
+            auto [entry, inserted] = table.insert(key, hasher(key));
+            CHECK_EQ(inserted, model.find(key) == model.end());
+            if (!inserted) {
+                CHECK_EQ(entry->value, model[key]);
+            }
+            entry->value = value;
+            model[key] = value;
+        }
+
+        void erase(const std::string& key) {
+            CHECK_EQ(table.erase(key, hasher(key)), model.erase(key) == 1);
+        }
+
+        bool verify() {
+            if (!CHECK_EQ(table.size(), model.size())) {
+                return false;
+            }
+            for (const auto& [key, value] : model) {
+                const TestEntry* entry = table.find(key, hasher(key));
+                if (!CHECK(entry != nullptr) || !CHECK_EQ(entry->value, value)) {
+                    return false;
+                }
+            }
+            size_t seen = 0;
+            table.for_each([&](const TestEntry& entry) {
+                seen += model.count(std::string(entry.key())) ? 1 : 0;
+            });
+            return CHECK_EQ(seen, model.size());
+        }
+    };
+
+    std::string key_for(size_t n) {
+        return "key:" + std::to_string(n);
+    }
+
+} // namespace
+
+BLITZDB_TEST(hash_table_operations_during_migration) {
+    {
+        Harness<std::hash<std::string_view>> h;
+        std::mt19937 random(1);
+        size_t migrating_ops = 0;
+        for (size_t step = 0; step < 60000; ++step) {
+            std::string key = key_for(random() % 20000);
+            if (random() % 4 == 0) {
+                h.erase(key);
+            }
+            else {
+                h.insert(key, static_cast<int>(step));
+            }
+            if (h.table.rehashing()) {
+                ++migrating_ops;
+                // Both tables hold entries here; check every few steps
+                if (migrating_ops % 97 == 0 && !h.verify()) {
+                    break;
+                }
+            }
+            // Lookups of keys that were never inserted
+            CHECK(h.table.find("missing", std::hash<std::string_view>()("missing")) == nullptr);
+        }
+        CHECK(migrating_ops > 1000);
+        h.verify();
+    }
+    CHECK_EQ(live_entries, 0);
+}
+
+BLITZDB_TEST(hash_table_insert_moves_key_out_of_draining_table) {
+    Harness<std::hash<std::string_view>> h;
+    size_t n = 0;
+    while (!h.table.rehashing()) {
+        h.insert(key_for(n), static_cast<int>(n));
+        ++n;
+    }
+    // Re-inserting an old key while the old table drains finds it, with
+    // its value, and keeps a single copy
+    for (size_t i = 0; i < n; ++i) {
+        h.insert(key_for(i), static_cast<int>(i + 1000));
+    }
+    h.verify();
+    while (h.table.rehashing()) {
+        h.table.migrate(1);
+    }
+    h.verify();
+}
+
+BLITZDB_TEST(hash_table_tombstone_churn) {
+    {
+        Harness<CollidingHash> h;
+        std::mt19937 random(2);
+        // A sliding window of live keys: each step adds the next key and
+        // drops the oldest, so most slots end up tombstoned unless the
+        // table cleans them out
+        constexpr size_t kLive = 300;
+        size_t peak_capacity = 0;
+        for (size_t n = 0; n < 20000; ++n) {
+            h.insert(key_for(n), static_cast<int>(n));
+            if (n >= kLive) {
+                h.erase(key_for(n - kLive));
+            }
+            // Now and then touch a random live key
+            if (n > kLive && random() % 8 == 0) {
+                h.insert(key_for(n - random() % kLive), static_cast<int>(n));
+            }
+            peak_capacity = std::max(peak_capacity, h.table.capacity());
+            if (n % 1000 == 999 && !h.verify()) {
+                break;
+            }
+        }
+        h.verify();
+        // Growth stays proportional to the live keys, not to the churn
+        CHECK(peak_capacity <= 8 * kLive);
+    }
+    CHECK_EQ(live_entries, 0);
+}
+
+BLITZDB_TEST(hash_table_erase_everything_and_refill) {
+    Harness<CollidingHash> h;
+    for (int round = 0; round < 5; ++round) {
+        for (size_t n = 0; n < 2000; ++n) {
+            h.insert(key_for(n), round);
+        }
+        REQUIRE(h.verify());
+        for (size_t n = 0; n < 2000; n += 2) {
+            h.erase(key_for(n));
+        }
+        REQUIRE(h.verify());
+        for (size_t n = 1; n < 2000; n += 2) {
+            h.erase(key_for(n));
+        }
+        REQUIRE(h.verify());
+        CHECK(h.table.empty());
+    }
+}
+
+BLITZDB_TEST(hash_table_for_each_from_visits_every_entry_once) {
+    Harness<std::hash<std::string_view>> h;
+    size_t n = 0;
+    while (!h.table.rehashing() || n < 1000) {
+        h.insert(key_for(n), static_cast<int>(n));
+        ++n;
+    }
+    REQUIRE(h.table.rehashing());
+
+    for (size_t window : { size_t{ 1 }, size_t{ 7 }, size_t{ 64 }, h.table.capacity() + 5 }) {
+        std::multiset<std::string> seen;
+        size_t position = 0;
+        size_t calls = 0;
+        do {
+            position = h.table.for_each_from(position, window, [&](TestEntry& entry) {
+                seen.insert(entry.key_);
+                return true;
+            });
+            ++calls;
+        } while (position != 0 && calls < 1000000);
+        CHECK_EQ(seen.size(), h.model.size());
+        CHECK_EQ(std::set<std::string>(seen.begin(), seen.end()).size(), h.model.size());
+    }
+
+    // Stopping early resumes right after the entry that stopped it
+    std::vector<std::string> seen;
+    size_t position = 0;
+    do {
+        position = h.table.for_each_from(position, 50, [&](TestEntry& entry) {
+            seen.push_back(entry.key_);
+            return seen.size() % 3 != 0;
+        });
+    } while (position != 0);
+    CHECK_EQ(seen.size(), h.model.size());
+    CHECK_EQ(std::set<std::string>(seen.begin(), seen.end()).size(), h.model.size());
+
+    // Past the end
+    CHECK_EQ(h.table.for_each_from(h.table.capacity() + 10, 10, [](TestEntry&) { return true; }), 0u);
+}
+
+BLITZDB_TEST(hash_table_entry_at_samples_live_entries) {
+    HashTable<TestEntry> empty;
+    CHECK(empty.entry_at(0, 100) == nullptr);
+
+    Harness<std::hash<std::string_view>> h;
+    size_t n = 0;
+    while (!h.table.rehashing() || n < 500) {
+        h.insert(key_for(n), static_cast<int>(n));
+        ++n;
+    }
+    for (size_t i = 0; i < n; i += 3) {
+        h.erase(key_for(i));
+    }
+
+    // Every slot position, one slot at a time, finds each entry once
+    std::set<std::string> sampled;
+    size_t total = h.table.capacity();
+    for (size_t position = 0; position < total; ++position) {
+        if (TestEntry* entry = h.table.entry_at(position, 1)) {
+            CHECK(h.model.count(entry->key_) == 1);
+            sampled.insert(entry->key_);
+        }
+    }
+    CHECK_EQ(sampled.size(), h.model.size());
+
+    // A full-width scan always finds something, wrapping past the end
+    for (size_t position = 0; position < 2 * total; position += 17) {
+        TestEntry* entry = h.table.entry_at(position, total);
+        if (!CHECK(entry != nullptr)) {
+            break;
+        }
+        CHECK(h.model.count(entry->key_) == 1);
+    }
+}
+
+BLITZDB_TEST(hash_table_reserve_and_move) {
+    {
+        HashTable<TestEntry> table;
+        std::hash<std::string_view> hasher;
+        table.reserve(5000);
+        size_t capacity = table.capacity();
+        for (size_t n = 0; n < 5000; ++n) {
+            table.insert(key_for(n), hasher(key_for(n)));
+        }
+        CHECK_EQ(table.capacity(), capacity);
+        CHECK(!table.rehashing());
+
+        HashTable<TestEntry> moved(std::move(table));
+        CHECK(table.empty());
+        CHECK_EQ(moved.size(), 5000u);
+        CHECK(moved.find(key_for(42), hasher(key_for(42))) != nullptr);
+
+        table = std::move(moved);
+        CHECK_EQ(table.size(), 5000u);
+        table.clear();
+        CHECK(table.empty());
+        CHECK_EQ(table.table_bytes(), 0u);
+    }
+    CHECK_EQ(live_entries, 0);
+}
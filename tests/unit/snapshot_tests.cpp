@@ -0,0 +1,257 @@
+// snapshot_tests.cpp : Snapshot save and load round trips, and damage
+// detection through the per-block CRC32C.
+
+#include "../test.h"
+#include "storage/snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace blitzdb;
+
+namespace {
+
+    // Built with += rather than "literal" + std::string, which trips a
+    // false -Wrestrict in GCC 12
+    std::string name(std::string_view prefix, size_t n) {
+        std::string out(prefix);
+        out += std::to_string(n);
+        return out;
+    }
+
+    // Strings of every encoding, packed and table hashes, and deadlines
+    void fill(InMemoryStorage& storage, size_t keys) {
+        int64_t later = InMemoryStorage::now_ms() + 3600 * 1000;
+        for (size_t i = 0; i < keys; ++i) {
+            std::string key = name("key:", i);
+            switch (i % 6) {
+            case 0:
+                storage.set(key, std::to_string(i * 7919));  // Integer encoded
+                break;
+            case 1:
+                storage.set(key, std::string(i % 50, 'a' + static_cast<char>(i % 26)));
+                break;
+            case 2:
+                storage.set(key, std::string(Value::kShareThreshold + i, 'L'));  // Shared buffer
+                break;
+            case 3:
+                storage.set(key, std::string("bin\0\r\n\xff", 7) + key);
+                break;
+            case 4: {
+                std::vector<std::string> fields;
+                for (size_t f = 0; f < (i % 3 == 0 ? 200 : 3); ++f) {
+                    fields.push_back(name("f", f));
+                    fields.push_back(name("v", f * i));
+                }
+                std::vector<std::string_view> pairs(fields.begin(), fields.end());
+                storage.hset(key, pairs);
+                break;
+            }
+            default:
+                storage.set(key, "volatile");
+                storage.set_expiry(key, later + static_cast<int64_t>(i));
+                break;
+            }
+        }
+    }
+
+    size_t key_count(const InMemoryStorage& storage) {
+        size_t keys = 0;
+        for (const ShardStats& shard : storage.shard_stats()) {
+            keys += shard.keys;
+        }
+        return keys;
+    }
+
+    std::vector<std::string> sorted_hash(InMemoryStorage& storage, const std::string& key) {
+        std::vector<std::string> flat = storage.hgetall(key);
+        std::vector<std::string> pairs;
+        for (size_t i = 0; i + 1 < flat.size(); i += 2) {
+            pairs.push_back(flat[i] + '=' + flat[i + 1]);
+        }
+        std::sort(pairs.begin(), pairs.end());
+        return pairs;
+    }
+
+    // Every key of `expected` has the same value and deadline in `actual`
+    bool same_keyspace(InMemoryStorage& expected, InMemoryStorage& actual, size_t keys) {
+        if (!CHECK_EQ(key_count(actual), key_count(expected))) {
+            return false;
+        }
+        for (size_t i = 0; i < keys; ++i) {
+            std::string key = name("key:", i);
+            if (i % 6 == 4) {
+                if (!CHECK(sorted_hash(actual, key) == sorted_hash(expected, key))) {
+                    return false;
+                }
+                continue;
+            }
+            auto want = expected.get(key);
+            auto got = actual.get(key);
+            if (!CHECK(got.has_value()) || !CHECK_EQ(got->view(), want->view())) {
+                return false;
+            }
+            // Deadlines are stored absolute, so they survive unchanged
+            int64_t ttl = actual.ttl_ms(key);
+            int64_t want_ttl = expected.ttl_ms(key);
+            if (!CHECK(want_ttl < 0 ? ttl == want_ttl : ttl > 0 && std::abs(want_ttl - ttl) < 60000)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string read_file(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void write_file(const std::string& path, const std::string& data) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
+    bool load_fails(const std::string& path) {
+        InMemoryStorage storage;
+        try {
+            load_snapshot(storage, path);
+        }
+        catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    }
+
+    constexpr size_t kKeys = 3000;
+
+} // namespace
+
+BLITZDB_TEST(snapshot_round_trip) {
+    test::TempDir dir;
+    std::string path = dir.file("dump.bdb");
+    InMemoryStorage source(16);
+    fill(source, kKeys);
+
+    SnapshotStats saved = write_snapshot(source, path, true);
+    CHECK_EQ(saved.keys, static_cast<uint64_t>(kKeys));
+    CHECK(saved.blocks > 1);
+
+    // Same shard count, more shards and fewer, on one thread and many
+    for (size_t shards : { size_t{ 16 }, size_t{ 64 }, size_t{ 1 } }) {
+        for (size_t threads : { size_t{ 1 }, size_t{ 0 } }) {
+            InMemoryStorage loaded(shards);
+            SnapshotStats stats = load_snapshot(loaded, path, threads);
+            CHECK_EQ(stats.keys, static_cast<uint64_t>(kKeys));
+            CHECK_EQ(stats.expired, 0u);
+            if (!same_keyspace(source, loaded, kKeys)) {
+                return;
+            }
+        }
+    }
+}
+
+BLITZDB_TEST(snapshot_stream_loader_matches_file) {
+    test::TempDir dir;
+    std::string path = dir.file("dump.bdb");
+    InMemoryStorage source;
+    fill(source, kKeys);
+    write_snapshot(source, path, true);
+    std::string data = read_file(path);
+
+    // Arriving in uneven pieces, as from a socket
+    InMemoryStorage loaded;
+    SnapshotStreamLoader loader(loaded, "stream");
+    std::string pending;
+    size_t offset = 0;
+    size_t piece = 1;
+    while (offset < data.size() && !loader.done()) {
+        size_t take = std::min(piece, data.size() - offset);
+        pending.append(data, offset, take);
+        offset += take;
+        pending.erase(0, loader.feed(pending));
+        piece = piece * 3 % 100003 + 1;
+    }
+    CHECK(loader.done());
+    CHECK(pending.empty());
+    CHECK_EQ(loader.stats().keys, static_cast<uint64_t>(kKeys));
+    same_keyspace(source, loaded, kKeys);
+}
+
+BLITZDB_TEST(snapshot_skips_keys_expired_since_saving) {
+    test::TempDir dir;
+    std::string path = dir.file("dump.bdb");
+    InMemoryStorage source;
+    source.set("stays", "1");
+    source.set("goes", "2");
+    source.set_expiry("goes", InMemoryStorage::now_ms() + 20);
+    write_snapshot(source, path, true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    InMemoryStorage loaded;
+    SnapshotStats stats = load_snapshot(loaded, path);
+    CHECK_EQ(stats.expired, 1u);
+    CHECK(loaded.exists("stays"));
+    CHECK(!loaded.exists("goes"));
+}
+
+BLITZDB_TEST(snapshot_empty_keyspace) {
+    test::TempDir dir;
+    std::string path = dir.file("dump.bdb");
+    InMemoryStorage source;
+    CHECK_EQ(write_snapshot(source, path, false).keys, 0u);
+    InMemoryStorage loaded;
+    CHECK_EQ(load_snapshot(loaded, path).keys, 0u);
+    CHECK_EQ(key_count(loaded), 0u);
+}
+
+BLITZDB_TEST(snapshot_detects_damage) {
+    test::TempDir dir;
+    std::string path = dir.file("dump.bdb");
+    InMemoryStorage source;
+    fill(source, kKeys);
+    write_snapshot(source, path, true);
+    const std::string good = read_file(path);
+    REQUIRE(good.size() > snapshot_format::kHeaderSize + 2 * snapshot_format::kBlockHeaderSize);
+    REQUIRE(!load_fails(path));
+
+    std::string damaged = dir.file("damaged.bdb");
+    auto flipped = [&](size_t offset) {
+        std::string data = good;
+        data[offset] ^= 0x20;
+        write_file(damaged, data);
+        return load_fails(damaged);
+    };
+    CHECK(flipped(0));                                                        // Magic
+    CHECK(flipped(snapshot_format::kHeaderSize - 1));                         // Header CRC
+    CHECK(flipped(snapshot_format::kHeaderSize + 13));                        // First block's CRC
+    CHECK(flipped(snapshot_format::kHeaderSize + snapshot_format::kBlockHeaderSize + 5));  // Its payload
+    CHECK(flipped(good.size() / 2));                                          // Somewhere in the middle
+    CHECK(flipped(good.size() - 1));                                          // Trailer
+
+    // Cut short anywhere, including right before the trailer
+    for (size_t size : { size_t{ 0 }, size_t{ 10 }, snapshot_format::kHeaderSize, good.size() / 3,
+             good.size() - snapshot_format::kBlockHeaderSize - 16, good.size() - 1 }) {
+        write_file(damaged, good.substr(0, size));
+        CHECK(load_fails(damaged));
+    }
+
+    // The stream loader rejects a damaged block too
+    std::string data = good;
+    data[snapshot_format::kHeaderSize + snapshot_format::kBlockHeaderSize + 5] ^= 0x20;
+    InMemoryStorage loaded;
+    SnapshotStreamLoader loader(loaded, "stream");
+    bool threw = false;
+    try {
+        loader.feed(data);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+}